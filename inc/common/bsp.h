@@ -59,9 +59,6 @@ typedef struct {
 
 typedef struct {
     mvertex_t   *v[2];
-#if USE_REF == REF_SOFT
-    uintptr_t   cachededgeoffset;
-#endif
 } medge_t;
 
 typedef struct {
@@ -98,8 +95,6 @@ typedef struct mface_s {
     int             firstvert;
     int             light_s, light_t;
     float           stylecache[MAX_LIGHTMAPS];
-#else
-    struct surfcache_s    *cachespots[MIPLEVELS]; // surface generation data
 #endif
 
     int             drawframe;
@@ -169,9 +164,6 @@ typedef struct {
 #if USE_REF
     mface_t         **firstleafface;
     int             numleaffaces;
-#if USE_REF == REF_SOFT
-    unsigned        key;
-#endif
 #endif
 } mleaf_t;
 
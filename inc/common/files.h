@@ -154,6 +154,8 @@ qerror_t FS_Seek(qhandle_t f, off_t offset);
 
 ssize_t  FS_Length(qhandle_t f);
 
+qerror_t FS_FileInfo(qhandle_t f, file_info_t *info);
+
 qboolean FS_WildCmp(const char *filter, const char *string);
 qboolean FS_ExtCmp(const char *extension, const char *string);
 
@@ -0,0 +1,50 @@
+/*
+Copyright (C) 2003-2008 Andrey Nazarov
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef HUFFMAN_H
+#define HUFFMAN_H
+
+//
+// huffman.h -- canonical Huffman coding of network messages
+//
+
+#define HUFF_SYMBOLS        256
+#define HUFF_MAX_BITS       15
+
+// code lengths are sent packed two per byte
+#define HUFF_LENGTHS_BYTES  (HUFF_SYMBOLS / 2)
+
+typedef struct {
+    byte        lengths[HUFF_SYMBOLS];
+    uint16_t    codes[HUFF_SYMBOLS];
+    uint16_t    counts[HUFF_MAX_BITS + 1];  // number of codes of each length
+    byte        symbols[HUFF_SYMBOLS];      // symbols in canonical order
+} huffman_t;
+
+void    HUFF_BuildFromFrequencies(huffman_t *huff, const unsigned *freqs);
+qboolean HUFF_BuildFromLengths(huffman_t *huff, const byte *lengths);
+
+void    HUFF_PackLengths(const huffman_t *huff, byte *out);
+void    HUFF_UnpackLengths(byte *lengths, const byte *in);
+
+size_t  HUFF_Encode(const huffman_t *huff, byte *out, size_t outlen,
+                    const byte *in, size_t inlen);
+qboolean HUFF_Decode(const huffman_t *huff, byte *out, size_t outlen,
+                     const byte *in, size_t inlen);
+
+#endif // HUFFMAN_H
@@ -22,6 +22,8 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "common/protocol.h"
 #include "common/sizebuf.h"
 
+// MSG_WriteDeltaEntity compares this struct bytewise, it must be
+// kept free of padding and between 32 and 64 bytes in size (see msg.c)
 typedef struct {
     uint16_t    number;
     int16_t     origin[3];
@@ -40,6 +42,9 @@ typedef struct {
     uint8_t     event;
 } entity_packed_t;
 
+// worst case size of a single entity update
+#define MAX_PACKED_ENTITY_BYTES 48
+
 typedef struct {
     pmove_state_t   pmove;
     int16_t         viewangles[3];
@@ -97,9 +102,11 @@ void    MSG_WriteLong(int c);
 void    MSG_WriteString(const char *s);
 void    MSG_WritePos(const vec3_t pos);
 void    MSG_WriteAngle(float f);
+#if USE_CLIENT || USE_SERVER
+int     MSG_WriteDeltaUsercmd(const usercmd_t *from, const usercmd_t *cmd, int version);
+#endif
 #if USE_CLIENT
 void    MSG_WriteBits(int value, int bits);
-int     MSG_WriteDeltaUsercmd(const usercmd_t *from, const usercmd_t *cmd, int version);
 int     MSG_WriteDeltaUsercmd_Enhanced(const usercmd_t *from, const usercmd_t *cmd, int version);
 #endif
 void    MSG_WriteDir(const vec3_t vector);
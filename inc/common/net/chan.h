@@ -40,6 +40,7 @@ typedef struct netchan_s {
     int         dropped;            // between last packet and previous
     unsigned    total_dropped;      // for statistics
     unsigned    total_received;
+    uint64_t    total_bytes_sent;
 
     unsigned    last_received;      // for timeouts
     unsigned    last_sent;          // for retransmits
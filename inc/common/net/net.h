@@ -210,7 +210,7 @@ void        NET_UpdateStream(netstream_t *s);
 
 ioentry_t   *NET_AddFd(qsocket_t fd);
 void        NET_RemoveFd(qsocket_t fd);
-int         NET_Sleep(int msec);
+int         NET_SleepUntil(uint64_t deadline);
 #if USE_AC_SERVER
 int         NET_Sleepv(int msec, ...);
 #endif
@@ -45,7 +45,8 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #define PROTOCOL_VERSION_Q2PRO_BEAM_ORIGIN      1017    // r1037-8
 #define PROTOCOL_VERSION_Q2PRO_SHORT_ANGLES     1018    // r1037-44
 #define PROTOCOL_VERSION_Q2PRO_SERVER_STATE     1019    // r1302
-#define PROTOCOL_VERSION_Q2PRO_CURRENT          1019    // r1302
+#define PROTOCOL_VERSION_Q2PRO_HUFFMAN          1020
+#define PROTOCOL_VERSION_Q2PRO_CURRENT          1020
 
 #define PROTOCOL_VERSION_MVD_MINIMUM            2009    // r168
 #define PROTOCOL_VERSION_MVD_CURRENT            2010    // r177
@@ -134,6 +135,9 @@ typedef enum {
     svc_gamestate, // q2pro specific, means svc_playerupdate in r1q2
     svc_setting,
 
+    // q2pro specific operations
+    svc_hpacket,
+
     svc_num_types
 } svc_ops_t;
 
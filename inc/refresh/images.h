@@ -33,6 +33,12 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #define R_Malloc(size)      Z_TagMalloc(size, TAG_RENDERER)
 #define R_Mallocz(size)     Z_TagMallocz(size, TAG_RENDERER)
 
+#if USE_THREADS && (USE_PNG || USE_JPG || USE_TGA)
+#define USE_IMG_THREADS 1
+#else
+#define USE_IMG_THREADS 0
+#endif
+
 #if USE_REF == REF_GL
 #define IMG_AllocPixels(x)  FS_AllocTempMem(x)
 #define IMG_FreePixels(x)   FS_FreeTempMem(x)
@@ -108,9 +114,17 @@ void IMG_GetPalette(void);
 
 image_t *IMG_ForHandle(qhandle_t h);
 
+#if USE_IMG_THREADS
+void IMG_Prefetch(const char *name, imagetype_t type);
+#else
+#define IMG_Prefetch(name, type)    (void)0
+#endif
+
 void IMG_ResampleTexture(const byte *in, int inwidth, int inheight,
                          byte *out, int outwidth, int outheight);
 void IMG_MipMap(byte *out, byte *in, int width, int height);
+void IMG_LightScaleTexture(byte *in, int inwidth, int inheight, const byte *table);
+void IMG_GrayScaleTexture(byte *in, int inwidth, int inheight, float colorscale);
 
 // these are implemented in src/refresh/[gl,sw]/images.c
 void IMG_Unload(image_t *image);
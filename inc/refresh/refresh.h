@@ -226,4 +226,7 @@ void    R_BeginFrame(void);
 void    R_EndFrame(void);
 void    R_ModeChanged(int width, int height, int flags, int rowbytes, void *pixels);
 
+// saves current frame as screenshots/<name>.png or .tga
+void    IMG_SaveFrame(const char *name);
+
 #endif // REFRESH_H
@@ -34,6 +34,8 @@ void SV_ErrorEvent(netadr_t *from, int ee_errno, int ee_info);
 void SV_Init(void);
 void SV_Shutdown(const char *finalmsg, error_type_t type);
 unsigned SV_Frame(unsigned msec);
+void SV_FlushMapCache(void);
+void SV_CheckMapCache(void);
 #if USE_SYSCON
 void SV_SetConsoleTitle(void);
 #endif
@@ -50,6 +50,7 @@ typedef enum {
 #define GMF_WANT_ALL_DISCONNECTS 8
 #define GMF_ENHANCED_SAVEGAMES 1024
 #define GMF_VARIABLE_FPS 2048
+#define GMF_ENTITY_HISTORY 4096
 
 //===============================================================
 
@@ -181,6 +182,32 @@ typedef struct {
     void (*DebugGraph)(float value, int color);
 } game_import_t;
 
+//
+// extended functions provided by the main engine, passed to the optional
+// GetGameAPIEx function exported by the game dll after GetGameAPI returns.
+// Copy no more than structsize bytes of it.
+//
+#define GAME_API_VERSION_EX     1
+
+typedef struct {
+    int         apiversion;
+    int         structsize;
+
+    // lag compensation, only available if the game sets GMF_ENTITY_HISTORY.
+    // RewindEntities moves solid bbox entities back to where they were when
+    // the given client saw them, accounting for its latency. Until
+    // RestoreEntities is called, trace clips against rewound positions.
+    // Rewound entities are not relinked, so other functions see them where
+    // they are now. Returns qfalse if there is nothing to rewind.
+    qboolean (*RewindEntities)(edict_t *ent);
+    void (*RestoreEntities)(void);
+
+    // savegames. WriteSaveFile takes a copy of the file data to be written
+    // out in the background together with the server files. Returns qfalse
+    // if it can't, in which case the game should write the file itself.
+    qboolean (*WriteSaveFile)(const char *filename, const void *data, size_t len);
+} game_import_ex_t;
+
 //
 // functions exported by the game subsystem
 //
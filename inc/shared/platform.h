@@ -26,8 +26,10 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #ifdef _WIN32
 #include <io.h>
 #include <direct.h>
+#include <sys/utime.h>
 #else
 #include <unistd.h>
+#include <utime.h>
 #endif
 
 #ifdef _WIN32
@@ -57,6 +59,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #define os_fstat(f, s)      _fstat(f, s)
 #define os_fileno(f)        _fileno(f)
 #define os_access(p, m)     _access(p, m)
+#define os_utime(p)         _utime(p, NULL)
 #define Q_ISREG(m)          (((m) & _S_IFMT) == _S_IFREG)
 #define Q_ISDIR(m)          (((m) & _S_IFMT) == _S_IFDIR)
 #define Q_STATBUF           struct _stat
@@ -67,6 +70,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #define os_fstat(f, s)      fstat(f, s)
 #define os_fileno(f)        fileno(f)
 #define os_access(p, m)     access(p, m)
+#define os_utime(p)         utime(p, NULL)
 #define Q_ISREG(m)          S_ISREG(m)
 #define Q_ISDIR(m)          S_ISDIR(m)
 #define Q_STATBUF           struct stat
@@ -46,6 +46,10 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 #define q_countof(a)        (sizeof(a) / sizeof(a[0]))
 
+// fails to compile if expression is false
+#define q_static_assert(expr, name) \
+    typedef char q_static_assert_##name[(expr) ? 1 : -1]
+
 typedef unsigned char byte;
 typedef enum { qfalse, qtrue } qboolean;
 typedef int qhandle_t;
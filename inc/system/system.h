@@ -27,7 +27,26 @@ void    Sys_FreeLibrary(void *handle);
 void    *Sys_GetProcAddress(void *handle, const char *sym);
 
 unsigned    Sys_Milliseconds(void);
+uint64_t    Sys_Microseconds(void);
 void    Sys_Sleep(int msec);
+void    Sys_SleepUntil(uint64_t deadline);
+
+qboolean Sys_RandomBytes(void *buffer, size_t size);
+
+#if USE_THREADS
+typedef struct sys_thread_s sys_thread_t;
+typedef struct sys_event_s  sys_event_t;
+
+// threads are created with all signals blocked
+sys_thread_t *Sys_CreateThread(void (*func)(void *), void *arg);
+void    Sys_JoinThread(sys_thread_t *thread);
+
+// auto-reset event, wakes up a single waiter
+sys_event_t *Sys_CreateEvent(void);
+void    Sys_DestroyEvent(sys_event_t *event);
+void    Sys_SignalEvent(sys_event_t *event);
+void    Sys_WaitEvent(sys_event_t *event);
+#endif
 
 void    Sys_Init(void);
 void    Sys_AddDefaultConfig(void);
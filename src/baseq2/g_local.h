@@ -441,6 +441,7 @@ typedef struct {
 extern  game_locals_t   game;
 extern  level_locals_t  level;
 extern  game_import_t   gi;
+extern  game_import_ex_t    gix;
 extern  game_export_t   globals;
 extern  spawn_temp_t    st;
 
@@ -543,6 +544,8 @@ extern  cvar_t  *sv_maplist;
 
 extern  cvar_t  *sv_features;
 
+extern  cvar_t  *g_antilag;
+
 #define world   (&g_edicts[0])
 
 // item spawnflags
@@ -783,6 +786,11 @@ void M_ChangeYaw(edict_t *ent);
 //
 void G_RunEntity(edict_t *ent);
 
+//
+// g_spawn.c
+//
+void ED_FlushCache(void);
+
 //
 // g_main.c
 //
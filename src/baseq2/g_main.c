@@ -21,6 +21,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 game_locals_t   game;
 level_locals_t  level;
 game_import_t   gi;
+game_import_ex_t    gix;
 game_export_t   globals;
 spawn_temp_t    st;
 
@@ -72,6 +73,8 @@ cvar_t  *sv_maplist;
 
 cvar_t  *sv_features;
 
+cvar_t  *g_antilag;
+
 void SpawnEntities(const char *mapname, const char *entities, const char *spawnpoint);
 void ClientThink(edict_t *ent, usercmd_t *cmd);
 qboolean ClientConnect(edict_t *ent, char *userinfo);
@@ -97,6 +100,8 @@ void ShutdownGame(void)
 
     gi.FreeTags(TAG_LEVEL);
     gi.FreeTags(TAG_GAME);
+
+    ED_FlushCache();
 }
 
 /*
@@ -110,6 +115,8 @@ is loaded.
 */
 void InitGame(void)
 {
+    int features;
+
     gi.dprintf("==== InitGame ====\n");
 
     gun_x = gi.cvar("gun_x", "0", 0);
@@ -136,6 +143,7 @@ void InitGame(void)
     coop = gi.cvar("coop", "0", CVAR_LATCH);
     skill = gi.cvar("skill", "1", CVAR_LATCH);
     maxentities = gi.cvar("maxentities", "1024", CVAR_LATCH);
+    g_antilag = gi.cvar("g_antilag", "0", CVAR_LATCH);
 
     // change anytime vars
     dmflags = gi.cvar("dmflags", "0", CVAR_SERVERINFO);
@@ -166,7 +174,10 @@ void InitGame(void)
     sv_features = gi.cvar("sv_features", NULL, 0);
 
     // export our own features
-    gi.cvar_forceset("g_features", va("%d", G_FEATURES));
+    features = G_FEATURES;
+    if (g_antilag->integer && gix.RewindEntities)
+        features |= GMF_ENTITY_HISTORY;
+    gi.cvar_forceset("g_features", va("%d", features));
 
     // items
     InitItems();
@@ -226,6 +237,21 @@ q_exported game_export_t *GetGameAPI(game_import_t *import)
     return &globals;
 }
 
+/*
+=================
+GetGameAPIEx
+
+Called by newer servers after GetGameAPI with extended entry points
+=================
+*/
+q_exported void GetGameAPIEx(const game_import_ex_t *import)
+{
+    if (import->apiversion < GAME_API_VERSION_EX)
+        return;
+
+    memcpy(&gix, import, min((size_t)import->structsize, sizeof(gix)));
+}
+
 #ifndef GAME_HARD_LINKED
 // this is only here so the functions in q_shared.c can link
 void Com_LPrintf(print_type_t type, const char *fmt, ...)
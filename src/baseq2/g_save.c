@@ -430,334 +430,453 @@ static const save_field_t gamefields[] = {
 
 //=========================================================
 
-static void write_data(void *buf, size_t len, FILE *f)
+/*
+Savegames are serialized into memory in one pass and then handed over to the
+server to be written out in the background, or written with a single fwrite
+if the server can't take them. They are read back the same way: whole file
+is loaded into memory first and parsed from there.
+*/
+typedef struct {
+    byte    *data;
+    size_t  cursize;
+    size_t  maxsize;
+    size_t  readcount;
+} savebuf_t;
+
+static savebuf_t    *save_buf;  // buffer being written or read
+
+static void free_buffer(void)
+{
+    if (save_buf) {
+        gi.TagFree(save_buf->data);
+        save_buf = NULL;
+    }
+}
+
+// frees the buffer in use before erroring out
+static void q_noreturn q_printf(1, 2) save_error(const char *fmt, ...)
+{
+    va_list     argptr;
+    char        text[MAX_STRING_CHARS];
+
+    va_start(argptr, fmt);
+    Q_vsnprintf(text, sizeof(text), fmt, argptr);
+    va_end(argptr);
+
+    free_buffer();
+    gi.error("%s", text);
+}
+
+static void *get_space(savebuf_t *b, size_t len)
 {
-    if (fwrite(buf, 1, len, f) != len) {
-        gi.error("%s: couldn't write %"PRIz" bytes", __func__, len);
+    byte *data;
+
+    if (b->cursize + len > b->maxsize) {
+        b->maxsize = max(b->maxsize * 2, b->cursize + len);
+        data = gi.TagMalloc(b->maxsize, TAG_GAME);
+        memcpy(data, b->data, b->cursize);
+        gi.TagFree(b->data);
+        b->data = data;
     }
+
+    data = b->data + b->cursize;
+    b->cursize += len;
+    return data;
+}
+
+static void write_data(void *buf, size_t len, savebuf_t *b)
+{
+    memcpy(get_space(b, len), buf, len);
 }
 
-static void write_short(FILE *f, short v)
+static void write_short(savebuf_t *b, short v)
 {
     v = LittleShort(v);
-    write_data(&v, sizeof(v), f);
+    write_data(&v, sizeof(v), b);
 }
 
-static void write_int(FILE *f, int v)
+static void write_int(savebuf_t *b, int v)
 {
     v = LittleLong(v);
-    write_data(&v, sizeof(v), f);
+    write_data(&v, sizeof(v), b);
 }
 
-static void write_float(FILE *f, float v)
+static void write_float(savebuf_t *b, float v)
 {
     v = LittleFloat(v);
-    write_data(&v, sizeof(v), f);
+    write_data(&v, sizeof(v), b);
 }
 
-static void write_string(FILE *f, char *s)
+static void write_string(savebuf_t *b, char *s)
 {
     size_t len;
 
     if (!s) {
-        write_int(f, -1);
+        write_int(b, -1);
         return;
     }
 
     len = strlen(s);
-    write_int(f, len);
-    write_data(s, len, f);
+    write_int(b, len);
+    write_data(s, len, b);
 }
 
-static void write_vector(FILE *f, vec_t *v)
+static void write_vector(savebuf_t *b, vec_t *v)
 {
-    write_float(f, v[0]);
-    write_float(f, v[1]);
-    write_float(f, v[2]);
+    write_float(b, v[0]);
+    write_float(b, v[1]);
+    write_float(b, v[2]);
 }
 
-static void write_index(FILE *f, void *p, size_t size, void *start, int max_index)
+static void write_index(savebuf_t *b, void *p, size_t size, void *start, int max_index)
 {
     size_t diff;
 
     if (!p) {
-        write_int(f, -1);
+        write_int(b, -1);
         return;
     }
 
     if (p < start || (byte *)p > (byte *)start + max_index * size) {
-        gi.error("%s: pointer out of range: %p", __func__, p);
+        save_error("%s: pointer out of range: %p", __func__, p);
     }
 
     diff = (byte *)p - (byte *)start;
     if (diff % size) {
-        gi.error("%s: misaligned pointer: %p", __func__, p);
+        save_error("%s: misaligned pointer: %p", __func__, p);
     }
-    write_int(f, (int)(diff / size));
+    write_int(b, (int)(diff / size));
+}
+
+// maps pointers to save_ptrs indices, built on first use
+#define PTR_HASH_SIZE   4096
+
+static short    ptr_hash[PTR_HASH_SIZE];    // index + 1, 0 if empty
+static qboolean ptr_hash_built;
+
+static unsigned hash_pointer(void *p, ptr_type_t type)
+{
+    return (((uintptr_t)p >> 2) * 0x9e3779b1U + type) & (PTR_HASH_SIZE - 1);
 }
 
-static void write_pointer(FILE *f, void *p, ptr_type_t type)
+static int hashed_pointer(void *p, ptr_type_t type)
 {
     const save_ptr_t *ptr;
+    unsigned h;
+
+    for (h = hash_pointer(p, type); ptr_hash[h]; h = (h + 1) & (PTR_HASH_SIZE - 1)) {
+        ptr = &save_ptrs[ptr_hash[h] - 1];
+        if (ptr->type == type && ptr->ptr == p) {
+            return ptr_hash[h] - 1;
+        }
+    }
+
+    return -1;
+}
+
+static void build_pointer_hash(void)
+{
+    const save_ptr_t *ptr;
+    unsigned h;
     int i;
 
-    if (!p) {
-        write_int(f, -1);
+    if (ptr_hash_built || num_save_ptrs >= PTR_HASH_SIZE / 2) {
         return;
     }
 
+    for (i = 0, ptr = save_ptrs; i < num_save_ptrs; i++, ptr++) {
+        // keep the first entry for duplicate pointers
+        if (hashed_pointer(ptr->ptr, ptr->type) != -1) {
+            continue;
+        }
+        for (h = hash_pointer(ptr->ptr, ptr->type); ptr_hash[h]; h = (h + 1) & (PTR_HASH_SIZE - 1))
+            ;
+        ptr_hash[h] = i + 1;
+    }
+
+    ptr_hash_built = qtrue;
+}
+
+static int find_pointer(void *p, ptr_type_t type)
+{
+    const save_ptr_t *ptr;
+    int i;
+
+    if (ptr_hash_built) {
+        return hashed_pointer(p, type);
+    }
+
+    // table is too small, fall back to linear search
     for (i = 0, ptr = save_ptrs; i < num_save_ptrs; i++, ptr++) {
         if (ptr->type == type && ptr->ptr == p) {
-            write_int(f, i);
-            return;
+            return i;
         }
     }
 
-    gi.error("%s: unknown pointer: %p", __func__, p);
+    return -1;
 }
 
-static void write_field(FILE *f, const save_field_t *field, void *base)
+static void write_pointer(savebuf_t *b, void *p, ptr_type_t type)
+{
+    int i;
+
+    if (!p) {
+        write_int(b, -1);
+        return;
+    }
+
+    i = find_pointer(p, type);
+    if (i == -1) {
+        save_error("%s: unknown pointer: %p", __func__, p);
+    }
+
+    write_int(b, i);
+}
+
+static void write_field(savebuf_t *b, const save_field_t *field, void *base)
 {
     void *p = (byte *)base + field->ofs;
     int i;
 
     switch (field->type) {
     case F_BYTE:
-        write_data(p, field->size, f);
+        write_data(p, field->size, b);
         break;
     case F_SHORT:
         for (i = 0; i < field->size; i++) {
-            write_short(f, ((short *)p)[i]);
+            write_short(b, ((short *)p)[i]);
         }
         break;
     case F_INT:
         for (i = 0; i < field->size; i++) {
-            write_int(f, ((int *)p)[i]);
+            write_int(b, ((int *)p)[i]);
         }
         break;
     case F_FLOAT:
         for (i = 0; i < field->size; i++) {
-            write_float(f, ((float *)p)[i]);
+            write_float(b, ((float *)p)[i]);
         }
         break;
     case F_VECTOR:
-        write_vector(f, (vec_t *)p);
+        write_vector(b, (vec_t *)p);
         break;
 
     case F_ZSTRING:
-        write_string(f, (char *)p);
+        write_string(b, (char *)p);
         break;
     case F_LSTRING:
-        write_string(f, *(char **)p);
+        write_string(b, *(char **)p);
         break;
 
     case F_EDICT:
-        write_index(f, *(void **)p, sizeof(edict_t), g_edicts, MAX_EDICTS - 1);
+        write_index(b, *(void **)p, sizeof(edict_t), g_edicts, MAX_EDICTS - 1);
         break;
     case F_CLIENT:
-        write_index(f, *(void **)p, sizeof(gclient_t), game.clients, game.maxclients - 1);
+        write_index(b, *(void **)p, sizeof(gclient_t), game.clients, game.maxclients - 1);
         break;
     case F_ITEM:
-        write_index(f, *(void **)p, sizeof(gitem_t), itemlist, game.num_items - 1);
+        write_index(b, *(void **)p, sizeof(gitem_t), itemlist, game.num_items - 1);
         break;
 
     case F_POINTER:
-        write_pointer(f, *(void **)p, field->size);
+        write_pointer(b, *(void **)p, field->size);
         break;
 
     default:
-        gi.error("%s: unknown field type", __func__);
+        save_error("%s: unknown field type", __func__);
     }
 }
 
-static void write_fields(FILE *f, const save_field_t *fields, void *base)
+static void write_fields(savebuf_t *b, const save_field_t *fields, void *base)
 {
     const save_field_t *field;
 
     for (field = fields; field->type; field++) {
-        write_field(f, field, base);
+        write_field(b, field, base);
     }
 }
 
-static void read_data(void *buf, size_t len, FILE *f)
+static void read_data(void *buf, size_t len, savebuf_t *b)
 {
-    if (fread(buf, 1, len, f) != len) {
-        gi.error("%s: couldn't read %"PRIz" bytes", __func__, len);
+    if (len > b->cursize - b->readcount) {
+        save_error("%s: couldn't read %"PRIz" bytes", __func__, len);
     }
+    memcpy(buf, b->data + b->readcount, len);
+    b->readcount += len;
 }
 
-static int read_short(FILE *f)
+static int read_short(savebuf_t *b)
 {
     short v;
 
-    read_data(&v, sizeof(v), f);
+    read_data(&v, sizeof(v), b);
     v = LittleShort(v);
 
     return v;
 }
 
-static int read_int(FILE *f)
+static int read_int(savebuf_t *b)
 {
     int v;
 
-    read_data(&v, sizeof(v), f);
+    read_data(&v, sizeof(v), b);
     v = LittleLong(v);
 
     return v;
 }
 
-static float read_float(FILE *f)
+static float read_float(savebuf_t *b)
 {
     float v;
 
-    read_data(&v, sizeof(v), f);
+    read_data(&v, sizeof(v), b);
     v = LittleFloat(v);
 
     return v;
 }
 
 
-static char *read_string(FILE *f)
+static char *read_string(savebuf_t *b)
 {
     int len;
     char *s;
 
-    len = read_int(f);
+    len = read_int(b);
     if (len == -1) {
         return NULL;
     }
 
     if (len < 0 || len > 65536) {
-        gi.error("%s: bad length", __func__);
+        save_error("%s: bad length", __func__);
     }
 
     s = gi.TagMalloc(len + 1, TAG_LEVEL);
-    read_data(s, len, f);
+    read_data(s, len, b);
     s[len] = 0;
 
     return s;
 }
 
-static void read_zstring(FILE *f, char *s, size_t size)
+static void read_zstring(savebuf_t *b, char *s, size_t size)
 {
     int len;
 
-    len = read_int(f);
+    len = read_int(b);
     if (len < 0 || len >= size) {
-        gi.error("%s: bad length", __func__);
+        save_error("%s: bad length", __func__);
     }
 
-    read_data(s, len, f);
+    read_data(s, len, b);
     s[len] = 0;
 }
 
-static void read_vector(FILE *f, vec_t *v)
+static void read_vector(savebuf_t *b, vec_t *v)
 {
-    v[0] = read_float(f);
-    v[1] = read_float(f);
-    v[2] = read_float(f);
+    v[0] = read_float(b);
+    v[1] = read_float(b);
+    v[2] = read_float(b);
 }
 
-static void *read_index(FILE *f, size_t size, void *start, int max_index)
+static void *read_index(savebuf_t *b, size_t size, void *start, int max_index)
 {
     int index;
     byte *p;
 
-    index = read_int(f);
+    index = read_int(b);
     if (index == -1) {
         return NULL;
     }
 
     if (index < 0 || index > max_index) {
-        gi.error("%s: bad index", __func__);
+        save_error("%s: bad index", __func__);
     }
 
     p = (byte *)start + index * size;
     return p;
 }
 
-static void *read_pointer(FILE *f, ptr_type_t type)
+static void *read_pointer(savebuf_t *b, ptr_type_t type)
 {
     int index;
     const save_ptr_t *ptr;
 
-    index = read_int(f);
+    index = read_int(b);
     if (index == -1) {
         return NULL;
     }
 
     if (index < 0 || index >= num_save_ptrs) {
-        gi.error("%s: bad index", __func__);
+        save_error("%s: bad index", __func__);
     }
 
     ptr = &save_ptrs[index];
     if (ptr->type != type) {
-        gi.error("%s: type mismatch", __func__);
+        save_error("%s: type mismatch", __func__);
     }
 
     return ptr->ptr;
 }
 
-static void read_field(FILE *f, const save_field_t *field, void *base)
+static void read_field(savebuf_t *b, const save_field_t *field, void *base)
 {
     void *p = (byte *)base + field->ofs;
     int i;
 
     switch (field->type) {
     case F_BYTE:
-        read_data(p, field->size, f);
+        read_data(p, field->size, b);
         break;
     case F_SHORT:
         for (i = 0; i < field->size; i++) {
-            ((short *)p)[i] = read_short(f);
+            ((short *)p)[i] = read_short(b);
         }
         break;
     case F_INT:
         for (i = 0; i < field->size; i++) {
-            ((int *)p)[i] = read_int(f);
+            ((int *)p)[i] = read_int(b);
         }
         break;
     case F_FLOAT:
         for (i = 0; i < field->size; i++) {
-            ((float *)p)[i] = read_float(f);
+            ((float *)p)[i] = read_float(b);
         }
         break;
     case F_VECTOR:
-        read_vector(f, (vec_t *)p);
+        read_vector(b, (vec_t *)p);
         break;
 
     case F_LSTRING:
-        *(char **)p = read_string(f);
+        *(char **)p = read_string(b);
         break;
     case F_ZSTRING:
-        read_zstring(f, (char *)p, field->size);
+        read_zstring(b, (char *)p, field->size);
         break;
 
     case F_EDICT:
-        *(edict_t **)p = read_index(f, sizeof(edict_t), g_edicts, game.maxentities - 1);
+        *(edict_t **)p = read_index(b, sizeof(edict_t), g_edicts, game.maxentities - 1);
         break;
     case F_CLIENT:
-        *(gclient_t **)p = read_index(f, sizeof(gclient_t), game.clients, game.maxclients - 1);
+        *(gclient_t **)p = read_index(b, sizeof(gclient_t), game.clients, game.maxclients - 1);
         break;
     case F_ITEM:
-        *(gitem_t **)p = read_index(f, sizeof(gitem_t), itemlist, game.num_items - 1);
+        *(gitem_t **)p = read_index(b, sizeof(gitem_t), itemlist, game.num_items - 1);
         break;
 
     case F_POINTER:
-        *(void **)p = read_pointer(f, field->size);
+        *(void **)p = read_pointer(b, field->size);
         break;
 
     default:
-        gi.error("%s: unknown field type", __func__);
+        save_error("%s: unknown field type", __func__);
     }
 }
 
-static void read_fields(FILE *f, const save_field_t *fields, void *base)
+static void read_fields(savebuf_t *b, const save_field_t *fields, void *base)
 {
     const save_field_t *field;
 
     for (field = fields; field->type; field++) {
-        read_field(f, field, base);
+        read_field(b, field, base);
     }
 }
 
@@ -767,6 +886,76 @@ static void read_fields(FILE *f, const save_field_t *fields, void *base)
 #define SAVE_MAGIC2  0x151413
 #define SAVE_VERSION 1
 
+static void begin_write(savebuf_t *b, size_t size)
+{
+    build_pointer_hash();
+
+    b->data = gi.TagMalloc(size, TAG_GAME);
+    b->cursize = 0;
+    b->maxsize = size;
+    b->readcount = 0;
+    save_buf = b;
+}
+
+static void end_write(savebuf_t *b, const char *filename)
+{
+    FILE *f;
+    size_t len;
+
+    // server copies the data and writes it out in the background
+    if (gix.WriteSaveFile && gix.WriteSaveFile(filename, b->data, b->cursize)) {
+        free_buffer();
+        return;
+    }
+
+    f = fopen(filename, "wb");
+    if (!f)
+        save_error("Couldn't open %s", filename);
+
+    len = fwrite(b->data, 1, b->cursize, f);
+    fclose(f);
+
+    free_buffer();
+
+    if (len != b->cursize)
+        save_error("Couldn't write %s", filename);
+}
+
+static void begin_read(savebuf_t *b, const char *filename)
+{
+    FILE *f;
+    long len;
+
+    save_buf = NULL;
+
+    f = fopen(filename, "rb");
+    if (!f)
+        save_error("Couldn't open %s", filename);
+
+    fseek(f, 0, SEEK_END);
+    len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    if (len < 0) {
+        fclose(f);
+        save_error("Couldn't read %s", filename);
+    }
+
+    b->data = gi.TagMalloc(len + 1, TAG_GAME);
+    b->cursize = fread(b->data, 1, len, f);
+    b->maxsize = len + 1;
+    b->readcount = 0;
+    save_buf = b;
+    fclose(f);
+
+    if (b->cursize != len)
+        save_error("Couldn't read %s", filename);
+}
+
+static void end_read(savebuf_t *b)
+{
+    free_buffer();
+}
+
 /*
 ============
 WriteGame
@@ -783,63 +972,56 @@ last save position.
 */
 void WriteGame(const char *filename, qboolean autosave)
 {
-    FILE    *f;
-    int     i;
+    savebuf_t   b;
+    int         i;
 
     if (!autosave)
         SaveClientData();
 
-    f = fopen(filename, "wb");
-    if (!f)
-        gi.error("Couldn't open %s", filename);
+    begin_write(&b, 0x2000 + game.maxclients * 0x800);
 
-    write_int(f, SAVE_MAGIC1);
-    write_int(f, SAVE_VERSION);
+    write_int(&b, SAVE_MAGIC1);
+    write_int(&b, SAVE_VERSION);
 
     game.autosaved = autosave;
-    write_fields(f, gamefields, &game);
+    write_fields(&b, gamefields, &game);
     game.autosaved = qfalse;
 
     for (i = 0; i < game.maxclients; i++) {
-        write_fields(f, clientfields, &game.clients[i]);
+        write_fields(&b, clientfields, &game.clients[i]);
     }
 
-    fclose(f);
+    end_write(&b, filename);
 }
 
 void ReadGame(const char *filename)
 {
-    FILE    *f;
-    int     i;
+    savebuf_t   b;
+    int         i;
 
     gi.FreeTags(TAG_GAME);
+    ED_FlushCache();
 
-    f = fopen(filename, "rb");
-    if (!f)
-        gi.error("Couldn't open %s", filename);
+    begin_read(&b, filename);
 
-    i = read_int(f);
+    i = read_int(&b);
     if (i != SAVE_MAGIC1) {
-        fclose(f);
-        gi.error("Not a save game");
+        save_error("Not a save game");
     }
 
-    i = read_int(f);
+    i = read_int(&b);
     if (i != SAVE_VERSION) {
-        fclose(f);
-        gi.error("Savegame from an older version.\n");
+        save_error("Savegame from an older version.\n");
     }
 
-    read_fields(f, gamefields, &game);
+    read_fields(&b, gamefields, &game);
 
     // should agree with server's version
     if (game.maxclients != (int)maxclients->value) {
-        fclose(f);
-        gi.error("Savegame has bad maxclients.\n");
+        save_error("Savegame has bad maxclients.\n");
     }
     if (game.maxentities <= game.maxclients || game.maxentities > MAX_EDICTS) {
-        fclose(f);
-        gi.error("Savegame has bad maxentities.\n");
+        save_error("Savegame has bad maxentities.\n");
     }
 
     g_edicts = gi.TagMalloc(game.maxentities * sizeof(g_edicts[0]), TAG_GAME);
@@ -848,10 +1030,10 @@ void ReadGame(const char *filename)
 
     game.clients = gi.TagMalloc(game.maxclients * sizeof(game.clients[0]), TAG_GAME);
     for (i = 0; i < game.maxclients; i++) {
-        read_fields(f, clientfields, &game.clients[i]);
+        read_fields(&b, clientfields, &game.clients[i]);
     }
 
-    fclose(f);
+    end_read(&b);
 }
 
 //==========================================================
@@ -865,31 +1047,29 @@ WriteLevel
 */
 void WriteLevel(const char *filename)
 {
-    int     i;
-    edict_t *ent;
-    FILE    *f;
+    int         i;
+    edict_t     *ent;
+    savebuf_t   b;
 
-    f = fopen(filename, "wb");
-    if (!f)
-        gi.error("Couldn't open %s", filename);
+    begin_write(&b, 0x1000 + globals.num_edicts * 0x400);
 
-    write_int(f, SAVE_MAGIC2);
-    write_int(f, SAVE_VERSION);
+    write_int(&b, SAVE_MAGIC2);
+    write_int(&b, SAVE_VERSION);
 
     // write out level_locals_t
-    write_fields(f, levelfields, &level);
+    write_fields(&b, levelfields, &level);
 
     // write out all the entities
     for (i = 0; i < globals.num_edicts; i++) {
         ent = &g_edicts[i];
         if (!ent->inuse)
             continue;
-        write_int(f, i);
-        write_fields(f, entityfields, ent);
+        write_int(&b, i);
+        write_fields(&b, entityfields, ent);
     }
-    write_int(f, -1);
+    write_int(&b, -1);
 
-    fclose(f);
+    end_write(&b, filename);
 }
 
 
@@ -911,51 +1091,47 @@ No clients are connected yet.
 */
 void ReadLevel(const char *filename)
 {
-    int     entnum;
-    FILE    *f;
-    int     i;
-    edict_t *ent;
+    int         entnum;
+    savebuf_t   b;
+    int         i;
+    edict_t     *ent;
 
     // free any dynamic memory allocated by loading the level
     // base state
     gi.FreeTags(TAG_LEVEL);
 
-    f = fopen(filename, "rb");
-    if (!f)
-        gi.error("Couldn't open %s", filename);
+    begin_read(&b, filename);
 
     // wipe all the entities
     memset(g_edicts, 0, game.maxentities * sizeof(g_edicts[0]));
     globals.num_edicts = maxclients->value + 1;
 
-    i = read_int(f);
+    i = read_int(&b);
     if (i != SAVE_MAGIC2) {
-        fclose(f);
-        gi.error("Not a save game");
+        save_error("Not a save game");
     }
 
-    i = read_int(f);
+    i = read_int(&b);
     if (i != SAVE_VERSION) {
-        fclose(f);
-        gi.error("Savegame from an older version.\n");
+        save_error("Savegame from an older version.\n");
     }
 
     // load the level locals
-    read_fields(f, levelfields, &level);
+    read_fields(&b, levelfields, &level);
 
     // load all the entities
     while (1) {
-        entnum = read_int(f);
+        entnum = read_int(&b);
         if (entnum == -1)
             break;
         if (entnum < 0 || entnum >= game.maxentities) {
-            gi.error("%s: bad entity number", __func__);
+            save_error("%s: bad entity number", __func__);
         }
         if (entnum >= globals.num_edicts)
             globals.num_edicts = entnum + 1;
 
         ent = &g_edicts[entnum];
-        read_fields(f, entityfields, ent);
+        read_fields(&b, entityfields, ent);
         ent->inuse = qtrue;
         ent->s.number = entnum;
 
@@ -964,7 +1140,7 @@ void ReadLevel(const char *filename)
         gi.linkentity(ent);
     }
 
-    fclose(f);
+    end_read(&b);
 
     // mark all clients as unconnected
     for (i = 0 ; i < maxclients->value ; i++) {
@@ -329,6 +329,133 @@ static const spawn_field_t temp_fields[] = {
 };
 
 
+/*
+==============================================================================
+
+NAME LOOKUP
+
+Spawn functions, items and fields are looked up by name through hash tables
+built on first use. Tables store index + 1, 0 marks an empty slot.
+
+==============================================================================
+*/
+
+#define SPAWN_HASH_SIZE     512
+
+static short    item_hash[SPAWN_HASH_SIZE];
+static short    func_hash[SPAWN_HASH_SIZE];
+static short    field_hash[SPAWN_HASH_SIZE];    // spawn_fields, then temp_fields
+static qboolean spawn_hash_built;
+
+static int      num_spawn_fields;
+
+// case insensitive, so that it works for field names too
+static unsigned hash_name(const char *s)
+{
+    unsigned h = 0;
+
+    while (*s)
+        h = h * 33 + Q_tolower(*s++);
+
+    return (h ^ (h >> 9)) & (SPAWN_HASH_SIZE - 1);
+}
+
+static void hash_insert(short *hash, const char *name, int index)
+{
+    unsigned h;
+
+    for (h = hash_name(name); hash[h]; h = (h + 1) & (SPAWN_HASH_SIZE - 1))
+        ;
+    hash[h] = index + 1;
+}
+
+static const spawn_field_t *field_num(int index)
+{
+    if (index < num_spawn_fields)
+        return &spawn_fields[index];
+    return &temp_fields[index - num_spawn_fields];
+}
+
+static gitem_t *find_item(const char *classname)
+{
+    gitem_t *item;
+    unsigned h;
+
+    for (h = hash_name(classname); item_hash[h]; h = (h + 1) & (SPAWN_HASH_SIZE - 1)) {
+        item = &itemlist[item_hash[h] - 1];
+        if (!strcmp(item->classname, classname))
+            return item;
+    }
+
+    return NULL;
+}
+
+static const spawn_func_t *find_spawn_func(const char *classname)
+{
+    const spawn_func_t *s;
+    unsigned h;
+
+    for (h = hash_name(classname); func_hash[h]; h = (h + 1) & (SPAWN_HASH_SIZE - 1)) {
+        s = &spawn_funcs[func_hash[h] - 1];
+        if (!strcmp(s->name, classname))
+            return s;
+    }
+
+    return NULL;
+}
+
+static const spawn_field_t *find_field(const char *key, qboolean *temp)
+{
+    const spawn_field_t *f;
+    unsigned h;
+    int i;
+
+    for (h = hash_name(key); field_hash[h]; h = (h + 1) & (SPAWN_HASH_SIZE - 1)) {
+        i = field_hash[h] - 1;
+        f = field_num(i);
+        if (!Q_stricmp(f->name, key)) {
+            *temp = i >= num_spawn_fields;
+            return f;
+        }
+    }
+
+    return NULL;
+}
+
+// earlier entries take precedence over later ones with the same name
+static void build_spawn_hash(void)
+{
+    const spawn_func_t *s;
+    const spawn_field_t *f;
+    gitem_t *item;
+    qboolean temp;
+    int i;
+
+    if (spawn_hash_built)
+        return;
+
+    for (i = 0, item = itemlist ; i < game.num_items ; i++, item++) {
+        if (item->classname && !find_item(item->classname))
+            hash_insert(item_hash, item->classname, i);
+    }
+
+    for (s = spawn_funcs ; s->name ; s++) {
+        if (!find_spawn_func(s->name))
+            hash_insert(func_hash, s->name, s - spawn_funcs);
+    }
+
+    for (f = spawn_fields ; f->name ; f++)
+        num_spawn_fields++;
+
+    for (i = 0 ; field_num(i)->name ; i++) {
+        f = field_num(i);
+        if (!find_field(f->name, &temp))
+            hash_insert(field_hash, f->name, i);
+    }
+
+    spawn_hash_built = qtrue;
+}
+
 /*
 ===============
 ED_CallSpawn
@@ -340,38 +467,117 @@ void ED_CallSpawn(edict_t *ent)
 {
     const spawn_func_t *s;
     gitem_t *item;
-    int     i;
 
     if (!ent->classname) {
         gi.dprintf("ED_CallSpawn: NULL classname\n");
         return;
     }
 
+    build_spawn_hash();
+
     // check item spawn functions
-    for (i = 0, item = itemlist ; i < game.num_items ; i++, item++) {
-        if (!item->classname)
-            continue;
-        if (!strcmp(item->classname, ent->classname)) {
-            // found it
-            SpawnItem(ent, item);
-            return;
-        }
+    item = find_item(ent->classname);
+    if (item) {
+        // found it
+        SpawnItem(ent, item);
+        return;
     }
 
     // check normal spawn functions
-    for (s = spawn_funcs ; s->name ; s++) {
-        if (!strcmp(s->name, ent->classname)) {
-            // found it
-            s->spawn(ent);
-            return;
-        }
+    s = find_spawn_func(ent->classname);
+    if (s) {
+        // found it
+        s->spawn(ent);
+        return;
     }
+
     gi.dprintf("%s doesn't have a spawn function\n", ent->classname);
 }
 
+/*
+==============================================================================
+
+ENTITY CACHE
+
+Entity string of the last spawned map is kept parsed into key/value pairs,
+with keys resolved to fields and values converted to binary. Spawning the
+same map again instantiates entities from pairs without tokenizing anything.
+
+==============================================================================
+*/
+
+typedef struct {
+    const spawn_field_t *field;
+    qboolean    temp;       // field is in spawn_temp_t rather than edict_t
+    union {
+        char    *string;
+        int     integer;
+        float   number;
+        vec3_t  vector;
+    } value;
+} spawn_pair_t;
+
+typedef struct {
+    int         firstpair;
+    int         numpairs;
+    qboolean    init;       // had any keys, even ignored ones
+} spawn_def_t;
+
+static struct {
+    char            *entities;  // copy of the parsed entity string
+    size_t          length;
+    char            *strings;   // unescaped string values
+    size_t          stringsize;
+    spawn_def_t     *defs;
+    int             numdefs, maxdefs;
+    spawn_pair_t    *pairs;
+    int             numpairs, maxpairs;
+} spawn_cache;
+
+/*
+===============
+ED_FlushCache
+
+Forgets the cached entity string. Called after TAG_GAME memory is freed.
+===============
+*/
+void ED_FlushCache(void)
+{
+    memset(&spawn_cache, 0, sizeof(spawn_cache));
+}
+
+static void free_cache(void)
+{
+    gi.TagFree(spawn_cache.entities);
+    gi.TagFree(spawn_cache.strings);
+    gi.TagFree(spawn_cache.defs);
+    gi.TagFree(spawn_cache.pairs);
+    ED_FlushCache();
+}
+
+static void *grow_array(void *data, int count, int *max, size_t size)
+{
+    void *newdata;
+
+    if (count < *max)
+        return data;
+
+    *max = *max ? *max * 2 : 64;
+    newdata = gi.TagMalloc(*max * size, TAG_GAME);
+    if (data) {
+        memcpy(newdata, data, count * size);
+        gi.TagFree(data);
+    }
+
+    return newdata;
+}
+
 /*
 =============
 ED_NewString
+
+Unescapes the string into the string pool, which is never shorter than
+the entity string it has been parsed from.
 =============
 */
 static char *ED_NewString(const char *string)
@@ -381,7 +587,7 @@ static char *ED_NewString(const char *string)
 
     l = strlen(string) + 1;
 
-    newb = gi.TagMalloc(l, TAG_LEVEL);
+    newb = spawn_cache.strings + spawn_cache.stringsize;
 
     new_p = newb;
 
@@ -396,63 +602,52 @@ static char *ED_NewString(const char *string)
             *new_p++ = string[i];
     }
 
+    spawn_cache.stringsize += new_p - newb;
     return newb;
 }
 
-
-
-
 /*
 ===============
 ED_ParseField
 
-Takes a key/value pair and sets the binary values
-in an edict
+Converts a key/value pair into binary form
 ===============
 */
-static qboolean ED_ParseField(const spawn_field_t *fields, const char *key, const char *value, byte *b)
+static qboolean ED_ParseField(const char *key, const char *value, spawn_pair_t *p)
 {
     const spawn_field_t *f;
-    float   v;
-    vec3_t  vec;
 
-    for (f = fields ; f->name ; f++) {
-        if (!Q_stricmp(f->name, key)) {
-            // found it
-            switch (f->type) {
-            case F_LSTRING:
-                *(char **)(b + f->ofs) = ED_NewString(value);
-                break;
-            case F_VECTOR:
-                if (sscanf(value, "%f %f %f", &vec[0], &vec[1], &vec[2]) != 3) {
-                    gi.dprintf("%s: couldn't parse '%s'\n", __func__, key);
-                    VectorClear(vec);
-                }
-                ((float *)(b + f->ofs))[0] = vec[0];
-                ((float *)(b + f->ofs))[1] = vec[1];
-                ((float *)(b + f->ofs))[2] = vec[2];
-                break;
-            case F_INT:
-                *(int *)(b + f->ofs) = atoi(value);
-                break;
-            case F_FLOAT:
-                *(float *)(b + f->ofs) = atof(value);
-                break;
-            case F_ANGLEHACK:
-                v = atof(value);
-                ((float *)(b + f->ofs))[0] = 0;
-                ((float *)(b + f->ofs))[1] = v;
-                ((float *)(b + f->ofs))[2] = 0;
-                break;
-            case F_IGNORE:
-                break;
-            default:
-                break;
-            }
-            return qtrue;
+    f = find_field(key, &p->temp);
+    if (!f)
+        return qfalse;
+
+    p->field = f;
+    switch (f->type) {
+    case F_LSTRING:
+        p->value.string = ED_NewString(value);
+        break;
+    case F_VECTOR:
+        if (sscanf(value, "%f %f %f", &p->value.vector[0], &p->value.vector[1], &p->value.vector[2]) != 3) {
+            gi.dprintf("%s: couldn't parse '%s'\n", __func__, key);
+            VectorClear(p->value.vector);
         }
+        break;
+    case F_INT:
+        p->value.integer = atoi(value);
+        break;
+    case F_FLOAT:
+        p->value.number = atof(value);
+        break;
+    case F_ANGLEHACK:
+        p->value.vector[0] = 0;
+        p->value.vector[1] = atof(value);
+        p->value.vector[2] = 0;
+        break;
+    default:
+        p->field = NULL;
+        break;
     }
-    return qfalse;
+    return qtrue;
 }
 
 /*
@@ -460,16 +655,16 @@ static qboolean ED_ParseField(const spawn_field_t *fields, const char *key, cons
 ED_ParseEdict
 
 Parses an edict out of the given string, returning the new position
-ed should be a properly initialized empty edict.
 ====================
 */
-void ED_ParseEdict(const char **data, edict_t *ent)
+static void ED_ParseEdict(const char **data, spawn_def_t *def)
 {
-    qboolean    init;
     char        *key, *value;
+    spawn_pair_t *p;
 
-    init = qfalse;
-    memset(&st, 0, sizeof(st));
+    def->firstpair = spawn_cache.numpairs;
+    def->numpairs = 0;
+    def->init = qfalse;
 
 // go through all the dictionary pairs
     while (1) {
@@ -488,21 +683,117 @@ void ED_ParseEdict(const char **data, edict_t *ent)
         if (value[0] == '}')
             gi.error("%s: closing brace without data", __func__);
 
-        init = qtrue;
+        def->init = qtrue;
 
         // keynames with a leading underscore are used for utility comments,
         // and are immediately discarded by quake
         if (key[0] == '_')
             continue;
 
-        if (!ED_ParseField(spawn_fields, key, value, (byte *)ent)) {
-            if (!ED_ParseField(temp_fields, key, value, (byte *)&st)) {
-                gi.dprintf("%s: %s is not a field\n", __func__, key);
-            }
+        spawn_cache.pairs = grow_array(spawn_cache.pairs, spawn_cache.numpairs,
+                                       &spawn_cache.maxpairs, sizeof(spawn_pair_t));
+        p = &spawn_cache.pairs[spawn_cache.numpairs];
+
+        if (!ED_ParseField(key, value, p)) {
+            gi.dprintf("%s: %s is not a field\n", __func__, key);
+            continue;
         }
+
+        // ignored fields are not stored
+        if (!p->field)
+            continue;
+
+        spawn_cache.numpairs++;
+        def->numpairs++;
     }
+}
+
+/*
+====================
+ED_ParseEntities
+
+Parses entity string into the cache, unless it is already there.
+====================
+*/
+static void ED_ParseEntities(const char *entities)
+{
+    const char  *data;
+    char        *com_token;
+    size_t      len;
+
+    len = strlen(entities);
+    if (spawn_cache.entities && spawn_cache.length == len &&
+        !memcmp(spawn_cache.entities, entities, len))
+        return;
 
-    if (!init)
+    free_cache();
+    build_spawn_hash();
+
+    spawn_cache.strings = gi.TagMalloc(len + 1, TAG_GAME);
+
+// parse ents
+    data = entities;
+    while (1) {
+        // parse the opening brace
+        com_token = COM_Parse(&data);
+        if (!data)
+            break;
+        if (com_token[0] != '{')
+            gi.error("ED_LoadFromFile: found %s when expecting {", com_token);
+
+        spawn_cache.defs = grow_array(spawn_cache.defs, spawn_cache.numdefs,
+                                      &spawn_cache.maxdefs, sizeof(spawn_def_t));
+        ED_ParseEdict(&data, &spawn_cache.defs[spawn_cache.numdefs++]);
+    }
+
+    // only now the cache is complete
+    spawn_cache.entities = gi.TagMalloc(len + 1, TAG_GAME);
+    memcpy(spawn_cache.entities, entities, len + 1);
+    spawn_cache.length = len;
+}
+
+/*
+====================
+ED_InitEdict
+
+Sets fields of the edict and spawn temp vars from parsed pairs.
+ent should be a properly initialized empty edict.
+====================
+*/
+static void ED_InitEdict(const spawn_def_t *def, edict_t *ent)
+{
+    const spawn_pair_t *p;
+    const spawn_field_t *f;
+    byte    *b;
+    size_t  len;
+    int     i;
+
+    memset(&st, 0, sizeof(st));
+
+    for (i = 0, p = &spawn_cache.pairs[def->firstpair]; i < def->numpairs; i++, p++) {
+        f = p->field;
+        b = p->temp ? (byte *)&st : (byte *)ent;
+        switch (f->type) {
+        case F_LSTRING:
+            len = strlen(p->value.string) + 1;
+            *(char **)(b + f->ofs) = memcpy(gi.TagMalloc(len, TAG_LEVEL), p->value.string, len);
+            break;
+        case F_VECTOR:
+        case F_ANGLEHACK:
+            VectorCopy(p->value.vector, (float *)(b + f->ofs));
+            break;
+        case F_INT:
+            *(int *)(b + f->ofs) = p->value.integer;
+            break;
+        case F_FLOAT:
+            *(float *)(b + f->ofs) = p->value.number;
+            break;
+        default:
+            break;
+        }
+    }
+
+    if (!def->init)
         memset(ent, 0, sizeof(*ent));
 }
 
@@ -568,7 +859,7 @@ void SpawnEntities(const char *mapname, const char *entities, const char *spawnp
 {
     edict_t     *ent;
     int         inhibit;
-    char        *com_token;
+    const spawn_def_t *def;
     int         i;
     float       skill_level;
 
@@ -594,23 +885,18 @@ void SpawnEntities(const char *mapname, const char *entities, const char *spawnp
     for (i = 0 ; i < game.maxclients ; i++)
         g_edicts[i + 1].client = game.clients + i;
 
+    ED_ParseEntities(entities);
+
     ent = NULL;
     inhibit = 0;
 
-// parse ents
-    while (1) {
-        // parse the opening brace
-        com_token = COM_Parse(&entities);
-        if (!entities)
-            break;
-        if (com_token[0] != '{')
-            gi.error("ED_LoadFromFile: found %s when expecting {", com_token);
-
+// spawn ents
+    for (i = 0, def = spawn_cache.defs ; i < spawn_cache.numdefs ; i++, def++) {
         if (!ent)
             ent = g_edicts;
         else
             ent = G_Spawn();
-        ED_ParseEdict(&entities, ent);
+        ED_InitEdict(def, ent);
 
         // yet another map hack
         if (!Q_stricmp(level.mapname, "command") && !Q_stricmp(ent->classname, "trigger_once") && !Q_stricmp(ent->model, "*27"))
@@ -116,6 +116,29 @@ qboolean fire_hit(edict_t *self, vec3_t aim, int damage, int kick)
 }
 
 
+/*
+=================
+rewind_entities
+
+Lag compensation for instant hit weapons. Moves other entities back to where
+the shooting client saw them. Must be paired with restore_entities.
+=================
+*/
+static qboolean rewind_entities(edict_t *self)
+{
+    if (!self->client || !g_antilag->integer || !gix.RewindEntities)
+        return qfalse;
+
+    return gix.RewindEntities(self);
+}
+
+static void restore_entities(qboolean rewound)
+{
+    if (rewound)
+        gix.RestoreEntities();
+}
+
+
 /*
 =================
 fire_lead
@@ -134,6 +157,9 @@ static void fire_lead(edict_t *self, vec3_t start, vec3_t aimdir, int damage, in
     vec3_t      water_start;
     qboolean    water = qfalse;
     int         content_mask = MASK_SHOT | MASK_WATER;
+    qboolean    rewound;
+
+    rewound = rewind_entities(self);
 
     tr = gi.trace(self->s.origin, NULL, NULL, start, self, MASK_SHOT);
     if (!(tr.fraction < 1.0)) {
@@ -200,6 +226,8 @@ static void fire_lead(edict_t *self, vec3_t start, vec3_t aimdir, int damage, in
         }
     }
 
+    restore_entities(rewound);
+
     // send gun puff / flash
     if (!((tr.surface) && (tr.surface->flags & SURF_SKY))) {
         if (tr.fraction < 1.0) {
@@ -610,8 +638,21 @@ void fire_rocket(edict_t *self, vec3_t start, vec3_t dir, int damage, int speed,
 /*
 =================
 fire_rail
+
+When entities are rewound, those hit are collected while traces see
+rewound positions and damaged after they are restored, so that damage and
+death code run against the real world. Otherwise they are damaged as the
+rail goes.
 =================
 */
+#define MAX_RAIL_HITS   64      // hits collected while rewound
+
+typedef struct {
+    edict_t *ent;
+    vec3_t  point;
+    vec3_t  normal;
+} rail_hit_t;
+
 void fire_rail(edict_t *self, vec3_t start, vec3_t aimdir, int damage, int kick)
 {
     vec3_t      from;
@@ -620,13 +661,18 @@ void fire_rail(edict_t *self, vec3_t start, vec3_t aimdir, int damage, int kick)
     edict_t     *ignore;
     int         mask;
     qboolean    water;
+    qboolean    rewound;
+    rail_hit_t  hits[MAX_RAIL_HITS];
+    int         i, numhits;
 
     VectorMA(start, 8192, aimdir, end);
     VectorCopy(start, from);
     ignore = self;
     water = qfalse;
     mask = MASK_SHOT | CONTENTS_SLIME | CONTENTS_LAVA;
-    while (ignore) {
+    numhits = 0;
+    rewound = rewind_entities(self);
+    while (ignore && !(rewound && numhits == MAX_RAIL_HITS)) {
         tr = gi.trace(from, NULL, NULL, end, ignore, mask);
 
         if (tr.contents & (CONTENTS_SLIME | CONTENTS_LAVA)) {
@@ -640,12 +686,26 @@ void fire_rail(edict_t *self, vec3_t start, vec3_t aimdir, int damage, int kick)
             else
                 ignore = NULL;
 
-            if ((tr.ent != self) && (tr.ent->takedamage))
-                T_Damage(tr.ent, self, self, aimdir, tr.endpos, tr.plane.normal, damage, kick, 0, MOD_RAILGUN);
+            if ((tr.ent != self) && (tr.ent->takedamage)) {
+                if (rewound) {
+                    hits[numhits].ent = tr.ent;
+                    VectorCopy(tr.endpos, hits[numhits].point);
+                    VectorCopy(tr.plane.normal, hits[numhits].normal);
+                    numhits++;
+                } else {
+                    T_Damage(tr.ent, self, self, aimdir, tr.endpos, tr.plane.normal, damage, kick, 0, MOD_RAILGUN);
+                }
+            }
         }
 
         VectorCopy(tr.endpos, from);
     }
+    restore_entities(rewound);
+
+    for (i = 0; i < numhits; i++) {
+        if (hits[i].ent->inuse && hits[i].ent->takedamage)
+            T_Damage(hits[i].ent, self, self, aimdir, hits[i].point, hits[i].normal, damage, kick, 0, MOD_RAILGUN);
+    }
 
     // send gun puff / flash
     gi.WriteByte(svc_temp_entity);
@@ -28,6 +28,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "common/cvar.h"
 #include "common/field.h"
 #include "common/files.h"
+#include "common/huffman.h"
 #include "common/pmove.h"
 #include "common/math.h"
 #include "common/msg.h"
@@ -177,6 +178,8 @@ typedef struct client_state_s {
 
     msgEsFlags_t    esFlags;
 
+    huffman_t       huffman;    // for decoding svc_hpacket
+
     server_frame_t  frames[UPDATE_BACKUP];
     unsigned        frameflags;
 
@@ -722,8 +725,6 @@ void CL_CheckPredictionError(void);
 // ========
 
 typedef struct cparticle_s {
-    struct cparticle_s    *next;
-
     float   time;
 
     vec3_t  org;
@@ -828,35 +828,103 @@ PARTICLE MANAGEMENT
 ==============================================================
 */
 
-static cparticle_t  *active_particles, *free_particles;
+/*
+Particles are stored as separate arrays for each attribute, packed at the
+start, so that the update pass runs over contiguous data and expired particles
+are removed by compacting in place. Effect code fills in cparticle_t spawn
+records, which are moved into the arrays at the start of CL_AddParticles.
+*/
+static struct {
+    int         num;        // live particles in arrays
+    int         max;        // capacity, cl_maxparticles
+    int         numspawn;   // spawned since last CL_AddParticles
+    cparticle_t *spawn;
+
+    float       *time;
+    float       *tscale;    // 0 for instant particles
+    float       *org[3];
+    float       *vel[3];
+    float       *accel[3];
+    float       *alpha;
+    float       *alphavel;
+    int         *color;
+    color_t     *rgba;
+
+    // results of integration pass
+    float       *curorg[3];
+    float       *curalpha;
+} cl_part;
+
+static cvar_t   *cl_maxparticles;
 
-static cparticle_t  particles[MAX_PARTICLES];
-static const int    cl_numparticles = MAX_PARTICLES;
+extern int          r_numparticles;
+extern int          r_maxparticles;
+extern particle_t   *r_particles;
 
 static void clear_particles(void)
 {
-    int     i;
+    cl_part.num = 0;
+    cl_part.numspawn = 0;
+}
+
+static void alloc_particles(int max)
+{
+    int pad = (max + 3) & ~3;
+    float *f;
+    int i;
+
+    Z_Free(cl_part.spawn);
+    Z_Free(cl_part.time);
+    Z_Free(r_particles);
+
+    // one block for all float attributes
+    cl_part.time = f = Z_Mallocz(pad * 17 * sizeof(float));
+    f += pad;
+    cl_part.tscale = f; f += pad;
+    for (i = 0; i < 3; i++) {
+        cl_part.org[i] = f; f += pad;
+        cl_part.vel[i] = f; f += pad;
+        cl_part.accel[i] = f; f += pad;
+        cl_part.curorg[i] = f; f += pad;
+    }
+    cl_part.alpha = f; f += pad;
+    cl_part.alphavel = f; f += pad;
+    cl_part.curalpha = f;
+
+    // the rest is allocated along with spawn records
+    cl_part.spawn = Z_Malloc(max * (sizeof(cparticle_t) + sizeof(int) + sizeof(color_t)));
+    cl_part.color = (int *)(cl_part.spawn + max);
+    cl_part.rgba = (color_t *)(cl_part.color + max);
+    cl_part.max = max;
 
-    free_particles = &particles[0];
-    active_particles = NULL;
+    r_particles = Z_Malloc(max * sizeof(particle_t));
+    r_maxparticles = max;
 
-    for (i = 0; i < cl_numparticles; i++)
-        particles[i].next = &particles[i + 1];
-    particles[cl_numparticles - 1].next = NULL;
+    clear_particles();
 }
 
-cparticle_t *CL_AllocParticle(void)
+static void cl_maxparticles_changed(cvar_t *self)
 {
-    cparticle_t *p;
+    int max = Cvar_ClampInteger(self, MAX_PARTICLES, 65536);
 
-    if (!free_particles)
+    if (max != cl_part.max)
+        alloc_particles(max);
+}
+
+/*
+===============
+CL_AllocParticle
+
+Returns a spawn record for a new particle, or NULL if all of
+cl_maxparticles are in use. All fields must be initialized by caller.
+===============
+*/
+cparticle_t *CL_AllocParticle(void)
+{
+    if (cl_part.num + cl_part.numspawn >= cl_part.max)
         return NULL;
-    p = free_particles;
-    free_particles = p->next;
-    p->next = active_particles;
-    active_particles = p;
 
-    return p;
+    return &cl_part.spawn[cl_part.numspawn++];
 }
 
 /*
@@ -1776,9 +1844,70 @@ void CL_TeleportParticles(vec3_t org)
 }
 
 
+// moves spawn records into arrays
+static void spawn_particles(void)
+{
+    cparticle_t *p = cl_part.spawn;
+    int i, j, n = cl_part.num;
 
-extern int          r_numparticles;
-extern particle_t   r_particles[MAX_PARTICLES];
+    for (i = 0; i < cl_part.numspawn; i++, p++, n++) {
+        cl_part.time[n] = p->time;
+        // PMM - added INSTANT_PARTICLE handling for heat beam
+        if (p->alphavel == INSTANT_PARTICLE) {
+            cl_part.tscale[n] = 0;
+            p->alphavel = 0;
+        } else {
+            cl_part.tscale[n] = 0.001f;
+        }
+        for (j = 0; j < 3; j++) {
+            cl_part.org[j][n] = p->org[j];
+            cl_part.vel[j][n] = p->vel[j];
+            cl_part.accel[j][n] = p->accel[j];
+        }
+        cl_part.alpha[n] = p->alpha;
+        cl_part.alphavel[n] = p->alphavel;
+        cl_part.color[n] = p->color;
+        cl_part.rgba[n] = p->rgba;
+    }
+
+    cl_part.num = n;
+    cl_part.numspawn = 0;
+}
+
+#ifdef __GNUC__
+// unaligned vector of 4 floats, compiles to SSE or NEON where available
+typedef float pvec_t __attribute__((vector_size(16), aligned(4)));
+#define PVEC(p, i)  (*(pvec_t *)&(p)[i])
+#endif
+
+// calculates current origin and alpha of all particles. arrays are padded
+// to multiple of 4, so this processes 4 particles at a time.
+static void integrate_particles(void)
+{
+    int i, j, n = cl_part.num;
+#ifdef __GNUC__
+    pvec_t now = { cl.time, cl.time, cl.time, cl.time };
+    pvec_t dt;
+
+    for (i = 0; i < n; i += 4) {
+        dt = (now - PVEC(cl_part.time, i)) * PVEC(cl_part.tscale, i);
+        PVEC(cl_part.curalpha, i) = PVEC(cl_part.alpha, i) + dt * PVEC(cl_part.alphavel, i);
+        for (j = 0; j < 3; j++)
+            PVEC(cl_part.curorg[j], i) = PVEC(cl_part.org[j], i) +
+                (PVEC(cl_part.vel[j], i) + PVEC(cl_part.accel[j], i) * dt) * dt;
+    }
+#else
+    float dt;
+
+    for (i = 0; i < n; i++) {
+        dt = (cl.time - cl_part.time[i]) * cl_part.tscale[i];
+        cl_part.curalpha[i] = cl_part.alpha[i] + dt * cl_part.alphavel[i];
+        for (j = 0; j < 3; j++)
+            cl_part.curorg[j][i] = cl_part.org[j][i] +
+                (cl_part.vel[j][i] + cl_part.accel[j][i] * dt) * dt;
+    }
+#endif
+}
 
 /*
 ===============
@@ -1787,75 +1916,59 @@ CL_AddParticles
 */
 void CL_AddParticles(void)
 {
-    cparticle_t     *p, *next;
-    float           alpha;
-    float           time = 0, time2;
-    //vec3_t            org;
-    int             color;
-    cparticle_t     *active, *tail;
     particle_t      *part;
+    float           alpha;
+    int             i, j, n;
 
-    active = NULL;
-    tail = NULL;
+    spawn_particles();
+    integrate_particles();
 
-    for (p = active_particles; p; p = next) {
-        next = p->next;
+    for (i = n = 0; i < cl_part.num; i++) {
+        alpha = cl_part.curalpha[i];
+        if (alpha <= 0)
+            continue;   // faded out
 
-        // PMM - added INSTANT_PARTICLE handling for heat beam
-        if (p->alphavel != INSTANT_PARTICLE) {
-            time = (cl.time - p->time) * 0.001;
-            alpha = p->alpha + time * p->alphavel;
-            if (alpha <= 0) {
-                // faded out
-                p->next = free_particles;
-                free_particles = p;
-                continue;
+        // compact in place
+        if (n != i) {
+            cl_part.time[n] = cl_part.time[i];
+            cl_part.tscale[n] = cl_part.tscale[i];
+            for (j = 0; j < 3; j++) {
+                cl_part.org[j][n] = cl_part.org[j][i];
+                cl_part.vel[j][n] = cl_part.vel[j][i];
+                cl_part.accel[j][n] = cl_part.accel[j][i];
             }
-        } else {
-            alpha = p->alpha;
+            cl_part.alpha[n] = cl_part.alpha[i];
+            cl_part.alphavel[n] = cl_part.alphavel[i];
+            cl_part.color[n] = cl_part.color[i];
+            cl_part.rgba[n] = cl_part.rgba[i];
         }
 
-        if (r_numparticles >= MAX_PARTICLES)
-            break;
-        part = &r_particles[r_numparticles++];
-
-        p->next = NULL;
-        if (!tail)
-            active = tail = p;
-        else {
-            tail->next = p;
-            tail = p;
-        }
+        if (r_numparticles < r_maxparticles) {
+            part = &r_particles[r_numparticles++];
 
-        if (alpha > 1.0)
-            alpha = 1;
-        color = p->color;
+            if (alpha > 1.0)
+                alpha = 1;
 
-        time2 = time * time;
+            part->origin[0] = cl_part.curorg[0][i];
+            part->origin[1] = cl_part.curorg[1][i];
+            part->origin[2] = cl_part.curorg[2][i];
 
-        part->origin[0] = p->org[0] + p->vel[0] * time + p->accel[0] * time2;
-        part->origin[1] = p->org[1] + p->vel[1] * time + p->accel[1] * time2;
-        part->origin[2] = p->org[2] + p->vel[2] * time + p->accel[2] * time2;
+            part->rgba = cl_part.rgba[n];
+            if (cl_part.color[n] == -1)
+                part->rgba.u8[3] *= alpha;
 
-        if (color == -1) {
-            part->rgba.u8[0] = p->rgba.u8[0];
-            part->rgba.u8[1] = p->rgba.u8[1];
-            part->rgba.u8[2] = p->rgba.u8[2];
-            part->rgba.u8[3] = p->rgba.u8[3] * alpha;
+            part->color = cl_part.color[n];
+            part->alpha = alpha;
         }
 
-        part->color = color;
-        part->alpha = alpha;
+        // PMM - instant particles are drawn once
+        if (!cl_part.tscale[n])
+            cl_part.alpha[n] = 0.0;
 
-//      V_AddParticle(&part);
-        // PMM
-        if (p->alphavel == INSTANT_PARTICLE) {
-            p->alphavel = 0.0;
-            p->alpha = 0.0;
-        }
+        n++;
     }
 
-    active_particles = active;
+    cl_part.num = n;
 }
 
 
@@ -1880,5 +1993,8 @@ void CL_InitEffects(void)
     for (i = 0; i < NUMVERTEXNORMALS * 3; i++)
         avelocities[0][i] = (rand() & 255) * 0.01;
 
+    cl_maxparticles = Cvar_Get("cl_maxparticles", "8192", 0);
+    cl_maxparticles->changed = cl_maxparticles_changed;
+    cl_maxparticles_changed(cl_maxparticles);
 }
 
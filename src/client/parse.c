@@ -616,6 +616,18 @@ static void CL_ParseServerData(void)
                 cl.pmp.waterhack = qtrue;
             }
         }
+        if (cls.protocolVersion >= PROTOCOL_VERSION_Q2PRO_HUFFMAN) {
+            byte lengths[HUFF_SYMBOLS], *data;
+
+            data = MSG_ReadData(HUFF_LENGTHS_BYTES);
+            if (!data) {
+                Com_Error(ERR_DROP, "%s: read past end of message", __func__);
+            }
+            HUFF_UnpackLengths(lengths, data);
+            if (!HUFF_BuildFromLengths(&cl.huffman, lengths)) {
+                Com_Error(ERR_DROP, "%s: bad Huffman code", __func__);
+            }
+        }
         cl.pmp.speedmult = 2;
         cl.pmp.flyhack = qtrue; // fly hack is unconditionally enabled
         cl.pmp.flyfriction = 4;
@@ -1103,6 +1115,43 @@ static void CL_ParseZPacket(void)
 #endif
 }
 
+static void CL_ParseHPacket(void)
+{
+    sizebuf_t   temp;
+    byte        buffer[MAX_MSGLEN];
+    int         inlen, outlen;
+
+    if (msg_read.data != msg_read_buffer) {
+        Com_Error(ERR_DROP, "%s: recursively entered", __func__);
+    }
+
+    inlen = MSG_ReadWord();
+    outlen = MSG_ReadWord();
+
+    if (inlen == -1 || outlen == -1 || msg_read.readcount + inlen > msg_read.cursize) {
+        Com_Error(ERR_DROP, "%s: read past end of message", __func__);
+    }
+
+    if (outlen > MAX_MSGLEN) {
+        Com_Error(ERR_DROP, "%s: invalid output length", __func__);
+    }
+
+    if (!HUFF_Decode(&cl.huffman, buffer, outlen,
+                     msg_read.data + msg_read.readcount, inlen)) {
+        Com_Error(ERR_DROP, "%s: failed to decode message", __func__);
+    }
+
+    msg_read.readcount += inlen;
+
+    temp = msg_read;
+    SZ_Init(&msg_read, buffer, outlen);
+    msg_read.cursize = outlen;
+
+    CL_ParseServerMessage();
+
+    msg_read = temp;
+}
+
 #if USE_FPS
 static void set_server_fps(int value)
 {
@@ -1287,6 +1336,14 @@ badbyte:
             }
             CL_ParseSetting();
             continue;
+
+        case svc_hpacket:
+            if (cls.serverProtocol != PROTOCOL_VERSION_Q2PRO ||
+                cls.protocolVersion < PROTOCOL_VERSION_Q2PRO_HUFFMAN) {
+                goto badbyte;
+            }
+            CL_ParseHPacket();
+            continue;
         }
 
         // if recording demos, copy off protocol invariant stuff
@@ -267,6 +267,9 @@ void CL_RegisterBspModels(void)
     char *name;
     int i;
 
+    // don't share the map cached by server if it changed on disk
+    SV_CheckMapCache();
+
     ret = BSP_Load(cl.configstrings[CS_MODELS + 1], &cl.bsp);
     if (cl.bsp == NULL) {
         Com_Error(ERR_DROP, "Couldn't load %s: %s",
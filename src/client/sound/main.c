@@ -125,6 +125,9 @@ static const cmdreg_t c_sound[] = {
     { "stopsound", S_StopAllSounds },
     { "soundlist", S_SoundList_f },
     { "soundinfo", S_SoundInfo_f },
+#if USE_SNDDMA && USE_TESTS
+    { "mixtest", S_MixTest_f },
+#endif
 
     { NULL }
 };
@@ -19,12 +19,43 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 #include "sound.h"
 
+#if (defined __i386__ || defined __x86_64__) && defined __GNUC__
+#define USE_MIX_X86     1
+#include <emmintrin.h>
+#include <immintrin.h>
+#endif
+
+#ifdef __ARM_NEON
+#define USE_MIX_NEON    1
+#include <arm_neon.h>
+#endif
+
 #define    PAINTBUFFER_SIZE    2048
 
-static int snd_scaletable[32][256];
+// max number of channels mixed in one pass over the paint buffer
+#define    MIX_BATCH           4
+
 static int snd_vol;
 
-static void WriteLinearBlast(int16_t *out, samplepair_t *samp, int count)
+// sound data with volume to be added to the paint buffer
+typedef struct {
+    const void  *data;
+    int         leftvol;    // channel volume * s_volume * 256
+    int         rightvol;
+} mixsrc_t;
+
+typedef struct {
+    const char  *name;
+    // add count samples of each of numsrcs sources to samp
+    void        (*paint8)(samplepair_t *samp, const mixsrc_t *src, int numsrcs, int count);
+    void        (*paint16)(samplepair_t *samp, const mixsrc_t *src, int numsrcs, int count);
+    // clip paint buffer into interleaved 16 bit stereo
+    void        (*blast)(int16_t *out, const samplepair_t *samp, int count);
+} mixer_t;
+
+static const mixer_t *mixer;
+
+static void WriteLinearBlast(int16_t *out, const samplepair_t *samp, int count)
 {
     int i, val;
 
@@ -55,7 +86,7 @@ static void TransferStereo16(samplepair_t *samp, int endtime)
             count = endtime - ltime;
 
         // write a linear blast of samples
-        WriteLinearBlast(out, samp, count);
+        mixer->blast(out, samp, count);
 
         samp += count;
         ltime += count;
@@ -125,57 +156,502 @@ CHANNEL MIXING
 ===============================================================================
 */
 
-static void Paint8(channel_t *ch, sfxcache_t *sc, int count, samplepair_t *samp)
+/*
+===============================================================================
+
+MIXING KERNELS
+
+Sources are mixed in batches to save paint buffer traffic. SIMD versions must
+be bit exact with the C versions, which are used as reference by `mixtest'.
+
+===============================================================================
+*/
+
+static void Paint8_C(samplepair_t *samp, const mixsrc_t *src, int numsrcs, int count)
+{
+    const uint8_t *sfx;
+    int i, j;
+
+    for (j = 0; j < numsrcs; j++, src++) {
+        sfx = src->data;
+        for (i = 0; i < count; i++) {
+            samp[i].left += (sfx[i] - 128) * src->leftvol;
+            samp[i].right += (sfx[i] - 128) * src->rightvol;
+        }
+    }
+}
+
+static void Paint16_C(samplepair_t *samp, const mixsrc_t *src, int numsrcs, int count)
+{
+    const int16_t *sfx;
+    int i, j;
+
+    for (j = 0; j < numsrcs; j++, src++) {
+        sfx = src->data;
+        for (i = 0; i < count; i++) {
+            samp[i].left += (sfx[i] * src->leftvol) >> 8;
+            samp[i].right += (sfx[i] * src->rightvol) >> 8;
+        }
+    }
+}
+
+static const mixer_t mixer_c = {
+    "C", Paint8_C, Paint16_C, WriteLinearBlast
+};
+
+#if USE_MIX_X86
+
+// low 32 bits of 32x32 bit products, SSE2 has no pmulld
+static inline __attribute__((target("sse2")))
+__m128i mullo_epi32(__m128i a, __m128i b)
+{
+    __m128i even = _mm_mul_epu32(a, b);
+    __m128i odd = _mm_mul_epu32(_mm_srli_si128(a, 4), _mm_srli_si128(b, 4));
+
+    return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+                              _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+
+// scales 4 samples into 2 vectors of interleaved left/right pairs
+#define SSE2_SCALE(d, vol, shift, lo, hi) do {                          \
+        __m128i _d = _mm_unpacklo_epi16(d, d);                          \
+        lo = _mm_srai_epi32(_mm_unpacklo_epi16(_d, _d), 16);            \
+        hi = _mm_srai_epi32(_mm_unpackhi_epi16(_d, _d), 16);            \
+        lo = _mm_srai_epi32(mullo_epi32(lo, vol), shift);               \
+        hi = _mm_srai_epi32(mullo_epi32(hi, vol), shift);               \
+    } while (0)
+
+static __attribute__((target("sse2")))
+void Paint8_SSE2(samplepair_t *samp, const mixsrc_t *src, int numsrcs, int count)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i bias = _mm_set1_epi16(128);
+    __m128i vol[MIX_BATCH], acc0, acc1, d, lo, hi;
+    int i, j, n;
+
+    for (; numsrcs > 0; numsrcs -= n, src += n) {
+        n = min(numsrcs, MIX_BATCH);
+        for (j = 0; j < n; j++) {
+            vol[j] = _mm_setr_epi32(src[j].leftvol, src[j].rightvol,
+                                    src[j].leftvol, src[j].rightvol);
+        }
+
+        for (i = 0; i + 4 <= count; i += 4) {
+            acc0 = _mm_loadu_si128((__m128i *)&samp[i + 0]);
+            acc1 = _mm_loadu_si128((__m128i *)&samp[i + 2]);
+            for (j = 0; j < n; j++) {
+                d = _mm_cvtsi32_si128(*(const int *)((const uint8_t *)src[j].data + i));
+                d = _mm_sub_epi16(_mm_unpacklo_epi8(d, zero), bias);
+                SSE2_SCALE(d, vol[j], 0, lo, hi);
+                acc0 = _mm_add_epi32(acc0, lo);
+                acc1 = _mm_add_epi32(acc1, hi);
+            }
+            _mm_storeu_si128((__m128i *)&samp[i + 0], acc0);
+            _mm_storeu_si128((__m128i *)&samp[i + 2], acc1);
+        }
+
+        if (i < count) {
+            mixsrc_t tail[MIX_BATCH];
+
+            for (j = 0; j < n; j++) {
+                tail[j] = src[j];
+                tail[j].data = (const uint8_t *)src[j].data + i;
+            }
+            Paint8_C(samp + i, tail, n, count - i);
+        }
+    }
+}
+
+static __attribute__((target("sse2")))
+void Paint16_SSE2(samplepair_t *samp, const mixsrc_t *src, int numsrcs, int count)
+{
+    __m128i vol[MIX_BATCH], acc0, acc1, d, lo, hi;
+    int i, j, n;
+
+    for (; numsrcs > 0; numsrcs -= n, src += n) {
+        n = min(numsrcs, MIX_BATCH);
+        for (j = 0; j < n; j++) {
+            vol[j] = _mm_setr_epi32(src[j].leftvol, src[j].rightvol,
+                                    src[j].leftvol, src[j].rightvol);
+        }
+
+        for (i = 0; i + 4 <= count; i += 4) {
+            acc0 = _mm_loadu_si128((__m128i *)&samp[i + 0]);
+            acc1 = _mm_loadu_si128((__m128i *)&samp[i + 2]);
+            for (j = 0; j < n; j++) {
+                d = _mm_loadl_epi64((const __m128i *)((const int16_t *)src[j].data + i));
+                SSE2_SCALE(d, vol[j], 8, lo, hi);
+                acc0 = _mm_add_epi32(acc0, lo);
+                acc1 = _mm_add_epi32(acc1, hi);
+            }
+            _mm_storeu_si128((__m128i *)&samp[i + 0], acc0);
+            _mm_storeu_si128((__m128i *)&samp[i + 2], acc1);
+        }
+
+        if (i < count) {
+            mixsrc_t tail[MIX_BATCH];
+
+            for (j = 0; j < n; j++) {
+                tail[j] = src[j];
+                tail[j].data = (const int16_t *)src[j].data + i;
+            }
+            Paint16_C(samp + i, tail, n, count - i);
+        }
+    }
+}
+
+static __attribute__((target("sse2")))
+void WriteLinearBlast_SSE2(int16_t *out, const samplepair_t *samp, int count)
 {
-    int data;
-    int *lscale, *rscale;
-    uint8_t *sfx;
+    __m128i a, b;
     int i;
 
-    if (ch->leftvol > 255)
-        ch->leftvol = 255;
-    if (ch->rightvol > 255)
-        ch->rightvol = 255;
+    // saturating pack does the clamping
+    for (i = 0; i + 4 <= count; i += 4) {
+        a = _mm_srai_epi32(_mm_loadu_si128((__m128i *)&samp[i + 0]), 8);
+        b = _mm_srai_epi32(_mm_loadu_si128((__m128i *)&samp[i + 2]), 8);
+        _mm_storeu_si128((__m128i *)(out + i * 2), _mm_packs_epi32(a, b));
+    }
 
-    lscale = snd_scaletable[ch->leftvol >> 3];
-    rscale = snd_scaletable[ch->rightvol >> 3];
-    sfx = (uint8_t *)sc->data + ch->pos;
+    WriteLinearBlast(out + i * 2, samp + i, count - i);
+}
 
-    for (i = 0; i < count; i++, samp++) {
-        data = *sfx++;
-        samp->left += lscale[data];
-        samp->right += rscale[data];
+static const mixer_t mixer_sse2 = {
+    "SSE2", Paint8_SSE2, Paint16_SSE2, WriteLinearBlast_SSE2
+};
+
+// duplicates 8 samples into 2 vectors of interleaved left/right pairs
+#define AVX2_SCALE(d, vol, shift, lo, hi) do {                          \
+        const __m256i _lo = _mm256_setr_epi32(0, 0, 1, 1, 2, 2, 3, 3);  \
+        const __m256i _hi = _mm256_setr_epi32(4, 4, 5, 5, 6, 6, 7, 7);  \
+        lo = _mm256_permutevar8x32_epi32(d, _lo);                       \
+        hi = _mm256_permutevar8x32_epi32(d, _hi);                       \
+        lo = _mm256_srai_epi32(_mm256_mullo_epi32(lo, vol), shift);     \
+        hi = _mm256_srai_epi32(_mm256_mullo_epi32(hi, vol), shift);     \
+    } while (0)
+
+static __attribute__((target("avx2")))
+void Paint8_AVX2(samplepair_t *samp, const mixsrc_t *src, int numsrcs, int count)
+{
+    const __m256i bias = _mm256_set1_epi32(128);
+    __m256i vol[MIX_BATCH], acc0, acc1, d, lo, hi;
+    int i, j, n;
+
+    for (; numsrcs > 0; numsrcs -= n, src += n) {
+        n = min(numsrcs, MIX_BATCH);
+        for (j = 0; j < n; j++) {
+            vol[j] = _mm256_set1_epi64x(((int64_t)src[j].rightvol << 32) |
+                                        (uint32_t)src[j].leftvol);
+        }
+
+        for (i = 0; i + 8 <= count; i += 8) {
+            acc0 = _mm256_loadu_si256((__m256i *)&samp[i + 0]);
+            acc1 = _mm256_loadu_si256((__m256i *)&samp[i + 4]);
+            for (j = 0; j < n; j++) {
+                d = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)
+                                         ((const uint8_t *)src[j].data + i)));
+                d = _mm256_sub_epi32(d, bias);
+                AVX2_SCALE(d, vol[j], 0, lo, hi);
+                acc0 = _mm256_add_epi32(acc0, lo);
+                acc1 = _mm256_add_epi32(acc1, hi);
+            }
+            _mm256_storeu_si256((__m256i *)&samp[i + 0], acc0);
+            _mm256_storeu_si256((__m256i *)&samp[i + 4], acc1);
+        }
+
+        if (i < count) {
+            mixsrc_t tail[MIX_BATCH];
+
+            for (j = 0; j < n; j++) {
+                tail[j] = src[j];
+                tail[j].data = (const uint8_t *)src[j].data + i;
+            }
+            Paint8_C(samp + i, tail, n, count - i);
+        }
     }
+}
+
+static __attribute__((target("avx2")))
+void Paint16_AVX2(samplepair_t *samp, const mixsrc_t *src, int numsrcs, int count)
+{
+    __m256i vol[MIX_BATCH], acc0, acc1, d, lo, hi;
+    int i, j, n;
+
+    for (; numsrcs > 0; numsrcs -= n, src += n) {
+        n = min(numsrcs, MIX_BATCH);
+        for (j = 0; j < n; j++) {
+            vol[j] = _mm256_set1_epi64x(((int64_t)src[j].rightvol << 32) |
+                                        (uint32_t)src[j].leftvol);
+        }
+
+        for (i = 0; i + 8 <= count; i += 8) {
+            acc0 = _mm256_loadu_si256((__m256i *)&samp[i + 0]);
+            acc1 = _mm256_loadu_si256((__m256i *)&samp[i + 4]);
+            for (j = 0; j < n; j++) {
+                d = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)
+                                          ((const int16_t *)src[j].data + i)));
+                AVX2_SCALE(d, vol[j], 8, lo, hi);
+                acc0 = _mm256_add_epi32(acc0, lo);
+                acc1 = _mm256_add_epi32(acc1, hi);
+            }
+            _mm256_storeu_si256((__m256i *)&samp[i + 0], acc0);
+            _mm256_storeu_si256((__m256i *)&samp[i + 4], acc1);
+        }
+
+        if (i < count) {
+            mixsrc_t tail[MIX_BATCH];
 
-    ch->pos += count;
+            for (j = 0; j < n; j++) {
+                tail[j] = src[j];
+                tail[j].data = (const int16_t *)src[j].data + i;
+            }
+            Paint16_C(samp + i, tail, n, count - i);
+        }
+    }
+}
+
+// clipping is memory bound, SSE2 version is good enough
+static const mixer_t mixer_avx2 = {
+    "AVX2", Paint8_AVX2, Paint16_AVX2, WriteLinearBlast_SSE2
+};
+
+#endif // USE_MIX_X86
+
+#if USE_MIX_NEON
+
+static void Paint8_NEON(samplepair_t *samp, const mixsrc_t *src, int numsrcs, int count)
+{
+    int32x4_t vol[MIX_BATCH], acc0, acc1;
+    int32x4x2_t d2;
+    int16x4_t d;
+    int i, j, n;
+
+    for (; numsrcs > 0; numsrcs -= n, src += n) {
+        n = min(numsrcs, MIX_BATCH);
+        for (j = 0; j < n; j++) {
+            int32_t v[4] = { src[j].leftvol, src[j].rightvol,
+                             src[j].leftvol, src[j].rightvol };
+            vol[j] = vld1q_s32(v);
+        }
+
+        for (i = 0; i + 4 <= count; i += 4) {
+            acc0 = vld1q_s32(&samp[i + 0].left);
+            acc1 = vld1q_s32(&samp[i + 2].left);
+            for (j = 0; j < n; j++) {
+                const uint8_t *p = (const uint8_t *)src[j].data + i;
+                int16_t v[4] = { p[0] - 128, p[1] - 128, p[2] - 128, p[3] - 128 };
+                d = vld1_s16(v);
+                d2 = vzipq_s32(vmovl_s16(d), vmovl_s16(d));
+                acc0 = vmlaq_s32(acc0, d2.val[0], vol[j]);
+                acc1 = vmlaq_s32(acc1, d2.val[1], vol[j]);
+            }
+            vst1q_s32(&samp[i + 0].left, acc0);
+            vst1q_s32(&samp[i + 2].left, acc1);
+        }
+
+        if (i < count) {
+            mixsrc_t tail[MIX_BATCH];
+
+            for (j = 0; j < n; j++) {
+                tail[j] = src[j];
+                tail[j].data = (const uint8_t *)src[j].data + i;
+            }
+            Paint8_C(samp + i, tail, n, count - i);
+        }
+    }
 }
 
-static void Paint16(channel_t *ch, sfxcache_t *sc, int count, samplepair_t *samp)
+static void Paint16_NEON(samplepair_t *samp, const mixsrc_t *src, int numsrcs, int count)
 {
-    int data;
-    int left, right;
-    int leftvol, rightvol;
-    int16_t *sfx;
+    int32x4_t vol[MIX_BATCH], acc0, acc1;
+    int32x4x2_t d2;
+    int32x4_t d;
+    int i, j, n;
+
+    for (; numsrcs > 0; numsrcs -= n, src += n) {
+        n = min(numsrcs, MIX_BATCH);
+        for (j = 0; j < n; j++) {
+            int32_t v[4] = { src[j].leftvol, src[j].rightvol,
+                             src[j].leftvol, src[j].rightvol };
+            vol[j] = vld1q_s32(v);
+        }
+
+        for (i = 0; i + 4 <= count; i += 4) {
+            acc0 = vld1q_s32(&samp[i + 0].left);
+            acc1 = vld1q_s32(&samp[i + 2].left);
+            for (j = 0; j < n; j++) {
+                d = vmovl_s16(vld1_s16((const int16_t *)src[j].data + i));
+                d2 = vzipq_s32(d, d);
+                acc0 = vaddq_s32(acc0, vshrq_n_s32(vmulq_s32(d2.val[0], vol[j]), 8));
+                acc1 = vaddq_s32(acc1, vshrq_n_s32(vmulq_s32(d2.val[1], vol[j]), 8));
+            }
+            vst1q_s32(&samp[i + 0].left, acc0);
+            vst1q_s32(&samp[i + 2].left, acc1);
+        }
+
+        if (i < count) {
+            mixsrc_t tail[MIX_BATCH];
+
+            for (j = 0; j < n; j++) {
+                tail[j] = src[j];
+                tail[j].data = (const int16_t *)src[j].data + i;
+            }
+            Paint16_C(samp + i, tail, n, count - i);
+        }
+    }
+}
+
+static void WriteLinearBlast_NEON(int16_t *out, const samplepair_t *samp, int count)
+{
+    int32x4_t a, b;
     int i;
 
-    leftvol = ch->leftvol * snd_vol;
-    rightvol = ch->rightvol * snd_vol;
-    sfx = (int16_t *)sc->data + ch->pos;
+    // saturating narrow does the clamping
+    for (i = 0; i + 4 <= count; i += 4) {
+        a = vshrq_n_s32(vld1q_s32(&samp[i + 0].left), 8);
+        b = vshrq_n_s32(vld1q_s32(&samp[i + 2].left), 8);
+        vst1q_s16(out + i * 2, vcombine_s16(vqmovn_s32(a), vqmovn_s32(b)));
+    }
+
+    WriteLinearBlast(out + i * 2, samp + i, count - i);
+}
+
+static const mixer_t mixer_neon = {
+    "NEON", Paint8_NEON, Paint16_NEON, WriteLinearBlast_NEON
+};
+
+#endif // USE_MIX_NEON
 
-    for (i = 0; i < count; i++, samp++) {
-        data = *sfx++;
-        left = (data * leftvol) >> 8;
-        right = (data * rightvol) >> 8;
-        samp->left += left;
-        samp->right += right;
+static const mixer_t *S_BestMixer(void)
+{
+#if USE_MIX_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return &mixer_avx2;
+    if (__builtin_cpu_supports("sse2"))
+        return &mixer_sse2;
+#endif
+#if USE_MIX_NEON
+    return &mixer_neon;
+#endif
+    return &mixer_c;
+}
+
+#if USE_TESTS
+
+#define MIXTEST_SOURCES 32
+#define MIXTEST_PASSES  64
+
+static void S_MixTestPass(const mixer_t *m, samplepair_t *samp, int16_t *out,
+                          const mixsrc_t *src, int count)
+{
+    memset(samp, 0, count * sizeof(*samp));
+    m->paint8(samp, src, MIXTEST_SOURCES / 2, count);
+    m->paint16(samp, src + MIXTEST_SOURCES / 2, MIXTEST_SOURCES / 2, count);
+    // mix a partial, misaligned segment too
+    m->paint16(samp + 3, src, 1, count - 10);
+    m->blast(out, samp, count);
+}
+
+/*
+============
+S_MixTest_f
+
+Mixes the same set of sources with every mixer supported by the CPU,
+checking output against the C version and printing timings.
+============
+*/
+void S_MixTest_f(void)
+{
+    static const mixer_t *const mixers[] = {
+        &mixer_c,
+#if USE_MIX_X86
+        &mixer_sse2,
+        &mixer_avx2,
+#endif
+#if USE_MIX_NEON
+        &mixer_neon,
+#endif
+    };
+    samplepair_t *samp = Z_Malloc(PAINTBUFFER_SIZE * sizeof(*samp));
+    int16_t *ref = Z_Malloc(PAINTBUFFER_SIZE * 2 * sizeof(*ref));
+    int16_t *out = Z_Malloc(PAINTBUFFER_SIZE * 2 * sizeof(*out));
+    uint8_t *data = Z_Malloc(PAINTBUFFER_SIZE * MIXTEST_SOURCES * 2);
+    mixsrc_t src[MIXTEST_SOURCES];
+    uint32_t seed = 0x1234567;
+    uint64_t start;
+    int i, j, vol;
+
+    for (i = 0; i < PAINTBUFFER_SIZE * MIXTEST_SOURCES * 2; i++) {
+        seed = seed * 1103515245 + 12345;
+        data[i] = seed >> 16;
+    }
+
+    vol = s_volume->value * 256;
+    for (i = 0; i < MIXTEST_SOURCES; i++) {
+        src[i].data = data + i * PAINTBUFFER_SIZE * 2;
+        if (i < MIXTEST_SOURCES / 2) {
+            src[i].leftvol = (i * 16 >> 3) * 8 * vol;
+            src[i].rightvol = ((255 - i * 16) >> 3) * 8 * vol;
+        } else {
+            src[i].leftvol = (i * 8) * vol;
+            src[i].rightvol = (255 - i * 8) * vol;
+        }
+    }
+
+    S_MixTestPass(&mixer_c, samp, ref, src, PAINTBUFFER_SIZE);
+
+    for (i = 0; i < q_countof(mixers); i++) {
+#if USE_MIX_X86
+        if (mixers[i] == &mixer_avx2 && !__builtin_cpu_supports("avx2"))
+            continue;
+#endif
+        S_MixTestPass(mixers[i], samp, out, src, PAINTBUFFER_SIZE);
+        if (memcmp(out, ref, PAINTBUFFER_SIZE * 2 * sizeof(*ref))) {
+            Com_EPrintf("%s mixer output differs from reference\n", mixers[i]->name);
+            continue;
+        }
+
+        start = Sys_Microseconds();
+        for (j = 0; j < MIXTEST_PASSES; j++)
+            S_MixTestPass(mixers[i], samp, out, src, PAINTBUFFER_SIZE);
+        Com_Printf("%s mixer: %"PRIu64" usec per %d channel pass%s\n",
+                   mixers[i]->name, (Sys_Microseconds() - start) / MIXTEST_PASSES,
+                   MIXTEST_SOURCES, mixers[i] == mixer ? " (active)" : "");
     }
 
-    ch->pos += count;
+    Z_Free(samp);
+    Z_Free(ref);
+    Z_Free(out);
+    Z_Free(data);
+}
+
+#endif // USE_TESTS
+
+static void S_InitMixSource(mixsrc_t *src, channel_t *ch, sfxcache_t *sc)
+{
+    if (sc->width == 1) {
+        if (ch->leftvol > 255)
+            ch->leftvol = 255;
+        if (ch->rightvol > 255)
+            ch->rightvol = 255;
+
+        // volume is quantized to 32 steps for 8 bit sounds
+        src->data = (uint8_t *)sc->data + ch->pos;
+        src->leftvol = (ch->leftvol >> 3) * 8 * snd_vol;
+        src->rightvol = (ch->rightvol >> 3) * 8 * snd_vol;
+    } else {
+        src->data = (int16_t *)sc->data + ch->pos;
+        src->leftvol = ch->leftvol * snd_vol;
+        src->rightvol = ch->rightvol * snd_vol;
+    }
 }
 
 void S_PaintChannels(int endtime)
 {
     samplepair_t paintbuffer[PAINTBUFFER_SIZE];
+    mixsrc_t batch8[MAX_CHANNELS], batch16[MAX_CHANNELS], src;
+    int num8, num16;
     int i;
     int end;
     channel_t *ch;
@@ -207,7 +683,9 @@ void S_PaintChannels(int endtime)
         // clear the paint buffer
         memset(paintbuffer, 0, (end - paintedtime) * sizeof(samplepair_t));
 
-        // paint in the channels.
+        // paint in the channels. channels covering the entire buffer
+        // are batched and mixed together in as few passes as possible.
+        num8 = num16 = 0;
         ch = channels;
         for (i = 0; i < s_numchannels; i++, ch++) {
             ltime = paintedtime;
@@ -228,12 +706,20 @@ void S_PaintChannels(int endtime)
                     break;
 
                 if (count > 0 && ch->sfx) {
-                    samplepair_t *samp = &paintbuffer[ltime - paintedtime];
-                    if (sc->width == 1)
-                        Paint8(ch, sc, count, samp);
-                    else
-                        Paint16(ch, sc, count, samp);
+                    S_InitMixSource(&src, ch, sc);
+                    if (count < end - paintedtime) {
+                        samplepair_t *samp = &paintbuffer[ltime - paintedtime];
+                        if (sc->width == 1)
+                            mixer->paint8(samp, &src, 1, count);
+                        else
+                            mixer->paint16(samp, &src, 1, count);
+                    } else if (sc->width == 1) {
+                        batch8[num8++] = src;
+                    } else {
+                        batch16[num16++] = src;
+                    }
 
+                    ch->pos += count;
                     ltime += count;
                 }
 
@@ -255,6 +741,11 @@ void S_PaintChannels(int endtime)
 
         }
 
+        if (num8)
+            mixer->paint8(paintbuffer, batch8, num8, end - paintedtime);
+        if (num16)
+            mixer->paint16(paintbuffer, batch16, num16, end - paintedtime);
+
         // transfer out according to DMA format
         TransferPaintBuffer(paintbuffer, end);
         paintedtime = end;
@@ -263,19 +754,14 @@ void S_PaintChannels(int endtime)
 
 void S_InitScaletable(void)
 {
-    int        i, j;
-    int        scale;
-
     Cvar_ClampValue(s_volume, 0, 1);
 
     snd_vol = s_volume->value * 256;
-    for (i = 0; i < 32; i++) {
-        scale = i * 8 * snd_vol;
-        for (j = 0; j < 256; j++) {
-            snd_scaletable[i][j] = (j - 128) * scale;
-        }
-    }
 
     s_volume->modified = qfalse;
-}
 
+    if (!mixer) {
+        mixer = S_BestMixer();
+        Com_DPrintf("Using %s sound mixer\n", mixer->name);
+    }
+}
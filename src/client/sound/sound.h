@@ -178,5 +178,8 @@ void S_BuildSoundList(int *sounds);
 #if USE_SNDDMA
 void S_InitScaletable(void);
 void S_PaintChannels(int endtime);
+#if USE_TESTS
+void S_MixTest_f(void);
+#endif
 #endif
 
@@ -57,7 +57,8 @@ int         r_numentities;
 entity_t    r_entities[MAX_ENTITIES];
 
 int         r_numparticles;
-particle_t  r_particles[MAX_PARTICLES];
+int         r_maxparticles;
+particle_t  *r_particles;   // allocated by effects code
 
 #if USE_LIGHTSTYLES
 lightstyle_t    r_lightstyles[MAX_LIGHTSTYLES];
@@ -103,7 +104,7 @@ V_AddParticle
 */
 void V_AddParticle(particle_t *p)
 {
-    if (r_numparticles >= MAX_PARTICLES)
+    if (r_numparticles >= r_maxparticles)
         return;
     r_particles[r_numparticles++] = *p;
 }
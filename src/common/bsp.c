@@ -1077,9 +1077,8 @@ HELPER FUNCTIONS
 
 #if USE_REF
 
-static lightpoint_t *light_point;
-
-static qboolean BSP_RecursiveLightPoint(mnode_t *node, float p1f, float p2f, vec3_t p1, vec3_t p2)
+static qboolean BSP_RecursiveLightPoint(lightpoint_t *point, mnode_t *node,
+                                        float p1f, float p2f, vec3_t p1, vec3_t p2)
 {
     vec_t d1, d2, frac, midf;
     vec3_t mid;
@@ -1105,7 +1104,7 @@ static qboolean BSP_RecursiveLightPoint(mnode_t *node, float p1f, float p2f, vec
         LerpVector(p1, p2, frac, mid);
 
         // check near side
-        if (BSP_RecursiveLightPoint(node->children[side], p1f, midf, p1, mid))
+        if (BSP_RecursiveLightPoint(point, node->children[side], p1f, midf, p1, mid))
             return qtrue;
 
         for (i = 0, surf = node->firstface; i < node->numfaces; i++, surf++) {
@@ -1126,16 +1125,16 @@ static qboolean BSP_RecursiveLightPoint(mnode_t *node, float p1f, float p2f, vec
             if (t < 0 || t > surf->extents[1])
                 continue;
 
-            light_point->surf = surf;
-            light_point->plane = *surf->plane;
-            light_point->s = s;
-            light_point->t = t;
-            light_point->fraction = midf;
+            point->surf = surf;
+            point->plane = *surf->plane;
+            point->s = s;
+            point->t = t;
+            point->fraction = midf;
             return qtrue;
         }
 
         // check far side
-        return BSP_RecursiveLightPoint(node->children[side ^ 1], midf, p2f, mid, p2);
+        return BSP_RecursiveLightPoint(point, node->children[side ^ 1], midf, p2f, mid, p2);
     }
 
     return qfalse;
@@ -1143,11 +1142,10 @@ static qboolean BSP_RecursiveLightPoint(mnode_t *node, float p1f, float p2f, vec
 
 void BSP_LightPoint(lightpoint_t *point, vec3_t start, vec3_t end, mnode_t *headnode)
 {
-    light_point = point;
-    light_point->surf = NULL;
-    light_point->fraction = 1;
+    point->surf = NULL;
+    point->fraction = 1;
 
-    BSP_RecursiveLightPoint(headnode, 0, 1, start, end);
+    BSP_RecursiveLightPoint(point, headnode, 0, 1, start, end);
 }
 
 void BSP_TransformedLightPoint(lightpoint_t *point, vec3_t start, vec3_t end,
@@ -1156,9 +1154,8 @@ void BSP_TransformedLightPoint(lightpoint_t *point, vec3_t start, vec3_t end,
     vec3_t start_l, end_l;
     vec3_t axis[3];
 
-    light_point = point;
-    light_point->surf = NULL;
-    light_point->fraction = 1;
+    point->surf = NULL;
+    point->fraction = 1;
 
     // subtract origin offset
     VectorSubtract(start, origin, start_l);
@@ -1172,7 +1169,7 @@ void BSP_TransformedLightPoint(lightpoint_t *point, vec3_t start, vec3_t end,
     }
 
     // sweep the line through the model
-    if (!BSP_RecursiveLightPoint(headnode, 0, 1, start_l, end_l))
+    if (!BSP_RecursiveLightPoint(point, headnode, 0, 1, start_l, end_l))
         return;
 
     // rotate plane normal into the worlds frame of reference
@@ -50,6 +50,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "system/system.h"
 
 #include <setjmp.h>
+#include <signal.h>
 
 static jmp_buf  abortframe;     // an ERR_DROP occured, exit the entire frame
 
@@ -78,6 +79,9 @@ cvar_t  *logfile_enable;    // 1 = create new, 2 = append to existing
 cvar_t  *logfile_flush;     // 1 = flush after each print
 cvar_t  *logfile_name;
 cvar_t  *logfile_prefix;
+#if USE_THREADS
+cvar_t  *logfile_async;
+#endif
 
 #if USE_CLIENT
 cvar_t  *cl_running;
@@ -190,6 +194,151 @@ static void Com_Redirect(const char *msg, size_t total)
     }
 }
 
+#if USE_THREADS
+
+#define LOG_RING_SIZE   0x10000     // must be power of two
+#define LOG_RING_MASK   (LOG_RING_SIZE - 1)
+
+// lines queued by the main thread and written by the log writer thread,
+// head is only advanced by the producer and tail only by the consumer
+static struct {
+    sys_thread_t    *thread;
+    sys_event_t     *event;
+    unsigned        head;
+    unsigned        tail;
+    int             shutdown;
+    ssize_t         error;
+    unsigned        dropped;        // since last notice
+    unsigned        total_dropped;  // since log was opened
+    volatile sig_atomic_t   rotate;
+    char            data[LOG_RING_SIZE];
+} logring;
+
+static void logring_thread(void *arg)
+{
+    unsigned head, tail, len;
+    ssize_t ret;
+
+    tail = logring.tail;
+    while (1) {
+        head = __atomic_load_n(&logring.head, __ATOMIC_SEQ_CST);
+        if (head == tail) {
+            if (__atomic_load_n(&logring.shutdown, __ATOMIC_ACQUIRE)) {
+                break;
+            }
+            Sys_WaitEvent(logring.event);
+            continue;
+        }
+
+        // write everything queued so far, wrapping around at most once
+        while (tail != head) {
+            len = min(head - tail, LOG_RING_SIZE - (tail & LOG_RING_MASK));
+            if (!logring.error) {
+                ret = FS_Write(logring.data + (tail & LOG_RING_MASK), len, com_logFile);
+                if (ret != len) {
+                    __atomic_store_n(&logring.error, ret < 0 ? ret : Q_ERR_FAILURE,
+                                     __ATOMIC_RELEASE);
+                }
+            }
+            tail += len;
+        }
+
+        __atomic_store_n(&logring.tail, tail, __ATOMIC_SEQ_CST);
+    }
+}
+
+static qboolean logring_push(const char *text, size_t len)
+{
+    unsigned head, tail, ofs, count;
+
+    head = logring.head;
+    tail = __atomic_load_n(&logring.tail, __ATOMIC_ACQUIRE);
+    if (len > LOG_RING_SIZE - (head - tail)) {
+        return qfalse;
+    }
+
+    ofs = head & LOG_RING_MASK;
+    count = min(len, LOG_RING_SIZE - ofs);
+    memcpy(logring.data + ofs, text, count);
+    memcpy(logring.data, text + count, len - count);
+
+    __atomic_store_n(&logring.head, head + len, __ATOMIC_SEQ_CST);
+
+    // wake up writer if it has caught up with us before this push
+    if (__atomic_load_n(&logring.tail, __ATOMIC_SEQ_CST) == head) {
+        Sys_SignalEvent(logring.event);
+    }
+
+    return qtrue;
+}
+
+static void logring_write(const char *text, size_t len)
+{
+    char buffer[64];
+    size_t notice;
+
+    if (logring.dropped) {
+        notice = Q_scnprintf(buffer, sizeof(buffer),
+                             "[%u messages dropped]\n", logring.dropped);
+        if (!logring_push(buffer, notice)) {
+            logring.dropped++;
+            logring.total_dropped++;
+            return;
+        }
+        logring.dropped = 0;
+    }
+
+    if (!logring_push(text, len)) {
+        logring.dropped++;
+        logring.total_dropped++;
+    }
+}
+
+static void logring_start(void)
+{
+    memset(&logring, 0, sizeof(logring) - sizeof(logring.data));
+
+    logring.event = Sys_CreateEvent();
+    logring.thread = Sys_CreateThread(logring_thread, NULL);
+    if (!logring.thread) {
+        Sys_DestroyEvent(logring.event);
+        logring.event = NULL;
+    }
+}
+
+static void logring_stop(void)
+{
+    if (!logring.thread) {
+        return;
+    }
+
+    __atomic_store_n(&logring.shutdown, 1, __ATOMIC_RELEASE);
+    Sys_SignalEvent(logring.event);
+    Sys_JoinThread(logring.thread);
+    Sys_DestroyEvent(logring.event);
+    logring.thread = NULL;
+    logring.event = NULL;
+}
+
+#endif // USE_THREADS
+
+static void logfile_error(ssize_t ret)
+{
+    qhandle_t tmp;
+
+#if USE_THREADS
+    // writer thread may still be using the handle
+    logring_stop();
+#endif
+
+    // zero handle BEFORE doing anything else to avoid recursion
+    tmp = com_logFile;
+    com_logFile = 0;
+    FS_FCloseFile(tmp);
+    Com_EPrintf("Couldn't write console log: %s\n", Q_ErrorString(ret));
+    Cvar_Set("logfile", "0");
+}
+
 static void logfile_close(void)
 {
     if (!com_logFile) {
@@ -198,6 +347,20 @@ static void logfile_close(void)
 
     Com_Printf("Closing console log.\n");
 
+#if USE_THREADS
+    if (logring.thread) {
+        logring_stop();
+        if (logring.total_dropped) {
+            Com_WPrintf("Async logging dropped %u messages.\n",
+                        logring.total_dropped);
+        }
+        if (logring.error) {
+            logfile_error(logring.error);
+            return;
+        }
+    }
+#endif
+
     FS_FCloseFile(com_logFile);
     com_logFile = 0;
 }
@@ -226,6 +389,13 @@ static void logfile_open(void)
 
     com_logFile = f;
     com_logNewline = qtrue;
+
+#if USE_THREADS
+    if (logfile_async->integer) {
+        logring_start();
+    }
+#endif
+
     Com_Printf("Logging console to %s\n", buffer);
 }
 
@@ -331,14 +501,22 @@ static void logfile_write(print_type_t type, const char *s)
     *p = 0;
 
     len = p - text;
+
+#if USE_THREADS
+    if (logring.thread) {
+        ret = __atomic_load_n(&logring.error, __ATOMIC_ACQUIRE);
+        if (ret) {
+            logfile_error(ret);
+        } else {
+            logring_write(text, len);
+        }
+        return;
+    }
+#endif
+
     ret = FS_Write(text, len, com_logFile);
     if (ret != len) {
-        // zero handle BEFORE doing anything else to avoid recursion
-        qhandle_t tmp = com_logFile;
-        com_logFile = 0;
-        FS_FCloseFile(tmp);
-        Com_EPrintf("Couldn't write console log: %s\n", Q_ErrorString(ret));
-        Cvar_Set("logfile", "0");
+        logfile_error(ret);
     }
 }
 
@@ -353,6 +531,14 @@ will close and reopen logfile handle for rotation.
 */
 void Com_FlushLogs(void)
 {
+#if USE_THREADS
+    // writer thread can't be stopped from signal handler, defer until
+    // the next frame
+    if (logring.thread) {
+        logring.rotate = qtrue;
+        return;
+    }
+#endif
     if (logfile_enable) {
         logfile_enable_changed(logfile_enable);
     }
@@ -678,6 +864,81 @@ static void Com_LastError_f(void)
     Com_Printf("%s\n", com_errorMsg);
 }
 
+/*
+==============================================================================
+
+                        FRAME SCHEDULER
+
+==============================================================================
+*/
+
+#define SCHED_BUCKETS   6
+
+static const unsigned sched_limits[SCHED_BUCKETS - 1] = {
+    10, 50, 100, 500, 1000
+};
+
+// how late the frame loop woke up relative to requested deadline
+static struct {
+    unsigned    wakeups;
+    unsigned    buckets[SCHED_BUCKETS];
+    uint64_t    total;
+    double      totalsq;
+    uint64_t    worst;
+} sched;
+
+static void sched_account(uint64_t late)
+{
+    int i;
+
+    for (i = 0; i < SCHED_BUCKETS - 1; i++) {
+        if (late < sched_limits[i]) {
+            break;
+        }
+    }
+
+    sched.buckets[i]++;
+    sched.wakeups++;
+    sched.total += late;
+    sched.totalsq += (double)late * late;
+    if (sched.worst < late) {
+        sched.worst = late;
+    }
+}
+
+static void Com_SchedStats_f(void)
+{
+    double mean, dev;
+    int i;
+
+    if (Cmd_Argc() > 1 && !strcmp(Cmd_Argv(1), "reset")) {
+        memset(&sched, 0, sizeof(sched));
+        return;
+    }
+
+    if (!sched.wakeups) {
+        Com_Printf("No timed wakeups.\n");
+        return;
+    }
+
+    mean = (double)sched.total / sched.wakeups;
+    dev = sched.totalsq / sched.wakeups - mean * mean;
+    dev = dev > 0 ? sqrt(dev) : 0;
+
+    Com_Printf("%u timed wakeups, late by %.1f usec on average "
+               "(deviation %.1f, worst %"PRIu64")\n",
+               sched.wakeups, mean, dev, sched.worst);
+    for (i = 0; i < SCHED_BUCKETS; i++) {
+        if (i < SCHED_BUCKETS - 1) {
+            Com_Printf("  < %4u usec: ", sched_limits[i]);
+        } else {
+            Com_Printf(" >= %4u usec: ", sched_limits[i - 1]);
+        }
+        Com_Printf("%u (%.1f%%)\n", sched.buckets[i],
+                   sched.buckets[i] * 100.0 / sched.wakeups);
+    }
+}
+
 #if 0
 static void Com_Setenv_f(void)
 {
@@ -902,6 +1163,9 @@ void Qcommon_Init(int argc, char **argv)
     logfile_flush = Cvar_Get("logfile_flush", "0", 0);
     logfile_name = Cvar_Get("logfile_name", "console", 0);
     logfile_prefix = Cvar_Get("logfile_prefix", "[%Y-%m-%d %H:%M] ", 0);
+#if USE_THREADS
+    logfile_async = Cvar_Get("logfile_async", "0", 0);
+#endif
 #if USE_CLIENT
     dedicated = Cvar_Get("dedicated", "0", CVAR_NOSET);
     cl_running = Cvar_Get("cl_running", "0", CVAR_ROM);
@@ -970,6 +1234,9 @@ void Qcommon_Init(int argc, char **argv)
     logfile_enable->changed = logfile_enable_changed;
     logfile_flush->changed = logfile_param_changed;
     logfile_name->changed = logfile_param_changed;
+#if USE_THREADS
+    logfile_async->changed = logfile_param_changed;
+#endif
     logfile_enable_changed(logfile_enable);
 
     // execute configs: default.cfg may come from the packfile, but config.cfg
@@ -982,6 +1249,7 @@ void Qcommon_Init(int argc, char **argv)
     Com_AddEarlyCommands(qtrue);
 
     Cmd_AddCommand("lasterror", Com_LastError_f);
+    Cmd_AddCommand("schedstats", Com_SchedStats_f);
 
     Cmd_AddCommand("quit", Com_Quit_f);
 #if !USE_CLIENT
@@ -1044,8 +1312,9 @@ void Qcommon_Frame(void)
     unsigned time_before, time_event, time_between, time_after;
     unsigned clientrem;
 #endif
-    unsigned oldtime, msec;
-    static unsigned remaining;
+    unsigned msec, remaining;
+    uint64_t now;
+    static uint64_t deadline, lasttime, residual;
     static float frac;
 
     if (setjmp(abortframe)) {
@@ -1059,31 +1328,43 @@ void Qcommon_Frame(void)
         time_before = Sys_Milliseconds();
 #endif
 
-    // sleep on network sockets when running a dedicated server
+    // sleep on network sockets until the next frame is due
     // still do a select(), but don't sleep when running a client!
-    NET_Sleep(remaining);
+    NET_SleepUntil(deadline);
 
     // calculate time spent running last frame and sleeping
-    oldtime = com_eventTime;
-    com_eventTime = Sys_Milliseconds();
-    if (oldtime > com_eventTime) {
-        oldtime = com_eventTime;
+    // in microseconds, carrying fractions of millisecond over
+    now = Sys_Microseconds();
+    if (deadline && now >= deadline) {
+        sched_account(now - deadline);
     }
-    msec = com_eventTime - oldtime;
+    deadline = 0;
+    if (!lasttime) {
+        lasttime = now;
+    }
+    residual += now - lasttime;
+    lasttime = now;
+    msec = residual / 1000;
 
 #if USE_CLIENT
     // spin until msec is non-zero if running a client
     if (!dedicated->integer && !com_timedemo->integer) {
         while (msec < 1) {
             qboolean break_now = CL_ProcessEvents();
-            com_eventTime = Sys_Milliseconds();
-            msec = com_eventTime - oldtime;
+            now = Sys_Microseconds();
+            residual += now - lasttime;
+            lasttime = now;
+            msec = residual / 1000;
             if (break_now)
                 break;
         }
     }
 #endif
 
+    residual -= msec * 1000;
+
+    com_eventTime = Sys_Milliseconds();
+
     if (msec > 250) {
         Com_DPrintf("Hitch warning: %u msec frame time\n", msec);
         msec = 100; // time was unreasonable,
@@ -1111,6 +1392,14 @@ void Qcommon_Frame(void)
     // run system console
     Sys_RunConsole();
 
+#if USE_THREADS
+    // reopen logfile if requested by signal handler
+    if (logring.rotate) {
+        logring.rotate = qfalse;
+        logfile_enable_changed(logfile_enable);
+    }
+#endif
+
     NET_UpdateStats();
 
     remaining = SV_Frame(msec);
@@ -1143,5 +1432,11 @@ void Qcommon_Frame(void)
                    all, ev, sv, gm, cl, rf);
     }
 #endif
+
+    // wake up exactly when the remaining time elapses, taking the
+    // fraction of millisecond already accumulated into account
+    if (remaining) {
+        deadline = lasttime + remaining * 1000ULL - residual;
+    }
 }
 
@@ -25,6 +25,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "common/prompt.h"
 #include "system/system.h"
 #include "client/client.h"
+#include "server/server.h"
 #include "format/pak.h"
 
 #include <fcntl.h>
@@ -830,6 +831,33 @@ static qerror_t get_fp_info(FILE *fp, file_info_t *info)
     return Q_ERR_SUCCESS;
 }
 
+/*
+================
+FS_FileInfo
+
+Returns size and times of the file opened for reading. Times of files
+inside packs are those of the pack itself.
+================
+*/
+qerror_t FS_FileInfo(qhandle_t f, file_info_t *info)
+{
+    file_t *file = file_for_handle(f);
+    qerror_t ret;
+
+    if (!file)
+        return Q_ERR_BADF;
+
+    if ((file->mode & FS_MODE_MASK) != FS_MODE_READ || !file->fp)
+        return Q_ERR_NOSYS;
+
+    ret = get_fp_info(file->fp, info);
+    if (ret)
+        return ret;
+
+    info->size = file->length;
+    return Q_ERR_SUCCESS;
+}
+
 static inline FILE *fopen_hack(const char *path, const char *mode)
 {
 #ifndef _GNU_SOURCE
@@ -3451,6 +3479,9 @@ void FS_Restart(qboolean total)
 {
     Com_Printf("----- FS_Restart -----\n");
 
+    // cached map may come from the old game directory
+    SV_FlushMapCache();
+
     if (total) {
         // perform full reset
         free_all_paths();
@@ -0,0 +1,274 @@
+/*
+Copyright (C) 2003-2008 Andrey Nazarov
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "shared/shared.h"
+#include "common/huffman.h"
+
+/*
+==============================================================================
+
+Canonical Huffman codes are built from byte frequencies collected by the
+sender, and transmitted to the receiver as a table of code lengths.
+Codes are limited to HUFF_MAX_BITS and written MSB first.
+
+==============================================================================
+*/
+
+typedef struct {
+    uint64_t    freq;
+    int         parent;
+} huffnode_t;
+
+// sorts symbols by descending frequency, ties broken by symbol value
+static const unsigned   *sort_freqs;
+
+static int freqcmp(const void *p1, const void *p2)
+{
+    int s1 = *(const byte *)p1;
+    int s2 = *(const byte *)p2;
+
+    if (sort_freqs[s1] > sort_freqs[s2])
+        return -1;
+    if (sort_freqs[s1] < sort_freqs[s2])
+        return 1;
+    return s1 - s2;
+}
+
+static void build_codes(huffman_t *huff)
+{
+    uint16_t next[HUFF_MAX_BITS + 1];
+    int offsets[HUFF_MAX_BITS + 1];
+    int i, len, code;
+
+    code = 0;
+    for (len = 1; len <= HUFF_MAX_BITS; len++) {
+        code = (code + huff->counts[len - 1]) << 1;
+        next[len] = code;
+    }
+
+    offsets[1] = 0;
+    for (len = 1; len < HUFF_MAX_BITS; len++)
+        offsets[len + 1] = offsets[len] + huff->counts[len];
+
+    for (i = 0; i < HUFF_SYMBOLS; i++) {
+        len = huff->lengths[i];
+        huff->codes[i] = next[len]++;
+        huff->symbols[offsets[len]++] = i;
+    }
+}
+
+/*
+=============
+HUFF_BuildFromFrequencies
+
+Builds length limited code from symbol frequencies. Every symbol gets a code,
+even if it has zero frequency.
+=============
+*/
+void HUFF_BuildFromFrequencies(huffman_t *huff, const unsigned *freqs)
+{
+    huffnode_t nodes[HUFF_SYMBOLS * 2 - 1];
+    byte order[HUFF_SYMBOLS];
+    int counts[HUFF_SYMBOLS];
+    int i, j, n, len, maxlen, min1, min2;
+
+    // build the tree by merging two least frequent nodes
+    for (i = 0; i < HUFF_SYMBOLS; i++) {
+        nodes[i].freq = freqs[i] + 1;
+        nodes[i].parent = -1;
+    }
+
+    for (n = HUFF_SYMBOLS; n < HUFF_SYMBOLS * 2 - 1; n++) {
+        min1 = min2 = -1;
+        for (i = 0; i < n; i++) {
+            if (nodes[i].parent != -1)
+                continue;
+            if (min1 == -1 || nodes[i].freq < nodes[min1].freq) {
+                min2 = min1;
+                min1 = i;
+            } else if (min2 == -1 || nodes[i].freq < nodes[min2].freq) {
+                min2 = i;
+            }
+        }
+        nodes[n].freq = nodes[min1].freq + nodes[min2].freq;
+        nodes[n].parent = -1;
+        nodes[min1].parent = n;
+        nodes[min2].parent = n;
+    }
+
+    // count number of codes of each length
+    memset(counts, 0, sizeof(counts));
+    maxlen = 0;
+    for (i = 0; i < HUFF_SYMBOLS; i++) {
+        for (len = 0, j = i; nodes[j].parent != -1; j = nodes[j].parent)
+            len++;
+        counts[len]++;
+        maxlen = max(maxlen, len);
+    }
+
+    // limit code lengths, keeping the tree complete
+    for (len = maxlen; len > HUFF_MAX_BITS; len--) {
+        while (counts[len] > 0) {
+            for (j = len - 2; !counts[j]; j--)
+                ;
+            counts[len] -= 2;
+            counts[len - 1]++;
+            counts[j + 1] += 2;
+            counts[j]--;
+        }
+    }
+
+    // assign shortest codes to most frequent symbols
+    for (i = 0; i < HUFF_SYMBOLS; i++)
+        order[i] = i;
+    sort_freqs = freqs;
+    qsort(order, HUFF_SYMBOLS, sizeof(order[0]), freqcmp);
+
+    memset(huff->counts, 0, sizeof(huff->counts));
+    for (i = 0, len = 1; len <= HUFF_MAX_BITS; len++) {
+        huff->counts[len] = counts[len];
+        for (j = 0; j < counts[len]; j++)
+            huff->lengths[order[i++]] = len;
+    }
+
+    build_codes(huff);
+}
+
+/*
+=============
+HUFF_BuildFromLengths
+
+Builds code from lengths received over the network. Returns qfalse if lengths
+are out of range or oversubscribed.
+=============
+*/
+qboolean HUFF_BuildFromLengths(huffman_t *huff, const byte *lengths)
+{
+    int i, len, left;
+
+    memset(huff->counts, 0, sizeof(huff->counts));
+    for (i = 0; i < HUFF_SYMBOLS; i++) {
+        len = lengths[i];
+        if (len < 1 || len > HUFF_MAX_BITS)
+            return qfalse;
+        huff->lengths[i] = len;
+        huff->counts[len]++;
+    }
+
+    left = 1;
+    for (len = 1; len <= HUFF_MAX_BITS; len++) {
+        left <<= 1;
+        left -= huff->counts[len];
+        if (left < 0)
+            return qfalse;
+    }
+
+    build_codes(huff);
+    return qtrue;
+}
+
+void HUFF_PackLengths(const huffman_t *huff, byte *out)
+{
+    int i;
+
+    for (i = 0; i < HUFF_LENGTHS_BYTES; i++)
+        out[i] = huff->lengths[i * 2] | (huff->lengths[i * 2 + 1] << 4);
+}
+
+void HUFF_UnpackLengths(byte *lengths, const byte *in)
+{
+    int i;
+
+    for (i = 0; i < HUFF_LENGTHS_BYTES; i++) {
+        lengths[i * 2 + 0] = in[i] & 15;
+        lengths[i * 2 + 1] = in[i] >> 4;
+    }
+}
+
+/*
+=============
+HUFF_Encode
+
+Returns number of bytes written, or 0 if output buffer is too small.
+=============
+*/
+size_t HUFF_Encode(const huffman_t *huff, byte *out, size_t outlen,
+                   const byte *in, size_t inlen)
+{
+    uint32_t bits = 0;
+    int numbits = 0;
+    size_t i, pos = 0;
+
+    for (i = 0; i < inlen; i++) {
+        bits = (bits << huff->lengths[in[i]]) | huff->codes[in[i]];
+        numbits += huff->lengths[in[i]];
+        while (numbits >= 8) {
+            if (pos == outlen)
+                return 0;
+            numbits -= 8;
+            out[pos++] = bits >> numbits;
+        }
+    }
+
+    if (numbits) {
+        if (pos == outlen)
+            return 0;
+        out[pos++] = bits << (8 - numbits);
+    }
+
+    return pos;
+}
+
+/*
+=============
+HUFF_Decode
+
+Decodes exactly outlen symbols. Returns qfalse if input is truncated or
+contains invalid code.
+=============
+*/
+qboolean HUFF_Decode(const huffman_t *huff, byte *out, size_t outlen,
+                     const byte *in, size_t inlen)
+{
+    size_t i, pos = 0;
+    int bit = 0, code, first, index, count, len;
+
+    for (i = 0; i < outlen; i++) {
+        code = first = index = 0;
+        for (len = 1; len <= HUFF_MAX_BITS; len++) {
+            if (pos == inlen)
+                return qfalse;
+            code |= (in[pos] >> (7 - bit)) & 1;
+            if (++bit == 8) {
+                bit = 0;
+                pos++;
+            }
+            count = huff->counts[len];
+            if (code < first + count)
+                break;
+            index += count;
+            first = (first + count) << 1;
+            code <<= 1;
+        }
+        if (len > HUFF_MAX_BITS)
+            return qfalse;
+        out[i] = huff->symbols[index + code - first];
+    }
+
+    return qtrue;
+}
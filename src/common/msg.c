@@ -22,6 +22,10 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "common/sizebuf.h"
 #include "common/math.h"
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 /*
 ==============================================================================
 
@@ -216,7 +220,7 @@ void MSG_WriteAngle(float f)
     MSG_WriteByte(ANGLE2BYTE(f));
 }
 
-#if USE_CLIENT
+#if USE_CLIENT || USE_SERVER
 
 /*
 =============
@@ -310,6 +314,10 @@ int MSG_WriteDeltaUsercmd(const usercmd_t *from, const usercmd_t *cmd, int versi
     return bits;
 }
 
+#endif // USE_CLIENT || USE_SERVER
+
+#if USE_CLIENT
+
 /*
 =============
 MSG_WriteBits
@@ -502,11 +510,102 @@ void MSG_PackEntity(entity_packed_t *out, const entity_state_t *in, qboolean sho
     out->event = in->event;
 }
 
+/*
+=============
+MSG_EntityChanges
+
+Returns a mask with one bit set for each byte of entity_packed_t that differs
+between two states. With SSE2 the whole struct is compared in three vector
+operations, individual fields are then tested against precomputed byte masks.
+Entity number is not included in the scalar version.
+=============
+*/
+#define ES_PACKED_SIZE  sizeof(entity_packed_t)
+
+#define ES_BYTES(f) \
+    ((((uint64_t)1 << sizeof(((entity_packed_t *)0)->f)) - 1) << q_offsetof(entity_packed_t, f))
+
+// byte masks and vector loads above depend on this exact layout
+q_static_assert(ES_PACKED_SIZE == 44, entity_packed_size);
+q_static_assert(q_offsetof(entity_packed_t, origin) == 2, entity_packed_origin);
+q_static_assert(q_offsetof(entity_packed_t, angles) == 8, entity_packed_angles);
+q_static_assert(q_offsetof(entity_packed_t, old_origin) == 14, entity_packed_old_origin);
+q_static_assert(q_offsetof(entity_packed_t, modelindex) == 20, entity_packed_modelindex);
+q_static_assert(q_offsetof(entity_packed_t, skinnum) == 24, entity_packed_skinnum);
+q_static_assert(q_offsetof(entity_packed_t, effects) == 28, entity_packed_effects);
+q_static_assert(q_offsetof(entity_packed_t, renderfx) == 32, entity_packed_renderfx);
+q_static_assert(q_offsetof(entity_packed_t, solid) == 36, entity_packed_solid);
+q_static_assert(q_offsetof(entity_packed_t, frame) == 40, entity_packed_frame);
+q_static_assert(q_offsetof(entity_packed_t, sound) == 42, entity_packed_sound);
+q_static_assert(q_offsetof(entity_packed_t, event) == 43, entity_packed_event);
+
+static inline uint64_t MSG_EntityChanges(const entity_packed_t *from, const entity_packed_t *to)
+{
+#ifdef __SSE2__
+    const byte *a = (const byte *)from;
+    const byte *b = (const byte *)to;
+    uint64_t same;
+
+    // last load overlaps the second one to avoid reading past the end
+    same  = (uint64_t)_mm_movemask_epi8(_mm_cmpeq_epi8(
+                _mm_loadu_si128((const __m128i *)(a +  0)),
+                _mm_loadu_si128((const __m128i *)(b +  0))));
+    same |= (uint64_t)_mm_movemask_epi8(_mm_cmpeq_epi8(
+                _mm_loadu_si128((const __m128i *)(a + 16)),
+                _mm_loadu_si128((const __m128i *)(b + 16)))) << 16;
+    same |= (uint64_t)_mm_movemask_epi8(_mm_cmpeq_epi8(
+                _mm_loadu_si128((const __m128i *)(a + ES_PACKED_SIZE - 16)),
+                _mm_loadu_si128((const __m128i *)(b + ES_PACKED_SIZE - 16)))) << (ES_PACKED_SIZE - 16);
+
+    return ~same & (((uint64_t)1 << ES_PACKED_SIZE) - 1);
+#else
+    uint64_t diff = 0;
+
+#define ES_DIFF(f) \
+    if (from->f != to->f) diff |= ES_BYTES(f)
+
+    ES_DIFF(origin[0]);
+    ES_DIFF(origin[1]);
+    ES_DIFF(origin[2]);
+    ES_DIFF(angles[0]);
+    ES_DIFF(angles[1]);
+    ES_DIFF(angles[2]);
+    ES_DIFF(old_origin[0]);
+    ES_DIFF(old_origin[1]);
+    ES_DIFF(old_origin[2]);
+    ES_DIFF(modelindex);
+    ES_DIFF(modelindex2);
+    ES_DIFF(modelindex3);
+    ES_DIFF(modelindex4);
+    ES_DIFF(skinnum);
+    ES_DIFF(effects);
+    ES_DIFF(renderfx);
+    ES_DIFF(solid);
+    ES_DIFF(frame);
+    ES_DIFF(sound);
+    ES_DIFF(event);
+
+#undef ES_DIFF
+
+    return diff;
+#endif
+}
+
+#define ES_WB(c) \
+    (*p++ = (c))
+#define ES_WS(c) \
+    (p[0] = (c) & 0xff, p[1] = ((c) >> 8) & 0xff, p += 2)
+#define ES_WL(c) \
+    (p[0] = (c) & 0xff, p[1] = ((c) >> 8) & 0xff, \
+     p[2] = ((c) >> 16) & 0xff, p[3] = (c) >> 24, p += 4)
+
 void MSG_WriteDeltaEntity(const entity_packed_t *from,
                           const entity_packed_t *to,
                           msgEsFlags_t          flags)
 {
     uint32_t    bits, mask;
+    uint64_t    diff;
+    byte        buffer[MAX_PACKED_ENTITY_BYTES], *p;
 
     if (!to) {
         if (!from)
@@ -537,32 +636,34 @@ void MSG_WriteDeltaEntity(const entity_packed_t *from,
     if (!from)
         from = &nullEntityState;
 
+    diff = MSG_EntityChanges(from, to);
+
+    // fast path for the most common case of entity not changed at all
+    if (!(diff & ~ES_BYTES(event)) && !to->event &&
+        !(to->renderfx & (RF_FRAMELERP | RF_BEAM)) &&
+        !(flags & (MSG_ES_FORCE | MSG_ES_NEWENTITY)))
+        return;
+
 // send an update
     bits = 0;
 
     if (!(flags & MSG_ES_FIRSTPERSON)) {
-        if (to->origin[0] != from->origin[0])
+        if (diff & ES_BYTES(origin[0]))
             bits |= U_ORIGIN1;
-        if (to->origin[1] != from->origin[1])
+        if (diff & ES_BYTES(origin[1]))
             bits |= U_ORIGIN2;
-        if (to->origin[2] != from->origin[2])
+        if (diff & ES_BYTES(origin[2]))
             bits |= U_ORIGIN3;
 
-        if (flags & MSG_ES_SHORTANGLES) {
-            if (to->angles[0] != from->angles[0])
-                bits |= U_ANGLE1 | U_ANGLE16;
-            if (to->angles[1] != from->angles[1])
-                bits |= U_ANGLE2 | U_ANGLE16;
-            if (to->angles[2] != from->angles[2])
-                bits |= U_ANGLE3 | U_ANGLE16;
-        } else {
-            if (to->angles[0] != from->angles[0])
-                bits |= U_ANGLE1;
-            if (to->angles[1] != from->angles[1])
-                bits |= U_ANGLE2;
-            if (to->angles[2] != from->angles[2])
-                bits |= U_ANGLE3;
-        }
+        if (diff & ES_BYTES(angles[0]))
+            bits |= U_ANGLE1;
+        if (diff & ES_BYTES(angles[1]))
+            bits |= U_ANGLE2;
+        if (diff & ES_BYTES(angles[2]))
+            bits |= U_ANGLE3;
+
+        if ((flags & MSG_ES_SHORTANGLES) && (bits & (U_ANGLE1 | U_ANGLE2 | U_ANGLE3)))
+            bits |= U_ANGLE16;
 
         if (flags & MSG_ES_NEWENTITY) {
             if (to->old_origin[0] != from->origin[0] ||
@@ -577,7 +678,7 @@ void MSG_WriteDeltaEntity(const entity_packed_t *from,
     else
         mask = 0xffff8000;  // don't confuse old clients
 
-    if (to->skinnum != from->skinnum) {
+    if (diff & ES_BYTES(skinnum)) {
         if (to->skinnum & mask)
             bits |= U_SKIN8 | U_SKIN16;
         else if (to->skinnum & 0x0000ff00)
@@ -586,14 +687,14 @@ void MSG_WriteDeltaEntity(const entity_packed_t *from,
             bits |= U_SKIN8;
     }
 
-    if (to->frame != from->frame) {
+    if (diff & ES_BYTES(frame)) {
         if (to->frame & 0xff00)
             bits |= U_FRAME16;
         else
             bits |= U_FRAME8;
     }
 
-    if (to->effects != from->effects) {
+    if (diff & ES_BYTES(effects)) {
         if (to->effects & mask)
             bits |= U_EFFECTS8 | U_EFFECTS16;
         else if (to->effects & 0x0000ff00)
@@ -602,7 +703,7 @@ void MSG_WriteDeltaEntity(const entity_packed_t *from,
             bits |= U_EFFECTS8;
     }
 
-    if (to->renderfx != from->renderfx) {
+    if (diff & ES_BYTES(renderfx)) {
         if (to->renderfx & mask)
             bits |= U_RENDERFX8 | U_RENDERFX16;
         else if (to->renderfx & 0x0000ff00)
@@ -611,32 +712,30 @@ void MSG_WriteDeltaEntity(const entity_packed_t *from,
             bits |= U_RENDERFX8;
     }
 
-    if (to->solid != from->solid)
+    if (diff & ES_BYTES(solid))
         bits |= U_SOLID;
 
     // event is not delta compressed, just 0 compressed
     if (to->event)
         bits |= U_EVENT;
 
-    if (to->modelindex != from->modelindex)
+    if (diff & ES_BYTES(modelindex))
         bits |= U_MODEL;
-    if (to->modelindex2 != from->modelindex2)
+    if (diff & ES_BYTES(modelindex2))
         bits |= U_MODEL2;
-    if (to->modelindex3 != from->modelindex3)
+    if (diff & ES_BYTES(modelindex3))
         bits |= U_MODEL3;
-    if (to->modelindex4 != from->modelindex4)
+    if (diff & ES_BYTES(modelindex4))
         bits |= U_MODEL4;
 
-    if (to->sound != from->sound)
+    if (diff & ES_BYTES(sound))
         bits |= U_SOUND;
 
     if (to->renderfx & RF_FRAMELERP) {
         bits |= U_OLDORIGIN;
     } else if (to->renderfx & RF_BEAM) {
         if (flags & MSG_ES_BEAMORIGIN) {
-            if (to->old_origin[0] != from->old_origin[0] ||
-                to->old_origin[1] != from->old_origin[1] ||
-                to->old_origin[2] != from->old_origin[2])
+            if (diff & ES_BYTES(old_origin))
                 bits |= U_OLDORIGIN;
         } else {
             bits |= U_OLDORIGIN;
@@ -664,102 +763,111 @@ void MSG_WriteDeltaEntity(const entity_packed_t *from,
     else if (bits & 0x0000ff00)
         bits |= U_MOREBITS1;
 
-    MSG_WriteByte(bits & 255);
+    // encode into local buffer, then reserve message space once
+    p = buffer;
+
+    ES_WB(bits & 255);
 
     if (bits & 0xff000000) {
-        MSG_WriteByte((bits >> 8) & 255);
-        MSG_WriteByte((bits >> 16) & 255);
-        MSG_WriteByte((bits >> 24) & 255);
+        ES_WB((bits >> 8) & 255);
+        ES_WB((bits >> 16) & 255);
+        ES_WB((bits >> 24) & 255);
     } else if (bits & 0x00ff0000) {
-        MSG_WriteByte((bits >> 8) & 255);
-        MSG_WriteByte((bits >> 16) & 255);
+        ES_WB((bits >> 8) & 255);
+        ES_WB((bits >> 16) & 255);
     } else if (bits & 0x0000ff00) {
-        MSG_WriteByte((bits >> 8) & 255);
+        ES_WB((bits >> 8) & 255);
     }
 
     //----------
 
     if (bits & U_NUMBER16)
-        MSG_WriteShort(to->number);
+        ES_WS(to->number);
     else
-        MSG_WriteByte(to->number);
+        ES_WB(to->number);
 
     if (bits & U_MODEL)
-        MSG_WriteByte(to->modelindex);
+        ES_WB(to->modelindex);
     if (bits & U_MODEL2)
-        MSG_WriteByte(to->modelindex2);
+        ES_WB(to->modelindex2);
     if (bits & U_MODEL3)
-        MSG_WriteByte(to->modelindex3);
+        ES_WB(to->modelindex3);
     if (bits & U_MODEL4)
-        MSG_WriteByte(to->modelindex4);
+        ES_WB(to->modelindex4);
 
     if (bits & U_FRAME8)
-        MSG_WriteByte(to->frame);
+        ES_WB(to->frame & 255);
     else if (bits & U_FRAME16)
-        MSG_WriteShort(to->frame);
+        ES_WS(to->frame);
 
     if ((bits & (U_SKIN8 | U_SKIN16)) == (U_SKIN8 | U_SKIN16))  //used for laser colors
-        MSG_WriteLong(to->skinnum);
+        ES_WL(to->skinnum);
     else if (bits & U_SKIN8)
-        MSG_WriteByte(to->skinnum);
+        ES_WB(to->skinnum & 255);
     else if (bits & U_SKIN16)
-        MSG_WriteShort(to->skinnum);
+        ES_WS(to->skinnum);
 
     if ((bits & (U_EFFECTS8 | U_EFFECTS16)) == (U_EFFECTS8 | U_EFFECTS16))
-        MSG_WriteLong(to->effects);
+        ES_WL(to->effects);
     else if (bits & U_EFFECTS8)
-        MSG_WriteByte(to->effects);
+        ES_WB(to->effects & 255);
     else if (bits & U_EFFECTS16)
-        MSG_WriteShort(to->effects);
+        ES_WS(to->effects);
 
     if ((bits & (U_RENDERFX8 | U_RENDERFX16)) == (U_RENDERFX8 | U_RENDERFX16))
-        MSG_WriteLong(to->renderfx);
+        ES_WL(to->renderfx);
     else if (bits & U_RENDERFX8)
-        MSG_WriteByte(to->renderfx);
+        ES_WB(to->renderfx & 255);
     else if (bits & U_RENDERFX16)
-        MSG_WriteShort(to->renderfx);
+        ES_WS(to->renderfx);
 
     if (bits & U_ORIGIN1)
-        MSG_WriteShort(to->origin[0]);
+        ES_WS(to->origin[0]);
     if (bits & U_ORIGIN2)
-        MSG_WriteShort(to->origin[1]);
+        ES_WS(to->origin[1]);
     if (bits & U_ORIGIN3)
-        MSG_WriteShort(to->origin[2]);
+        ES_WS(to->origin[2]);
 
     if ((flags & MSG_ES_SHORTANGLES) && (bits & U_ANGLE16)) {
         if (bits & U_ANGLE1)
-            MSG_WriteShort(to->angles[0]);
+            ES_WS(to->angles[0]);
         if (bits & U_ANGLE2)
-            MSG_WriteShort(to->angles[1]);
+            ES_WS(to->angles[1]);
         if (bits & U_ANGLE3)
-            MSG_WriteShort(to->angles[2]);
+            ES_WS(to->angles[2]);
     } else {
         if (bits & U_ANGLE1)
-            MSG_WriteByte(to->angles[0] >> 8);
+            ES_WB((to->angles[0] >> 8) & 255);
         if (bits & U_ANGLE2)
-            MSG_WriteByte(to->angles[1] >> 8);
+            ES_WB((to->angles[1] >> 8) & 255);
         if (bits & U_ANGLE3)
-            MSG_WriteByte(to->angles[2] >> 8);
+            ES_WB((to->angles[2] >> 8) & 255);
     }
 
     if (bits & U_OLDORIGIN) {
-        MSG_WriteShort(to->old_origin[0]);
-        MSG_WriteShort(to->old_origin[1]);
-        MSG_WriteShort(to->old_origin[2]);
+        ES_WS(to->old_origin[0]);
+        ES_WS(to->old_origin[1]);
+        ES_WS(to->old_origin[2]);
     }
 
     if (bits & U_SOUND)
-        MSG_WriteByte(to->sound);
+        ES_WB(to->sound);
     if (bits & U_EVENT)
-        MSG_WriteByte(to->event);
+        ES_WB(to->event);
     if (bits & U_SOLID) {
         if (flags & MSG_ES_LONGSOLID)
-            MSG_WriteLong(to->solid);
+            ES_WL(to->solid);
         else
-            MSG_WriteShort(to->solid);
+            ES_WS(to->solid);
     }
+
+    MSG_WriteData(buffer, p - buffer);
 }
 
+#undef ES_WB
+#undef ES_WS
+#undef ES_WL
+
 void MSG_PackPlayer(player_packed_t *out, const player_state_t *in)
 {
     int i;
@@ -2546,6 +2654,7 @@ const char *MSG_ServerCommandString(int cmd)
         S(zpacket)
         S(zdownload)
         S(gamestate)
+        S(hpacket)
 #undef S
     }
 }
@@ -270,6 +270,7 @@ static size_t NetchanOld_Transmit(netchan_t *netchan, size_t length, const void
     netchan->outgoing_sequence++;
     netchan->reliable_ack_pending = qfalse;
     netchan->last_sent = com_localTime;
+    netchan->total_bytes_sent += send.cursize * numpackets;
 
     return send.cursize * numpackets;
 }
@@ -511,6 +512,7 @@ static size_t NetchanNew_TransmitNextFragment(netchan_t *netchan)
     // send the datagram
     NET_SendPacket(netchan->sock, send.data, send.cursize,
                    &netchan->remote_address);
+    netchan->total_bytes_sent += send.cursize;
 
     return send.cursize;
 }
@@ -620,6 +622,7 @@ static size_t NetchanNew_Transmit(netchan_t *netchan, size_t length, const void
     netchan->outgoing_sequence++;
     netchan->reliable_ack_pending = qfalse;
     netchan->last_sent = com_localTime;
+    netchan->total_bytes_sent += send.cursize * numpackets;
 
     return send.cursize * numpackets;
 }
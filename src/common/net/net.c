@@ -224,6 +224,9 @@ char *NET_AdrToString(const netadr_t *a)
     static char s[MAX_QPATH];
 
     switch (a->type) {
+    case NA_BAD:
+        strcpy(s, "none");
+        return s;
     case NA_LOOPBACK:
         strcpy(s, "loopback");
         return s;
@@ -616,24 +619,31 @@ void NET_RemoveFd(qsocket_t fd)
 
 /*
 =============
-NET_Sleep
+NET_SleepUntil
 
-Sleeps msec or until some file descriptor is ready. Implementation is not
+Sleeps until Sys_Microseconds reaches deadline or until some file descriptor
+is ready. Zero deadline only polls descriptors. Implementation is not
 terribly efficient, but that's fine for a small number of descriptors we
 typically have.
 =============
 */
-int NET_Sleep(int msec)
+int NET_SleepUntil(uint64_t deadline)
 {
     struct timeval tv;
     fd_set rfds, wfds, efds;
     ioentry_t *e;
     qsocket_t fd;
+    uint64_t now, usec;
     int i, ret;
 
+    now = Sys_Microseconds();
+    usec = deadline > now ? deadline - now : 0;
+
     if (!io_numfds) {
         // don't bother with select()
-        Sys_Sleep(msec);
+        if (usec) {
+            Sys_SleepUntil(deadline);
+        }
         return 0;
     }
 
@@ -654,8 +664,8 @@ int NET_Sleep(int msec)
         if (e->wantexcept) FD_SET(fd, &efds);
     }
 
-    tv.tv_sec = msec / 1000;
-    tv.tv_usec = (msec % 1000) * 1000;
+    tv.tv_sec = usec / 1000000;
+    tv.tv_usec = usec % 1000000;
 
     ret = os_select(io_numfds, &rfds, &wfds, &efds, &tv);
     if (ret == -1) {
@@ -834,6 +844,10 @@ qboolean NET_SendPacket(netsrc_t sock, const void *data,
     if (len == 0)
         return qfalse;
 
+    // simulated connections have no remote end
+    if (to->type == NA_BAD)
+        return qfalse;
+
     if (len > MAX_PACKETLEN) {
         Com_EPrintf("%s: oversize packet to %s\n", __func__,
                     NET_AdrToString(to));
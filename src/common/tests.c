@@ -21,6 +21,8 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "common/cmd.h"
 #include "common/common.h"
 #include "common/files.h"
+#include "common/huffman.h"
+#include "common/msg.h"
 #include "common/tests.h"
 #include "system/system.h"
 
@@ -491,6 +493,515 @@ static void Com_TestSnprintf_f(void)
     Com_Printf("%d failures, %d strings tested\n", errors, num_snprintf_tests * 2);
 }
 
+// unoptimized version of MSG_WriteDeltaEntity kept for reference
+static void WriteDeltaEntity_Reference(const entity_packed_t *from,
+                                       const entity_packed_t *to,
+                                       msgEsFlags_t          flags)
+{
+    uint32_t    bits, mask;
+
+    if (!to) {
+        if (!from)
+            Com_Error(ERR_DROP, "%s: NULL", __func__);
+
+        if (from->number < 1 || from->number >= MAX_EDICTS)
+            Com_Error(ERR_DROP, "%s: bad number: %d", __func__, from->number);
+
+        bits = U_REMOVE;
+        if (from->number & 0xff00)
+            bits |= U_NUMBER16 | U_MOREBITS1;
+
+        MSG_WriteByte(bits & 255);
+        if (bits & 0x0000ff00)
+            MSG_WriteByte((bits >> 8) & 255);
+
+        if (bits & U_NUMBER16)
+            MSG_WriteShort(from->number);
+        else
+            MSG_WriteByte(from->number);
+
+        return; // remove entity
+    }
+
+    if (to->number < 1 || to->number >= MAX_EDICTS)
+        Com_Error(ERR_DROP, "%s: bad number: %d", __func__, to->number);
+
+    if (!from)
+        from = &nullEntityState;
+
+// send an update
+    bits = 0;
+
+    if (!(flags & MSG_ES_FIRSTPERSON)) {
+        if (to->origin[0] != from->origin[0])
+            bits |= U_ORIGIN1;
+        if (to->origin[1] != from->origin[1])
+            bits |= U_ORIGIN2;
+        if (to->origin[2] != from->origin[2])
+            bits |= U_ORIGIN3;
+
+        if (flags & MSG_ES_SHORTANGLES) {
+            if (to->angles[0] != from->angles[0])
+                bits |= U_ANGLE1 | U_ANGLE16;
+            if (to->angles[1] != from->angles[1])
+                bits |= U_ANGLE2 | U_ANGLE16;
+            if (to->angles[2] != from->angles[2])
+                bits |= U_ANGLE3 | U_ANGLE16;
+        } else {
+            if (to->angles[0] != from->angles[0])
+                bits |= U_ANGLE1;
+            if (to->angles[1] != from->angles[1])
+                bits |= U_ANGLE2;
+            if (to->angles[2] != from->angles[2])
+                bits |= U_ANGLE3;
+        }
+
+        if (flags & MSG_ES_NEWENTITY) {
+            if (to->old_origin[0] != from->origin[0] ||
+                to->old_origin[1] != from->origin[1] ||
+                to->old_origin[2] != from->origin[2])
+                bits |= U_OLDORIGIN;
+        }
+    }
+
+    if (flags & MSG_ES_UMASK)
+        mask = 0xffff0000;
+    else
+        mask = 0xffff8000;  // don't confuse old clients
+
+    if (to->skinnum != from->skinnum) {
+        if (to->skinnum & mask)
+            bits |= U_SKIN8 | U_SKIN16;
+        else if (to->skinnum & 0x0000ff00)
+            bits |= U_SKIN16;
+        else
+            bits |= U_SKIN8;
+    }
+
+    if (to->frame != from->frame) {
+        if (to->frame & 0xff00)
+            bits |= U_FRAME16;
+        else
+            bits |= U_FRAME8;
+    }
+
+    if (to->effects != from->effects) {
+        if (to->effects & mask)
+            bits |= U_EFFECTS8 | U_EFFECTS16;
+        else if (to->effects & 0x0000ff00)
+            bits |= U_EFFECTS16;
+        else
+            bits |= U_EFFECTS8;
+    }
+
+    if (to->renderfx != from->renderfx) {
+        if (to->renderfx & mask)
+            bits |= U_RENDERFX8 | U_RENDERFX16;
+        else if (to->renderfx & 0x0000ff00)
+            bits |= U_RENDERFX16;
+        else
+            bits |= U_RENDERFX8;
+    }
+
+    if (to->solid != from->solid)
+        bits |= U_SOLID;
+
+    // event is not delta compressed, just 0 compressed
+    if (to->event)
+        bits |= U_EVENT;
+
+    if (to->modelindex != from->modelindex)
+        bits |= U_MODEL;
+    if (to->modelindex2 != from->modelindex2)
+        bits |= U_MODEL2;
+    if (to->modelindex3 != from->modelindex3)
+        bits |= U_MODEL3;
+    if (to->modelindex4 != from->modelindex4)
+        bits |= U_MODEL4;
+
+    if (to->sound != from->sound)
+        bits |= U_SOUND;
+
+    if (to->renderfx & RF_FRAMELERP) {
+        bits |= U_OLDORIGIN;
+    } else if (to->renderfx & RF_BEAM) {
+        if (flags & MSG_ES_BEAMORIGIN) {
+            if (to->old_origin[0] != from->old_origin[0] ||
+                to->old_origin[1] != from->old_origin[1] ||
+                to->old_origin[2] != from->old_origin[2])
+                bits |= U_OLDORIGIN;
+        } else {
+            bits |= U_OLDORIGIN;
+        }
+    }
+
+    //
+    // write the message
+    //
+    if (!bits && !(flags & MSG_ES_FORCE))
+        return;     // nothing to send!
+
+    if (flags & MSG_ES_REMOVE)
+        bits |= U_REMOVE; // used for MVD stream only
+
+    //----------
+
+    if (to->number & 0xff00)
+        bits |= U_NUMBER16;     // number8 is implicit otherwise
+
+    if (bits & 0xff000000)
+        bits |= U_MOREBITS3 | U_MOREBITS2 | U_MOREBITS1;
+    else if (bits & 0x00ff0000)
+        bits |= U_MOREBITS2 | U_MOREBITS1;
+    else if (bits & 0x0000ff00)
+        bits |= U_MOREBITS1;
+
+    MSG_WriteByte(bits & 255);
+
+    if (bits & 0xff000000) {
+        MSG_WriteByte((bits >> 8) & 255);
+        MSG_WriteByte((bits >> 16) & 255);
+        MSG_WriteByte((bits >> 24) & 255);
+    } else if (bits & 0x00ff0000) {
+        MSG_WriteByte((bits >> 8) & 255);
+        MSG_WriteByte((bits >> 16) & 255);
+    } else if (bits & 0x0000ff00) {
+        MSG_WriteByte((bits >> 8) & 255);
+    }
+
+    //----------
+
+    if (bits & U_NUMBER16)
+        MSG_WriteShort(to->number);
+    else
+        MSG_WriteByte(to->number);
+
+    if (bits & U_MODEL)
+        MSG_WriteByte(to->modelindex);
+    if (bits & U_MODEL2)
+        MSG_WriteByte(to->modelindex2);
+    if (bits & U_MODEL3)
+        MSG_WriteByte(to->modelindex3);
+    if (bits & U_MODEL4)
+        MSG_WriteByte(to->modelindex4);
+
+    if (bits & U_FRAME8)
+        MSG_WriteByte(to->frame);
+    else if (bits & U_FRAME16)
+        MSG_WriteShort(to->frame);
+
+    if ((bits & (U_SKIN8 | U_SKIN16)) == (U_SKIN8 | U_SKIN16))  //used for laser colors
+        MSG_WriteLong(to->skinnum);
+    else if (bits & U_SKIN8)
+        MSG_WriteByte(to->skinnum);
+    else if (bits & U_SKIN16)
+        MSG_WriteShort(to->skinnum);
+
+    if ((bits & (U_EFFECTS8 | U_EFFECTS16)) == (U_EFFECTS8 | U_EFFECTS16))
+        MSG_WriteLong(to->effects);
+    else if (bits & U_EFFECTS8)
+        MSG_WriteByte(to->effects);
+    else if (bits & U_EFFECTS16)
+        MSG_WriteShort(to->effects);
+
+    if ((bits & (U_RENDERFX8 | U_RENDERFX16)) == (U_RENDERFX8 | U_RENDERFX16))
+        MSG_WriteLong(to->renderfx);
+    else if (bits & U_RENDERFX8)
+        MSG_WriteByte(to->renderfx);
+    else if (bits & U_RENDERFX16)
+        MSG_WriteShort(to->renderfx);
+
+    if (bits & U_ORIGIN1)
+        MSG_WriteShort(to->origin[0]);
+    if (bits & U_ORIGIN2)
+        MSG_WriteShort(to->origin[1]);
+    if (bits & U_ORIGIN3)
+        MSG_WriteShort(to->origin[2]);
+
+    if ((flags & MSG_ES_SHORTANGLES) && (bits & U_ANGLE16)) {
+        if (bits & U_ANGLE1)
+            MSG_WriteShort(to->angles[0]);
+        if (bits & U_ANGLE2)
+            MSG_WriteShort(to->angles[1]);
+        if (bits & U_ANGLE3)
+            MSG_WriteShort(to->angles[2]);
+    } else {
+        if (bits & U_ANGLE1)
+            MSG_WriteByte(to->angles[0] >> 8);
+        if (bits & U_ANGLE2)
+            MSG_WriteByte(to->angles[1] >> 8);
+        if (bits & U_ANGLE3)
+            MSG_WriteByte(to->angles[2] >> 8);
+    }
+
+    if (bits & U_OLDORIGIN) {
+        MSG_WriteShort(to->old_origin[0]);
+        MSG_WriteShort(to->old_origin[1]);
+        MSG_WriteShort(to->old_origin[2]);
+    }
+
+    if (bits & U_SOUND)
+        MSG_WriteByte(to->sound);
+    if (bits & U_EVENT)
+        MSG_WriteByte(to->event);
+    if (bits & U_SOLID) {
+        if (flags & MSG_ES_LONGSOLID)
+            MSG_WriteLong(to->solid);
+        else
+            MSG_WriteShort(to->solid);
+    }
+}
+
+#define DELTA_ENTITIES  256
+
+static int random_bits(int bits)
+{
+    return rand() & ((1 << bits) - 1);
+}
+
+static void evolve_entity(entity_packed_t *to, const entity_packed_t *from)
+{
+    int i, r;
+
+    *to = *from;
+    to->event = 0;
+
+    r = rand() % 100;
+    if (r < 40)
+        return; // most entities don't change
+
+    VectorCopy(from->origin, to->old_origin);
+    for (i = 0; i < 3; i++) {
+        if (rand() & 1)
+            to->origin[i] += random_bits(8) - 128;
+        if (rand() % 3 == 0)
+            to->angles[i] = random_bits(16);
+    }
+    if (rand() & 1)
+        to->frame = rand() % 10 ? random_bits(8) : random_bits(16);
+    if (rand() % 20 == 0)
+        to->event = random_bits(3);
+    if (rand() % 50 == 0)
+        to->effects = rand() % 4 ? random_bits(8) : (uint32_t)rand() << 8;
+    if (rand() % 50 == 0)
+        to->renderfx = rand() % 4 ? random_bits(8) : random_bits(16);
+    if (rand() % 100 == 0)
+        to->skinnum = rand() % 4 ? random_bits(8) : (uint32_t)rand() << 4;
+    if (rand() % 100 == 0)
+        to->solid = random_bits(16);
+    if (rand() % 100 == 0)
+        to->sound = random_bits(8);
+    if (rand() % 100 == 0) {
+        to->modelindex = random_bits(8);
+        to->modelindex2 = random_bits(8);
+        to->modelindex3 = random_bits(8);
+        to->modelindex4 = random_bits(8);
+    }
+}
+
+static msgEsFlags_t random_es_flags(void)
+{
+    msgEsFlags_t flags = 0;
+
+    if (rand() % 10 == 0)
+        flags |= MSG_ES_FORCE;
+    if (rand() % 10 == 0)
+        flags |= MSG_ES_NEWENTITY;
+    if (rand() % 20 == 0)
+        flags |= MSG_ES_FIRSTPERSON;
+    if (rand() & 1)
+        flags |= MSG_ES_LONGSOLID;
+    if (rand() & 1)
+        flags |= MSG_ES_UMASK;
+    if (rand() & 1)
+        flags |= MSG_ES_BEAMORIGIN;
+    if (rand() & 1)
+        flags |= MSG_ES_SHORTANGLES;
+    if (rand() % 20 == 0)
+        flags |= MSG_ES_REMOVE;
+
+    return flags;
+}
+
+static void encode_frames(void (*encode)(const entity_packed_t *,
+                                         const entity_packed_t *,
+                                         msgEsFlags_t),
+                          const entity_packed_t *states,
+                          const msgEsFlags_t *flags, int numframes)
+{
+    const entity_packed_t *from, *to;
+    int i, j;
+
+    for (i = 1; i < numframes; i++) {
+        from = states + (i - 1) * DELTA_ENTITIES;
+        to = states + i * DELTA_ENTITIES;
+        for (j = 0; j < DELTA_ENTITIES; j++) {
+            if (msg_write.cursize > msg_write.maxsize / 2)
+                SZ_Clear(&msg_write);
+            encode(&from[j], &to[j], flags[i * DELTA_ENTITIES + j]);
+        }
+    }
+
+    SZ_Clear(&msg_write);
+}
+
+// compare MSG_WriteDeltaEntity output against reference version
+// and benchmark both on a generated sequence of frames
+static void MSG_TestDeltaEntity_f(void)
+{
+    entity_packed_t *states, *from, *to;
+    msgEsFlags_t *flags;
+    byte buffer[64];
+    size_t len;
+    int i, j, numframes, errors;
+    unsigned start, time_ref, time_new;
+
+    numframes = 1000;
+    if (Cmd_Argc() > 1)
+        numframes = atoi(Cmd_Argv(1));
+    clamp(numframes, 2, 100000);
+
+    srand(0);
+
+    states = Z_Malloc(sizeof(*states) * DELTA_ENTITIES * numframes);
+    flags = Z_Malloc(sizeof(*flags) * DELTA_ENTITIES * numframes);
+
+    for (j = 0; j < DELTA_ENTITIES; j++) {
+        states[j] = nullEntityState;
+        states[j].number = j + 1 + (j & 1) * 256;
+        flags[j] = 0;
+    }
+
+    for (i = 1; i < numframes; i++) {
+        for (j = 0; j < DELTA_ENTITIES; j++) {
+            evolve_entity(&states[i * DELTA_ENTITIES + j],
+                          &states[(i - 1) * DELTA_ENTITIES + j]);
+            flags[i * DELTA_ENTITIES + j] = random_es_flags();
+        }
+    }
+
+    SZ_Clear(&msg_write);
+
+    errors = 0;
+    for (i = 1; i < numframes; i++) {
+        from = states + (i - 1) * DELTA_ENTITIES;
+        to = states + i * DELTA_ENTITIES;
+        for (j = 0; j < DELTA_ENTITIES; j++) {
+            WriteDeltaEntity_Reference(&from[j], &to[j], flags[i * DELTA_ENTITIES + j]);
+            len = msg_write.cursize;
+            memcpy(buffer, msg_write.data, len);
+            SZ_Clear(&msg_write);
+
+            MSG_WriteDeltaEntity(&from[j], &to[j], flags[i * DELTA_ENTITIES + j]);
+            if (msg_write.cursize != len || memcmp(msg_write.data, buffer, len)) {
+                if (errors < 10)
+                    Com_EPrintf("MSG_WriteDeltaEntity( %d, %d, %#x ) mismatch\n",
+                                i, to[j].number, flags[i * DELTA_ENTITIES + j]);
+                errors++;
+            }
+            SZ_Clear(&msg_write);
+        }
+    }
+
+    start = Sys_Milliseconds();
+    encode_frames(WriteDeltaEntity_Reference, states, flags, numframes);
+    time_ref = Sys_Milliseconds() - start;
+
+    start = Sys_Milliseconds();
+    encode_frames(MSG_WriteDeltaEntity, states, flags, numframes);
+    time_new = Sys_Milliseconds() - start;
+
+    Com_Printf("%d failures, %d deltas tested\n",
+               errors, (numframes - 1) * DELTA_ENTITIES);
+    Com_Printf("%u msec reference, %u msec optimized\n", time_ref, time_new);
+
+    Z_Free(states);
+    Z_Free(flags);
+}
+
+// build codes from various distributions and check round trip
+static void HUFF_Test_f(void)
+{
+    static unsigned freqs[HUFF_SYMBOLS];
+    static byte raw[4096], enc[4096];
+    static byte dec[sizeof(raw) + 8];   // truncation check decodes past the end
+    byte packed[HUFF_LENGTHS_BYTES], lengths[HUFF_SYMBOLS];
+    huffman_t huff, huff2;
+    size_t len, total_raw, total_enc;
+    int i, j, pass, errors;
+
+    srand(0);
+
+    errors = 0;
+    total_raw = total_enc = 0;
+    for (pass = 0; pass < 4; pass++) {
+        for (i = 0; i < HUFF_SYMBOLS; i++) {
+            switch (pass) {
+            case 0:     // untrained
+                freqs[i] = 0;
+                break;
+            case 1:     // small values are common
+                freqs[i] = 0x10000 / (i + 1);
+                break;
+            case 2:     // exponential, forces length limiting
+                freqs[i] = 1U << (i % 31);
+                break;
+            default:    // random
+                freqs[i] = rand() & 0xfff;
+                break;
+            }
+        }
+
+        HUFF_BuildFromFrequencies(&huff, freqs);
+
+        // check transmitted code matches
+        HUFF_PackLengths(&huff, packed);
+        HUFF_UnpackLengths(lengths, packed);
+        if (!HUFF_BuildFromLengths(&huff2, lengths) ||
+            memcmp(huff.codes, huff2.codes, sizeof(huff.codes))) {
+            Com_EPrintf("HUFF_BuildFromLengths mismatch (pass %d)\n", pass);
+            errors++;
+            continue;
+        }
+
+        // generate data following the distribution
+        for (i = 0; i < sizeof(raw); i++) {
+            if (pass == 1)
+                raw[i] = rand() % 4 ? rand() & 15 : rand() & 255;
+            else if (pass == 2)
+                raw[i] = 30 - (rand() % 4 ? 0 : rand() % 31);
+            else
+                raw[i] = rand() & 255;
+        }
+
+        for (j = 1; j <= sizeof(raw); j *= 2) {
+            len = HUFF_Encode(&huff, enc, sizeof(enc), raw, j);
+            if (!len)
+                continue;   // doesn't fit
+            if (!HUFF_Decode(&huff2, dec, j, enc, len) || memcmp(raw, dec, j)) {
+                Com_EPrintf("HUFF_Decode mismatch (pass %d, %d bytes)\n", pass, j);
+                errors++;
+            }
+            if (HUFF_Decode(&huff2, dec, j + 8, enc, len)) {
+                Com_EPrintf("HUFF_Decode read past end (pass %d, %d bytes)\n", pass, j);
+                errors++;
+            }
+            total_raw += j;
+            total_enc += len;
+        }
+    }
+
+    // oversubscribed code must be rejected
+    memset(lengths, 1, sizeof(lengths));
+    if (HUFF_BuildFromLengths(&huff2, lengths)) {
+        Com_EPrintf("HUFF_BuildFromLengths accepted bad code\n");
+        errors++;
+    }
+
+    Com_Printf("%d failures, %"PRIz" bytes coded into %"PRIz"\n",
+               errors, total_raw, total_enc);
+}
+
 void TST_Init(void)
 {
     Cmd_AddCommand("error", Com_Error_f);
@@ -503,5 +1014,7 @@ void TST_Init(void)
     Cmd_AddCommand("normtest", Com_TestNorm_f);
     Cmd_AddCommand("infotest", Com_TestInfo_f);
     Cmd_AddCommand("snprintftest", Com_TestSnprintf_f);
+    Cmd_AddCommand("deltatest", MSG_TestDeltaEntity_f);
+    Cmd_AddCommand("hufftest", HUFF_Test_f);
 }
 
@@ -400,65 +400,6 @@ static byte intensitytable[256];
 static byte gammaintensitytable[256];
 static float colorscale;
 
-/*
-================
-GL_GrayScaleTexture
-
-Transform to grayscale by replacing color components with
-overall pixel luminance computed from weighted color sum
-================
-*/
-static void GL_GrayScaleTexture(byte *in, int inwidth, int inheight)
-{
-    int     i, c;
-    byte    *p;
-    float   r, g, b, y;
-
-    p = in;
-    c = inwidth * inheight;
-
-    for (i = 0; i < c; i++, p += 4) {
-        r = p[0];
-        g = p[1];
-        b = p[2];
-        y = LUMINANCE(r, g, b);
-        p[0] = y + (r - y) * colorscale;
-        p[1] = y + (g - y) * colorscale;
-        p[2] = y + (b - y) * colorscale;
-    }
-}
-
-/*
-================
-GL_LightScaleTexture
-
-Scale up the pixel values in a texture to increase the
-lighting range
-================
-*/
-static void GL_LightScaleTexture(byte *in, int inwidth, int inheight, qboolean mipmap)
-{
-    int     i, c;
-    byte    *p;
-
-    p = in;
-    c = inwidth * inheight;
-
-    if (mipmap) {
-        for (i = 0; i < c; i++, p += 4) {
-            p[0] = gammaintensitytable[p[0]];
-            p[1] = gammaintensitytable[p[1]];
-            p[2] = gammaintensitytable[p[2]];
-        }
-    } else {
-        for (i = 0; i < c; i++, p += 4) {
-            p[0] = gammatable[p[0]];
-            p[1] = gammatable[p[1]];
-            p[2] = gammatable[p[2]];
-        }
-    }
-}
-
 static void GL_ColorInvertTexture(byte *in, int inwidth, int inheight)
 {
     int     i, c;
@@ -614,7 +555,7 @@ static qboolean GL_Upload32(byte *data, int width, int height, qboolean mipmap)
     // set colorscale and lightscale before mipmap
     comp = gl_tex_solid_format;
     if (is_wall() && colorscale != 1) {
-        GL_GrayScaleTexture(data, width, height);
+        IMG_GrayScaleTexture(data, width, height, colorscale);
         if (colorscale == 0) {
             comp = GL_LUMINANCE;
         }
@@ -622,7 +563,8 @@ static qboolean GL_Upload32(byte *data, int width, int height, qboolean mipmap)
 
     if (!(r_config.flags & QVF_GAMMARAMP) &&
         (mipmap || gl_gamma_scale_pics->integer)) {
-        GL_LightScaleTexture(data, width, height, mipmap);
+        IMG_LightScaleTexture(data, width, height,
+                              mipmap ? gammaintensitytable : gammatable);
     }
 
     if (is_wall() && gl_invert->integer) {
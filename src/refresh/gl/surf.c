@@ -775,6 +775,13 @@ void GL_LoadWorld(const char *name)
 
     Com_DPrintf("%s: world size %.f (%.f)\n", __func__, gl_static.world.size, s);
 
+    // let replacement textures decode in parallel
+    for (i = 0, info = bsp->texinfo; i < bsp->numtexinfo; i++, info++) {
+        Q_concat(buffer, sizeof(buffer), "textures/", info->name, ".wal", NULL);
+        FS_NormalizePath(buffer, buffer);
+        IMG_Prefetch(buffer, IT_WALL);
+    }
+
     // register all texinfo
     for (i = 0, info = bsp->texinfo; i < bsp->numtexinfo; i++, info++) {
         Q_concat(buffer, sizeof(buffer), "textures/", info->name, ".wal", NULL);
@@ -26,6 +26,9 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "common/cvar.h"
 #include "common/files.h"
 #include "refresh/images.h"
+#include "common/bsp.h"
+#include "common/mdfour.h"
+#include "system/system.h"
 #include "format/pcx.h"
 #include "format/wal.h"
 
@@ -44,6 +47,48 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include <setjmp.h>
 #endif
 
+#if USE_PNG || USE_JPG || USE_TGA
+#define USE_IMG_CACHE   1
+#else
+#define USE_IMG_CACHE   0
+#endif
+
+// intrinsics versions of the image processing routines, selected at run time.
+// Grayscale conversion must round the same way as scalar code, so this needs
+// SSE math rather than x87.
+#if (defined __x86_64__ || defined __SSE2_MATH__) && defined __GNUC__
+#define USE_IMG_X86 1
+#include <immintrin.h>
+#endif
+
+#if USE_IMG_THREADS
+// set while 32-bit image decoders are running on worker threads. They can't
+// print messages or use zone allocator then. Images that failed to decode are
+// loaded again on the main thread, which reports any errors.
+static qboolean img_parallel;
+
+static byte *alloc_pixels(size_t size)
+{
+    if (img_parallel) {
+        return malloc(size);
+    }
+    return IMG_AllocPixels(size);
+}
+
+static void free_pixels(byte *pixels)
+{
+    if (img_parallel) {
+        free(pixels);
+    } else {
+        IMG_FreePixels(pixels);
+    }
+}
+#else
+#define img_parallel        qfalse
+#define alloc_pixels(size)  IMG_AllocPixels(size)
+#define free_pixels(pixels) IMG_FreePixels(pixels)
+#endif
+
 #define IMG_LOAD(x) \
     static qerror_t IMG_Load##x(byte *rawdata, size_t rawlen, \
         const char *filename, byte **pic, int *width, int *height)
@@ -459,12 +504,14 @@ IMG_LOAD(TGA)
     } else if (pixel_size == 24) {
         bpp = 3;
     } else {
-        Com_DPrintf("%s: %s: only 32 and 24 bit targa RGB images supported\n", __func__, filename);
+        if (!img_parallel)
+            Com_DPrintf("%s: %s: only 32 and 24 bit targa RGB images supported\n", __func__, filename);
         return Q_ERR_INVALID_FORMAT;
     }
 
     if (w < 1 || h < 1 || w > MAX_TEXTURE_SIZE || h > MAX_TEXTURE_SIZE) {
-        Com_DPrintf("%s: %s: invalid image dimensions\n", __func__, filename);
+        if (!img_parallel)
+            Com_DPrintf("%s: %s: invalid image dimensions\n", __func__, filename);
         return Q_ERR_INVALID_FORMAT;
     }
 
@@ -487,7 +534,8 @@ IMG_LOAD(TGA)
         }
     } else if (image_type == 10) {
         if (attributes & 32) {
-            Com_DPrintf("%s: %s: vertically flipped, RLE encoded images are not supported\n", __func__, filename);
+            if (!img_parallel)
+                Com_DPrintf("%s: %s: vertically flipped, RLE encoded images are not supported\n", __func__, filename);
             return Q_ERR_INVALID_FORMAT;
         }
         if (pixel_size == 32) {
@@ -496,14 +544,18 @@ IMG_LOAD(TGA)
             decode = tga_decode_bgr_rle;
         }
     } else {
-        Com_DPrintf("%s: %s: only type 2 and 10 targa RGB images supported\n", __func__, filename);
+        if (!img_parallel)
+            Com_DPrintf("%s: %s: only type 2 and 10 targa RGB images supported\n", __func__, filename);
         return Q_ERR_INVALID_FORMAT;
     }
 
-    pixels = IMG_AllocPixels(w * h * 4);
+    pixels = alloc_pixels(w * h * 4);
+    if (!pixels) {
+        return Q_ERR(ENOMEM);
+    }
     ret = decode(rawdata + offset, pixels, w, h, rawdata + rawlen);
     if (ret < 0) {
-        IMG_FreePixels(pixels);
+        free_pixels(pixels);
         return ret;
     }
 
@@ -566,6 +618,10 @@ METHODDEF(void) my_output_message(j_common_ptr cinfo)
     char buffer[JMSG_LENGTH_MAX];
     my_error_ptr jerr = (my_error_ptr)cinfo->err;
 
+    if (img_parallel) {
+        return;
+    }
+
     (*cinfo->err->format_message)(cinfo, buffer);
 
     Com_EPrintf("libjpeg: %s: %s\n", jerr->filename, buffer);
@@ -662,7 +718,8 @@ IMG_LOAD(JPG)
     jpeg_read_header(&cinfo, TRUE);
 
     if (cinfo.out_color_space != JCS_RGB && cinfo.out_color_space != JCS_GRAYSCALE) {
-        Com_DPrintf("%s: %s: invalid image color space\n", __func__, filename);
+        if (!img_parallel)
+            Com_DPrintf("%s: %s: invalid image color space\n", __func__, filename);
         ret = Q_ERR_INVALID_FORMAT;
         goto fail;
     }
@@ -670,22 +727,28 @@ IMG_LOAD(JPG)
     jpeg_start_decompress(&cinfo);
 
     if (cinfo.output_components != 3 && cinfo.output_components != 1) {
-        Com_DPrintf("%s: %s: invalid number of color components\n", __func__, filename);
+        if (!img_parallel)
+            Com_DPrintf("%s: %s: invalid number of color components\n", __func__, filename);
         ret = Q_ERR_INVALID_FORMAT;
         goto fail;
     }
 
     if (cinfo.output_width > MAX_TEXTURE_SIZE || cinfo.output_height > MAX_TEXTURE_SIZE) {
-        Com_DPrintf("%s: %s: invalid image dimensions\n", __func__, filename);
+        if (!img_parallel)
+            Com_DPrintf("%s: %s: invalid image dimensions\n", __func__, filename);
         ret = Q_ERR_INVALID_FORMAT;
         goto fail;
     }
 
-    pixels = out = IMG_AllocPixels(cinfo.output_height * cinfo.output_width * 4);
+    pixels = out = alloc_pixels(cinfo.output_height * cinfo.output_width * 4);
+    if (!pixels) {
+        ret = Q_ERR(ENOMEM);
+        goto fail;
+    }
     row_pointer = (JSAMPROW)buffer;
 
     if (setjmp(jerr.setjmp_buffer)) {
-        IMG_FreePixels(pixels);
+        free_pixels(pixels);
         ret = jerr.error;
         goto fail;
     }
@@ -897,7 +960,7 @@ static void my_png_error_fn(png_structp png_ptr, png_const_charp error_msg)
 {
     my_png_error *err = png_get_error_ptr(png_ptr);
 
-    if (err->error == Q_ERR_LIBRARY_ERROR) {
+    if (err->error == Q_ERR_LIBRARY_ERROR && !img_parallel) {
         Com_EPrintf("libpng: %s: %s\n", err->filename, error_msg);
     }
     longjmp(png_jmpbuf(png_ptr), -1);
@@ -907,6 +970,10 @@ static void my_png_warning_fn(png_structp png_ptr, png_const_charp warning_msg)
 {
     my_png_error *err = png_get_error_ptr(png_ptr);
 
+    if (img_parallel) {
+        return;
+    }
+
     Com_WPrintf("libpng: %s: %s\n", err->filename, warning_msg);
 }
 
@@ -956,7 +1023,8 @@ IMG_LOAD(PNG)
     }
 
     if (w > MAX_TEXTURE_SIZE || h > MAX_TEXTURE_SIZE) {
-        Com_DPrintf("%s: %s: invalid image dimensions\n", __func__, filename);
+        if (!img_parallel)
+            Com_DPrintf("%s: %s: invalid image dimensions\n", __func__, filename);
         ret = Q_ERR_INVALID_FORMAT;
         goto fail;
     }
@@ -992,14 +1060,18 @@ IMG_LOAD(PNG)
     png_read_update_info(png_ptr, info_ptr);
 
     rowbytes = png_get_rowbytes(png_ptr, info_ptr);
-    pixels = IMG_AllocPixels(h * rowbytes);
+    pixels = alloc_pixels(h * rowbytes);
+    if (!pixels) {
+        ret = Q_ERR(ENOMEM);
+        goto fail;
+    }
 
     for (row = 0; row < h; row++) {
         row_pointers[row] = pixels + row * rowbytes;
     }
 
     if (setjmp(png_jmpbuf(png_ptr))) {
-        IMG_FreePixels(pixels);
+        free_pixels(pixels);
         ret = my_err.error;
         goto fail;
     }
@@ -1289,6 +1361,27 @@ static void IMG_ScreenShotPNG_f(void)
 }
 #endif
 
+/*
+==================
+IMG_SaveFrame
+
+Saves current frame under the given name in the best lossless format
+available. Used by the headless video driver to dump frames for offline
+comparison.
+==================
+*/
+void IMG_SaveFrame(const char *name)
+{
+#if USE_PNG
+    make_screenshot(name, ".png", IMG_SavePNG, qfalse,
+                    r_screenshot_compression->integer);
+#elif USE_TGA
+    make_screenshot(name, ".tga", IMG_SaveTGA, qtrue, 0);
+#else
+    Com_Printf("Can't save frame, no lossless format available.\n");
+#endif
+}
+
 /*
 =========================================================
 
@@ -1297,14 +1390,327 @@ IMAGE PROCESSING
 =========================================================
 */
 
+// Image processing routines have CPU specific versions selected at run time.
+// All versions produce bit identical results. Resampling and mipmapping work
+// one row at a time, color scaling works on arrays of pixels.
+typedef struct {
+    const char  *name;
+    void        (*resample)(byte *out, const byte *inrow1, const byte *inrow2,
+                            const unsigned *p1, const unsigned *p2, int width);
+    void        (*mipmap)(byte *out, const byte *inrow1, const byte *inrow2, int width);
+    void        (*lightscale)(byte *p, int count, const byte *table);
+    void        (*grayscale)(byte *p, int count, float colorscale);
+} imgkernels_t;
+
+static void resample_row(byte *out, const byte *inrow1, const byte *inrow2,
+                         const unsigned *p1, const unsigned *p2, int width)
+{
+    int j;
+    const byte  *pix1, *pix2, *pix3, *pix4;
+
+    for (j = 0; j < width; j++) {
+        pix1 = inrow1 + p1[j];
+        pix2 = inrow1 + p2[j];
+        pix3 = inrow2 + p1[j];
+        pix4 = inrow2 + p2[j];
+        out[0] = (pix1[0] + pix2[0] + pix3[0] + pix4[0]) >> 2;
+        out[1] = (pix1[1] + pix2[1] + pix3[1] + pix4[1]) >> 2;
+        out[2] = (pix1[2] + pix2[2] + pix3[2] + pix4[2]) >> 2;
+        out[3] = (pix1[3] + pix2[3] + pix3[3] + pix4[3]) >> 2;
+        out += 4;
+    }
+}
+
+static void mipmap_row(byte *out, const byte *inrow1, const byte *inrow2, int width)
+{
+    int j;
+
+    for (j = 0; j < width; j++, out += 4, inrow1 += 8, inrow2 += 8) {
+        out[0] = (inrow1[0] + inrow1[4] + inrow2[0] + inrow2[4]) >> 2;
+        out[1] = (inrow1[1] + inrow1[5] + inrow2[1] + inrow2[5]) >> 2;
+        out[2] = (inrow1[2] + inrow1[6] + inrow2[2] + inrow2[6]) >> 2;
+        out[3] = (inrow1[3] + inrow1[7] + inrow2[3] + inrow2[7]) >> 2;
+    }
+}
+
+static void lightscale(byte *p, int count, const byte *table)
+{
+    int i;
+
+    for (i = 0; i < count; i++, p += 4) {
+        p[0] = table[p[0]];
+        p[1] = table[p[1]];
+        p[2] = table[p[2]];
+    }
+}
+
+static void grayscale(byte *p, int count, float colorscale)
+{
+    int     i;
+    float   r, g, b, y;
+
+    for (i = 0; i < count; i++, p += 4) {
+        r = p[0];
+        g = p[1];
+        b = p[2];
+        y = LUMINANCE(r, g, b);
+        p[0] = y + (r - y) * colorscale;
+        p[1] = y + (g - y) * colorscale;
+        p[2] = y + (b - y) * colorscale;
+    }
+}
+
+static const imgkernels_t img_kernels_c = {
+    "C",
+    resample_row,
+    mipmap_row,
+    lightscale,
+    grayscale
+};
+
+#if USE_IMG_X86
+
+// (a + b + c + d) >> 2 for each byte, widened to 16 bits so nothing is lost
+static inline __attribute__((target("sse2")))
+__m128i average4_sse2(__m128i a, __m128i b, __m128i c, __m128i d)
+{
+    __m128i zero = _mm_setzero_si128();
+    __m128i lo, hi;
+
+    lo = _mm_add_epi16(_mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero)),
+                       _mm_add_epi16(_mm_unpacklo_epi8(c, zero), _mm_unpacklo_epi8(d, zero)));
+    hi = _mm_add_epi16(_mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero)),
+                       _mm_add_epi16(_mm_unpackhi_epi8(c, zero), _mm_unpackhi_epi8(d, zero)));
+
+    return _mm_packus_epi16(_mm_srli_epi16(lo, 2), _mm_srli_epi16(hi, 2));
+}
+
+static inline __attribute__((target("sse2")))
+__m128i load_pixels_sse2(const byte *row, const unsigned *p)
+{
+    return _mm_setr_epi32(*(const int *)(row + p[0]), *(const int *)(row + p[1]),
+                          *(const int *)(row + p[2]), *(const int *)(row + p[3]));
+}
+
+static __attribute__((target("sse2")))
+void resample_row_sse2(byte *out, const byte *inrow1, const byte *inrow2,
+                       const unsigned *p1, const unsigned *p2, int width)
+{
+    int j;
+
+    for (j = 0; j + 4 <= width; j += 4, out += 16) {
+        __m128i a = load_pixels_sse2(inrow1, p1 + j);
+        __m128i b = load_pixels_sse2(inrow1, p2 + j);
+        __m128i c = load_pixels_sse2(inrow2, p1 + j);
+        __m128i d = load_pixels_sse2(inrow2, p2 + j);
+
+        _mm_storeu_si128((__m128i *)out, average4_sse2(a, b, c, d));
+    }
+
+    resample_row(out, inrow1, inrow2, p1 + j, p2 + j, width - j);
+}
+
+// sums each pair of neighbour pixels from two rows into one pixel of 16 bit
+// components, returns two of them
+static inline __attribute__((target("sse2")))
+__m128i mipmap_sums_sse2(const byte *inrow1, const byte *inrow2)
+{
+    __m128i zero = _mm_setzero_si128();
+    __m128i a = _mm_loadu_si128((const __m128i *)inrow1);
+    __m128i b = _mm_loadu_si128((const __m128i *)inrow2);
+    __m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+    __m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));
+
+    return _mm_add_epi16(_mm_unpacklo_epi64(lo, hi), _mm_unpackhi_epi64(lo, hi));
+}
+
+// all loads happen before the store, so this is safe to do in place
+static __attribute__((target("sse2")))
+void mipmap_row_sse2(byte *out, const byte *inrow1, const byte *inrow2, int width)
+{
+    int j;
+
+    for (j = 0; j + 4 <= width; j += 4, out += 16, inrow1 += 32, inrow2 += 32) {
+        __m128i lo = mipmap_sums_sse2(inrow1, inrow2);
+        __m128i hi = mipmap_sums_sse2(inrow1 + 16, inrow2 + 16);
+
+        _mm_storeu_si128((__m128i *)out,
+                         _mm_packus_epi16(_mm_srli_epi16(lo, 2), _mm_srli_epi16(hi, 2)));
+    }
+
+    mipmap_row(out, inrow1, inrow2, width - j);
+}
+
+// matches LUMINANCE() evaluation order exactly, so that results round the
+// same way as scalar SSE math does
+static __attribute__((target("sse2")))
+void grayscale_sse2(byte *p, int count, float colorscale)
+{
+    __m128i mask = _mm_set1_epi32(255);
+    __m128 scale = _mm_set1_ps(colorscale);
+    __m128 kr = _mm_set1_ps(0.2126f);
+    __m128 kg = _mm_set1_ps(0.7152f);
+    __m128 kb = _mm_set1_ps(0.0722f);
+    int i;
+
+    for (i = 0; i + 4 <= count; i += 4, p += 16) {
+        __m128i x = _mm_loadu_si128((const __m128i *)p);
+        __m128 r = _mm_cvtepi32_ps(_mm_and_si128(x, mask));
+        __m128 g = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(x, 8), mask));
+        __m128 b = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(x, 16), mask));
+        __m128 y = _mm_add_ps(_mm_add_ps(_mm_mul_ps(r, kr), _mm_mul_ps(g, kg)), _mm_mul_ps(b, kb));
+        __m128i ri = _mm_cvttps_epi32(_mm_add_ps(y, _mm_mul_ps(_mm_sub_ps(r, y), scale)));
+        __m128i gi = _mm_cvttps_epi32(_mm_add_ps(y, _mm_mul_ps(_mm_sub_ps(g, y), scale)));
+        __m128i bi = _mm_cvttps_epi32(_mm_add_ps(y, _mm_mul_ps(_mm_sub_ps(b, y), scale)));
+
+        x = _mm_andnot_si128(_mm_set1_epi32(0xffffff), x);
+        x = _mm_or_si128(x, _mm_or_si128(ri, _mm_or_si128(_mm_slli_epi32(gi, 8), _mm_slli_epi32(bi, 16))));
+        _mm_storeu_si128((__m128i *)p, x);
+    }
+
+    grayscale(p, count - i, colorscale);
+}
+
+// returns output pixels 0, 1 in the low lane and 2, 3 in the high lane
+static inline __attribute__((target("avx2")))
+__m256i mipmap_sums_avx2(const byte *inrow1, const byte *inrow2)
+{
+    __m256i zero = _mm256_setzero_si256();
+    __m256i a = _mm256_loadu_si256((const __m256i *)inrow1);
+    __m256i b = _mm256_loadu_si256((const __m256i *)inrow2);
+    __m256i lo = _mm256_add_epi16(_mm256_unpacklo_epi8(a, zero), _mm256_unpacklo_epi8(b, zero));
+    __m256i hi = _mm256_add_epi16(_mm256_unpackhi_epi8(a, zero), _mm256_unpackhi_epi8(b, zero));
+
+    return _mm256_add_epi16(_mm256_unpacklo_epi64(lo, hi), _mm256_unpackhi_epi64(lo, hi));
+}
+
+static __attribute__((target("avx2")))
+void mipmap_row_avx2(byte *out, const byte *inrow1, const byte *inrow2, int width)
+{
+    int j;
+
+    for (j = 0; j + 8 <= width; j += 8, out += 32, inrow1 += 64, inrow2 += 64) {
+        __m256i lo = mipmap_sums_avx2(inrow1, inrow2);
+        __m256i hi = mipmap_sums_avx2(inrow1 + 32, inrow2 + 32);
+        __m256i x = _mm256_packus_epi16(_mm256_srli_epi16(lo, 2), _mm256_srli_epi16(hi, 2));
+
+        // packed as 0, 1, 4, 5 | 2, 3, 6, 7
+        _mm256_storeu_si256((__m256i *)out, _mm256_permute4x64_epi64(x, _MM_SHUFFLE(3, 1, 2, 0)));
+    }
+
+    mipmap_row_sse2(out, inrow1, inrow2, width - j);
+}
+
+static __attribute__((target("avx2")))
+void lightscale_avx2(byte *p, int count, const byte *table)
+{
+    __m256i mask = _mm256_set1_epi32(255);
+    int wide[256];
+    int i;
+
+    // not worth widening the table for small images
+    if (count < 256) {
+        lightscale(p, count, table);
+        return;
+    }
+
+    for (i = 0; i < 256; i++)
+        wide[i] = table[i];
+
+    for (i = 0; i + 8 <= count; i += 8, p += 32) {
+        __m256i x = _mm256_loadu_si256((const __m256i *)p);
+        __m256i r = _mm256_i32gather_epi32(wide, _mm256_and_si256(x, mask), 4);
+        __m256i g = _mm256_i32gather_epi32(wide, _mm256_and_si256(_mm256_srli_epi32(x, 8), mask), 4);
+        __m256i b = _mm256_i32gather_epi32(wide, _mm256_and_si256(_mm256_srli_epi32(x, 16), mask), 4);
+
+        x = _mm256_andnot_si256(_mm256_set1_epi32(0xffffff), x);
+        x = _mm256_or_si256(x, _mm256_or_si256(r, _mm256_or_si256(_mm256_slli_epi32(g, 8), _mm256_slli_epi32(b, 16))));
+        _mm256_storeu_si256((__m256i *)p, x);
+    }
+
+    lightscale(p, count - i, table);
+}
+
+static __attribute__((target("avx2")))
+void grayscale_avx2(byte *p, int count, float colorscale)
+{
+    __m256i mask = _mm256_set1_epi32(255);
+    __m256 scale = _mm256_set1_ps(colorscale);
+    __m256 kr = _mm256_set1_ps(0.2126f);
+    __m256 kg = _mm256_set1_ps(0.7152f);
+    __m256 kb = _mm256_set1_ps(0.0722f);
+    int i;
+
+    for (i = 0; i + 8 <= count; i += 8, p += 32) {
+        __m256i x = _mm256_loadu_si256((const __m256i *)p);
+        __m256 r = _mm256_cvtepi32_ps(_mm256_and_si256(x, mask));
+        __m256 g = _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(x, 8), mask));
+        __m256 b = _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(x, 16), mask));
+        __m256 y = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(r, kr), _mm256_mul_ps(g, kg)), _mm256_mul_ps(b, kb));
+        __m256i ri = _mm256_cvttps_epi32(_mm256_add_ps(y, _mm256_mul_ps(_mm256_sub_ps(r, y), scale)));
+        __m256i gi = _mm256_cvttps_epi32(_mm256_add_ps(y, _mm256_mul_ps(_mm256_sub_ps(g, y), scale)));
+        __m256i bi = _mm256_cvttps_epi32(_mm256_add_ps(y, _mm256_mul_ps(_mm256_sub_ps(b, y), scale)));
+
+        x = _mm256_andnot_si256(_mm256_set1_epi32(0xffffff), x);
+        x = _mm256_or_si256(x, _mm256_or_si256(ri, _mm256_or_si256(_mm256_slli_epi32(gi, 8), _mm256_slli_epi32(bi, 16))));
+        _mm256_storeu_si256((__m256i *)p, x);
+    }
+
+    grayscale_sse2(p, count - i, colorscale);
+}
+
+// table lookups need gathers, so SSE2 set uses C version for them
+static const imgkernels_t img_kernels_sse2 = {
+    "SSE2",
+    resample_row_sse2,
+    mipmap_row_sse2,
+    lightscale,
+    grayscale_sse2
+};
+
+// gathers are slower than separate loads for resampling
+static const imgkernels_t img_kernels_avx2 = {
+    "AVX2",
+    resample_row_sse2,
+    mipmap_row_avx2,
+    lightscale_avx2,
+    grayscale_avx2
+};
+
+#endif // USE_IMG_X86
+
+static const imgkernels_t   *img_kernels = &img_kernels_c;
+
+static qboolean img_kernels_supported(const imgkernels_t *kernels)
+{
+#if USE_IMG_X86
+    __builtin_cpu_init();
+    if (kernels == &img_kernels_avx2)
+        return __builtin_cpu_supports("avx2");
+    if (kernels == &img_kernels_sse2)
+        return __builtin_cpu_supports("sse2");
+#endif
+    return qtrue;
+}
+
+static const imgkernels_t *img_best_kernels(void)
+{
+#if USE_IMG_X86
+    if (img_kernels_supported(&img_kernels_avx2))
+        return &img_kernels_avx2;
+    if (img_kernels_supported(&img_kernels_sse2))
+        return &img_kernels_sse2;
+#endif
+    return &img_kernels_c;
+}
+
 void IMG_ResampleTexture(const byte *in, int inwidth, int inheight,
                          byte *out, int outwidth, int outheight)
 {
-    int i, j;
+    int i;
     const byte  *inrow1, *inrow2;
     unsigned    frac, fracstep;
     unsigned    p1[MAX_TEXTURE_SIZE], p2[MAX_TEXTURE_SIZE];
-    const byte  *pix1, *pix2, *pix3, *pix4;
     float       heightScale;
 
     if (outwidth > MAX_TEXTURE_SIZE) {
@@ -1329,17 +1735,8 @@ void IMG_ResampleTexture(const byte *in, int inwidth, int inheight,
     for (i = 0; i < outheight; i++) {
         inrow1 = in + inwidth * (int)((i + 0.25f) * heightScale);
         inrow2 = in + inwidth * (int)((i + 0.75f) * heightScale);
-        for (j = 0; j < outwidth; j++) {
-            pix1 = inrow1 + p1[j];
-            pix2 = inrow1 + p2[j];
-            pix3 = inrow2 + p1[j];
-            pix4 = inrow2 + p2[j];
-            out[0] = (pix1[0] + pix2[0] + pix3[0] + pix4[0]) >> 2;
-            out[1] = (pix1[1] + pix2[1] + pix3[1] + pix4[1]) >> 2;
-            out[2] = (pix1[2] + pix2[2] + pix3[2] + pix4[2]) >> 2;
-            out[3] = (pix1[3] + pix2[3] + pix3[3] + pix4[3]) >> 2;
-            out += 4;
-        }
+        img_kernels->resample(out, inrow1, inrow2, p1, p2, outwidth);
+        out += outwidth * 4;
     }
 }
 
@@ -1347,18 +1744,178 @@ void IMG_MipMap(byte *out, byte *in, int width, int height)
 {
     int     i, j;
 
-    width <<= 2;
+    // odd widths make source rows drift by one pixel, preserve that
+    if (width & 1) {
+        width <<= 2;
+        height >>= 1;
+        for (i = 0; i < height; i++, in += width) {
+            for (j = 0; j < width; j += 8, out += 4, in += 8) {
+                out[0] = (in[0] + in[4] + in[width + 0] + in[width + 4]) >> 2;
+                out[1] = (in[1] + in[5] + in[width + 1] + in[width + 5]) >> 2;
+                out[2] = (in[2] + in[6] + in[width + 2] + in[width + 6]) >> 2;
+                out[3] = (in[3] + in[7] + in[width + 3] + in[width + 7]) >> 2;
+            }
+        }
+        return;
+    }
+
     height >>= 1;
-    for (i = 0; i < height; i++, in += width) {
-        for (j = 0; j < width; j += 8, out += 4, in += 8) {
-            out[0] = (in[0] + in[4] + in[width + 0] + in[width + 4]) >> 2;
-            out[1] = (in[1] + in[5] + in[width + 1] + in[width + 5]) >> 2;
-            out[2] = (in[2] + in[6] + in[width + 2] + in[width + 6]) >> 2;
-            out[3] = (in[3] + in[7] + in[width + 3] + in[width + 7]) >> 2;
+    for (i = 0; i < height; i++, in += width * 8, out += width * 2) {
+        img_kernels->mipmap(out, in, in + width * 4, width >> 1);
+    }
+}
+
+/*
+================
+IMG_LightScaleTexture
+
+Scale up the pixel values in a texture to increase the
+lighting range, using given gamma table
+================
+*/
+void IMG_LightScaleTexture(byte *in, int inwidth, int inheight, const byte *table)
+{
+    img_kernels->lightscale(in, inwidth * inheight, table);
+}
+
+/*
+================
+IMG_GrayScaleTexture
+
+Transform to grayscale by replacing color components with
+overall pixel luminance computed from weighted color sum
+================
+*/
+void IMG_GrayScaleTexture(byte *in, int inwidth, int inheight, float colorscale)
+{
+    img_kernels->grayscale(in, inwidth * inheight, colorscale);
+}
+
+#if USE_TESTS
+
+static void bench_fill(byte *p, size_t size)
+{
+    uint32_t seed = 0x12345678;
+    size_t i;
+
+    for (i = 0; i < size; i++) {
+        seed = seed * 1664525 + 1013904223;
+        p[i] = seed >> 24;
+    }
+}
+
+/*
+================
+IMG_Bench_f
+
+Runs each set of image processing routines supported by the CPU over a range
+of texture sizes, checking results against the C versions and printing
+average time spent per texture.
+================
+*/
+static void IMG_Bench_f(void)
+{
+    static const imgkernels_t *const sets[] = {
+        &img_kernels_c,
+#if USE_IMG_X86
+        &img_kernels_sse2,
+        &img_kernels_avx2,
+#endif
+    };
+    static const int sizes[] = { 64, 128, 256, 512, 1024 };
+    const imgkernels_t *active = img_kernels;
+    byte table[256];
+    byte *src, *dst, *ref[4];
+    int i, j, k, n, size, insize, runs, diff;
+    size_t bytes;
+    uint64_t start, usec[4];
+
+    runs = Cmd_Argc() > 1 ? atoi(Cmd_Argv(1)) : 10;
+    clamp(runs, 1, 1000);
+
+    for (i = 0; i < 256; i++)
+        table[i] = min(255, i * 3 / 2);
+
+    for (k = 0; k < q_countof(sizes); k++) {
+        size = sizes[k];
+        insize = size * 3 / 4;
+        bytes = size * size * 4;
+        src = Z_Malloc(bytes);
+        dst = Z_Malloc(bytes);
+        for (n = 0; n < 4; n++)
+            ref[n] = Z_Malloc(bytes);
+
+        for (i = 0; i < q_countof(sets); i++) {
+            if (!img_kernels_supported(sets[i]))
+                continue;
+
+            img_kernels = sets[i];
+            bench_fill(src, bytes);
+            memset(usec, 0, sizeof(usec));
+            diff = 0;
+
+            for (j = 0; j < runs; j++) {
+                // resample from 3/4 size, like non power of two textures
+                start = Sys_Microseconds();
+                IMG_ResampleTexture(src, insize, insize, dst, size, size);
+                usec[0] += Sys_Microseconds() - start;
+                if (!i)
+                    memcpy(ref[0], dst, bytes);
+                else if (!j && memcmp(ref[0], dst, bytes))
+                    diff |= 1;
+
+                // full mipmap chain in place
+                memcpy(dst, src, bytes);
+                start = Sys_Microseconds();
+                for (n = size; n > 1; n >>= 1)
+                    IMG_MipMap(dst, dst, n, n);
+                usec[1] += Sys_Microseconds() - start;
+                if (!i)
+                    memcpy(ref[1], dst, bytes / 2);
+                else if (!j && memcmp(ref[1], dst, bytes / 2))
+                    diff |= 2;
+
+                memcpy(dst, src, bytes);
+                start = Sys_Microseconds();
+                IMG_LightScaleTexture(dst, size, size, table);
+                usec[2] += Sys_Microseconds() - start;
+                if (!i)
+                    memcpy(ref[2], dst, bytes);
+                else if (!j && memcmp(ref[2], dst, bytes))
+                    diff |= 4;
+
+                memcpy(dst, src, bytes);
+                start = Sys_Microseconds();
+                IMG_GrayScaleTexture(dst, size, size, 0.5f);
+                usec[3] += Sys_Microseconds() - start;
+                if (!i)
+                    memcpy(ref[3], dst, bytes);
+                else if (!j && memcmp(ref[3], dst, bytes))
+                    diff |= 8;
+            }
+
+            Com_Printf("%4dx%-4d %-4s: resample %6.1f, mipmap %6.1f, "
+                       "lightscale %6.1f, grayscale %6.1f us%s\n",
+                       size, size, sets[i]->name,
+                       (float)usec[0] / runs, (float)usec[1] / runs,
+                       (float)usec[2] / runs, (float)usec[3] / runs,
+                       sets[i] == active ? " (active)" : "");
+            if (diff)
+                Com_EPrintf("%s routines: results differ from reference (mask %d)\n",
+                            sets[i]->name, diff);
         }
+
+        Z_Free(src);
+        Z_Free(dst);
+        for (n = 0; n < 4; n++)
+            Z_Free(ref[n]);
     }
+
+    img_kernels = active;
 }
 
+#endif // USE_TESTS
+
 /*
 =========================================================
 
@@ -1402,6 +1959,77 @@ static cvar_t   *r_override_textures;
 static cvar_t   *r_texture_formats;
 #endif
 
+// time spent loading images since registration has started
+static struct {
+    int         sequence;
+    int         images;
+    int         cached, written;
+    uint64_t    read, decode, upload;
+#if USE_IMG_THREADS
+    uint64_t    decode_wall;
+#endif
+} img_stats;
+
+#if USE_IMG_THREADS
+
+#define MAX_DECODE_THREADS  16
+
+// number of images decoded by each thread at once
+#define DECODE_BATCH        4
+
+// starting a thread is not worth it for fewer images than this
+#define DECODE_MIN_JOBS     2
+
+typedef enum {
+    JOB_PENDING,    // not read from disk yet
+    JOB_READY,      // read from disk, not decoded yet
+    JOB_DONE,       // decoded, successfully or not
+    JOB_SKIPPED     // consumed or should be loaded as usual
+} jobstate_t;
+
+typedef struct {
+    char            name[MAX_QPATH];    // as requested
+    char            path[MAX_QPATH];    // as found on disk
+    size_t          len;
+    imagetype_t     type;
+    jobstate_t      state;
+    imageformat_t   fmt, orig;
+    byte            *data;
+    size_t          datalen;
+    byte            *pic;
+    int             width, height;
+    qerror_t        ret;
+    unsigned        usec;
+    int             next;   // hash chain, 1-based
+    qboolean        hashed; // digest is valid
+    qboolean        cached; // pic was read from cache, not malloc'ed
+    byte            digest[16];
+} decodejob_t;
+
+static decodejob_t  *img_jobs;
+static int          img_numjobs;
+static int          img_maxjobs;
+static int          img_jobhash[RIMAGES_HASH];
+static int          img_jobsequence;
+
+static int          img_nextjob;
+static int          img_lastjob;
+
+// set while reading image files for decoding on worker threads
+static decodejob_t  *img_deferred;
+
+static cvar_t       *r_decode_threads;
+
+#endif // USE_IMG_THREADS
+
+static void check_stats(void)
+{
+    if (img_stats.sequence != registration_sequence) {
+        memset(&img_stats, 0, sizeof(img_stats));
+        img_stats.sequence = registration_sequence;
+    }
+}
+
 /*
 ===============
 IMG_List_f
@@ -1436,6 +2064,23 @@ static void IMG_List_f(void)
     }
     Com_Printf("Total images: %d (out of %d slots)\n", count, r_numImages);
     Com_Printf("Total texels: %d (not counting mipmaps)\n", texels);
+
+    if (img_stats.sequence == registration_sequence && img_stats.images) {
+        Com_Printf("Loaded %d images: %u ms reading, %u ms decoding, %u ms uploading\n",
+                   img_stats.images, (unsigned)(img_stats.read / 1000),
+                   (unsigned)(img_stats.decode / 1000), (unsigned)(img_stats.upload / 1000));
+#if USE_IMG_CACHE
+        if (img_stats.cached || img_stats.written) {
+            Com_Printf("Texture cache: %d images read, %d written\n",
+                       img_stats.cached, img_stats.written);
+        }
+#endif
+#if USE_IMG_THREADS
+        if (img_stats.decode_wall) {
+            Com_Printf("Parallel decoding: %u ms\n", (unsigned)(img_stats.decode_wall / 1000));
+        }
+#endif
+    }
 }
 
 static image_t *alloc_image(void)
@@ -1481,49 +2126,371 @@ static image_t *lookup_image(const char *name,
     return NULL;
 }
 
-static imageformat_t try_image_format(const imageloader_t *ldr,
-                                      const char *filename, byte **pic,
-                                      byte **tmp, int *width, int *height)
-{
-    byte *data;
-    ssize_t len;
-    qerror_t ret;
+#if USE_IMG_CACHE
 
-    // load the file
-    len = FS_LoadFile(filename, (void **)&data);
-    if (!data) {
-        return len;
-    }
+/*
+=========================================================
 
-    // decompress the image
-    ret = ldr->load(data, len, filename, pic, width, height);
-    if (ret < 0) {
-        FS_FreeFile(data);
-        return ret;
-    }
+TEXTURE CACHE
 
-    // TODO: guess real image format on file contents
-    ret = ldr - img_loaders;
+Decoded 32-bit images are kept on disk in texcache/ directory of the current
+game, named after MD4 digest of the source file. Each entry is a fixed size
+header followed by raw RGBA pixels, so loading one is a plain read (or could
+be a memory mapping). Entries are written as images are decoded. Reading an entry updates its
+modification time, and least recently used entries are removed first when
+the cache grows over r_texture_cache_size megabytes.
 
-    // unless this is a WAL texture, raw image data is
-    // no longer needed, free it now
-    if (ret != IM_WAL) {
-        FS_FreeFile(data);
-        *tmp = NULL;
-    } else {
-        *tmp = data;
-    }
+Gamma, intensity and picmip are applied after decoding by the renderer, so
+the cache stays valid when they change.
 
-    return ret;
-}
+=========================================================
+*/
 
-#if USE_PNG || USE_JPG || USE_TGA
+#define CACHE_DIR       "texcache"
+#define CACHE_IDENT     (('C'<<24)+('X'<<16)+('T'<<8)+'Q')  // "QTXC"
+#define CACHE_VERSION   1
 
-// tries to load the image with a different extension
-static qerror_t try_other_formats(imageformat_t orig, imagetype_t type,
-                                  char *buffer, char *ext, byte **pic,
-                                  byte **tmp, int *width, int *height)
-{
+typedef struct {
+    uint32_t    ident;
+    uint32_t    version;
+    uint32_t    width;
+    uint32_t    height;
+    byte        digest[16];
+} cachehdr_t;
+
+static cvar_t   *r_texture_cache;
+static cvar_t   *r_texture_cache_size;
+
+// total size of cache entries on disk, -1 if not known yet
+static int64_t  img_cachesize = -1;
+
+// set by texcache_prewarm to skip reading entries that already exist
+static qboolean img_prewarm;
+
+// source file contents and format identify the entry
+static void cache_digest(byte *data, size_t len, imageformat_t fmt, byte *digest)
+{
+    struct mdfour md;
+    byte b = fmt;
+
+    mdfour_begin(&md);
+    mdfour_update(&md, &b, 1);
+    mdfour_update(&md, data, len);
+    mdfour_result(&md, digest);
+}
+
+static void cache_path(char *buffer, const byte *digest)
+{
+    char hex[33];
+    int i;
+
+    for (i = 0; i < 16; i++) {
+        hex[i * 2 + 0] = "0123456789abcdef"[digest[i] >> 4];
+        hex[i * 2 + 1] = "0123456789abcdef"[digest[i] & 15];
+    }
+    hex[32] = 0;
+
+    // spread over 16 subdirectories to keep directory listings short
+    Q_snprintf(buffer, MAX_QPATH, CACHE_DIR "/%c/%s.tex", hex[0], hex);
+}
+
+// marks entry as recently used for cache_trim
+static void cache_touch(const char *path)
+{
+    char buffer[MAX_OSPATH];
+
+    if (Q_snprintf(buffer, sizeof(buffer), "%s/%s", fs_gamedir, path) < sizeof(buffer)) {
+        os_utime(buffer);
+    }
+}
+
+static byte *cache_read(const byte *digest, int *width, int *height)
+{
+    char path[MAX_QPATH];
+    cachehdr_t hdr;
+    qhandle_t f;
+    ssize_t len;
+    size_t size;
+    unsigned w, h;
+    byte *pic;
+
+    cache_path(path, digest);
+    len = FS_FOpenFile(path, &f, FS_MODE_READ | FS_TYPE_REAL | FS_PATH_GAME);
+    if (!f) {
+        return NULL;
+    }
+
+    pic = NULL;
+    if (FS_Read(&hdr, sizeof(hdr), f) != sizeof(hdr)) {
+        goto fail;
+    }
+    if (LittleLong(hdr.ident) != CACHE_IDENT ||
+        LittleLong(hdr.version) != CACHE_VERSION ||
+        memcmp(hdr.digest, digest, sizeof(hdr.digest))) {
+        goto fail;
+    }
+
+    w = LittleLong(hdr.width);
+    h = LittleLong(hdr.height);
+    if (w < 1 || h < 1 || w > MAX_TEXTURE_SIZE || h > MAX_TEXTURE_SIZE) {
+        goto fail;
+    }
+
+    size = w * h * 4;
+    if (len != sizeof(hdr) + size) {
+        goto fail;
+    }
+
+    pic = IMG_AllocPixels(size);
+    if (FS_Read(pic, size, f) != size) {
+        IMG_FreePixels(pic);
+        pic = NULL;
+        goto fail;
+    }
+
+    *width = w;
+    *height = h;
+    cache_touch(path);
+
+fail:
+    FS_FCloseFile(f);
+    return pic;
+}
+
+static int entrycmp(const void *p1, const void *p2)
+{
+    const file_info_t *a = *(const file_info_t **)p1;
+    const file_info_t *b = *(const file_info_t **)p2;
+
+    if (a->mtime < b->mtime)
+        return -1;
+    if (a->mtime > b->mtime)
+        return 1;
+    return 0;
+}
+
+// removes least recently used entries until the cache takes no more than
+// given size. also recalculates total size of the cache.
+static void cache_trim(int64_t limit)
+{
+    void **list[16], **all;
+    file_info_t *info;
+    int i, j, count[16], total;
+    char path[MAX_OSPATH];
+    int64_t size;
+
+    size = total = 0;
+    for (i = 0; i < 16; i++) {
+        list[i] = FS_ListFiles(va(CACHE_DIR "/%x", i), ".tex",
+                               FS_TYPE_REAL | FS_PATH_GAME |
+                               FS_SEARCH_EXTRAINFO, &count[i]);
+        for (j = 0; j < count[i]; j++) {
+            info = list[i][j];
+            size += info->size;
+        }
+        total += count[i];
+    }
+
+    img_cachesize = size;
+
+    if (size > limit && total) {
+        all = Z_Malloc(total * sizeof(all[0]));
+        for (i = 0, total = 0; i < 16; i++) {
+            for (j = 0; j < count[i]; j++) {
+                all[total++] = list[i][j];
+            }
+        }
+
+        qsort(all, total, sizeof(all[0]), entrycmp);
+
+        for (i = 0; i < total && img_cachesize > limit; i++) {
+            info = all[i];
+            if (Q_snprintf(path, sizeof(path), "%s/" CACHE_DIR "/%c/%s",
+                           fs_gamedir, info->name[0], info->name) >= sizeof(path)) {
+                continue;
+            }
+            if (!remove(path)) {
+                img_cachesize -= info->size;
+            }
+        }
+
+        Z_Free(all);
+    }
+
+    for (i = 0; i < 16; i++) {
+        FS_FreeList(list[i]);
+    }
+}
+
+static void cache_write(const byte *digest, const byte *pic, int width, int height)
+{
+    char path[MAX_QPATH], temp[MAX_QPATH];
+    cachehdr_t hdr;
+    qhandle_t f;
+    size_t size;
+    int64_t limit;
+    qerror_t ret;
+
+    limit = (int64_t)Cvar_ClampInteger(r_texture_cache_size, 1, 65536) << 20;
+    size = sizeof(hdr) + width * height * 4;
+
+    if (img_cachesize < 0) {
+        cache_trim(limit);
+    }
+
+    // make some room, leaving space for a few more entries
+    if (img_cachesize + size > limit) {
+        cache_trim(limit - limit / 4);
+        if (img_cachesize + size > limit) {
+            return;
+        }
+    }
+
+    hdr.ident = LittleLong(CACHE_IDENT);
+    hdr.version = LittleLong(CACHE_VERSION);
+    hdr.width = LittleLong(width);
+    hdr.height = LittleLong(height);
+    memcpy(hdr.digest, digest, sizeof(hdr.digest));
+
+    // write under temporary name so that partially written
+    // entries are never picked up
+    cache_path(path, digest);
+    Q_concat(temp, sizeof(temp), path, ".tmp", NULL);
+
+    FS_FOpenFile(temp, &f, FS_MODE_WRITE);
+    if (!f) {
+        return;
+    }
+
+    ret = Q_ERR_FAILURE;
+    if (FS_Write(&hdr, sizeof(hdr), f) == sizeof(hdr) &&
+        FS_Write(pic, size - sizeof(hdr), f) == size - sizeof(hdr)) {
+        ret = Q_ERR_SUCCESS;
+    }
+
+    FS_FCloseFile(f);
+
+    if (!ret) {
+        ret = FS_RenameFile(temp, path);
+    }
+
+    if (ret) {
+        Com_DPrintf("%s: couldn't write %s: %s\n", __func__, path, Q_ErrorString(ret));
+        if (Q_concat(path, sizeof(path), fs_gamedir, "/", temp, NULL) < sizeof(path))
+            remove(path);
+        return;
+    }
+
+    img_cachesize += size;
+    img_stats.written++;
+}
+
+#endif // USE_IMG_CACHE
+
+static imageformat_t try_image_format(const imageloader_t *ldr,
+                                      const char *filename, byte **pic,
+                                      byte **tmp, int *width, int *height)
+{
+    byte *data;
+    ssize_t len;
+    qerror_t ret;
+    uint64_t start;
+#if USE_IMG_CACHE
+    byte digest[16];
+    qboolean hashed = qfalse;
+#endif
+
+#if USE_IMG_THREADS
+    // 8-bit images are cheap to decode, leave them for the main thread
+    if (img_deferred && ldr - img_loaders <= IM_WAL) {
+        return Q_ERR_AGAIN;
+    }
+#endif
+
+    // load the file
+    start = Sys_Microseconds();
+    len = FS_LoadFile(filename, (void **)&data);
+    img_stats.read += Sys_Microseconds() - start;
+    if (!data) {
+        return len;
+    }
+
+#if USE_IMG_CACHE
+    // 32-bit images may have been decoded before
+    if (r_texture_cache->integer && ldr - img_loaders > IM_WAL) {
+        start = Sys_Microseconds();
+        cache_digest(data, len, ldr - img_loaders, digest);
+        hashed = qtrue;
+        if (img_prewarm) {
+            char path[MAX_QPATH];
+
+            cache_path(path, digest);
+            if (FS_FileExistsEx(path, FS_TYPE_REAL | FS_PATH_GAME)) {
+                cache_touch(path);
+                FS_FreeFile(data);
+                return Q_ERR_EXIST;
+            }
+        } else {
+            *pic = cache_read(digest, width, height);
+        }
+        img_stats.read += Sys_Microseconds() - start;
+        if (*pic) {
+            FS_FreeFile(data);
+            *tmp = NULL;
+            img_stats.cached++;
+            return ldr - img_loaders;
+        }
+    }
+#endif
+
+#if USE_IMG_THREADS
+    // just keep the file, it will be decoded later
+    if (img_deferred) {
+        img_deferred->data = data;
+        img_deferred->datalen = len;
+        img_deferred->hashed = hashed;
+        memcpy(img_deferred->digest, digest, sizeof(digest));
+        return ldr - img_loaders;
+    }
+#endif
+
+    // decompress the image
+    start = Sys_Microseconds();
+    ret = ldr->load(data, len, filename, pic, width, height);
+    img_stats.decode += Sys_Microseconds() - start;
+    if (ret < 0) {
+        FS_FreeFile(data);
+        return ret;
+    }
+
+#if USE_IMG_CACHE
+    if (hashed) {
+        cache_write(digest, *pic, *width, *height);
+    }
+#endif
+
+    // TODO: guess real image format on file contents
+    ret = ldr - img_loaders;
+
+    // unless this is a WAL texture, raw image data is
+    // no longer needed, free it now
+    if (ret != IM_WAL) {
+        FS_FreeFile(data);
+        *tmp = NULL;
+    } else {
+        *tmp = data;
+    }
+
+    return ret;
+}
+
+#if USE_PNG || USE_JPG || USE_TGA
+
+// tries to load the image with a different extension
+static qerror_t try_other_formats(imageformat_t orig, imagetype_t type,
+                                  char *buffer, char *ext, byte **pic,
+                                  byte **tmp, int *width, int *height)
+{
     const imageloader_t *ldr;
     imageformat_t fmt;
     qerror_t ret;
@@ -1635,42 +2602,17 @@ static void r_texture_formats_changed(cvar_t *self)
 
 #endif // USE_PNG || USE_JPG || USE_TGA
 
-// finds or loads the given image, adding it to the hash table.
-static qerror_t find_or_load_image(const char *name, size_t len,
-                                   imagetype_t type, imageflags_t flags,
-                                   image_t **image_p)
+// loads the pic from disk, trying other formats if needed. returns format
+// of the loaded pic and stores format implied by the original extension.
+static qerror_t load_image_file(imagetype_t type, char *buffer, size_t len,
+                                imageformat_t *orig, byte **pic, byte **tmp,
+                                int *width, int *height)
 {
-    image_t *image;
-    byte *pic, *tmp;
-    int width, height;
-    char buffer[MAX_QPATH], *ext;
-    unsigned hash;
     const imageloader_t *ldr;
     imageformat_t fmt;
+    char *ext;
     qerror_t ret;
 
-    *image_p = NULL;
-
-    // must have an extension and at least 1 char of base name
-    if (len <= 4) {
-        return Q_ERR_NAMETOOSHORT;
-    }
-    if (name[len - 4] != '.') {
-        return Q_ERR_INVALID_PATH;
-    }
-
-    hash = FS_HashPathLen(name, len - 4, RIMAGES_HASH);
-
-    // look for it
-    if ((image = lookup_image(name, type, hash, len - 4)) != NULL) {
-        image->flags |= flags & IF_PERMANENT;
-        image->registration_sequence = registration_sequence;
-        *image_p = image;
-        return Q_ERR_SUCCESS;
-    }
-
-    // copy filename off
-    memcpy(buffer, name, len + 1);
     ext = buffer + len - 3;
 
     // find out original extension
@@ -1681,13 +2623,14 @@ static qerror_t find_or_load_image(const char *name, size_t len,
         }
     }
 
-    // load the pic from disk
-    pic = tmp = NULL;
+    *orig = fmt;
+    *pic = *tmp = NULL;
+
 #if USE_PNG || USE_JPG || USE_TGA
     if (fmt == IM_MAX) {
         // unknown extension, but give it a chance to load anyway
         ret = try_other_formats(IM_MAX, type,
-                                buffer, ext, &pic, &tmp, &width, &height);
+                                buffer, ext, pic, tmp, width, height);
         if (ret == Q_ERR_NOENT) {
             // not found, change error to invalid path
             ret = Q_ERR_INVALID_PATH;
@@ -1695,23 +2638,472 @@ static qerror_t find_or_load_image(const char *name, size_t len,
     } else if (r_override_textures->integer) {
         // forcibly replace the extension
         ret = try_other_formats(IM_MAX, type,
-                                buffer, ext, &pic, &tmp, &width, &height);
+                                buffer, ext, pic, tmp, width, height);
     } else {
         // first try with original extension
-        ret = try_image_format(ldr, buffer, &pic, &tmp, &width, &height);
+        ret = try_image_format(ldr, buffer, pic, tmp, width, height);
         if (ret == Q_ERR_NOENT) {
             // retry with remaining extensions
             ret = try_other_formats(fmt, type,
-                                    buffer, ext, &pic, &tmp, &width, &height);
+                                    buffer, ext, pic, tmp, width, height);
         }
     }
 #else
     if (fmt == IM_MAX) {
         return Q_ERR_INVALID_PATH;
     }
-    ret = try_image_format(ldr, buffer, &pic, &tmp, &width, &height);
+    ret = try_image_format(ldr, buffer, pic, tmp, width, height);
 #endif
 
+    return ret;
+}
+
+#if USE_IMG_CACHE
+
+/*
+===============
+IMG_CachePrewarm_f
+
+Decodes replacement textures used by all maps in the given directory,
+so that they end up in the texture cache.
+===============
+*/
+static void IMG_CachePrewarm_f(void)
+{
+    const char *dir = Cmd_Argc() > 1 ? Cmd_Argv(1) : "maps";
+    char buffer[MAX_QPATH];
+    void **list;
+    bsp_t *bsp;
+    mtexinfo_t *info, *other;
+    imageformat_t fmt;
+    byte *pic, *tmp;
+    int i, j, count, width, height;
+    int maps, images, written;
+    size_t len;
+    qerror_t ret;
+
+    if (!r_texture_cache->integer) {
+        Com_Printf("Texture cache is disabled.\n");
+        return;
+    }
+
+    list = FS_ListFiles(dir, ".bsp", FS_SEARCH_STRIPEXT, &count);
+    if (!list) {
+        Com_Printf("No maps found in %s.\n", dir);
+        return;
+    }
+
+    maps = images = 0;
+    written = img_stats.written;
+    img_prewarm = qtrue;
+
+    for (i = 0; i < count; i++) {
+        if (Q_concat(buffer, sizeof(buffer), dir, "/", list[i], ".bsp", NULL) >= sizeof(buffer)) {
+            continue;
+        }
+
+        ret = BSP_Load(buffer, &bsp);
+        if (!bsp) {
+            Com_EPrintf("Couldn't load %s: %s\n", buffer, Q_ErrorString(ret));
+            continue;
+        }
+
+        for (j = 0, info = bsp->texinfo; j < bsp->numtexinfo; j++, info++) {
+            // many texinfos share the same texture
+            for (other = bsp->texinfo; other < info; other++) {
+                if (!strcmp(other->name, info->name)) {
+                    break;
+                }
+            }
+            if (other < info) {
+                continue;
+            }
+
+            len = Q_concat(buffer, sizeof(buffer), "textures/", info->name, ".wal", NULL);
+            if (len >= sizeof(buffer)) {
+                continue;
+            }
+            len = FS_NormalizePath(buffer, buffer);
+
+            ret = load_image_file(IT_WALL, buffer, len, &fmt, &pic, &tmp, &width, &height);
+            if (ret == Q_ERR_EXIST) {
+                images++;
+            } else if (ret > IM_WAL) {
+                FS_FreeFile(tmp ? tmp : pic);
+                images++;
+            } else if (ret >= 0) {
+                FS_FreeFile(tmp ? tmp : pic);
+            }
+        }
+
+        BSP_Free(bsp);
+        maps++;
+    }
+
+    img_prewarm = qfalse;
+    FS_FreeList(list);
+
+    Com_Printf("Texture cache has %d images for %d maps, %d new.\n",
+               images, maps, img_stats.written - written);
+}
+
+static void IMG_CacheClear_f(void)
+{
+    cache_trim(0);
+
+    if (img_cachesize) {
+        Com_Printf("Couldn't remove some texture cache entries.\n");
+    } else {
+        Com_Printf("Texture cache cleared.\n");
+    }
+}
+
+#endif // USE_IMG_CACHE
+
+#if USE_IMG_THREADS
+
+/*
+=========================================================
+
+PARALLEL DECODING
+
+Renderer may announce images it is going to load with IMG_Prefetch. When the
+first of them is actually requested, files for a batch of following images
+are read from disk on the main thread, then decoded on worker threads and the
+main thread at once. Uploading decoded images still happens serially, as
+they are requested.
+
+=========================================================
+*/
+
+static void free_jobs(void)
+{
+    decodejob_t *job;
+    int i;
+
+    for (i = 0, job = img_jobs; i < img_numjobs; i++, job++) {
+        FS_FreeFile(job->data);
+        if (job->cached) {
+            IMG_FreePixels(job->pic);
+        } else {
+            free(job->pic);
+        }
+    }
+
+    Z_Free(img_jobs);
+    img_jobs = NULL;
+    img_numjobs = img_maxjobs = 0;
+    memset(img_jobhash, 0, sizeof(img_jobhash));
+}
+
+static decodejob_t *find_job(const char *name, size_t len,
+                             imagetype_t type, unsigned hash)
+{
+    decodejob_t *job;
+    int i;
+
+    if (img_jobsequence != registration_sequence) {
+        return NULL;
+    }
+
+    for (i = img_jobhash[hash]; i; i = job->next) {
+        job = &img_jobs[i - 1];
+        if (job->type == type && job->len == len &&
+            !FS_pathcmp(job->name, name)) {
+            return job;
+        }
+    }
+
+    return NULL;
+}
+
+// finds the file on disk and reads it, without decoding
+static void read_job(decodejob_t *job)
+{
+    byte *pic, *tmp;
+    int width, height;
+    qerror_t ret;
+
+    memcpy(job->path, job->name, job->len + 1);
+
+    img_deferred = job;
+    ret = load_image_file(job->type, job->path, job->len,
+                          &job->orig, &pic, &tmp, &width, &height);
+    img_deferred = NULL;
+
+    if (ret <= IM_WAL) {
+        job->state = JOB_SKIPPED;
+        return;
+    }
+
+    job->fmt = ret;
+    job->state = JOB_READY;
+
+    // nothing to decode if found in cache
+    if (pic) {
+        job->pic = pic;
+        job->width = width;
+        job->height = height;
+        job->cached = qtrue;
+        job->ret = Q_ERR_SUCCESS;
+        job->state = JOB_DONE;
+    }
+}
+
+static void decode_jobs(void)
+{
+    decodejob_t *job;
+    uint64_t start;
+    int i;
+
+    while (1) {
+        i = __atomic_fetch_add(&img_nextjob, 1, __ATOMIC_RELAXED);
+        if (i >= img_lastjob) {
+            break;
+        }
+
+        job = &img_jobs[i];
+        if (job->state != JOB_READY) {
+            continue;
+        }
+
+        start = Sys_Microseconds();
+        job->ret = img_loaders[job->fmt].load(job->data, job->datalen,
+                                              job->path, &job->pic,
+                                              &job->width, &job->height);
+        job->usec = Sys_Microseconds() - start;
+        job->state = JOB_DONE;
+    }
+}
+
+static void decode_thread(void *arg)
+{
+    decode_jobs();
+}
+
+static void decode_batch(int first)
+{
+    sys_thread_t *threads[MAX_DECODE_THREADS];
+    decodejob_t *job;
+    uint64_t start;
+    int i, count, last, numthreads;
+
+    numthreads = Cvar_ClampInteger(r_decode_threads, 0, MAX_DECODE_THREADS);
+    last = min(first + (numthreads + 1) * DECODE_BATCH, img_numjobs);
+
+    // file system is not thread safe, so read files first
+    for (i = first, count = 0; i < last; i++) {
+        job = &img_jobs[i];
+        if (job->state == JOB_PENDING) {
+            read_job(job);
+        }
+        if (job->state == JOB_READY) {
+            count++;
+        }
+    }
+
+    if (!count) {
+        return;
+    }
+
+    start = Sys_Microseconds();
+
+    img_nextjob = first;
+    img_lastjob = last;
+    img_parallel = qtrue;
+
+    // main thread decodes too, and picks up whatever jobs are left
+    // if threads couldn't be created
+    numthreads = min(numthreads, count / DECODE_MIN_JOBS - 1);
+    for (i = 0; i < numthreads; i++) {
+        threads[i] = Sys_CreateThread(decode_thread, NULL);
+        if (!threads[i]) {
+            break;
+        }
+    }
+    numthreads = i;
+
+    decode_jobs();
+
+    for (i = 0; i < numthreads; i++) {
+        Sys_JoinThread(threads[i]);
+    }
+
+    img_parallel = qfalse;
+
+    img_stats.decode_wall += Sys_Microseconds() - start;
+
+    for (i = first; i < last; i++) {
+        job = &img_jobs[i];
+        if (job->state == JOB_DONE && job->data) {
+            if (job->hashed && job->ret >= 0) {
+                cache_write(job->digest, job->pic, job->width, job->height);
+            }
+            FS_FreeFile(job->data);
+            job->data = NULL;
+            img_stats.decode += job->usec;
+        }
+    }
+}
+
+// returns the pic if it was decoded in advance
+static qerror_t load_prefetched(char *buffer, size_t len, imagetype_t type,
+                                unsigned hash, imageformat_t *orig, byte **pic,
+                                byte **tmp, int *width, int *height)
+{
+    decodejob_t *job;
+    uint64_t start;
+    size_t size;
+
+    job = find_job(buffer, len, type, hash);
+    if (!job) {
+        return Q_ERR_AGAIN;
+    }
+
+    if (job->state == JOB_PENDING) {
+        decode_batch(job - img_jobs);
+    }
+
+    if (job->state != JOB_DONE || job->ret < 0) {
+        // let the main thread load it again and report errors
+        job->state = JOB_SKIPPED;
+        return Q_ERR_AGAIN;
+    }
+
+    if (job->cached) {
+        // already in zone memory
+        *pic = job->pic;
+        job->cached = qfalse;
+    } else {
+        // move pixels into zone memory
+        start = Sys_Microseconds();
+        size = job->width * job->height * 4;
+        *pic = IMG_AllocPixels(size);
+        memcpy(*pic, job->pic, size);
+        free(job->pic);
+        img_stats.upload += Sys_Microseconds() - start;
+    }
+
+    job->pic = NULL;
+    job->state = JOB_SKIPPED;
+
+    memcpy(buffer, job->path, len + 1);
+    *orig = job->orig;
+    *tmp = NULL;
+    *width = job->width;
+    *height = job->height;
+
+    return job->fmt;
+}
+
+/*
+===============
+IMG_Prefetch
+
+Queues the image for parallel decoding. Images should be requested
+in the same order they were queued.
+===============
+*/
+void IMG_Prefetch(const char *name, imagetype_t type)
+{
+    decodejob_t *job;
+    unsigned hash;
+    size_t len;
+
+    if (r_decode_threads->integer < 1) {
+        return;
+    }
+
+    if (img_jobsequence != registration_sequence) {
+        free_jobs();
+        img_jobsequence = registration_sequence;
+    }
+
+    len = strlen(name);
+    if (len <= 4 || len >= MAX_QPATH || name[len - 4] != '.') {
+        return;
+    }
+
+    hash = FS_HashPathLen(name, len - 4, RIMAGES_HASH);
+
+    // already loaded or queued?
+    if (lookup_image(name, type, hash, len - 4)) {
+        return;
+    }
+    if (find_job(name, len, type, hash)) {
+        return;
+    }
+
+    if (img_numjobs == img_maxjobs) {
+        img_maxjobs += 64;
+        img_jobs = Z_Realloc(img_jobs, img_maxjobs * sizeof(*job));
+    }
+
+    job = &img_jobs[img_numjobs++];
+    memset(job, 0, sizeof(*job));
+    memcpy(job->name, name, len + 1);
+    job->len = len;
+    job->type = type;
+    job->state = JOB_PENDING;
+    job->next = img_jobhash[hash];
+    img_jobhash[hash] = img_numjobs;
+}
+
+#else
+
+#define load_prefetched(buffer, len, type, hash, orig, pic, tmp, width, height) \
+    Q_ERR_AGAIN
+
+#endif // USE_IMG_THREADS
+
+// finds or loads the given image, adding it to the hash table.
+static qerror_t find_or_load_image(const char *name, size_t len,
+                                   imagetype_t type, imageflags_t flags,
+                                   image_t **image_p)
+{
+    image_t *image;
+    byte *pic, *tmp;
+    int width, height;
+    char buffer[MAX_QPATH];
+    unsigned hash;
+    imageformat_t fmt;
+    qerror_t ret;
+    uint64_t start;
+
+    *image_p = NULL;
+
+    // must have an extension and at least 1 char of base name
+    if (len <= 4) {
+        return Q_ERR_NAMETOOSHORT;
+    }
+    if (name[len - 4] != '.') {
+        return Q_ERR_INVALID_PATH;
+    }
+
+    hash = FS_HashPathLen(name, len - 4, RIMAGES_HASH);
+
+    // look for it
+    if ((image = lookup_image(name, type, hash, len - 4)) != NULL) {
+        image->flags |= flags & IF_PERMANENT;
+        image->registration_sequence = registration_sequence;
+        *image_p = image;
+        return Q_ERR_SUCCESS;
+    }
+
+    check_stats();
+
+    // copy filename off
+    memcpy(buffer, name, len + 1);
+
+    // see if it was decoded in advance
+    ret = load_prefetched(buffer, len, type, hash,
+                          &fmt, &pic, &tmp, &width, &height);
+    if (ret < 0) {
+        // load the pic from disk
+        ret = load_image_file(type, buffer, len,
+                              &fmt, &pic, &tmp, &width, &height);
+    }
+
     if (ret < 0) {
         return ret;
     }
@@ -1743,12 +3135,15 @@ static qerror_t find_or_load_image(const char *name, size_t len,
     // texture, we need to recover original image dimensions for proper
     // texture alignment
     if (fmt <= IM_WAL && ret > IM_WAL) {
-        get_image_dimensions(image, fmt, buffer, ext);
+        get_image_dimensions(image, fmt, buffer, buffer + len - 3);
     }
 #endif
 
     // upload the image to card
+    start = Sys_Microseconds();
     IMG_Load(image, pic, width, height);
+    img_stats.upload += Sys_Microseconds() - start;
+    img_stats.images++;
 
 #if USE_REF == REF_GL
     // don't need pics in memory after GL upload
@@ -1927,6 +3322,11 @@ void IMG_FreeUnused(void)
     if (count) {
         Com_DPrintf("%s: %i images freed\n", __func__, count);
     }
+
+#if USE_IMG_THREADS
+    // free whatever wasn't requested
+    free_jobs();
+#endif
 }
 
 void IMG_FreeAll(void)
@@ -1954,6 +3354,10 @@ void IMG_FreeAll(void)
 
     // &r_images[0] == R_NOTEXTURE
     r_numImages = 1;
+
+#if USE_IMG_THREADS
+    free_jobs();
+#endif
 }
 
 /*
@@ -2000,6 +3404,13 @@ fail:
 static const cmdreg_t img_cmd[] = {
     { "imagelist", IMG_List_f },
     { "screenshot", IMG_ScreenShot_f },
+#if USE_IMG_CACHE
+    { "texcache_prewarm", IMG_CachePrewarm_f },
+    { "texcache_clear", IMG_CacheClear_f },
+#endif
+#if USE_TESTS
+    { "imgbench", IMG_Bench_f },
+#endif
 #if USE_TGA
     { "screenshottga", IMG_ScreenShotTGA_f },
 #endif
@@ -2038,6 +3449,15 @@ void IMG_Init(void)
     r_texture_formats->changed = r_texture_formats_changed;
     r_texture_formats_changed(r_texture_formats);
 
+#if USE_IMG_THREADS
+    r_decode_threads = Cvar_Get("r_decode_threads", "0", 0);
+#endif
+
+#if USE_IMG_CACHE
+    r_texture_cache = Cvar_Get("r_texture_cache", "0", 0);
+    r_texture_cache_size = Cvar_Get("r_texture_cache_size", "256", 0);
+#endif
+
 #if USE_JPG
     r_screenshot_format = Cvar_Get("gl_screenshot_format", "jpg", 0);
 #elif USE_PNG
@@ -2053,6 +3473,8 @@ void IMG_Init(void)
 
     Cmd_Register(img_cmd);
 
+    img_kernels = img_best_kernels();
+
     for (i = 0; i < RIMAGES_HASH; i++) {
         List_Init(&r_imageHash[i]);
     }
@@ -19,7 +19,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 #include "sw.h"
 
-static finalvert_t      fv[2][8];
+static R_TLS finalvert_t      fv[2][8];
 
 void R_AliasProjectAndClipTestFinalVert(finalvert_t *fv);
 
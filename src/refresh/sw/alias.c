@@ -22,29 +22,29 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 */
 #include "sw.h"
 
-int             r_amodels_drawn;
+R_TLS int             r_amodels_drawn;
 
-affinetridesc_t r_affinetridesc;
+R_TLS affinetridesc_t r_affinetridesc;
 
-vec3_t          r_plightvec;
-vec3_t          r_lerped[1024];
-vec3_t          r_lerp_frontv, r_lerp_backv, r_lerp_move;
+R_TLS vec3_t          r_plightvec;
+R_TLS vec3_t          r_lerped[1024];
+R_TLS vec3_t          r_lerp_frontv, r_lerp_backv, r_lerp_move;
 
-int             r_ambientlight;
-fixed8_t        r_aliasblendcolor[3];
-float           r_shadelight;
+R_TLS int             r_ambientlight;
+R_TLS fixed8_t        r_aliasblendcolor[3];
+R_TLS float           r_shadelight;
 
-int             r_alias_alpha;
-int             r_alias_one_minus_alpha;
+R_TLS int             r_alias_alpha;
+R_TLS int             r_alias_one_minus_alpha;
 
-maliasframe_t   *r_thisframe, *r_lastframe;
+R_TLS maliasframe_t   *r_thisframe, *r_lastframe;
 
-float   aliastransform[3][4];
-float   aliasworldtransform[3][4];
-float   aliasoldworldtransform[3][4];
+R_TLS float   aliastransform[3][4];
+R_TLS float   aliasworldtransform[3][4];
+R_TLS float   aliasoldworldtransform[3][4];
 
-static float    s_ziscale;
-static vec3_t   s_alias_forward, s_alias_right, s_alias_up;
+static R_TLS float    s_ziscale;
+static R_TLS vec3_t   s_alias_forward, s_alias_right, s_alias_up;
 
 #define BBOX_TRIVIAL_ACCEPT 0
 #define BBOX_MUST_CLIP_XY   1
@@ -448,11 +448,8 @@ static qboolean R_AliasSetupSkin(void)
         pskindesc = IMG_ForHandle(currententity->skin);
     else {
         skinnum = currententity->skinnum;
-        if ((skinnum >= currentmodel->numskins) || (skinnum < 0)) {
-            Com_DPrintf("R_AliasSetupSkin %s: no such skin # %d\n",
-                        currentmodel->name, skinnum);
-            skinnum = 0;
-        }
+        if ((skinnum >= currentmodel->numskins) || (skinnum < 0))
+            skinnum = 0;    // reported by R_CheckEntities
 
         pskindesc = currentmodel->skins[skinnum];
     }
@@ -535,16 +532,11 @@ static void R_AliasSetupFrames(void)
     int thisframe = currententity->frame;
     int lastframe = currententity->oldframe;
 
-    if (thisframe >= currentmodel->numframes || thisframe < 0) {
-        Com_DPrintf("%s: %s: no such thisframe %d\n",
-                    __func__, currentmodel->name, thisframe);
+    // bad frames are reported by R_CheckEntities
+    if (thisframe >= currentmodel->numframes || thisframe < 0)
         thisframe = 0;
-    }
-    if (lastframe >= currentmodel->numframes || lastframe < 0) {
-        Com_DPrintf("%s: %s: no such lastframe %d\n",
-                    __func__, currentmodel->name, lastframe);
+    if (lastframe >= currentmodel->numframes || lastframe < 0)
         lastframe = 0;
-    }
 
     r_thisframe = &currentmodel->frames[thisframe];
     r_lastframe = &currentmodel->frames[lastframe];
@@ -594,10 +586,7 @@ static void R_AliasSetUpLerpData(float backlerp)
 
 static void R_AliasSetupBlend(void)
 {
-    extern void (*d_pdrawspans)(void *);
-    extern void R_PolysetDrawSpansConstant8_Blended(void *);
-    extern void R_PolysetDrawSpans8_Blended(void *);
-    extern void R_PolysetDrawSpans8_Opaque(void *);
+    extern R_TLS void (*d_pdrawspans)(spanpackage_t *);
 
     int         mask;
     color_t     color;
@@ -636,11 +625,11 @@ static void R_AliasSetupBlend(void)
         d_pdrawspans = R_PolysetDrawSpansConstant8_Blended;
     } else if (currententity->flags & RF_TRANSLUCENT) {
         if (currententity->alpha == 1)
-            d_pdrawspans = R_PolysetDrawSpans8_Opaque;
+            d_pdrawspans = sw_kernels->polysetopaque;
         else
-            d_pdrawspans = R_PolysetDrawSpans8_Blended;
+            d_pdrawspans = sw_kernels->polysetblended;
     } else {
-        d_pdrawspans = R_PolysetDrawSpans8_Opaque;
+        d_pdrawspans = sw_kernels->polysetopaque;
     }
 }
 
@@ -675,11 +664,8 @@ void R_AliasDrawModel(void)
     }
 
     // set up the skin and verify it exists
-    if (!R_AliasSetupSkin()) {
-        Com_DPrintf("R_AliasDrawModel %s: NULL skin found\n",
-                    currentmodel->name);
-        return;
-    }
+    if (!R_AliasSetupSkin())
+        return;     // reported by R_CheckEntities
 
     r_amodels_drawn++;
     R_AliasSetupLighting();
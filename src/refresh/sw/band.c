@@ -0,0 +1,287 @@
+/*
+Copyright (C) 2003-2008 Andrey Nazarov
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+// band.c -- splitting the view between rendering threads
+
+#include "sw.h"
+
+band_t          r_bands[MAX_BANDS];
+int             r_numbands = 1;
+R_TLS band_t    *r_band = &r_bands[0];
+
+cvar_t          *sw_threads;
+
+#if USE_BAND_THREADS
+static void R_BandThread(void *arg)
+{
+    band_t  *band = arg;
+
+    while (1) {
+        Sys_WaitEvent(band->start);
+        if (band->quit)
+            break;
+        R_RenderBand(band);
+        Sys_SignalEvent(band->done);
+    }
+}
+#endif
+
+/*
+================
+R_ShutdownBands
+
+Stops all rendering threads. Band 0 is always rendered by the main thread.
+================
+*/
+void R_ShutdownBands(void)
+{
+#if USE_BAND_THREADS
+    band_t  *band;
+    int     i;
+
+    for (i = 1, band = &r_bands[1]; i < MAX_BANDS; i++, band++) {
+        if (!band->thread)
+            continue;
+
+        band->quit = qtrue;
+        Sys_SignalEvent(band->start);
+        Sys_JoinThread(band->thread);
+        Sys_DestroyEvent(band->start);
+        Sys_DestroyEvent(band->done);
+
+        band->thread = NULL;
+        band->start = band->done = NULL;
+        band->quit = qfalse;
+    }
+#endif
+
+    // make R_InitBands start threads again after full restart
+    r_numbands = 1;
+}
+
+/*
+================
+R_InitBands
+
+(Re)creates bands when the number of threads has changed.
+================
+*/
+void R_InitBands(void)
+{
+    qboolean    caches;
+    int         n = 1;
+
+#if USE_BAND_THREADS
+    n = Cvar_ClampInteger(sw_threads, 0, MAX_BANDS);
+    if (n < 1)
+        n = 1;
+#endif
+
+    sw_threads->modified = qfalse;
+
+    if (n == r_numbands)
+        return;
+
+    R_ShutdownBands();
+
+    // surface caches and edge tables are per band
+    caches = r_bands[0].sc_base != NULL;
+    R_FreeBandData();
+    R_FreeCaches();
+
+    r_numbands = n;
+
+    if (caches)
+        R_InitCaches();
+    if (r_worldmodel)
+        R_AllocBandData();
+
+#if USE_BAND_THREADS
+    {
+        band_t  *band;
+        int     i;
+
+        for (i = 1, band = &r_bands[1]; i < n; i++, band++) {
+            band->start = Sys_CreateEvent();
+            band->done = Sys_CreateEvent();
+            band->thread = Sys_CreateThread(R_BandThread, band);
+        }
+    }
+#endif
+
+    Com_DPrintf("%s: %d bands\n", __func__, n);
+}
+
+/*
+================
+R_AllocBandData
+
+Allocates per-band data that depends on the current map.
+================
+*/
+void R_AllocBandData(void)
+{
+    band_t  *band;
+    int     i;
+
+    R_FreeBandData();
+
+    for (i = 0, band = r_bands; i < r_numbands; i++, band++) {
+        if (r_cnumsurfs > NUMSTACKSURFACES)
+            band->auxsurfaces = R_Mallocz(r_cnumsurfs * sizeof(surf_t));
+
+        if (r_numallocatededges > NUMSTACKEDGES)
+            band->auxedges = R_Mallocz(r_numallocatededges * sizeof(edge_t));
+
+        if (r_worldmodel) {
+            // sky box has 6 faces and 12 edges of its own
+            band->cachespots = R_Mallocz((r_worldmodel->numfaces + 6) *
+                                         MIPLEVELS * sizeof(band->cachespots[0]));
+            band->leafkeys = R_Mallocz(r_worldmodel->numleafs *
+                                       sizeof(band->leafkeys[0]));
+            band->edgecache = R_Mallocz((r_worldmodel->numedges + 12) *
+                                        sizeof(band->edgecache[0]));
+        }
+    }
+}
+
+void R_FreeBandData(void)
+{
+    band_t  *band;
+    int     i;
+
+    // surface caches point back into cachespots
+    D_FlushCaches();
+
+    for (i = 0, band = r_bands; i < MAX_BANDS; i++, band++) {
+        Z_Free(band->auxsurfaces);
+        Z_Free(band->auxedges);
+        Z_Free(band->cachespots);
+        Z_Free(band->leafkeys);
+        Z_Free(band->edgecache);
+
+        band->auxsurfaces = NULL;
+        band->auxedges = NULL;
+        band->cachespots = NULL;
+        band->leafkeys = NULL;
+        band->edgecache = NULL;
+    }
+}
+
+/*
+================
+R_RenderBands
+
+Splits the view evenly between bands and renders them in parallel.
+================
+*/
+void R_RenderBands(void)
+{
+    band_t  *band;
+    int     i, height;
+
+    height = r_refdef.vrect.height;
+
+    for (i = 0, band = r_bands; i < r_numbands; i++, band++) {
+        band->top = height * i / r_numbands;
+        band->bottom = height * (i + 1) / r_numbands;
+        band->usec = 0;
+    }
+
+#if USE_BAND_THREADS
+    for (i = 1, band = &r_bands[1]; i < r_numbands; i++, band++)
+        if (band->bottom > band->top)
+            Sys_SignalEvent(band->start);
+#endif
+
+    if (r_bands[0].bottom > r_bands[0].top)
+        R_RenderBand(&r_bands[0]);
+
+#if USE_BAND_THREADS
+    for (i = 1, band = &r_bands[1]; i < r_numbands; i++, band++)
+        if (band->bottom > band->top)
+            Sys_WaitEvent(band->done);
+#endif
+
+    // restore full view for post-processing
+    if (r_numbands > 1)
+        R_SetupView(NULL);
+
+    // all threads are idle now, safe to raise errors
+    for (i = 0, band = r_bands; i < r_numbands; i++, band++) {
+        if (band->bottom > band->top && band->error[0])
+            Com_Error(band->errtype, "%s", band->error);
+    }
+
+    c_faceclip = r_polycount = r_drawnpolycount = c_surf = 0;
+    r_amodels_drawn = r_outofsurfaces = r_outofedges = 0;
+
+    for (i = 0, band = r_bands; i < r_numbands; i++, band++) {
+        if (band->bottom == band->top)
+            continue;
+        if (band->outofbedges)
+            Com_Printf("Out of edges for bmodel\n");
+        c_faceclip += band->faceclip;
+        r_polycount += band->polycount;
+        r_drawnpolycount += band->drawnpolycount;
+        c_surf += band->surfs;
+        r_amodels_drawn += band->amodels;
+        r_outofsurfaces += band->outofsurfaces;
+        r_outofedges += band->outofedges;
+    }
+}
+
+/*
+================
+R_BandError
+
+Aborts rendering of the current band. Com_Error can't be called from
+rendering threads, so the error is saved and raised by R_RenderBands
+once all bands have finished.
+================
+*/
+void R_BandError(error_type_t type, const char *fmt, ...)
+{
+    band_t  *band = r_band;
+    va_list argptr;
+
+    va_start(argptr, fmt);
+    Q_vsnprintf(band->error, sizeof(band->error), fmt, argptr);
+    va_end(argptr);
+
+    band->errtype = type;
+    longjmp(band->abortframe, 1);
+}
+
+/*
+=============
+R_PrintBandTimes
+=============
+*/
+void R_PrintBandTimes(void)
+{
+    char    buffer[MAX_STRING_CHARS];
+    size_t  len = 0;
+    int     i;
+
+    buffer[0] = 0;
+    for (i = 0; i < r_numbands; i++)
+        len += Q_scnprintf(buffer + len, sizeof(buffer) - len,
+                           " %u", r_bands[i].usec);
+
+    Com_Printf("bands:%s us\n", buffer);
+}
@@ -1,6 +1,6 @@
 #define BLOCK_SIZE  (1 << BLOCK_SHIFT)
 
-static void BLOCK_FUNC(void)
+void BLOCK_FUNC(void)
 {
     int     lightleft[3], lightright[3];
     int     lightleftstep[3], lightrightstep[3];
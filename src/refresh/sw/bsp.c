@@ -22,27 +22,27 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 //
 // current entity info
 //
-qboolean        insubmodel;
-entity_t        *currententity;
-vec3_t          modelorg;       // modelorg is the viewpoint reletive to
+R_TLS qboolean        insubmodel;
+R_TLS entity_t        *currententity;
+R_TLS vec3_t          modelorg;       // modelorg is the viewpoint reletive to
 // the currently rendering entity
-vec3_t          r_entorigin;    // the currently rendering entity in world
+R_TLS vec3_t          r_entorigin;    // the currently rendering entity in world
 // coordinates
 
-float           entity_rotation[3][3];
+R_TLS float           entity_rotation[3][3];
 
-int             r_currentbkey;
+R_TLS int             r_currentbkey;
 
 #define MAX_BMODEL_VERTS    500         // 6K
 #define MAX_BMODEL_EDGES    1000        // 12K
 
-static mvertex_t    *pbverts;
-static bedge_t      *pbedges;
-static int          numbverts, numbedges;
+static R_TLS mvertex_t    *pbverts;
+static R_TLS bedge_t      *pbedges;
+static R_TLS int          numbverts, numbedges;
 
-static mvertex_t    *pfrontenter, *pfrontexit;
+static R_TLS mvertex_t    *pfrontenter, *pfrontexit;
 
-static qboolean     makeclippededge;
+static R_TLS qboolean     makeclippededge;
 
 
 //===========================================================================
@@ -207,7 +207,7 @@ void R_RecursiveClipBPoly(bedge_t *pedges, mnode_t *pnode, mface_t *psurf)
             // and exiting points
             // FIXME: share the clip edge by having a winding direction flag?
             if (numbedges >= (MAX_BMODEL_EDGES - 1)) {
-                Com_Printf("Out of edges for bmodel\n");
+                r_band->outofbedges++;
                 return;
             }
 
@@ -244,7 +244,7 @@ void R_RecursiveClipBPoly(bedge_t *pedges, mnode_t *pnode, mface_t *psurf)
 // plane to both sides (but in opposite directions)
     if (makeclippededge) {
         if (numbedges >= (MAX_BMODEL_EDGES - 2)) {
-            Com_Error(ERR_DROP, "Out of edges for bmodel");
+            R_BandError(ERR_DROP, "Out of edges for bmodel");
         }
 
         ptedge = &pbedges[numbedges];
@@ -280,7 +280,7 @@ void R_RecursiveClipBPoly(bedge_t *pedges, mnode_t *pnode, mface_t *psurf)
                                 continue;       // not visible
                         }
 
-                        r_currentbkey = pl->key;
+                        r_currentbkey = r_band->leafkeys[pl - r_worldmodel->leafs];
                         R_RenderBmodelFace(psideedges[i], psurf);
                     }
                 } else {
@@ -385,7 +385,7 @@ void R_DrawSubmodelPolygons(mmodel_t *pmodel, int clipflags, mnode_t *topnode)
         // draw the polygon
         if (((psurf->drawflags & DSURF_PLANEBACK) && (dot < -BACKFACE_EPSILON)) ||
             (!(psurf->drawflags & DSURF_PLANEBACK) && (dot > BACKFACE_EPSILON))) {
-            r_currentkey = ((mleaf_t *)topnode)->key;
+            r_currentkey = r_band->leafkeys[(mleaf_t *)topnode - r_worldmodel->leafs];
 
             // FIXME: use bounding-box-based frustum clipping info?
             R_RenderFace(psurf, clipflags);
@@ -394,7 +394,7 @@ void R_DrawSubmodelPolygons(mmodel_t *pmodel, int clipflags, mnode_t *topnode)
 }
 
 
-int c_drawnode;
+R_TLS int c_drawnode;
 
 /*
 ================
@@ -458,6 +458,8 @@ void R_RecursiveWorldNode(mnode_t *node, int clipflags)
                     return;     // not visible
             }
 
+            // bands may mark the same faces concurrently, but they all
+            // store the same value
             mark = pleaf->firstleafface;
             c = pleaf->numleaffaces;
             if (c) {
@@ -467,7 +469,7 @@ void R_RecursiveWorldNode(mnode_t *node, int clipflags)
                 } while (--c);
             }
 
-            pleaf->key = r_currentkey;
+            r_band->leafkeys[pleaf - r_worldmodel->leafs] = r_currentkey;
             r_currentkey++;     // all bmodels in a leaf share the same key
             return;
         }
@@ -534,8 +536,6 @@ void R_RenderWorld(void)
 
     c_drawnode = 0;
 
-    // auto cycle the world frame for texture animation
-    r_worldentity.frame = (int)(r_newrefdef.time * 2);
     currententity = &r_worldentity;
 
     VectorCopy(r_origin, modelorg);
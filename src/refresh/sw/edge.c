@@ -43,40 +43,38 @@ have a sentinal at both ends?
 */
 
 
-edge_t  *auxedges;
-edge_t  *r_edges, *edge_p, *edge_max;
+R_TLS edge_t  *r_edges, *edge_p, *edge_max;
 
-surf_t  *auxsurfaces;
-surf_t  *surfaces, *surface_p, *surf_max;
+R_TLS surf_t  *surfaces, *surface_p, *surf_max;
 
 // surfaces are generated in back to front order by the bsp, so if a surf
 // pointer is greater than another one, it should be drawn in front
 // surfaces[1] is the background, and is used as the active surface stack
 
-edge_t  *newedges[MAXHEIGHT];
-edge_t  *removeedges[MAXHEIGHT];
+R_TLS edge_t  *newedges[MAXHEIGHT];
+R_TLS edge_t  *removeedges[MAXHEIGHT];
 
-espan_t *span_p, *max_span_p;
+R_TLS espan_t *span_p, *max_span_p;
 
-int     r_currentkey;
+R_TLS int     r_currentkey;
 
-int current_iv;
+R_TLS int current_iv;
 
-int edge_head_u_shift20, edge_tail_u_shift20;
+R_TLS int edge_head_u_shift20, edge_tail_u_shift20;
 
-static void (*pdrawfunc)(void);
+static R_TLS void (*pdrawfunc)(void);
 
-edge_t  edge_head;
-edge_t  edge_tail;
-edge_t  edge_aftertail;
-edge_t  edge_sentinel;
+R_TLS edge_t  edge_head;
+R_TLS edge_t  edge_tail;
+R_TLS edge_t  edge_aftertail;
+R_TLS edge_t  edge_sentinel;
 
-float   fv;
+R_TLS float   fv;
 
-static int  miplevel;
+static R_TLS int  miplevel;
 
-float       scale_for_mip;
-int         ubasestep, errorterm, erroradjustup, erroradjustdown;
+R_TLS float       scale_for_mip;
+R_TLS int         ubasestep, errorterm, erroradjustup, erroradjustdown;
 
 // FIXME: should go away
 extern void         R_RotateBmodel(void);
@@ -691,11 +689,11 @@ SURFACE FILLING
 =========================================================================
 */
 
-mface_t     *pface;
-surfcache_t     *pcurrentcache;
-vec3_t          transformed_modelorg;
-vec3_t          world_transformed_modelorg;
-vec3_t          local_modelorg;
+R_TLS mface_t     *pface;
+R_TLS surfcache_t     *pcurrentcache;
+R_TLS vec3_t          transformed_modelorg;
+R_TLS vec3_t          world_transformed_modelorg;
+R_TLS vec3_t          local_modelorg;
 
 /*
 =============
@@ -857,9 +855,9 @@ void D_TurbulentSurf(surf_t *s)
 
     // textures that aren't warping are just flowing. Use blanktable instead.
     if (!(pface->texinfo->c.flags & SURF_WARP))
-        D_DrawTurbulent16(s->spans, blanktable);
+        sw_kernels->drawturbulent(s->spans, blanktable);
     else
-        D_DrawTurbulent16(s->spans, sintable);
+        sw_kernels->drawturbulent(s->spans, sintable);
 
     D_DrawZSpans(s->spans);
 
@@ -901,7 +899,7 @@ void D_SkySurf(surf_t *s)
 
         D_CalcGradients(pface);
 
-        D_DrawSpans16(s->spans);
+        sw_kernels->drawspans(s->spans);
     }
 
 // set up a gradient for the background surface that places it
@@ -952,7 +950,7 @@ void D_SolidSurf(surf_t *s)
 
     D_CalcGradients(pface);
 
-    D_DrawSpans16(s->spans);
+    sw_kernels->drawspans(s->spans);
 
     D_DrawZSpans(s->spans);
 
@@ -31,21 +31,6 @@ void IMG_Unload(image_t *image)
     image->pixels[0] = NULL;
 }
 
-static void R_LightScaleTexture(byte *in, int inwidth, int inheight)
-{
-    int     i, c;
-    byte    *p;
-
-    p = in;
-    c = inwidth * inheight;
-
-    for (i = 0; i < c; i++, p += TEX_BYTES) {
-        p[0] = gammatable[p[0]];
-        p[1] = gammatable[p[1]];
-        p[2] = gammatable[p[2]];
-    }
-}
-
 /*
 ================
 IMG_Load
@@ -73,7 +58,7 @@ void IMG_Load(image_t *image, byte *pic, int width, int height)
             }
 
             if (!(r_config.flags & QVF_GAMMARAMP))
-                R_LightScaleTexture(image->pixels[0], MIPSIZE(c), 1);
+                IMG_LightScaleTexture(image->pixels[0], MIPSIZE(c), 1, gammatable);
         } else {
             image->pixels[0] = R_Malloc(c * TEX_BYTES);
             for (i = 0; i < c; i++) {
@@ -94,7 +79,7 @@ void IMG_Load(image_t *image, byte *pic, int width, int height)
         image->pixels[3] = image->pixels[2] + b * TEX_BYTES / 16;
 
         if (!(r_config.flags & QVF_GAMMARAMP))
-            R_LightScaleTexture(pic, width, height);
+            IMG_LightScaleTexture(pic, width, height, gammatable);
 
         if (width == image->width && height == image->height)
             memcpy(image->pixels[0], pic, width * height * TEX_BYTES);
@@ -118,7 +103,7 @@ void IMG_Load(image_t *image, byte *pic, int width, int height)
     }
 
     if (image->type == IT_SKIN && !(r_config.flags & QVF_GAMMARAMP))
-        R_LightScaleTexture(image->pixels[0], width, height);
+        IMG_LightScaleTexture(image->pixels[0], width, height, gammatable);
 }
 
 void R_BuildGammaTable(void)
@@ -189,7 +189,7 @@ void R_LightPoint(vec3_t p, vec3_t color)
 
 //===================================================================
 
-blocklight_t        blocklights[MAX_BLOCKLIGHTS * LIGHTMAP_BYTES];
+R_TLS blocklight_t        blocklights[MAX_BLOCKLIGHTS * LIGHTMAP_BYTES];
 
 /*
 ===============
@@ -312,7 +312,7 @@ void R_BuildLightMap(void)
     tmax = T_MAX(surf);
     size = smax * tmax;
     if (size > MAX_BLOCKLIGHTS) {
-        Com_Error(ERR_DROP, "R_BuildLightMap: surface blocklights size %i > %i", size, MAX_BLOCKLIGHTS);
+        R_BandError(ERR_DROP, "R_BuildLightMap: surface blocklights size %i > %i", size, MAX_BLOCKLIGHTS);
     }
 
 // clear to no light
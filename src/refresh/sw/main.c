@@ -26,7 +26,7 @@ refcfg_t    r_config;
 entity_t    r_worldentity;
 
 refdef_t    r_newrefdef;
-model_t     *currentmodel;
+R_TLS model_t     *currentmodel;
 
 bsp_t       *r_worldmodel;
 
@@ -35,58 +35,58 @@ byte        r_warpbuffer[WARP_WIDTH * WARP_HEIGHT * VID_BYTES];
 float       r_time1;
 int         r_numallocatededges;
 float       r_aliasuvscale = 1.0;
-int         r_outofsurfaces;
-int         r_outofedges;
+R_TLS int         r_outofsurfaces;
+R_TLS int         r_outofedges;
 
 qboolean    r_dowarp;
 
-int         c_surf;
+R_TLS int         c_surf;
 int         r_maxsurfsseen, r_maxedgesseen, r_cnumsurfs;
-int         r_clipflags;
+R_TLS int         r_clipflags;
 
 //
 // view origin
 //
-vec3_t  vup, base_vup;
-vec3_t  vpn, base_vpn;
-vec3_t  vright, base_vright;
-vec3_t  r_origin;
+R_TLS vec3_t  vup, base_vup;
+R_TLS vec3_t  vpn, base_vpn;
+R_TLS vec3_t  vright, base_vright;
+R_TLS vec3_t  r_origin;
 
 //
 // screen size info
 //
-oldrefdef_t r_refdef;
-float       xcenter, ycenter;
-float       xscale, yscale;
-float       xscaleinv, yscaleinv;
-float       xscaleshrink, yscaleshrink;
-float       aliasxscale, aliasyscale, aliasxcenter, aliasycenter;
+R_TLS oldrefdef_t r_refdef;
+R_TLS float       xcenter, ycenter;
+R_TLS float       xscale, yscale;
+R_TLS float       xscaleinv, yscaleinv;
+R_TLS float       xscaleshrink, yscaleshrink;
+R_TLS float       aliasxscale, aliasyscale, aliasxcenter, aliasycenter;
 
-int     r_screenrowbytes;
+R_TLS int     r_screenrowbytes;
 
-float   verticalFieldOfView;
-float   xOrigin, yOrigin;
+R_TLS float   verticalFieldOfView;
+R_TLS float   xOrigin, yOrigin;
 
-cplane_t    screenedge[4];
+R_TLS cplane_t    screenedge[4];
 
 //
 // refresh flags
 //
 int     r_framecount = 1;   // so frame counts initialized to 0 don't match
 int     r_visframecount;
-int     d_spanpixcount;
-int     r_polycount;
-int     r_drawnpolycount;
-int     r_wholepolycount;
+R_TLS int     d_spanpixcount;
+R_TLS int     r_polycount;
+R_TLS int     r_drawnpolycount;
+R_TLS int     r_wholepolycount;
 
-int         *pfrustum_indexes[4];
-int         r_frustum_indexes[4 * 6];
+R_TLS int         *pfrustum_indexes[4];
+R_TLS int         r_frustum_indexes[4 * 6];
 
 mleaf_t     *r_viewleaf;
 int         r_viewcluster, r_oldviewcluster;
 
-float   da_time1, da_time2, dp_time1, dp_time2, db_time1, db_time2, rw_time1, rw_time2;
-float   se_time1, se_time2, de_time1, de_time2;
+R_TLS float   da_time1, da_time2, dp_time1, dp_time2, db_time1, db_time2, rw_time1, rw_time2;
+R_TLS float   se_time1, se_time2, de_time1, de_time2;
 
 void R_MarkLeaves(void);
 
@@ -142,18 +142,18 @@ void            *d_pcolormap;
 // FIXME: make into one big structure, like cl or sv
 // FIXME: do separately for refresh engine and driver
 
-float   d_sdivzstepu, d_tdivzstepu, d_zistepu;
-float   d_sdivzstepv, d_tdivzstepv, d_zistepv;
-float   d_sdivzorigin, d_tdivzorigin, d_ziorigin;
+R_TLS float   d_sdivzstepu, d_tdivzstepu, d_zistepu;
+R_TLS float   d_sdivzstepv, d_tdivzstepv, d_zistepv;
+R_TLS float   d_sdivzorigin, d_tdivzorigin, d_ziorigin;
 
-fixed16_t   sadjust, tadjust, bbextents, bbextentt;
+R_TLS fixed16_t   sadjust, tadjust, bbextents, bbextentt;
 
-pixel_t         *cacheblock;
-int             cachewidth;
-pixel_t         *d_viewbuffer;
+R_TLS pixel_t         *cacheblock;
+R_TLS int             cachewidth;
+R_TLS pixel_t         *d_viewbuffer;
 short           *d_pzbuffer;
-unsigned int    d_zrowbytes;
-unsigned int    d_zwidth;
+R_TLS unsigned int    d_zrowbytes;
+R_TLS unsigned int    d_zwidth;
 
 #endif  // !USE_ASM
 
@@ -177,6 +177,161 @@ void R_InitTurb(void)
     }
 }
 
+static const swkernels_t sw_kernels_c = {
+    "C",
+    D_DrawSpans16,
+    D_DrawTurbulent16,
+    {
+        R_DrawSurfaceBlock8_mip0,
+        R_DrawSurfaceBlock8_mip1,
+        R_DrawSurfaceBlock8_mip2,
+        R_DrawSurfaceBlock8_mip3
+    },
+    R_PolysetDrawSpans8_Opaque,
+    R_PolysetDrawSpans8_Blended
+};
+
+#if USE_SW_X86
+// 32 bit multiplies and gathers needed for alias model spans are AVX2 only
+static const swkernels_t sw_kernels_sse2 = {
+    "SSE2",
+    D_DrawSpans16_SSE2,
+    D_DrawTurbulent16_SSE2,
+    {
+        R_DrawSurfaceBlock8_mip0_SSE2,
+        R_DrawSurfaceBlock8_mip1_SSE2,
+        R_DrawSurfaceBlock8_mip2_SSE2,
+        R_DrawSurfaceBlock8_mip3_SSE2
+    },
+    R_PolysetDrawSpans8_Opaque,
+    R_PolysetDrawSpans8_Blended
+};
+
+static const swkernels_t sw_kernels_avx2 = {
+    "AVX2",
+    D_DrawSpans16_AVX2,
+    D_DrawTurbulent16_AVX2,
+    {
+        R_DrawSurfaceBlock8_mip0_AVX2,
+        R_DrawSurfaceBlock8_mip1_AVX2,
+        R_DrawSurfaceBlock8_mip2_SSE2,
+        R_DrawSurfaceBlock8_mip3_SSE2
+    },
+    R_PolysetDrawSpans8_Opaque_AVX2,
+    R_PolysetDrawSpans8_Blended_AVX2
+};
+#endif
+
+const swkernels_t   *sw_kernels = &sw_kernels_c;
+
+static qboolean R_KernelsSupported(const swkernels_t *kernels)
+{
+#if USE_SW_X86
+    __builtin_cpu_init();
+    if (kernels == &sw_kernels_avx2)
+        return __builtin_cpu_supports("avx2");
+    if (kernels == &sw_kernels_sse2)
+        return __builtin_cpu_supports("sse2");
+#endif
+    return qtrue;
+}
+
+static const swkernels_t *R_BestKernels(void)
+{
+#if USE_SW_X86
+    if (R_KernelsSupported(&sw_kernels_avx2))
+        return &sw_kernels_avx2;
+    if (R_KernelsSupported(&sw_kernels_sse2))
+        return &sw_kernels_sse2;
+#endif
+    return &sw_kernels_c;
+}
+
+#if USE_TESTS
+
+/*
+================
+R_KernelBench_f
+
+Renders the last frame repeatedly with each set of pixel kernels supported by
+the CPU, checking the 3D view against the C kernels and printing frame rates
+with the surface cache kept and flushed every frame.
+================
+*/
+static void R_KernelBench_f(void)
+{
+    static const swkernels_t *const sets[] = {
+        &sw_kernels_c,
+#if USE_SW_X86
+        &sw_kernels_sse2,
+        &sw_kernels_avx2,
+#endif
+    };
+    const swkernels_t *active = sw_kernels;
+    refdef_t fd = r_newrefdef;
+    byte *ref, *row, *src;
+    int i, j, x, y, frames, rowbytes, diff;
+    uint64_t start, cached, flushed;
+
+    if (!r_worldmodel || !fd.width || !fd.height) {
+        Com_Printf("No frame to render.\n");
+        return;
+    }
+
+    frames = Cmd_Argc() > 1 ? atoi(Cmd_Argv(1)) : 100;
+    clamp(frames, 1, 10000);
+
+    rowbytes = fd.width * VID_BYTES;
+    ref = Z_Malloc(rowbytes * fd.height);
+
+    for (i = 0; i < q_countof(sets); i++) {
+        if (!R_KernelsSupported(sets[i]))
+            continue;
+
+        sw_kernels = sets[i];
+        D_FlushCaches();
+        R_RenderFrame(&fd);
+
+        // compare colors only, the fourth byte of each pixel is unused
+        diff = 0;
+        for (y = 0; y < fd.height; y++) {
+            src = vid.buffer + (fd.y + y) * vid.rowbytes + fd.x * VID_BYTES;
+            row = ref + y * rowbytes;
+            if (!i) {
+                memcpy(row, src, rowbytes);
+                continue;
+            }
+            for (x = 0; x < rowbytes; x += VID_BYTES)
+                if (memcmp(row + x, src + x, 3))
+                    diff++;
+        }
+
+        start = Sys_Microseconds();
+        for (j = 0; j < frames; j++)
+            R_RenderFrame(&fd);
+        cached = Sys_Microseconds() - start;
+
+        start = Sys_Microseconds();
+        for (j = 0; j < frames; j++) {
+            D_FlushCaches();
+            R_RenderFrame(&fd);
+        }
+        flushed = Sys_Microseconds() - start;
+
+        Com_Printf("%s kernels: %.1f fps, %.1f fps flushing surface cache%s\n",
+                   sets[i]->name, frames * 1e6 / max(cached, 1),
+                   frames * 1e6 / max(flushed, 1), sets[i] == active ? " (active)" : "");
+        if (diff)
+            Com_EPrintf("%s kernels: %d pixels differ from reference\n", sets[i]->name, diff);
+    }
+
+    sw_kernels = active;
+    D_FlushCaches();
+    Z_Free(ref);
+}
+
+#endif // USE_TESTS
+
 void D_SCDump_f(void);
 
 void R_Register(void)
@@ -196,6 +351,7 @@ void R_Register(void)
     sw_waterwarp = Cvar_Get("sw_waterwarp", "1", 0);
     sw_dynamic = Cvar_Get("sw_dynamic", "1", 0);
     sw_modulate = Cvar_Get("sw_modulate", "1", 0);
+    sw_threads = Cvar_Get("sw_threads", "0", 0);
 
     //Start Added by Lewey
     sw_drawsird = Cvar_Get("sw_drawsird", "0", 0);
@@ -212,6 +368,9 @@ void R_Register(void)
     vid_gamma = Cvar_Get("vid_gamma", "1.0", CVAR_ARCHIVE | CVAR_FILES);
 
     Cmd_AddCommand("scdump", D_SCDump_f);
+#if USE_TESTS
+    Cmd_AddCommand("swbench", R_KernelBench_f);
+#endif
 
 //PGM
     sw_lockpvs = Cvar_Get("sw_lockpvs", "0", 0);
@@ -222,6 +381,9 @@ void R_Register(void)
 void R_UnRegister(void)
 {
     Cmd_RemoveCommand("scdump");
+#if USE_TESTS
+    Cmd_RemoveCommand("swbench");
+#endif
 }
 
 void R_ModeChanged(int width, int height, int flags, int rowbytes, void *pixels)
@@ -284,6 +446,11 @@ qboolean R_Init(qboolean total)
 
     R_Register();
 
+    sw_kernels = R_BestKernels();
+    Com_DPrintf("Using %s pixel kernels\n", sw_kernels->name);
+
+    R_InitBands();
+
     IMG_Init();
     MOD_Init();
 
@@ -292,18 +459,6 @@ qboolean R_Init(qboolean total)
 
     R_InitSkyBox();
 
-    view_clipplanes[0].leftedge = qtrue;
-    view_clipplanes[1].rightedge = qtrue;
-    view_clipplanes[1].leftedge =
-        view_clipplanes[2].leftedge =
-            view_clipplanes[3].leftedge = qfalse;
-    view_clipplanes[0].rightedge =
-        view_clipplanes[2].rightedge =
-            view_clipplanes[3].rightedge = qfalse;
-
-    r_refdef.xOrigin = XCENTERING;
-    r_refdef.yOrigin = YCENTERING;
-
     R_InitTurb();
 
     return qtrue;
@@ -324,15 +479,7 @@ void R_Shutdown(qboolean total)
 
     R_ShutdownImages();
 
-    if (auxsurfaces) {
-        Z_Free(auxsurfaces);
-        auxsurfaces = NULL;
-    }
-
-    if (auxedges) {
-        Z_Free(auxedges);
-        auxedges = NULL;
-    }
+    R_FreeBandData();
 
     // free world model
     if (r_worldmodel) {
@@ -344,6 +491,8 @@ void R_Shutdown(qboolean total)
         return;
     }
 
+    R_ShutdownBands();
+
     // free z buffer
     if (d_pzbuffer) {
         Z_Free(d_pzbuffer);
@@ -369,36 +518,13 @@ void R_NewMap(void)
 {
     r_viewcluster = -1;
 
-    if (auxsurfaces) {
-        Z_Free(auxsurfaces);
-        auxsurfaces = NULL;
-    }
-
-    if (auxedges) {
-        Z_Free(auxedges);
-        auxedges = NULL;
-    }
-
     r_cnumsurfs = Cvar_ClampInteger(sw_maxsurfs, MINSURFACES, MAXSURFACES);
-
-    if (r_cnumsurfs > NUMSTACKSURFACES) {
-        surfaces = auxsurfaces = R_Mallocz(r_cnumsurfs * sizeof(surf_t));
-        surface_p = surfaces;
-        surf_max = &surfaces[r_cnumsurfs];
-        // surface 0 doesn't really exist; it's just a dummy because index 0
-        // is used to indicate no edge attached to surface
-        surfaces--;
-        R_SurfacePatch();
-    }
+    r_numallocatededges = Cvar_ClampInteger(sw_maxedges, MINEDGES, MAXEDGES);
 
     r_maxedgesseen = 0;
     r_maxsurfsseen = 0;
 
-    r_numallocatededges = Cvar_ClampInteger(sw_maxedges, MINEDGES, MAXEDGES);
-
-    if (r_numallocatededges > NUMSTACKEDGES) {
-        auxedges = R_Mallocz(r_numallocatededges * sizeof(edge_t));
-    }
+    R_AllocBandData();
 }
 
 
@@ -507,10 +633,9 @@ static int R_DrawEntities(int translucent)
             case MOD_SPRITE:
                 R_DrawSprite();
                 break;
-            case MOD_EMPTY:
-                break;
             default:
-                Com_Error(ERR_FATAL, "%s: bad model type", __func__);
+                // checked by R_CheckEntities
+                break;
             }
         }
     }
@@ -676,6 +801,100 @@ void RotatedBBox(vec3_t mins, vec3_t maxs, vec3_t angles,
     }
 }
 
+/*
+=============
+R_CheckEntities
+
+Validates entities on the main thread before bands are rendered, since
+rendering threads can't raise errors or print anything. Bad frame and
+skin numbers are replaced silently by the alias model code.
+=============
+*/
+static void R_CheckEntities(void)
+{
+    int         i;
+    entity_t    *ent;
+    model_t     *model;
+
+    if (!r_drawentities->integer)
+        return;
+
+    for (i = 0; i < r_newrefdef.num_entities; i++) {
+        ent = &r_newrefdef.entities[i];
+        if (ent->flags & RF_BEAM)
+            continue;
+        if (ent->model & 0x80000000)
+            continue;   // checked by R_PushBEntityDlights
+
+        model = MOD_ForHandle(ent->model);
+        if (!model)
+            continue;
+
+        switch (model->type) {
+        case MOD_ALIAS:
+            if (ent->skin) {
+                IMG_ForHandle(ent->skin);   // raises error if out of range
+            } else if (ent->skinnum >= model->numskins || ent->skinnum < 0) {
+                Com_DPrintf("R_AliasSetupSkin %s: no such skin # %d\n",
+                            model->name, ent->skinnum);
+            } else if (!model->skins[ent->skinnum]) {
+                Com_DPrintf("R_AliasDrawModel %s: NULL skin found\n",
+                            model->name);
+            }
+            if (ent->frame >= model->numframes || ent->frame < 0)
+                Com_DPrintf("R_AliasSetupFrames: %s: no such thisframe %d\n",
+                            model->name, ent->frame);
+            if (ent->oldframe >= model->numframes || ent->oldframe < 0)
+                Com_DPrintf("R_AliasSetupFrames: %s: no such lastframe %d\n",
+                            model->name, ent->oldframe);
+            break;
+        case MOD_SPRITE:
+        case MOD_EMPTY:
+            break;
+        default:
+            Com_Error(ERR_FATAL, "%s: bad model type", __func__);
+        }
+    }
+}
+
+/*
+=============
+R_PushBEntityDlights
+
+Dynamic lighting is calculated for all bmodels up front, since surfaces
+are shared between bands.
+=============
+*/
+static void R_PushBEntityDlights(void)
+{
+    int         i, index;
+    mmodel_t    *model;
+    entity_t    *ent;
+
+    if (!r_drawentities->integer)
+        return;
+
+    for (i = 0; i < r_newrefdef.num_entities; i++) {
+        ent = &r_newrefdef.entities[i];
+        index = ent->model;
+        if (!(index & 0x80000000)) {
+            continue;
+        }
+        index = ~index;
+        if (index < 1 || index >= r_worldmodel->nummodels) {
+            Com_Error(ERR_DROP, "%s: inline model %d out of range",
+                      __func__, index);
+        }
+        model = &r_worldmodel->models[index];
+        if (model->numfaces == 0)
+            continue;   // clip brush only
+        if (ent->flags & RF_BEAM)
+            continue;
+
+        R_PushDlights(model->headnode);
+    }
+}
+
 /*
 =============
 R_DrawBEntitiesOnList
@@ -695,7 +914,6 @@ void R_DrawBEntitiesOnList(void)
 
     VectorCopy(modelorg, oldorigin);
     insubmodel = qtrue;
-    r_dlightframecount = r_framecount;
 
     for (i = 0; i < r_newrefdef.num_entities; i++) {
         currententity = &r_newrefdef.entities[i];
@@ -704,10 +922,8 @@ void R_DrawBEntitiesOnList(void)
             continue;
         }
         index = ~index;
-        if (index < 1 || index >= r_worldmodel->nummodels) {
-            Com_Error(ERR_DROP, "%s: inline model %d out of range",
-                      __func__, index);
-        }
+        if (index < 1 || index >= r_worldmodel->nummodels)
+            continue;   // checked by R_PushBEntityDlights
         model = &r_worldmodel->models[index];
         if (model->numfaces == 0)
             continue;   // clip brush only
@@ -734,9 +950,6 @@ void R_DrawBEntitiesOnList(void)
         // FIXME: stop transforming twice
         R_RotateBmodel();
 
-        // calculate dynamic lighting for bmodel
-        R_PushDlights(model->headnode);
-
         if (topnode->plane) {
             // not a leaf; has to be clipped to the world BSP
             r_clipflags = clipflags;
@@ -776,22 +989,24 @@ void R_EdgeDrawing(void)
     if (r_newrefdef.rdflags & RDF_NOWORLDMODEL)
         return;
 
-    if (auxedges) {
-        r_edges = auxedges;
+    if (r_band->auxedges) {
+        r_edges = r_band->auxedges;
     } else {
         r_edges = (edge_t *)
                   (((uintptr_t)&ledges[0] + CACHE_SIZE - 1) & ~(CACHE_SIZE - 1));
     }
 
-    if (!auxsurfaces) {
+    if (r_band->auxsurfaces) {
+        surfaces = r_band->auxsurfaces;
+    } else {
         surfaces = (surf_t *)
                    (((uintptr_t)&lsurfs[0] + CACHE_SIZE - 1) & ~(CACHE_SIZE - 1));
-        surf_max = &surfaces[r_cnumsurfs];
-        // surface 0 doesn't really exist; it's just a dummy because index 0
-        // is used to indicate no edge attached to surface
-        surfaces--;
-        R_SurfacePatch();
     }
+    surf_max = &surfaces[r_cnumsurfs];
+    // surface 0 doesn't really exist; it's just a dummy because index 0
+    // is used to indicate no edge attached to surface
+    surfaces--;
+    R_SurfacePatch();
 
     R_BeginEdgeFrame();
 
@@ -816,6 +1031,63 @@ void R_EdgeDrawing(void)
     R_ScanEdges();
 }
 
+/*
+================
+R_RenderBand
+
+Renders the given band of the view. May be called by any rendering thread.
+================
+*/
+void R_RenderBand(band_t *band)
+{
+    uint64_t    start = Sys_Microseconds();
+
+    r_band = band;
+
+    band->error[0] = 0;
+    band->outofbedges = 0;
+    if (setjmp(band->abortframe)) {
+        // R_BandError was called, drop the rest of the band
+        insubmodel = qfalse;
+        c_surf = 0;
+        return;
+    }
+
+    R_SetupView(band);
+
+    R_EdgeDrawing();
+
+    if (r_dspeeds->integer) {
+        se_time2 = Sys_Milliseconds();
+        de_time1 = se_time2;
+    }
+
+    R_DrawEntitiesOnList();
+
+    if (r_dspeeds->integer) {
+        de_time2 = Sys_Milliseconds();
+        dp_time1 = Sys_Milliseconds();
+    }
+
+    R_DrawParticles();
+
+    if (r_dspeeds->integer)
+        dp_time2 = Sys_Milliseconds();
+
+    R_DrawAlphaSurfaces();
+
+    band->faceclip = c_faceclip;
+    band->polycount = r_polycount;
+    band->drawnpolycount = r_drawnpolycount;
+    band->surfs = c_surf;
+    band->amodels = r_amodels_drawn;
+    band->outofsurfaces = r_outofsurfaces;
+    band->outofedges = r_outofedges;
+    c_surf = 0;
+
+    band->usec = Sys_Microseconds() - start;
+}
+
 //=======================================================================
 
 byte *IMG_ReadPixels(qboolean reverse, int *width, int *height)
@@ -870,8 +1142,8 @@ void R_RenderFrame(refdef_t *fd)
     if (!r_worldmodel && !(r_newrefdef.rdflags & RDF_NOWORLDMODEL))
         Com_Error(ERR_FATAL, "R_RenderView: NULL worldmodel");
 
-    VectorCopy(fd->vieworg, r_refdef.vieworg);
-    VectorCopy(fd->viewangles, r_refdef.viewangles);
+    if (sw_threads->modified)
+        R_InitBands();
 
     if (!sw_dynamic->integer)
         r_newrefdef.num_dlights = 0;
@@ -883,29 +1155,14 @@ void R_RenderFrame(refdef_t *fd)
 
     R_MarkLeaves();     // done here so we know if we're in water
 
-    if (r_worldmodel)
+    if (r_worldmodel) {
         R_PushDlights(r_worldmodel->nodes);
-
-    R_EdgeDrawing();
-
-    if (r_dspeeds->integer) {
-        se_time2 = Sys_Milliseconds();
-        de_time1 = se_time2;
+        R_PushBEntityDlights();
     }
 
-    R_DrawEntitiesOnList();
+    R_CheckEntities();
 
-    if (r_dspeeds->integer) {
-        de_time2 = Sys_Milliseconds();
-        dp_time1 = Sys_Milliseconds();
-    }
-
-    R_DrawParticles();
-
-    if (r_dspeeds->integer)
-        dp_time2 = Sys_Milliseconds();
-
-    R_DrawAlphaSurfaces();
+    R_RenderBands();
 
     //Start Replaced by Lewey
     if (sw_drawsird->integer && !(r_newrefdef.rdflags & RDF_NOWORLDMODEL)) {
@@ -927,8 +1184,11 @@ void R_RenderFrame(refdef_t *fd)
     if (sw_aliasstats->integer)
         R_PrintAliasStats();
 
-    if (r_speeds->integer)
+    if (r_speeds->integer) {
         R_PrintTimes();
+        if (r_numbands > 1)
+            R_PrintBandTimes();
+    }
 
     if (r_dspeeds->integer)
         R_PrintDSpeeds();
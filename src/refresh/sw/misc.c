@@ -29,12 +29,12 @@ float           d_scalemip[NUM_MIPS - 1];
 
 static const float  basemip[NUM_MIPS - 1] = {1.0, 0.5 * 0.8, 0.25 * 0.8};
 
-int d_vrectx, d_vrecty, d_vrectright_particle, d_vrectbottom_particle;
+R_TLS int d_vrectx, d_vrecty, d_vrectright_particle, d_vrectbottom_particle;
 
-int d_pix_min, d_pix_max, d_pix_shift;
+R_TLS int d_pix_min, d_pix_max, d_pix_shift;
 
-int     d_scantable[MAXHEIGHT];
-short   *zspantable[MAXHEIGHT];
+R_TLS int     d_scantable[MAXHEIGHT];
+R_TLS short   *zspantable[MAXHEIGHT];
 
 /*
 ================
@@ -96,14 +96,6 @@ void D_ViewChanged(void)
         zspantable[i] = d_pzbuffer + i * d_zwidth;
     }
 
-    /*
-    ** clear Z-buffer and color-buffers if we're doing the gallery
-    */
-    if (r_newrefdef.rdflags & RDF_NOWORLDMODEL) {
-        memset(d_pzbuffer, 0xff, vid.width * vid.height * sizeof(d_pzbuffer[0]));
-        R_DrawFill8(r_newrefdef.x, r_newrefdef.y, r_newrefdef.width, r_newrefdef.height, /*(int)sw_clearcolor->value & 0xff*/0);
-    }
-
     D_Patch();
 }
 
@@ -347,21 +339,32 @@ void R_ViewChanged(vrectSoft_t *vr)
 
 /*
 ===============
-R_SetupFrame
+R_SetupView
+
+Sets up view parameters for rendering the given band of the view, or
+the entire view if band is NULL. Called by each rendering thread.
 ===============
 */
-void R_SetupFrame(void)
+void R_SetupView(const band_t *band)
 {
-    int         i;
     vrectSoft_t     vrect;
+    float           s;
+    int             top, bottom;
 
-    if (r_fullbright->modified) {
-        r_fullbright->modified = qfalse;
-        D_FlushCaches();    // so all lighting changes
-    }
+    VectorCopy(r_newrefdef.vieworg, r_refdef.vieworg);
+    VectorCopy(r_newrefdef.viewangles, r_refdef.viewangles);
 
-    r_framecount++;
+    r_refdef.xOrigin = XCENTERING;
+    r_refdef.yOrigin = YCENTERING;
 
+    view_clipplanes[0].leftedge = qtrue;
+    view_clipplanes[1].rightedge = qtrue;
+    view_clipplanes[1].leftedge =
+        view_clipplanes[2].leftedge =
+            view_clipplanes[3].leftedge = qfalse;
+    view_clipplanes[0].rightedge =
+        view_clipplanes[2].rightedge =
+            view_clipplanes[3].rightedge = qfalse;
 
 // build the transformation matrix for the given view angles
     VectorCopy(r_refdef.vieworg, modelorg);
@@ -369,17 +372,6 @@ void R_SetupFrame(void)
 
     AngleVectors(r_refdef.viewangles, vpn, vright, vup);
 
-// current viewleaf
-    if (!(r_newrefdef.rdflags & RDF_NOWORLDMODEL)) {
-        r_viewleaf = BSP_PointLeaf(r_worldmodel->nodes, r_origin);
-        r_viewcluster = r_viewleaf->cluster;
-    }
-
-    if (sw_waterwarp->integer && (r_newrefdef.rdflags & RDF_UNDERWATER))
-        r_dowarp = qtrue;
-    else
-        r_dowarp = qfalse;
-
     if (r_dowarp) {
         // warp into off screen buffer
         vrect.x = 0;
@@ -401,6 +393,37 @@ void R_SetupFrame(void)
 
     R_ViewChanged(&vrect);
 
+// narrow the view down to the rows of the band, keeping projection intact
+    if (band) {
+        top = vrect.y + band->top;
+        bottom = vrect.y + band->bottom;
+
+        if (band->top > 0) {
+            s = (ycenter - (top - 0.5)) * yscaleinv;
+            VectorSet(screenedge[2].normal, 0, -1, s);
+            VectorNormalize(screenedge[2].normal);
+        }
+
+        if (band->bottom < vrect.height) {
+            s = (ycenter - (bottom - 0.5)) * yscaleinv;
+            VectorSet(screenedge[3].normal, 0, 1, -s);
+            VectorNormalize(screenedge[3].normal);
+        }
+
+        r_refdef.vrect.y = top;
+        r_refdef.vrect.height = bottom - top;
+        r_refdef.fvrecty = (float)top;
+        r_refdef.fvrecty_adj = (float)top - 0.5;
+        r_refdef.vrectbottom = bottom;
+        r_refdef.fvrectbottom = (float)bottom;
+        r_refdef.fvrectbottom_adj = (float)bottom - 0.5;
+
+        r_refdef.aliasvrect.y = (int)(top * r_aliasuvscale);
+        r_refdef.aliasvrect.height = (int)((bottom - top) * r_aliasuvscale);
+        r_refdef.aliasvrectbottom = r_refdef.aliasvrect.y +
+                                    r_refdef.aliasvrect.height;
+    }
+
 // start off with just the four screen edge clip planes
     R_TransformFrustum();
     R_SetUpFrustumIndexes();
@@ -419,12 +442,57 @@ void R_SetupFrame(void)
     r_amodels_drawn = 0;
     r_outofsurfaces = 0;
     r_outofedges = 0;
+}
+
+/*
+===============
+R_SetupFrame
+
+Sets up state shared by all bands. Called once per frame by the main thread.
+===============
+*/
+void R_SetupFrame(void)
+{
+    int         i;
+
+    if (r_fullbright->modified) {
+        r_fullbright->modified = qfalse;
+        D_FlushCaches();    // so all lighting changes
+    }
+
+    r_framecount++;
+
+    // auto cycle the world frame for texture animation
+    r_worldentity.frame = (int)(r_newrefdef.time * 2);
+
+// current viewleaf
+    if (!(r_newrefdef.rdflags & RDF_NOWORLDMODEL)) {
+        r_viewleaf = BSP_PointLeaf(r_worldmodel->nodes, r_newrefdef.vieworg);
+        r_viewcluster = r_viewleaf->cluster;
+    }
+
+    if (sw_waterwarp->integer && (r_newrefdef.rdflags & RDF_UNDERWATER))
+        r_dowarp = qtrue;
+    else
+        r_dowarp = qfalse;
 
 // d_setup
     d_minmip = Cvar_ClampInteger(sw_mipcap, 0, NUM_MIPS - 1);
 
     for (i = 0; i < (NUM_MIPS - 1); i++)
         d_scalemip[i] = basemip[i] * sw_mipscale->value;
+
+    R_SetupView(NULL);
+
+    R_SetupSkyBox();
+
+    /*
+    ** clear Z-buffer and color-buffers if we're doing the gallery
+    */
+    if (r_newrefdef.rdflags & RDF_NOWORLDMODEL) {
+        memset(d_pzbuffer, 0xff, vid.width * vid.height * sizeof(d_pzbuffer[0]));
+        R_DrawFill8(r_newrefdef.x, r_newrefdef.y, r_newrefdef.width, r_newrefdef.height, /*(int)sw_clearcolor->value & 0xff*/0);
+    }
 }
 
 /*
@@ -37,6 +37,14 @@ static void ProcessTexinfo(bsp_t *bsp)
     vec_t len1, len2;
     char name[MAX_QPATH];
 
+    // let replacement textures decode in parallel
+    tex = bsp->texinfo;
+    for (i = 0; i < bsp->numtexinfo; i++, tex++) {
+        Q_concat(name, sizeof(name), "textures/", tex->name, ".wal", NULL);
+        FS_NormalizePath(name, name);
+        IMG_Prefetch(name, IT_WALL);
+    }
+
     tex = bsp->texinfo;
     for (i = 0; i < bsp->numtexinfo; i++, tex++) {
         len1 = VectorLength(tex->axis[0]);
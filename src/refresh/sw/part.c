@@ -25,7 +25,7 @@ typedef struct {
     vec3_t      right, up, pn;
 } partparms_t;
 
-static partparms_t partparms;
+static R_TLS partparms_t partparms;
 
 /*
 ** R_DrawParticle
@@ -46,7 +46,7 @@ static void R_DrawParticle(void)
     float   zi;
     byte    *pdest;
     short   *pz;
-    int     i, izi, pix, count, u, v;
+    int     i, izi, pix, count, u, v, top, bottom;
 
     /*
     ** transform the particle
@@ -75,12 +75,6 @@ static void R_DrawParticle(void)
         return;
     }
 
-    /*
-    ** compute addresses of zbuffer, framebuffer, and
-    ** compute the Z-buffer reference value.
-    */
-    pz = d_pzbuffer + (d_zwidth * v) + u;
-    pdest = d_viewbuffer + d_scantable[v] + u * VID_BYTES;
     izi = (int)(zi * 0x8000);
 
     /*
@@ -93,10 +87,24 @@ static void R_DrawParticle(void)
     else if (pix > d_pix_max)
         pix = d_pix_max;
 
+    /*
+    ** only touch the rows of the band being rendered
+    */
+    top = max(v, r_refdef.vrect.y);
+    bottom = min(v + pix, r_refdef.vrectbottom);
+    if (top >= bottom)
+        return;
+
+    /*
+    ** compute addresses of zbuffer and framebuffer
+    */
+    pz = d_pzbuffer + (d_zwidth * top) + u;
+    pdest = d_viewbuffer + d_scantable[top] + u * VID_BYTES;
+
     /*
     ** render the appropriate pixels
     */
-    for (count = pix; count; count--, pz += d_zwidth, pdest += r_screenrowbytes) {
+    for (count = bottom - top; count; count--, pz += d_zwidth, pdest += r_screenrowbytes) {
         for (i = 0; i < pix; i++) {
             if (pz[i] <= izi) {
                 pz[i] = izi;
@@ -30,22 +30,23 @@ typedef struct {
     unsigned  u, v;
 } spanletvars_t;
 
-static spanletvars_t s_spanletvars;
+static R_TLS spanletvars_t s_spanletvars;
 
-static fixed8_t r_polyblendcolor[3];
+static R_TLS fixed8_t r_polyblendcolor[3];
 
-static espan_t  *s_polygon_spans;
+static R_TLS espan_t  *s_polygon_spans;
 
-static polydesc_t  r_polydesc;
+static R_TLS polydesc_t  r_polydesc;
 
-mface_t *r_alpha_surfaces;
+R_TLS mface_t *r_alpha_surfaces[MAX_ALPHA_SURFACES];
+R_TLS int r_numalphasurfaces;
 
-static int *r_turb_turb;
+static R_TLS int *r_turb_turb;
 
-static int      clip_current;
-static vec5_t   r_clip_verts[2][MAXWORKINGVERTS + 2];
+static R_TLS int      clip_current;
+static R_TLS vec5_t   r_clip_verts[2][MAXWORKINGVERTS + 2];
 
-static int      s_minindex, s_maxindex;
+static R_TLS int      s_minindex, s_maxindex;
 
 static void R_DrawPoly(int iswater);
 
@@ -569,7 +570,7 @@ static void R_ClipAndDrawPoly(float alpha, int isturbulent, int textured)
         if (nump < 3)
             return;
         if (nump > MAXWORKINGVERTS)
-            Com_Error(ERR_DROP, "R_ClipAndDrawPoly: too many points: %d", nump);
+            R_BandError(ERR_DROP, "R_ClipAndDrawPoly: too many points: %d", nump);
     }
 
 // transform vertices into viewspace and project
@@ -769,7 +770,7 @@ static void R_DrawPoly(int iswater)
 */
 void R_DrawAlphaSurfaces(void)
 {
-    mface_t *s = r_alpha_surfaces;
+    mface_t *s;
 
     //currentmodel = r_worldmodel;
 
@@ -777,7 +778,9 @@ void R_DrawAlphaSurfaces(void)
     modelorg[1] = -r_origin[1];
     modelorg[2] = -r_origin[2];
 
-    while (s) {
+    // surfaces were added front to back
+    while (r_numalphasurfaces) {
+        s = r_alpha_surfaces[--r_numalphasurfaces];
         R_BuildPolygonFromSurface(s);
 
 //=======
@@ -794,11 +797,7 @@ void R_DrawAlphaSurfaces(void)
             R_ClipAndDrawPoly(0.30f, (s->texinfo->c.flags & (SURF_WARP | SURF_FLOWING)), qtrue);
 //PGM
 //=======
-
-        s = s->next;
     }
-
-    r_alpha_surfaces = NULL;
 }
 
 /*
@@ -25,67 +25,59 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #define DPS_MAXSPANS            MAXHEIGHT+1
 // 1 extra for spanpackage that marks end
 
-// !!! if this is changed, it must be changed in asm_draw.h too !!!
-typedef struct {
-    void            *pdest;
-    short           *pz;
-    int             count;
-    byte            *ptex;
-    int             sfrac, tfrac, light, zi;
-} spanpackage_t;
-
+// edge vertexes are indexes into r_p, -1 if unused
 typedef struct {
     int     isflattop;
     int     numleftedges;
-    int     *pleftedgevert0;
-    int     *pleftedgevert1;
-    int     *pleftedgevert2;
+    int     leftedgevert0;
+    int     leftedgevert1;
+    int     leftedgevert2;
     int     numrightedges;
-    int     *prightedgevert0;
-    int     *prightedgevert1;
-    int     *prightedgevert2;
+    int     rightedgevert0;
+    int     rightedgevert1;
+    int     rightedgevert2;
 } edgetable_t;
 
-aliastriangleparms_t aliastriangleparms;
+R_TLS aliastriangleparms_t aliastriangleparms;
 
-int r_p0[6], r_p1[6], r_p2[6];
+R_TLS int r_p[3][6];
 
-int         d_xdenom;
+R_TLS int         d_xdenom;
 
-static const edgetable_t    *pedgetable;
+static R_TLS const edgetable_t    *pedgetable;
 
 static const edgetable_t    edgetables[12] = {
-    {0, 1, r_p0, r_p2, NULL, 2, r_p0, r_p1, r_p2},
-    {0, 2, r_p1, r_p0, r_p2, 1, r_p1, r_p2, NULL},
-    {1, 1, r_p0, r_p2, NULL, 1, r_p1, r_p2, NULL},
-    {0, 1, r_p1, r_p0, NULL, 2, r_p1, r_p2, r_p0},
-    {0, 2, r_p0, r_p2, r_p1, 1, r_p0, r_p1, NULL},
-    {0, 1, r_p2, r_p1, NULL, 1, r_p2, r_p0, NULL},
-    {0, 1, r_p2, r_p1, NULL, 2, r_p2, r_p0, r_p1},
-    {0, 2, r_p2, r_p1, r_p0, 1, r_p2, r_p0, NULL},
-    {0, 1, r_p1, r_p0, NULL, 1, r_p1, r_p2, NULL},
-    {1, 1, r_p2, r_p1, NULL, 1, r_p0, r_p1, NULL},
-    {1, 1, r_p1, r_p0, NULL, 1, r_p2, r_p0, NULL},
-    {0, 1, r_p0, r_p2, NULL, 1, r_p0, r_p1, NULL},
+    {0, 1, 0, 2, -1, 2, 0, 1, 2},
+    {0, 2, 1, 0, 2, 1, 1, 2, -1},
+    {1, 1, 0, 2, -1, 1, 1, 2, -1},
+    {0, 1, 1, 0, -1, 2, 1, 2, 0},
+    {0, 2, 0, 2, 1, 1, 0, 1, -1},
+    {0, 1, 2, 1, -1, 1, 2, 0, -1},
+    {0, 1, 2, 1, -1, 2, 2, 0, 1},
+    {0, 2, 2, 1, 0, 1, 2, 0, -1},
+    {0, 1, 1, 0, -1, 1, 1, 2, -1},
+    {1, 1, 2, 1, -1, 1, 0, 1, -1},
+    {1, 1, 1, 0, -1, 1, 2, 0, -1},
+    {0, 1, 0, 2, -1, 1, 0, 1, -1},
 };
 
 // FIXME: some of these can become statics
-int             a_sstepxfrac, a_tstepxfrac, r_lstepx, a_ststepxwhole;
-int             r_sstepx, r_tstepx, r_lstepy, r_sstepy, r_tstepy;
-int             r_zistepx, r_zistepy;
-int             d_aspancount, d_countextrastep;
-
-spanpackage_t           *a_spans;
-spanpackage_t           *d_pedgespanpackage;
-byte                    *d_pdest, *d_ptex;
-short                   *d_pz;
-int                     d_sfrac, d_tfrac, d_light, d_zi;
-int                     d_ptexextrastep, d_sfracextrastep;
-int                     d_tfracextrastep, d_lightextrastep, d_pdestextrastep;
-int                     d_lightbasestep, d_pdestbasestep, d_ptexbasestep;
-int                     d_sfracbasestep, d_tfracbasestep;
-int                     d_ziextrastep, d_zibasestep;
-int                     d_pzextrastep, d_pzbasestep;
+R_TLS int             a_sstepxfrac, a_tstepxfrac, r_lstepx, a_ststepxwhole;
+R_TLS int             r_sstepx, r_tstepx, r_lstepy, r_sstepy, r_tstepy;
+R_TLS int             r_zistepx, r_zistepy;
+R_TLS int             d_aspancount, d_countextrastep;
+
+R_TLS spanpackage_t           *a_spans;
+R_TLS spanpackage_t           *d_pedgespanpackage;
+R_TLS byte                    *d_pdest, *d_ptex;
+R_TLS short                   *d_pz;
+R_TLS int                     d_sfrac, d_tfrac, d_light, d_zi;
+R_TLS int                     d_ptexextrastep, d_sfracextrastep;
+R_TLS int                     d_tfracextrastep, d_lightextrastep, d_pdestextrastep;
+R_TLS int                     d_lightbasestep, d_pdestbasestep, d_ptexbasestep;
+R_TLS int                     d_sfracbasestep, d_tfracbasestep;
+R_TLS int                     d_ziextrastep, d_zibasestep;
+R_TLS int                     d_pzextrastep, d_pzbasestep;
 
 typedef struct {
     int     quotient;
@@ -96,15 +88,11 @@ static const adivtab_t  adivtab[32 * 32] = {
 #include "adivtab.h"
 };
 
-byte    *skintable[MAX_LBM_HEIGHT];
-int     skinwidth;
-byte    *skinstart;
+R_TLS byte    *skintable[MAX_LBM_HEIGHT];
+R_TLS int     skinwidth;
+R_TLS byte    *skinstart;
 
-void (*d_pdrawspans)(spanpackage_t *pspanpackage);
-
-void R_PolysetDrawSpansConstant8_Blended(spanpackage_t *pspanpackage);
-void R_PolysetDrawSpans8_Blended(spanpackage_t *pspanpackage);
-void R_PolysetDrawSpans8_Opaque(spanpackage_t *pspanpackage);
+R_TLS void (*d_pdrawspans)(spanpackage_t *pspanpackage);
 
 void R_PolysetCalcGradients(int skinwidth);
 void R_PolysetSetEdgeTable(void);
@@ -167,26 +155,26 @@ void R_DrawTriangle(void)
     if (d_xdenom < 0) {
         a_spans = spans;
 
-        r_p0[0] = aliastriangleparms.a->u;      // u
-        r_p0[1] = aliastriangleparms.a->v;      // v
-        r_p0[2] = aliastriangleparms.a->s;      // s
-        r_p0[3] = aliastriangleparms.a->t;      // t
-        r_p0[4] = aliastriangleparms.a->l;      // light
-        r_p0[5] = aliastriangleparms.a->zi;     // iz
-
-        r_p1[0] = aliastriangleparms.b->u;
-        r_p1[1] = aliastriangleparms.b->v;
-        r_p1[2] = aliastriangleparms.b->s;
-        r_p1[3] = aliastriangleparms.b->t;
-        r_p1[4] = aliastriangleparms.b->l;
-        r_p1[5] = aliastriangleparms.b->zi;
-
-        r_p2[0] = aliastriangleparms.c->u;
-        r_p2[1] = aliastriangleparms.c->v;
-        r_p2[2] = aliastriangleparms.c->s;
-        r_p2[3] = aliastriangleparms.c->t;
-        r_p2[4] = aliastriangleparms.c->l;
-        r_p2[5] = aliastriangleparms.c->zi;
+        r_p[0][0] = aliastriangleparms.a->u;      // u
+        r_p[0][1] = aliastriangleparms.a->v;      // v
+        r_p[0][2] = aliastriangleparms.a->s;      // s
+        r_p[0][3] = aliastriangleparms.a->t;      // t
+        r_p[0][4] = aliastriangleparms.a->l;      // light
+        r_p[0][5] = aliastriangleparms.a->zi;     // iz
+
+        r_p[1][0] = aliastriangleparms.b->u;
+        r_p[1][1] = aliastriangleparms.b->v;
+        r_p[1][2] = aliastriangleparms.b->s;
+        r_p[1][3] = aliastriangleparms.b->t;
+        r_p[1][4] = aliastriangleparms.b->l;
+        r_p[1][5] = aliastriangleparms.b->zi;
+
+        r_p[2][0] = aliastriangleparms.c->u;
+        r_p[2][1] = aliastriangleparms.c->v;
+        r_p[2][2] = aliastriangleparms.c->s;
+        r_p[2][3] = aliastriangleparms.c->t;
+        r_p[2][4] = aliastriangleparms.c->l;
+        r_p[2][5] = aliastriangleparms.c->zi;
 
         R_PolysetSetEdgeTable();
         R_RasterizeAliasPolySmooth();
@@ -338,10 +326,10 @@ void R_PolysetCalcGradients(int skinwidth)
     float   xstepdenominv, ystepdenominv, t0, t1;
     float   p01_minus_p21, p11_minus_p21, p00_minus_p20, p10_minus_p20;
 
-    p00_minus_p20 = r_p0[0] - r_p2[0];
-    p01_minus_p21 = r_p0[1] - r_p2[1];
-    p10_minus_p20 = r_p1[0] - r_p2[0];
-    p11_minus_p21 = r_p1[1] - r_p2[1];
+    p00_minus_p20 = r_p[0][0] - r_p[2][0];
+    p01_minus_p21 = r_p[0][1] - r_p[2][1];
+    p10_minus_p20 = r_p[1][0] - r_p[2][0];
+    p11_minus_p21 = r_p[1][1] - r_p[2][1];
 
     xstepdenominv = 1.0 / (float)d_xdenom;
 
@@ -350,29 +338,29 @@ void R_PolysetCalcGradients(int skinwidth)
 // ceil () for light so positive steps are exaggerated, negative steps
 // diminished,  pushing us away from underflow toward overflow. Underflow is
 // very visible, overflow is very unlikely, because of ambient lighting
-    t0 = r_p0[4] - r_p2[4];
-    t1 = r_p1[4] - r_p2[4];
+    t0 = r_p[0][4] - r_p[2][4];
+    t1 = r_p[1][4] - r_p[2][4];
     r_lstepx = (int)
                ceil((t1 * p01_minus_p21 - t0 * p11_minus_p21) * xstepdenominv);
     r_lstepy = (int)
                ceil((t1 * p00_minus_p20 - t0 * p10_minus_p20) * ystepdenominv);
 
-    t0 = r_p0[2] - r_p2[2];
-    t1 = r_p1[2] - r_p2[2];
+    t0 = r_p[0][2] - r_p[2][2];
+    t1 = r_p[1][2] - r_p[2][2];
     r_sstepx = (int)((t1 * p01_minus_p21 - t0 * p11_minus_p21) *
                      xstepdenominv);
     r_sstepy = (int)((t1 * p00_minus_p20 - t0 * p10_minus_p20) *
                      ystepdenominv);
 
-    t0 = r_p0[3] - r_p2[3];
-    t1 = r_p1[3] - r_p2[3];
+    t0 = r_p[0][3] - r_p[2][3];
+    t1 = r_p[1][3] - r_p[2][3];
     r_tstepx = (int)((t1 * p01_minus_p21 - t0 * p11_minus_p21) *
                      xstepdenominv);
     r_tstepy = (int)((t1 * p00_minus_p20 - t0 * p10_minus_p20) *
                      ystepdenominv);
 
-    t0 = r_p0[5] - r_p2[5];
-    t1 = r_p1[5] - r_p2[5];
+    t0 = r_p[0][5] - r_p[2][5];
+    t1 = r_p[1][5] - r_p[2][5];
     r_zistepx = (int)((t1 * p01_minus_p21 - t0 * p11_minus_p21) *
                       xstepdenominv);
     r_zistepy = (int)((t1 * p00_minus_p20 - t0 * p10_minus_p20) *
@@ -392,62 +380,73 @@ void R_PolysetCalcGradients(int skinwidth)
     a_ststepxwhole = skinwidth * (r_tstepx >> 16) + (r_sstepx >> 16) * TEX_BYTES;
 }
 
-void R_PolysetDrawSpans8_Blended(spanpackage_t *pspanpackage)
+/*
+================
+R_PolysetSpanLength
+
+Returns number of pixels in the next span and steps the span end.
+================
+*/
+static inline int R_PolysetSpanLength(const spanpackage_t *pspanpackage)
 {
-    int     lcount;
-    byte    *lpdest;
-    byte    *lptex;
-    int     lsfrac, ltfrac;
-    int     llight;
-    int     lzi;
-    short   *lpz;
+    int     lcount = d_aspancount - pspanpackage->count;
+
+    errorterm += erroradjustup;
+    if (errorterm >= 0) {
+        d_aspancount += d_countextrastep;
+        errorterm -= erroradjustdown;
+    } else {
+        d_aspancount += ubasestep;
+    }
+
+    return lcount;
+}
+
+static inline void R_PolysetBlendedPixels(const spanpackage_t *span, int lcount)
+{
+    byte    *lpdest = span->pdest;
+    byte    *lptex = span->ptex;
+    short   *lpz = span->pz;
+    int     lsfrac = span->sfrac;
+    int     ltfrac = span->tfrac;
+    int     llight = span->light;
+    int     lzi = span->zi;
     int     tmp[3];
 
     do {
-        lcount = d_aspancount - pspanpackage->count;
-
-        errorterm += erroradjustup;
-        if (errorterm >= 0) {
-            d_aspancount += d_countextrastep;
-            errorterm -= erroradjustdown;
-        } else {
-            d_aspancount += ubasestep;
+        if ((lzi >> 16) >= *lpz) {
+            tmp[0] = (lptex[0] * llight) >> 16;
+            tmp[1] = (lptex[1] * llight) >> 16;
+            tmp[2] = (lptex[2] * llight) >> 16;
+            lpdest[0] = (lpdest[0] * r_alias_one_minus_alpha + tmp[2] * r_alias_alpha) >> 8;
+            lpdest[1] = (lpdest[1] * r_alias_one_minus_alpha + tmp[1] * r_alias_alpha) >> 8;
+            lpdest[2] = (lpdest[2] * r_alias_one_minus_alpha + tmp[0] * r_alias_alpha) >> 8;
+            *lpz = lzi >> 16;
+        }
+        lpdest += VID_BYTES;
+        lzi += r_zistepx;
+        lpz++;
+        llight += r_lstepx;
+        lptex += a_ststepxwhole;
+        lsfrac += a_sstepxfrac;
+        lptex += (lsfrac >> 16) * TEX_BYTES;
+        lsfrac &= 0xFFFF;
+        ltfrac += a_tstepxfrac;
+        if (ltfrac & 0x10000) {
+            lptex += r_affinetridesc.skinwidth;
+            ltfrac &= 0xFFFF;
         }
+    } while (--lcount);
+}
 
-        if (lcount) {
-            lpdest = pspanpackage->pdest;
-            lptex = pspanpackage->ptex;
-            lpz = pspanpackage->pz;
-            lsfrac = pspanpackage->sfrac;
-            ltfrac = pspanpackage->tfrac;
-            llight = pspanpackage->light;
-            lzi = pspanpackage->zi;
+void R_PolysetDrawSpans8_Blended(spanpackage_t *pspanpackage)
+{
+    int     lcount;
 
-            do {
-                if ((lzi >> 16) >= *lpz) {
-                    tmp[0] = (lptex[0] * llight) >> 16;
-                    tmp[1] = (lptex[1] * llight) >> 16;
-                    tmp[2] = (lptex[2] * llight) >> 16;
-                    lpdest[0] = (lpdest[0] * r_alias_one_minus_alpha + tmp[2] * r_alias_alpha) >> 8;
-                    lpdest[1] = (lpdest[1] * r_alias_one_minus_alpha + tmp[1] * r_alias_alpha) >> 8;
-                    lpdest[2] = (lpdest[2] * r_alias_one_minus_alpha + tmp[0] * r_alias_alpha) >> 8;
-                    *lpz = lzi >> 16;
-                }
-                lpdest += VID_BYTES;
-                lzi += r_zistepx;
-                lpz++;
-                llight += r_lstepx;
-                lptex += a_ststepxwhole;
-                lsfrac += a_sstepxfrac;
-                lptex += (lsfrac >> 16) * TEX_BYTES;
-                lsfrac &= 0xFFFF;
-                ltfrac += a_tstepxfrac;
-                if (ltfrac & 0x10000) {
-                    lptex += r_affinetridesc.skinwidth;
-                    ltfrac &= 0xFFFF;
-                }
-            } while (--lcount);
-        }
+    do {
+        lcount = R_PolysetSpanLength(pspanpackage);
+        if (lcount)
+            R_PolysetBlendedPixels(pspanpackage, lcount);
 
         pspanpackage++;
     } while (pspanpackage->count != -999999);
@@ -461,15 +460,7 @@ void R_PolysetDrawSpansConstant8_Blended(spanpackage_t *pspanpackage)
     short   *lpz;
 
     do {
-        lcount = d_aspancount - pspanpackage->count;
-
-        errorterm += erroradjustup;
-        if (errorterm >= 0) {
-            d_aspancount += d_countextrastep;
-            errorterm -= erroradjustdown;
-        } else {
-            d_aspancount += ubasestep;
-        }
+        lcount = R_PolysetSpanLength(pspanpackage);
 
         if (lcount) {
             lpdest = pspanpackage->pdest;
@@ -493,65 +484,199 @@ void R_PolysetDrawSpansConstant8_Blended(spanpackage_t *pspanpackage)
 }
 
 #if !USE_ASM
+static inline void R_PolysetOpaquePixels(const spanpackage_t *span, int lcount)
+{
+    byte    *lpdest = span->pdest;
+    byte    *lptex = span->ptex;
+    short   *lpz = span->pz;
+    int     lsfrac = span->sfrac;
+    int     ltfrac = span->tfrac;
+    int     llight = span->light;
+    int     lzi = span->zi;
+
+    do {
+        if ((lzi >> 16) >= *lpz) {
+            lpdest[0] = (lptex[2] * llight) >> 16;
+            lpdest[1] = (lptex[1] * llight) >> 16;
+            lpdest[2] = (lptex[0] * llight) >> 16;
+            *lpz = lzi >> 16;
+        }
+        lpdest += VID_BYTES;
+        lzi += r_zistepx;
+        lpz++;
+        llight += r_lstepx;
+        lptex += a_ststepxwhole;
+        lsfrac += a_sstepxfrac;
+        lptex += (lsfrac >> 16) * TEX_BYTES;
+        lsfrac &= 0xFFFF;
+        ltfrac += a_tstepxfrac;
+        if (ltfrac & 0x10000) {
+            lptex += r_affinetridesc.skinwidth;
+            ltfrac &= 0xFFFF;
+        }
+    } while (--lcount);
+}
+
 void R_PolysetDrawSpans8_Opaque(spanpackage_t *pspanpackage)
 {
     int     lcount;
 
     do {
-        lcount = d_aspancount - pspanpackage->count;
+        lcount = R_PolysetSpanLength(pspanpackage);
+        if (lcount)
+            R_PolysetOpaquePixels(pspanpackage, lcount);
 
-        errorterm += erroradjustup;
-        if (errorterm >= 0) {
-            d_aspancount += d_countextrastep;
-            errorterm -= erroradjustdown;
-        } else {
-            d_aspancount += ubasestep;
+        pspanpackage++;
+    } while (pspanpackage->count != -999999);
+}
+#endif
+
+#if USE_SW_X86
+
+typedef struct {
+    __m256i     pix;        // texels
+    __m256i     light;
+    __m256i     pass;       // lanes that passed depth test
+} polylanes_t;
+
+/*
+================
+R_PolysetLanes_AVX2
+
+Depth tests and fetches texels for the next 8 pixels of the span, then steps
+the span past them. Affine stepping is done in closed form: after k pixels
+texture pointer has moved by k whole steps, plus a texel for each carry out of
+s fraction and a row for each carry out of t fraction.
+================
+*/
+static inline __attribute__((target("avx2")))
+void R_PolysetLanes_AVX2(polylanes_t *l, spanpackage_t *span)
+{
+    const __m256i   lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    __m256i         sfrac, tfrac, ofs, zi, z;
+
+    sfrac = _mm256_add_epi32(_mm256_set1_epi32(span->sfrac),
+                             _mm256_mullo_epi32(lane, _mm256_set1_epi32(a_sstepxfrac)));
+    tfrac = _mm256_add_epi32(_mm256_set1_epi32(span->tfrac),
+                             _mm256_mullo_epi32(lane, _mm256_set1_epi32(a_tstepxfrac)));
+    ofs = _mm256_mullo_epi32(lane, _mm256_set1_epi32(a_ststepxwhole));
+    ofs = _mm256_add_epi32(ofs, _mm256_slli_epi32(_mm256_srli_epi32(sfrac, 16), 2));
+    ofs = _mm256_add_epi32(ofs, _mm256_mullo_epi32(_mm256_srli_epi32(tfrac, 16),
+                                                   _mm256_set1_epi32(r_affinetridesc.skinwidth)));
+    l->pix = _mm256_i32gather_epi32((const int *)span->ptex, ofs, 1);
+
+    l->light = _mm256_add_epi32(_mm256_set1_epi32(span->light),
+                                _mm256_mullo_epi32(lane, _mm256_set1_epi32(r_lstepx)));
+
+    zi = _mm256_add_epi32(_mm256_set1_epi32(span->zi),
+                          _mm256_mullo_epi32(lane, _mm256_set1_epi32(r_zistepx)));
+    zi = _mm256_srai_epi32(zi, 16);
+    z = _mm256_cvtepi16_epi32(_mm_loadu_si128((__m128i *)span->pz));
+    l->pass = _mm256_xor_si256(_mm256_cmpgt_epi32(z, zi), _mm256_set1_epi32(-1));
+    z = _mm256_blendv_epi8(z, zi, l->pass);
+    z = _mm256_permute4x64_epi64(_mm256_packs_epi32(z, z), _MM_SHUFFLE(3, 1, 2, 0));
+    _mm_storeu_si128((__m128i *)span->pz, _mm256_castsi256_si128(z));
+
+    span->pz += 8;
+    span->pdest = (byte *)span->pdest + 8 * VID_BYTES;
+    span->zi += 8 * r_zistepx;
+    span->light += 8 * r_lstepx;
+    span->ptex += 8 * a_ststepxwhole;
+    span->sfrac += 8 * a_sstepxfrac;
+    span->ptex += (span->sfrac >> 16) * TEX_BYTES;
+    span->sfrac &= 0xFFFF;
+    span->tfrac += 8 * a_tstepxfrac;
+    span->ptex += (span->tfrac >> 16) * r_affinetridesc.skinwidth;
+    span->tfrac &= 0xFFFF;
+}
+
+// returns texel channel scaled by light, (tex[c] * light) >> 16
+static inline __attribute__((target("avx2")))
+__m256i R_PolysetShade_AVX2(const polylanes_t *l, int c)
+{
+    __m256i tex = _mm256_and_si256(_mm256_srli_epi32(l->pix, c * 8), _mm256_set1_epi32(255));
+
+    return _mm256_srai_epi32(_mm256_mullo_epi32(tex, l->light), 16);
+}
+
+// packs low bytes of 3 channels into pixels
+static inline __attribute__((target("avx2")))
+__m256i R_PolysetPack_AVX2(__m256i c0, __m256i c1, __m256i c2)
+{
+    const __m256i mask = _mm256_set1_epi32(255);
+
+    c0 = _mm256_and_si256(c0, mask);
+    c1 = _mm256_slli_epi32(_mm256_and_si256(c1, mask), 8);
+    c2 = _mm256_slli_epi32(_mm256_and_si256(c2, mask), 16);
+    return _mm256_or_si256(_mm256_or_si256(c0, c1), c2);
+}
+
+__attribute__((target("avx2")))
+void R_PolysetDrawSpans8_Opaque_AVX2(spanpackage_t *pspanpackage)
+{
+    spanpackage_t   span;
+    polylanes_t     l;
+    __m256i         pix;
+    int             *pdest;
+    int             lcount;
+
+    do {
+        lcount = R_PolysetSpanLength(pspanpackage);
+        span = *pspanpackage;
+
+        for (; lcount >= 8; lcount -= 8) {
+            pdest = span.pdest;
+            R_PolysetLanes_AVX2(&l, &span);
+            pix = R_PolysetPack_AVX2(R_PolysetShade_AVX2(&l, 2),
+                                     R_PolysetShade_AVX2(&l, 1),
+                                     R_PolysetShade_AVX2(&l, 0));
+            _mm256_maskstore_epi32(pdest, l.pass, pix);
         }
 
-        if (lcount) {
-            int     lsfrac, ltfrac;
-            byte    *lpdest;
-            byte    *lptex;
-            int     llight;
-            int     lzi;
-            short   *lpz;
+        if (lcount)
+            R_PolysetOpaquePixels(&span, lcount);
 
-            lpdest = pspanpackage->pdest;
-            lptex = pspanpackage->ptex;
-            lpz = pspanpackage->pz;
-            lsfrac = pspanpackage->sfrac;
-            ltfrac = pspanpackage->tfrac;
-            llight = pspanpackage->light;
-            lzi = pspanpackage->zi;
+        pspanpackage++;
+    } while (pspanpackage->count != -999999);
+}
 
-            do {
-                if ((lzi >> 16) >= *lpz) {
-                    lpdest[0] = (lptex[2] * llight) >> 16;
-                    lpdest[1] = (lptex[1] * llight) >> 16;
-                    lpdest[2] = (lptex[0] * llight) >> 16;
-                    *lpz = lzi >> 16;
-                }
-                lpdest += VID_BYTES;
-                lzi += r_zistepx;
-                lpz++;
-                llight += r_lstepx;
-                lptex += a_ststepxwhole;
-                lsfrac += a_sstepxfrac;
-                lptex += (lsfrac >> 16) * TEX_BYTES;
-                lsfrac &= 0xFFFF;
-                ltfrac += a_tstepxfrac;
-                if (ltfrac & 0x10000) {
-                    lptex += r_affinetridesc.skinwidth;
-                    ltfrac &= 0xFFFF;
-                }
-            } while (--lcount);
+__attribute__((target("avx2")))
+void R_PolysetDrawSpans8_Blended_AVX2(spanpackage_t *pspanpackage)
+{
+    const __m256i   mask = _mm256_set1_epi32(255);
+    __m256i         alpha = _mm256_set1_epi32(r_alias_alpha);
+    __m256i         one_minus_alpha = _mm256_set1_epi32(r_alias_one_minus_alpha);
+    __m256i         dst, c[3];
+    spanpackage_t   span;
+    polylanes_t     l;
+    int             *pdest;
+    int             i, lcount;
+
+    do {
+        lcount = R_PolysetSpanLength(pspanpackage);
+        span = *pspanpackage;
+
+        for (; lcount >= 8; lcount -= 8) {
+            pdest = span.pdest;
+            R_PolysetLanes_AVX2(&l, &span);
+            dst = _mm256_loadu_si256((__m256i *)pdest);
+            for (i = 0; i < 3; i++) {
+                c[i] = _mm256_and_si256(_mm256_srli_epi32(dst, i * 8), mask);
+                c[i] = _mm256_add_epi32(_mm256_mullo_epi32(c[i], one_minus_alpha),
+                                        _mm256_mullo_epi32(R_PolysetShade_AVX2(&l, 2 - i), alpha));
+                c[i] = _mm256_srai_epi32(c[i], 8);
+            }
+            _mm256_maskstore_epi32(pdest, l.pass, R_PolysetPack_AVX2(c[0], c[1], c[2]));
         }
 
+        if (lcount)
+            R_PolysetBlendedPixels(&span, lcount);
+
         pspanpackage++;
     } while (pspanpackage->count != -999999);
 }
-#endif
 
+#endif // USE_SW_X86
 
 /*
 ================
@@ -565,11 +690,11 @@ void R_RasterizeAliasPolySmooth(void)
     int             working_lstepx, originalcount;
     int             ystart;
 
-    plefttop = pedgetable->pleftedgevert0;
-    prighttop = pedgetable->prightedgevert0;
+    plefttop = r_p[pedgetable->leftedgevert0];
+    prighttop = r_p[pedgetable->rightedgevert0];
 
-    pleftbottom = pedgetable->pleftedgevert1;
-    prightbottom = pedgetable->prightedgevert1;
+    pleftbottom = r_p[pedgetable->leftedgevert1];
+    prightbottom = r_p[pedgetable->rightedgevert1];
 
     initialleftheight = pleftbottom[1] - plefttop[1];
     initialrightheight = prightbottom[1] - prighttop[1];
@@ -701,7 +826,7 @@ void R_RasterizeAliasPolySmooth(void)
         int     height;
 
         plefttop = pleftbottom;
-        pleftbottom = pedgetable->pleftedgevert2;
+        pleftbottom = r_p[pedgetable->leftedgevert2];
 
         height = pleftbottom[1] - plefttop[1];
 
@@ -823,7 +948,7 @@ void R_RasterizeAliasPolySmooth(void)
         d_aspancount = prightbottom[0] - prighttop[0];
 
         prighttop = prightbottom;
-        prightbottom = pedgetable->prightedgevert2;
+        prightbottom = r_p[pedgetable->rightedgevert2];
 
         height = prightbottom[1] - prighttop[1];
 
@@ -854,9 +979,9 @@ void R_PolysetSetEdgeTable(void)
 // determine which edges are right & left, and the order in which
 // to rasterize them
 //
-    if (r_p0[1] >= r_p1[1]) {
-        if (r_p0[1] == r_p1[1]) {
-            if (r_p0[1] < r_p2[1])
+    if (r_p[0][1] >= r_p[1][1]) {
+        if (r_p[0][1] == r_p[1][1]) {
+            if (r_p[0][1] < r_p[2][1])
                 pedgetable = &edgetables[2];
             else
                 pedgetable = &edgetables[5];
@@ -867,14 +992,14 @@ void R_PolysetSetEdgeTable(void)
         }
     }
 
-    if (r_p0[1] == r_p2[1]) {
+    if (r_p[0][1] == r_p[2][1]) {
         if (edgetableindex)
             pedgetable = &edgetables[8];
         else
             pedgetable = &edgetables[9];
 
         return;
-    } else if (r_p1[1] == r_p2[1]) {
+    } else if (r_p[1][1] == r_p[2][1]) {
         if (edgetableindex)
             pedgetable = &edgetables[10];
         else
@@ -883,10 +1008,10 @@ void R_PolysetSetEdgeTable(void)
         return;
     }
 
-    if (r_p0[1] > r_p2[1])
+    if (r_p[0][1] > r_p[2][1])
         edgetableindex += 2;
 
-    if (r_p1[1] > r_p2[1])
+    if (r_p[1][1] > r_p[2][1])
         edgetableindex += 4;
 
     pedgetable = &edgetables[edgetableindex];
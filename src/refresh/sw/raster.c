@@ -30,29 +30,29 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #define FRAMECOUNT_MASK         0x7FFFFFFFUL
 #endif
 
-uintptr_t   cacheoffset;
+R_TLS uintptr_t   cacheoffset;
 
-int         c_faceclip;                 // number of faces clipped
+R_TLS int         c_faceclip;                 // number of faces clipped
 
 
-clipplane_t *entity_clipplanes;
-clipplane_t view_clipplanes[4];
-clipplane_t world_clipplanes[16];
+R_TLS clipplane_t *entity_clipplanes;
+R_TLS clipplane_t view_clipplanes[4];
+R_TLS clipplane_t world_clipplanes[16];
 
-medge_t         *r_pedge;
+R_TLS medge_t         *r_pedge;
 
-qboolean        r_leftclipped, r_rightclipped;
-qboolean        r_nearzionly;
+R_TLS qboolean        r_leftclipped, r_rightclipped;
+R_TLS qboolean        r_nearzionly;
 
-mvertex_t   r_leftenter, r_leftexit;
-mvertex_t   r_rightenter, r_rightexit;
+R_TLS mvertex_t   r_leftenter, r_leftexit;
+R_TLS mvertex_t   r_rightenter, r_rightexit;
 
-int             r_emitted;
-float           r_nearzi;
-float           r_u1, r_v1, r_lzi1;
-int             r_ceilv1;
+R_TLS int             r_emitted;
+R_TLS float           r_nearzi;
+R_TLS float           r_u1, r_v1, r_lzi1;
+R_TLS int             r_ceilv1;
 
-qboolean        r_lastvertvalid;
+R_TLS qboolean        r_lastvertvalid;
 
 
 #if !USE_ASM
@@ -309,11 +309,11 @@ void R_ClipEdge(mvertex_t *pv0, mvertex_t *pv1, clipplane_t *clip)
 R_EmitCachedEdge
 ================
 */
-void R_EmitCachedEdge(void)
+static void R_EmitCachedEdge(uintptr_t offset)
 {
     edge_t      *pedge_t;
 
-    pedge_t = (edge_t *)((byte *)r_edges + r_pedge->cachededgeoffset);
+    pedge_t = (edge_t *)((byte *)r_edges + offset);
 
     if (!pedge_t->surfs[0])
         pedge_t->surfs[0] = surface_p - surfaces;
@@ -343,11 +343,13 @@ void R_RenderFace(mface_t *fa, int clipflags)
     msurfedge_t *surfedge;
     clipplane_t *pclip;
     qboolean    makeleftedge, makerightedge;
+    uintptr_t   *pcache;
+    int         num;
 
     // translucent surfaces are not drawn by the edge renderer
     if (fa->texinfo->c.flags & (SURF_TRANS33 | SURF_TRANS66)) {
-        fa->next = r_alpha_surfaces;
-        r_alpha_surfaces = fa;
+        if (r_numalphasurfaces < MAX_ALPHA_SURFACES)
+            r_alpha_surfaces[r_numalphasurfaces++] = fa;
         return;
     }
 
@@ -393,20 +395,23 @@ void R_RenderFace(mface_t *fa, int clipflags)
     for (i = 0; i < fa->numsurfedges; i++, surfedge++) {
         r_pedge = surfedge->edge;
 
+        // edge cache is private to the band
+        num = r_pedge - r_worldmodel->edges;
+        if (num < 0 || num >= r_worldmodel->numedges)
+            num = r_worldmodel->numedges + R_SkyEdgeNum(r_pedge);
+        pcache = &r_band->edgecache[num];
+
         // if the edge is cached, we can just reuse the edge
         if (!insubmodel) {
-            if (r_pedge->cachededgeoffset & FULLY_CLIPPED_CACHED) {
-                if ((r_pedge->cachededgeoffset & FRAMECOUNT_MASK) ==
-                    r_framecount) {
+            if (*pcache & FULLY_CLIPPED_CACHED) {
+                if ((*pcache & FRAMECOUNT_MASK) == r_framecount) {
                     r_lastvertvalid = qfalse;
                     continue;
                 }
             } else {
-                if ((((byte *)edge_p - (byte *)r_edges) >
-                     r_pedge->cachededgeoffset) &&
-                    (((edge_t *)((byte *)r_edges +
-                                 r_pedge->cachededgeoffset))->owner == r_pedge)) {
-                    R_EmitCachedEdge();
+                if ((((byte *)edge_p - (byte *)r_edges) > *pcache) &&
+                    (((edge_t *)((byte *)r_edges + *pcache))->owner == r_pedge)) {
+                    R_EmitCachedEdge(*pcache);
                     r_lastvertvalid = qfalse;
                     continue;
                 }
@@ -419,7 +424,7 @@ void R_RenderFace(mface_t *fa, int clipflags)
         R_ClipEdge(r_pedge->v[surfedge->vert    ],
                    r_pedge->v[surfedge->vert ^ 1],
                    pclip);
-        r_pedge->cachededgeoffset = cacheoffset;
+        *pcache = cacheoffset;
 
         if (r_leftclipped)
             makeleftedge = qtrue;
@@ -493,8 +498,8 @@ void R_RenderBmodelFace(bedge_t *pedges, mface_t *psurf)
     qboolean    makeleftedge, makerightedge;
 
     if (psurf->texinfo->c.flags & (SURF_TRANS33 | SURF_TRANS66)) {
-        psurf->next = r_alpha_surfaces;
-        r_alpha_surfaces = psurf;
+        if (r_numalphasurfaces < MAX_ALPHA_SURFACES)
+            r_alpha_surfaces[r_numalphasurfaces++] = psurf;
         return;
     }
 
@@ -77,143 +77,62 @@ void D_WarpScreen(void)
 
 /*
 =============
-D_DrawTurbulent16
+D_DrawSpan
+
+Draws spancount pixels of a span with constant s and t steps.
 =============
 */
-void D_DrawTurbulent16(espan_t *pspan, int *warptable)
+static inline void D_DrawSpan(byte *pdest, const byte *pbase, const int *turb,
+                              fixed16_t s, fixed16_t t, fixed16_t sstep,
+                              fixed16_t tstep, int spancount)
 {
-    int             count, spancount;
-    byte            *pbase, *pdest, *ptex;
-    fixed16_t       s, t, snext, tnext, sstep, tstep;
-    float           sdivz, tdivz, zi, z, du, dv, spancountminus1;
-    float           sdivz16stepu, tdivz16stepu, zi16stepu;
-    int             *turb;
-    int             turb_s, turb_t;
-
-    turb = warptable + ((int)(r_newrefdef.time * SPEED) & (CYCLE - 1));
-
-    sstep = 0;   // keep compiler happy
-    tstep = 0;   // ditto
-
-    pbase = (byte *)cacheblock;
-
-    sdivz16stepu = d_sdivzstepu * 16;
-    tdivz16stepu = d_tdivzstepu * 16;
-    zi16stepu = d_zistepu * 16;
+    const byte  *ptex;
 
     do {
-        pdest = (byte *)d_viewbuffer + d_scantable[pspan->v] + pspan->u * VID_BYTES;
-
-        count = pspan->count;
-
-        // calculate the initial s/z, t/z, 1/z, s, and t and clamp
-        du = (float)pspan->u;
-        dv = (float)pspan->v;
+        ptex = pbase + (s >> 16) * TEX_BYTES + (t >> 16) * cachewidth;
+        pdest[0] = ptex[2];
+        pdest[1] = ptex[1];
+        pdest[2] = ptex[0];
+        pdest += VID_BYTES;
+        s += sstep;
+        t += tstep;
+    } while (--spancount > 0);
+}
 
-        sdivz = d_sdivzorigin + dv * d_sdivzstepv + du * d_sdivzstepu;
-        tdivz = d_tdivzorigin + dv * d_tdivzstepv + du * d_tdivzstepu;
-        zi = d_ziorigin + dv * d_zistepv + du * d_zistepu;
-        z = (float)0x10000 / zi;    // prescale to 16.16 fixed-point
-
-        s = (int)(sdivz * z) + sadjust;
-        if (s > bbextents)
-            s = bbextents;
-        else if (s < 0)
-            s = 0;
-
-        t = (int)(tdivz * z) + tadjust;
-        if (t > bbextentt)
-            t = bbextentt;
-        else if (t < 0)
-            t = 0;
-
-        do {
-            // calculate s and t at the far end of the span
-            if (count >= 16)
-                spancount = 16;
-            else
-                spancount = count;
-
-            count -= spancount;
-
-            if (q_likely(count)) {
-                // calculate s/z, t/z, zi->fixed s and t at far end of span,
-                // calculate s and t steps across span by shifting
-                sdivz += sdivz16stepu;
-                tdivz += tdivz16stepu;
-                zi += zi16stepu;
-                z = (float)0x10000 / zi;    // prescale to 16.16 fixed-point
-
-                snext = (int)(sdivz * z) + sadjust;
-                if (snext > bbextents)
-                    snext = bbextents;
-                else if (snext < 16)
-                    snext = 16; // prevent round-off error on <0 steps from
-                                // from causing overstepping & running off the
-                                // edge of the texture
-
-                tnext = (int)(tdivz * z) + tadjust;
-                if (tnext > bbextentt)
-                    tnext = bbextentt;
-                else if (tnext < 16)
-                    tnext = 16; // guard against round-off error on <0 steps
-
-                sstep = (snext - s) >> 4;
-                tstep = (tnext - t) >> 4;
-            } else {
-                // calculate s/z, t/z, zi->fixed s and t at last pixel in span (so
-                // can't step off polygon), clamp, calculate s and t steps across
-                // span by division, biasing steps low so we don't run off the
-                // texture
-                spancountminus1 = (float)(spancount - 1);
-                sdivz += d_sdivzstepu * spancountminus1;
-                tdivz += d_tdivzstepu * spancountminus1;
-                zi += d_zistepu * spancountminus1;
-                z = (float)0x10000 / zi;    // prescale to 16.16 fixed-point
-
-                snext = (int)(sdivz * z) + sadjust;
-                if (snext > bbextents)
-                    snext = bbextents;
-                else if (snext < 16)
-                    snext = 16; // prevent round-off error on <0 steps from
-                                // from causing overstepping & running off the
-                                // edge of the texture
-
-                tnext = (int)(tdivz * z) + tadjust;
-                if (tnext > bbextentt)
-                    tnext = bbextentt;
-                else if (tnext < 16)
-                    tnext = 16; // guard against round-off error on <0 steps
-
-                if (spancount > 1) {
-                    sstep = (snext - s) / (spancount - 1);
-                    tstep = (tnext - t) / (spancount - 1);
-                }
-            }
-
-            s = s & ((CYCLE << 16) - 1);
-            t = t & ((CYCLE << 16) - 1);
+static inline void D_DrawTurbulentSpan(byte *pdest, const byte *pbase, const int *turb,
+                                       fixed16_t s, fixed16_t t, fixed16_t sstep,
+                                       fixed16_t tstep, int spancount)
+{
+    const byte  *ptex;
+    int         turb_s, turb_t;
 
-            do {
-                turb_s = ((s + turb[(t >> 16) & (CYCLE - 1)]) >> 16) & 63;
-                turb_t = ((t + turb[(s >> 16) & (CYCLE - 1)]) >> 16) & 63;
-                ptex = pbase + (turb_t * 64 * TEX_BYTES) + turb_s * TEX_BYTES;
-                pdest[0] = ptex[2];
-                pdest[1] = ptex[1];
-                pdest[2] = ptex[0];
-                pdest += VID_BYTES;
-                s += sstep;
-                t += tstep;
-            } while (--spancount > 0);
-
-            s = snext;
-            t = tnext;
-
-        } while (count > 0);
+    s = s & ((CYCLE << 16) - 1);
+    t = t & ((CYCLE << 16) - 1);
 
-    } while ((pspan = pspan->pnext) != NULL);
+    do {
+        turb_s = ((s + turb[(t >> 16) & (CYCLE - 1)]) >> 16) & 63;
+        turb_t = ((t + turb[(s >> 16) & (CYCLE - 1)]) >> 16) & 63;
+        ptex = pbase + (turb_t * 64 * TEX_BYTES) + turb_s * TEX_BYTES;
+        pdest[0] = ptex[2];
+        pdest[1] = ptex[1];
+        pdest[2] = ptex[0];
+        pdest += VID_BYTES;
+        s += sstep;
+        t += tstep;
+    } while (--spancount > 0);
 }
 
+/*
+=============
+D_DrawTurbulent16
+=============
+*/
+#define SPAN_FUNC   D_DrawTurbulent16
+#define SPAN_DRAW   D_DrawTurbulentSpan
+#define SPAN_TARGET
+#define SPAN_TURB
+#include "span.h"
+
 #if !USE_ASM
 
 /*
@@ -221,130 +140,10 @@ void D_DrawTurbulent16(espan_t *pspan, int *warptable)
 D_DrawSpans16
 =============
 */
-void D_DrawSpans16(espan_t *pspan)
-{
-    int             count, spancount;
-    byte            *pbase, *pdest, *ptex;
-    fixed16_t       s, t, snext, tnext, sstep, tstep;
-    float           sdivz, tdivz, zi, z, du, dv, spancountminus1;
-    float           sdivz16stepu, tdivz16stepu, zi16stepu;
-
-    sstep = 0;  // keep compiler happy
-    tstep = 0;  // ditto
-
-    pbase = (byte *)cacheblock;
-
-    sdivz16stepu = d_sdivzstepu * 16;
-    tdivz16stepu = d_tdivzstepu * 16;
-    zi16stepu = d_zistepu * 16;
-
-    do {
-        pdest = (byte *)d_viewbuffer + d_scantable[pspan->v] + pspan->u * VID_BYTES;
-
-        count = pspan->count;
-
-        // calculate the initial s/z, t/z, 1/z, s, and t and clamp
-        du = (float)pspan->u;
-        dv = (float)pspan->v;
-
-        sdivz = d_sdivzorigin + dv * d_sdivzstepv + du * d_sdivzstepu;
-        tdivz = d_tdivzorigin + dv * d_tdivzstepv + du * d_tdivzstepu;
-        zi = d_ziorigin + dv * d_zistepv + du * d_zistepu;
-        z = (float)0x10000 / zi;    // prescale to 16.16 fixed-point
-
-        s = (int)(sdivz * z) + sadjust;
-        if (s > bbextents)
-            s = bbextents;
-        else if (s < 0)
-            s = 0;
-
-        t = (int)(tdivz * z) + tadjust;
-        if (t > bbextentt)
-            t = bbextentt;
-        else if (t < 0)
-            t = 0;
-
-        do {
-            // calculate s and t at the far end of the span
-            if (count >= 16)
-                spancount = 16;
-            else
-                spancount = count;
-
-            count -= spancount;
-
-            if (q_likely(count)) {
-                // calculate s/z, t/z, zi->fixed s and t at far end of span,
-                // calculate s and t steps across span by shifting
-                sdivz += sdivz16stepu;
-                tdivz += tdivz16stepu;
-                zi += zi16stepu;
-                z = (float)0x10000 / zi;    // prescale to 16.16 fixed-point
-
-                snext = (int)(sdivz * z) + sadjust;
-                if (snext > bbextents)
-                    snext = bbextents;
-                else if (snext < 16)
-                    snext = 16; // prevent round-off error on <0 steps from
-                                // from causing overstepping & running off the
-                                // edge of the texture
-
-                tnext = (int)(tdivz * z) + tadjust;
-                if (tnext > bbextentt)
-                    tnext = bbextentt;
-                else if (tnext < 16)
-                    tnext = 16;  // guard against round-off error on <0 steps
-
-                sstep = (snext - s) >> 4;
-                tstep = (tnext - t) >> 4;
-            } else {
-                // calculate s/z, t/z, zi->fixed s and t at last pixel in span (so
-                // can't step off polygon), clamp, calculate s and t steps across
-                // span by division, biasing steps low so we don't run off the
-                // texture
-                spancountminus1 = (float)(spancount - 1);
-                sdivz += d_sdivzstepu * spancountminus1;
-                tdivz += d_tdivzstepu * spancountminus1;
-                zi += d_zistepu * spancountminus1;
-                z = (float)0x10000 / zi;    // prescale to 16.16 fixed-point
-
-                snext = (int)(sdivz * z) + sadjust;
-                if (snext > bbextents)
-                    snext = bbextents;
-                else if (snext < 16)
-                    snext = 16; // prevent round-off error on <0 steps from
-                                // from causing overstepping & running off the
-                                // edge of the texture
-
-                tnext = (int)(tdivz * z) + tadjust;
-                if (tnext > bbextentt)
-                    tnext = bbextentt;
-                else if (tnext < 16)
-                    tnext = 16;  // guard against round-off error on <0 steps
-
-                if (spancount > 1) {
-                    sstep = (snext - s) / (spancount - 1);
-                    tstep = (tnext - t) / (spancount - 1);
-                }
-            }
-
-            do {
-                ptex = pbase + (s >> 16) * TEX_BYTES + (t >> 16) * cachewidth;
-                pdest[0] = ptex[2];
-                pdest[1] = ptex[1];
-                pdest[2] = ptex[0];
-                pdest += VID_BYTES;
-                s += sstep;
-                t += tstep;
-            } while (--spancount > 0);
-
-            s = snext;
-            t = tnext;
-
-        } while (count > 0);
-
-    } while ((pspan = pspan->pnext) != NULL);
-}
+#define SPAN_FUNC   D_DrawSpans16
+#define SPAN_DRAW   D_DrawSpan
+#define SPAN_TARGET
+#include "span.h"
 
 /*
 =============
@@ -402,3 +201,168 @@ void D_DrawZSpans(espan_t *pspan)
 
 #endif
 
+
+#if USE_SW_X86
+
+/*
+SSE2 versions fetch texels one by one and store 4 pixels at a time. AVX2
+versions step 8 pixels in parallel and fetch texels with gathers, spans are
+drawn by masked stores so that no pixel past the end is touched.
+*/
+
+// RGBA texels to BGR pixels
+static inline __attribute__((target("sse2")))
+__m128i D_PackTexels_SSE2(const __m128i *tex)
+{
+    const __m128i   mask = _mm_set1_epi32(255);
+    __m128i         v, r, g, b;
+
+    v = _mm_unpacklo_epi64(_mm_unpacklo_epi32(tex[0], tex[1]),
+                           _mm_unpacklo_epi32(tex[2], tex[3]));
+    r = _mm_slli_epi32(_mm_and_si128(v, mask), 16);
+    g = _mm_and_si128(v, _mm_set1_epi32(255 << 8));
+    b = _mm_and_si128(_mm_srli_epi32(v, 16), mask);
+    return _mm_or_si128(_mm_or_si128(r, g), b);
+}
+
+#define TEXEL(p)    _mm_cvtsi32_si128(*(const int *)(p))
+
+static inline __attribute__((target("sse2")))
+void D_DrawSpan_SSE2(byte *pdest, const byte *pbase, const int *turb,
+                     fixed16_t s, fixed16_t t, fixed16_t sstep,
+                     fixed16_t tstep, int spancount)
+{
+    __m128i     tex[4];
+    int         i;
+
+    for (; spancount >= 4; spancount -= 4, pdest += 4 * VID_BYTES) {
+        for (i = 0; i < 4; i++, s += sstep, t += tstep)
+            tex[i] = TEXEL(pbase + (s >> 16) * TEX_BYTES + (t >> 16) * cachewidth);
+        _mm_storeu_si128((__m128i *)pdest, D_PackTexels_SSE2(tex));
+    }
+
+    if (spancount)
+        D_DrawSpan(pdest, pbase, turb, s, t, sstep, tstep, spancount);
+}
+
+static inline __attribute__((target("sse2")))
+void D_DrawTurbulentSpan_SSE2(byte *pdest, const byte *pbase, const int *turb,
+                              fixed16_t s, fixed16_t t, fixed16_t sstep,
+                              fixed16_t tstep, int spancount)
+{
+    __m128i     tex[4];
+    int         i, turb_s, turb_t;
+
+    s = s & ((CYCLE << 16) - 1);
+    t = t & ((CYCLE << 16) - 1);
+
+    for (; spancount >= 4; spancount -= 4, pdest += 4 * VID_BYTES) {
+        for (i = 0; i < 4; i++, s += sstep, t += tstep) {
+            turb_s = ((s + turb[(t >> 16) & (CYCLE - 1)]) >> 16) & 63;
+            turb_t = ((t + turb[(s >> 16) & (CYCLE - 1)]) >> 16) & 63;
+            tex[i] = TEXEL(pbase + (turb_t * 64 * TEX_BYTES) + turb_s * TEX_BYTES);
+        }
+        _mm_storeu_si128((__m128i *)pdest, D_PackTexels_SSE2(tex));
+    }
+
+    if (spancount)
+        D_DrawTurbulentSpan(pdest, pbase, turb, s, t, sstep, tstep, spancount);
+}
+
+#undef TEXEL
+
+#define SPAN_FUNC   D_DrawTurbulent16_SSE2
+#define SPAN_DRAW   D_DrawTurbulentSpan_SSE2
+#define SPAN_TARGET __attribute__((target("sse2")))
+#define SPAN_TURB
+#include "span.h"
+
+#define SPAN_FUNC   D_DrawSpans16_SSE2
+#define SPAN_DRAW   D_DrawSpan_SSE2
+#define SPAN_TARGET __attribute__((target("sse2")))
+#include "span.h"
+
+static inline __attribute__((target("avx2")))
+__m256i D_SwizzleTexels_AVX2(__m256i v)
+{
+    const __m256i   shuf = _mm256_setr_epi8(
+        2, 1, 0, -1, 6, 5, 4, -1, 10, 9, 8, -1, 14, 13, 12, -1,
+        2, 1, 0, -1, 6, 5, 4, -1, 10, 9, 8, -1, 14, 13, 12, -1);
+
+    return _mm256_shuffle_epi8(v, shuf);
+}
+
+static inline __attribute__((target("avx2")))
+void D_DrawSpan_AVX2(byte *pdest, const byte *pbase, const int *turb,
+                     fixed16_t s, fixed16_t t, fixed16_t sstep,
+                     fixed16_t tstep, int spancount)
+{
+    const __m256i   lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    __m256i         vs, vt, vsstep, vtstep, width, mask, ofs, tex;
+
+    vs = _mm256_add_epi32(_mm256_set1_epi32(s), _mm256_mullo_epi32(lane, _mm256_set1_epi32(sstep)));
+    vt = _mm256_add_epi32(_mm256_set1_epi32(t), _mm256_mullo_epi32(lane, _mm256_set1_epi32(tstep)));
+    vsstep = _mm256_set1_epi32(sstep * 8);
+    vtstep = _mm256_set1_epi32(tstep * 8);
+    width = _mm256_set1_epi32(cachewidth);
+
+    do {
+        mask = _mm256_cmpgt_epi32(_mm256_set1_epi32(spancount), lane);
+        ofs = _mm256_slli_epi32(_mm256_srai_epi32(vs, 16), 2);
+        ofs = _mm256_add_epi32(ofs, _mm256_mullo_epi32(_mm256_srai_epi32(vt, 16), width));
+        tex = _mm256_mask_i32gather_epi32(_mm256_setzero_si256(), (const int *)pbase, ofs, mask, 1);
+        _mm256_maskstore_epi32((int *)pdest, mask, D_SwizzleTexels_AVX2(tex));
+        vs = _mm256_add_epi32(vs, vsstep);
+        vt = _mm256_add_epi32(vt, vtstep);
+        pdest += 8 * VID_BYTES;
+        spancount -= 8;
+    } while (spancount > 0);
+}
+
+static inline __attribute__((target("avx2")))
+void D_DrawTurbulentSpan_AVX2(byte *pdest, const byte *pbase, const int *turb,
+                              fixed16_t s, fixed16_t t, fixed16_t sstep,
+                              fixed16_t tstep, int spancount)
+{
+    const __m256i   lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m256i   cycle = _mm256_set1_epi32(CYCLE - 1);
+    const __m256i   mask63 = _mm256_set1_epi32(63);
+    __m256i         vs, vt, vsstep, vtstep, mask, turb_s, turb_t, tex;
+
+    s = s & ((CYCLE << 16) - 1);
+    t = t & ((CYCLE << 16) - 1);
+
+    vs = _mm256_add_epi32(_mm256_set1_epi32(s), _mm256_mullo_epi32(lane, _mm256_set1_epi32(sstep)));
+    vt = _mm256_add_epi32(_mm256_set1_epi32(t), _mm256_mullo_epi32(lane, _mm256_set1_epi32(tstep)));
+    vsstep = _mm256_set1_epi32(sstep * 8);
+    vtstep = _mm256_set1_epi32(tstep * 8);
+
+    do {
+        mask = _mm256_cmpgt_epi32(_mm256_set1_epi32(spancount), lane);
+        turb_s = _mm256_i32gather_epi32(turb, _mm256_and_si256(_mm256_srai_epi32(vt, 16), cycle), 4);
+        turb_t = _mm256_i32gather_epi32(turb, _mm256_and_si256(_mm256_srai_epi32(vs, 16), cycle), 4);
+        turb_s = _mm256_and_si256(_mm256_srai_epi32(_mm256_add_epi32(vs, turb_s), 16), mask63);
+        turb_t = _mm256_and_si256(_mm256_srai_epi32(_mm256_add_epi32(vt, turb_t), 16), mask63);
+        // every 64x64 texel is valid, masking only the stores
+        tex = _mm256_or_si256(_mm256_slli_epi32(turb_t, 8), _mm256_slli_epi32(turb_s, 2));
+        tex = _mm256_i32gather_epi32((const int *)pbase, tex, 1);
+        _mm256_maskstore_epi32((int *)pdest, mask, D_SwizzleTexels_AVX2(tex));
+        vs = _mm256_add_epi32(vs, vsstep);
+        vt = _mm256_add_epi32(vt, vtstep);
+        pdest += 8 * VID_BYTES;
+        spancount -= 8;
+    } while (spancount > 0);
+}
+
+#define SPAN_FUNC   D_DrawTurbulent16_AVX2
+#define SPAN_DRAW   D_DrawTurbulentSpan_AVX2
+#define SPAN_TARGET __attribute__((target("avx2")))
+#define SPAN_TURB
+#include "span.h"
+
+#define SPAN_FUNC   D_DrawSpans16_AVX2
+#define SPAN_DRAW   D_DrawSpan_AVX2
+#define SPAN_TARGET __attribute__((target("avx2")))
+#include "span.h"
+
+#endif // USE_SW_X86
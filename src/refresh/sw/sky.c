@@ -22,7 +22,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 //static float        sky_rotate;
 //static vec3_t       sky_axis;
 
-static int          r_skyframe;
+static R_TLS int          r_skyframe;
 static mface_t      r_skyfaces[6];
 static cplane_t     r_skyplanes[6];
 static mtexinfo_t   r_skytexinfo[6];
@@ -104,26 +104,20 @@ void R_InitSkyBox(void)
     for (i = 0; i < 12; i++) {
         r_skyedges[i].v[0] = &r_skyverts[box_edges[i * 2 + 0] - 1];
         r_skyedges[i].v[1] = &r_skyverts[box_edges[i * 2 + 1] - 1];
-        r_skyedges[i].cachededgeoffset = 0;
     }
 }
 
 /*
 ================
-R_EmitSkyBox
+R_SetupSkyBox
+
+Positions the box around the view origin. Called once per frame,
+before any bands are rendered.
 ================
 */
-void R_EmitSkyBox(void)
+void R_SetupSkyBox(void)
 {
     int i, j;
-    int oldkey;
-
-    if (insubmodel)
-        return;        // submodels should never have skies
-    if (r_skyframe == r_framecount)
-        return;        // already set this frame
-
-    r_skyframe = r_framecount;
 
     // set the eight fake vertexes
     for (i = 0; i < 8; i++)
@@ -142,6 +136,24 @@ void R_EmitSkyBox(void)
         r_skytexinfo[i].offset[0] = -DotProduct(r_origin, r_skytexinfo[i].axis[0]);
         r_skytexinfo[i].offset[1] = -DotProduct(r_origin, r_skytexinfo[i].axis[1]);
     }
+}
+
+/*
+================
+R_EmitSkyBox
+================
+*/
+void R_EmitSkyBox(void)
+{
+    int i;
+    int oldkey;
+
+    if (insubmodel)
+        return;        // submodels should never have skies
+    if (r_skyframe == r_framecount)
+        return;        // already set this frame
+
+    r_skyframe = r_framecount;
 
     // emit the six faces
     oldkey = r_currentkey;
@@ -152,6 +164,21 @@ void R_EmitSkyBox(void)
     r_currentkey = oldkey;  // bsp sorting order
 }
 
+/*
+================
+R_SkyFaceNum
+================
+*/
+int R_SkyFaceNum(mface_t *surf)
+{
+    return surf - r_skyfaces;
+}
+
+int R_SkyEdgeNum(medge_t *edge)
+{
+    return edge - r_skyedges;
+}
+
 /*
 ============
 R_SetSky
@@ -0,0 +1,140 @@
+//
+// Perspective correct span stepping, included by scan.c. Steps s and t in 16
+// pixel chunks and calls SPAN_DRAW to draw each chunk. Defines SPAN_FUNC with
+// D_DrawTurbulent16 signature if SPAN_TURB is defined and D_DrawSpans16
+// signature otherwise.
+//
+
+#ifdef SPAN_TURB
+SPAN_TARGET void SPAN_FUNC(espan_t *pspan, int *warptable)
+#else
+SPAN_TARGET void SPAN_FUNC(espan_t *pspan)
+#endif
+{
+    int             count, spancount;
+    byte            *pbase, *pdest;
+    fixed16_t       s, t, snext, tnext, sstep, tstep;
+    float           sdivz, tdivz, zi, z, du, dv, spancountminus1;
+    float           sdivz16stepu, tdivz16stepu, zi16stepu;
+    const int       *turb;
+
+#ifdef SPAN_TURB
+    turb = warptable + ((int)(r_newrefdef.time * SPEED) & (CYCLE - 1));
+#else
+    turb = NULL;
+#endif
+
+    sstep = 0;  // keep compiler happy
+    tstep = 0;  // ditto
+
+    pbase = (byte *)cacheblock;
+
+    sdivz16stepu = d_sdivzstepu * 16;
+    tdivz16stepu = d_tdivzstepu * 16;
+    zi16stepu = d_zistepu * 16;
+
+    do {
+        pdest = (byte *)d_viewbuffer + d_scantable[pspan->v] + pspan->u * VID_BYTES;
+
+        count = pspan->count;
+
+        // calculate the initial s/z, t/z, 1/z, s, and t and clamp
+        du = (float)pspan->u;
+        dv = (float)pspan->v;
+
+        sdivz = d_sdivzorigin + dv * d_sdivzstepv + du * d_sdivzstepu;
+        tdivz = d_tdivzorigin + dv * d_tdivzstepv + du * d_tdivzstepu;
+        zi = d_ziorigin + dv * d_zistepv + du * d_zistepu;
+        z = (float)0x10000 / zi;    // prescale to 16.16 fixed-point
+
+        s = (int)(sdivz * z) + sadjust;
+        if (s > bbextents)
+            s = bbextents;
+        else if (s < 0)
+            s = 0;
+
+        t = (int)(tdivz * z) + tadjust;
+        if (t > bbextentt)
+            t = bbextentt;
+        else if (t < 0)
+            t = 0;
+
+        do {
+            // calculate s and t at the far end of the span
+            if (count >= 16)
+                spancount = 16;
+            else
+                spancount = count;
+
+            count -= spancount;
+
+            if (q_likely(count)) {
+                // calculate s/z, t/z, zi->fixed s and t at far end of span,
+                // calculate s and t steps across span by shifting
+                sdivz += sdivz16stepu;
+                tdivz += tdivz16stepu;
+                zi += zi16stepu;
+                z = (float)0x10000 / zi;    // prescale to 16.16 fixed-point
+
+                snext = (int)(sdivz * z) + sadjust;
+                if (snext > bbextents)
+                    snext = bbextents;
+                else if (snext < 16)
+                    snext = 16; // prevent round-off error on <0 steps from
+                                // from causing overstepping & running off the
+                                // edge of the texture
+
+                tnext = (int)(tdivz * z) + tadjust;
+                if (tnext > bbextentt)
+                    tnext = bbextentt;
+                else if (tnext < 16)
+                    tnext = 16;  // guard against round-off error on <0 steps
+
+                sstep = (snext - s) >> 4;
+                tstep = (tnext - t) >> 4;
+            } else {
+                // calculate s/z, t/z, zi->fixed s and t at last pixel in span (so
+                // can't step off polygon), clamp, calculate s and t steps across
+                // span by division, biasing steps low so we don't run off the
+                // texture
+                spancountminus1 = (float)(spancount - 1);
+                sdivz += d_sdivzstepu * spancountminus1;
+                tdivz += d_tdivzstepu * spancountminus1;
+                zi += d_zistepu * spancountminus1;
+                z = (float)0x10000 / zi;    // prescale to 16.16 fixed-point
+
+                snext = (int)(sdivz * z) + sadjust;
+                if (snext > bbextents)
+                    snext = bbextents;
+                else if (snext < 16)
+                    snext = 16; // prevent round-off error on <0 steps from
+                                // from causing overstepping & running off the
+                                // edge of the texture
+
+                tnext = (int)(tdivz * z) + tadjust;
+                if (tnext > bbextentt)
+                    tnext = bbextentt;
+                else if (tnext < 16)
+                    tnext = 16;  // guard against round-off error on <0 steps
+
+                if (spancount > 1) {
+                    sstep = (snext - s) / (spancount - 1);
+                    tstep = (tnext - t) / (spancount - 1);
+                }
+            }
+
+            SPAN_DRAW(pdest, pbase, turb, s, t, sstep, tstep, spancount);
+            pdest += spancount * VID_BYTES;
+
+            s = snext;
+            t = tnext;
+
+        } while (count > 0);
+
+    } while ((pspan = pspan->pnext) != NULL);
+}
+
+#undef SPAN_FUNC
+#undef SPAN_DRAW
+#undef SPAN_TARGET
+#undef SPAN_TURB
@@ -19,32 +19,17 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 #include "sw.h"
 
-drawsurf_t  r_drawsurf;
-
-static int          sourcetstep;
-static void         *prowdestbase;
-static byte         *pbasesource;
-static int          surfrowbytes;
-static unsigned     *r_lightptr;
-static int          r_stepback;
-static int          r_lightwidth;
-static int          r_numhblocks, r_numvblocks;
-static byte         *r_source, *r_sourcemax;
-
-static void R_DrawSurfaceBlock8_mip0(void);
-static void R_DrawSurfaceBlock8_mip1(void);
-static void R_DrawSurfaceBlock8_mip2(void);
-static void R_DrawSurfaceBlock8_mip3(void);
-
-static void (*surfmiptable[4])(void) = {
-    R_DrawSurfaceBlock8_mip0,
-    R_DrawSurfaceBlock8_mip1,
-    R_DrawSurfaceBlock8_mip2,
-    R_DrawSurfaceBlock8_mip3
-};
-
-static int          sc_size;
-static surfcache_t  *sc_rover, *sc_base;
+R_TLS drawsurf_t  r_drawsurf;
+
+static R_TLS int          sourcetstep;
+static R_TLS void         *prowdestbase;
+static R_TLS byte         *pbasesource;
+static R_TLS int          surfrowbytes;
+static R_TLS unsigned     *r_lightptr;
+static R_TLS int          r_stepback;
+static R_TLS int          r_lightwidth;
+static R_TLS int          r_numhblocks, r_numvblocks;
+static R_TLS byte         *r_source, *r_sourcemax;
 
 /*
 ===============
@@ -103,7 +88,7 @@ void R_DrawSurface(void)
     r_numhblocks = r_drawsurf.surfwidth >> blockdivshift;
     r_numvblocks = r_drawsurf.surfheight >> blockdivshift;
 
-    pblockdrawer = surfmiptable[r_drawsurf.surfmip];
+    pblockdrawer = sw_kernels->surfblock[r_drawsurf.surfmip];
 // TODO: only needs to be set when there is a display settings change
     horzblockstep = blocksize * TEX_BYTES;
 
@@ -163,6 +148,156 @@ void R_DrawSurface(void)
 
 #endif
 
+#if USE_SW_X86
+
+/*
+Lightmap blending with 16 bit lanes. Light is interpolated in 32 bits and then
+truncated to 16 bits, which is exact because every per pixel light value is
+within 0-65535, and (texel * light) >> 16 maps directly to unsigned high
+multiply. Each pixel has 4 lanes, the last one has zero light.
+*/
+
+static inline __attribute__((target("sse2")))
+__m128i R_LoadLight_SSE2(const unsigned *p)
+{
+    return _mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i *)p), _mm_cvtsi32_si128(p[2]));
+}
+
+// low 16 bits of 32 bit lanes of a and b, without saturation
+static inline __attribute__((target("sse2")))
+__m128i R_PackLight_SSE2(__m128i a, __m128i b)
+{
+    a = _mm_srai_epi32(_mm_slli_epi32(a, 16), 16);
+    b = _mm_srai_epi32(_mm_slli_epi32(b, 16), 16);
+    return _mm_packs_epi32(a, b);
+}
+
+#define BLOCK_LOOP_BEGIN                                                    \
+    for (v = 0; v < r_numvblocks; v++) {                                    \
+        left = R_LoadLight_SSE2(r_lightptr);                                \
+        right = R_LoadLight_SSE2(r_lightptr + LIGHTMAP_BYTES);              \
+        r_lightptr += r_lightwidth;                                         \
+        leftstep = _mm_sub_epi32(R_LoadLight_SSE2(r_lightptr), left);       \
+        leftstep = _mm_srai_epi32(leftstep, shift);                         \
+        rightstep = _mm_sub_epi32(R_LoadLight_SSE2(r_lightptr + LIGHTMAP_BYTES), right); \
+        rightstep = _mm_srai_epi32(rightstep, shift);                       \
+                                                                            \
+        for (i = 0; i < size; i++) {                                        \
+            /* light of the two leftmost pixels and step by two pixels */   \
+            step = _mm_srai_epi32(_mm_sub_epi32(left, right), shift);       \
+            light = _mm_sub_epi32(_mm_slli_epi32(step, shift), step);       \
+            light = _mm_add_epi32(right, light);                            \
+            l = R_PackLight_SSE2(light, _mm_sub_epi32(light, step));        \
+            step = _mm_slli_epi32(step, 1);                                 \
+            lstep = R_PackLight_SSE2(step, step);
+
+#define BLOCK_LOOP_END                                                      \
+            psource += sourcetstep;                                         \
+            left = _mm_add_epi32(left, leftstep);                           \
+            right = _mm_add_epi32(right, rightstep);                        \
+            prowdest += surfrowbytes;                                       \
+        }                                                                   \
+                                                                            \
+        if (psource >= r_sourcemax)                                         \
+            psource -= r_stepback;                                          \
+    }
+
+static inline __attribute__((target("sse2"), always_inline))
+void R_DrawSurfaceBlock_SSE2(int shift)
+{
+    int     v, i, b, size = 1 << shift;
+    byte    *psource = pbasesource;
+    byte    *prowdest = prowdestbase;
+    __m128i left, right, leftstep, rightstep, step, light;
+    __m128i l, lstep, src, lo, hi;
+    __m128i zero = _mm_setzero_si128();
+
+    BLOCK_LOOP_BEGIN
+        if (size == 2) {
+            src = _mm_loadl_epi64((__m128i *)psource);
+            lo = _mm_mulhi_epu16(_mm_unpacklo_epi8(src, zero), l);
+            _mm_storel_epi64((__m128i *)prowdest, _mm_packus_epi16(lo, lo));
+        } else {
+            for (b = 0; b < size * TEX_BYTES; b += 16) {
+                src = _mm_loadu_si128((__m128i *)(psource + b));
+                lo = _mm_mulhi_epu16(_mm_unpacklo_epi8(src, zero), l);
+                l = _mm_sub_epi16(l, lstep);
+                hi = _mm_mulhi_epu16(_mm_unpackhi_epi8(src, zero), l);
+                l = _mm_sub_epi16(l, lstep);
+                _mm_storeu_si128((__m128i *)(prowdest + b), _mm_packus_epi16(lo, hi));
+            }
+        }
+    BLOCK_LOOP_END
+}
+
+// same as above, 8 pixels at a time for blocks of 8 and 16
+static inline __attribute__((target("avx2"), always_inline))
+void R_DrawSurfaceBlock_AVX2(int shift)
+{
+    int     v, i, b, size = 1 << shift;
+    byte    *psource = pbasesource;
+    byte    *prowdest = prowdestbase;
+    __m128i left, right, leftstep, rightstep, step, light;
+    __m128i l, lstep;
+    __m256i l4, lstep4, lo, hi;
+
+    BLOCK_LOOP_BEGIN
+        l4 = _mm256_inserti128_si256(_mm256_castsi128_si256(l), _mm_sub_epi16(l, lstep), 1);
+        lstep4 = _mm256_broadcastsi128_si256(_mm_add_epi16(lstep, lstep));
+        for (b = 0; b < size * TEX_BYTES; b += 32) {
+            lo = _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i *)(psource + b)));
+            lo = _mm256_mulhi_epu16(lo, l4);
+            l4 = _mm256_sub_epi16(l4, lstep4);
+            hi = _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i *)(psource + b + 16)));
+            hi = _mm256_mulhi_epu16(hi, l4);
+            l4 = _mm256_sub_epi16(l4, lstep4);
+            lo = _mm256_permute4x64_epi64(_mm256_packus_epi16(lo, hi), _MM_SHUFFLE(3, 1, 2, 0));
+            _mm256_storeu_si256((__m256i *)(prowdest + b), lo);
+        }
+    BLOCK_LOOP_END
+}
+
+#undef BLOCK_LOOP_BEGIN
+#undef BLOCK_LOOP_END
+
+__attribute__((target("sse2")))
+void R_DrawSurfaceBlock8_mip0_SSE2(void)
+{
+    R_DrawSurfaceBlock_SSE2(4);
+}
+
+__attribute__((target("sse2")))
+void R_DrawSurfaceBlock8_mip1_SSE2(void)
+{
+    R_DrawSurfaceBlock_SSE2(3);
+}
+
+__attribute__((target("sse2")))
+void R_DrawSurfaceBlock8_mip2_SSE2(void)
+{
+    R_DrawSurfaceBlock_SSE2(2);
+}
+
+__attribute__((target("sse2")))
+void R_DrawSurfaceBlock8_mip3_SSE2(void)
+{
+    R_DrawSurfaceBlock_SSE2(1);
+}
+
+__attribute__((target("avx2")))
+void R_DrawSurfaceBlock8_mip0_AVX2(void)
+{
+    R_DrawSurfaceBlock_AVX2(4);
+}
+
+__attribute__((target("avx2")))
+void R_DrawSurfaceBlock8_mip1_AVX2(void)
+{
+    R_DrawSurfaceBlock_AVX2(3);
+}
+
+#endif // USE_SW_X86
+
 
 //============================================================================
 
@@ -171,12 +306,16 @@ void R_DrawSurface(void)
 ================
 R_InitCaches
 
+Each band gets its own cache, large enough to hold most of the surfaces
+visible through it.
 ================
 */
 void R_InitCaches(void)
 {
+    band_t  *band;
     int     size;
     int     pix;
+    int     i;
 
     // calculate size to allocate
     if (sw_surfcacheoverride->integer) {
@@ -189,29 +328,44 @@ void R_InitCaches(void)
             size += (pix - 64000) * 3;
     }
 
+    // a band sees only a part of the view, but surfaces are often shared
+    // between neighbouring bands and cached twice
+    if (r_numbands > 1) {
+        size = size * 2 / r_numbands;
+        if (size < SURFCACHE_SIZE_AT_320X240)
+            size = SURFCACHE_SIZE_AT_320X240;
+    }
+
     // round up to page size
     size = (size + 8191) & ~8191;
 
-    Com_DPrintf("%ik surface cache\n", size / 1024);
+    Com_DPrintf("%d x %ik surface cache\n", r_numbands, size / 1024);
 
-    sc_size = size;
-    sc_base = (surfcache_t *)R_Malloc(size);
-    sc_rover = sc_base;
+    for (i = 0, band = r_bands; i < r_numbands; i++, band++) {
+        band->sc_size = size;
+        band->sc_base = (surfcache_t *)R_Malloc(size);
+        band->sc_rover = band->sc_base;
 
-    sc_base->next = NULL;
-    sc_base->owner = NULL;
-    sc_base->size = sc_size;
+        band->sc_base->next = NULL;
+        band->sc_base->owner = NULL;
+        band->sc_base->size = band->sc_size;
+    }
 }
 
 void R_FreeCaches(void)
 {
-    if (sc_base) {
-        Z_Free(sc_base);
-        sc_base = NULL;
-    }
+    band_t  *band;
+    int     i;
+
+    for (i = 0, band = r_bands; i < MAX_BANDS; i++, band++) {
+        if (band->sc_base) {
+            Z_Free(band->sc_base);
+            band->sc_base = NULL;
+        }
 
-    sc_size = 0;
-    sc_rover = NULL;
+        band->sc_size = 0;
+        band->sc_rover = NULL;
+    }
 }
 
 /*
@@ -222,20 +376,24 @@ D_FlushCaches
 void D_FlushCaches(void)
 {
     surfcache_t     *c;
+    band_t          *band;
+    int             i;
 
-    if (!sc_base)
-        return;
+    for (i = 0, band = r_bands; i < MAX_BANDS; i++, band++) {
+        if (!band->sc_base)
+            continue;
 
-    for (c = sc_base; c; c = c->next) {
-        if (c->owner) {
-            *c->owner = NULL;
+        for (c = band->sc_base; c; c = c->next) {
+            if (c->owner) {
+                *c->owner = NULL;
+            }
         }
-    }
 
-    sc_rover = sc_base;
-    sc_base->next = NULL;
-    sc_base->owner = NULL;
-    sc_base->size = sc_size;
+        band->sc_rover = band->sc_base;
+        band->sc_base->next = NULL;
+        band->sc_base->owner = NULL;
+        band->sc_base->size = band->sc_size;
+    }
 }
 
 /*
@@ -245,52 +403,54 @@ D_SCAlloc
 */
 surfcache_t     *D_SCAlloc(int width, int size)
 {
+    band_t                  *band = r_band;
     surfcache_t             *new;
 
     if ((width < 0) || (width > 256))
-        Com_Error(ERR_FATAL, "D_SCAlloc: bad cache width %d\n", width);
+        R_BandError(ERR_FATAL, "D_SCAlloc: bad cache width %d\n", width);
 
     if ((size <= 0) || (size > 0x10000 * TEX_BYTES))
-        Com_Error(ERR_FATAL, "D_SCAlloc: bad cache size %d\n", size);
+        R_BandError(ERR_FATAL, "D_SCAlloc: bad cache size %d\n", size);
 
     size += sizeof(surfcache_t) - 4;
     size = (size + 3) & ~3;
-    if (size > sc_size)
-        Com_Error(ERR_FATAL, "D_SCAlloc: %i > cache size of %i", size, sc_size);
+    if (size > band->sc_size)
+        R_BandError(ERR_FATAL, "D_SCAlloc: %i > cache size of %i", size, band->sc_size);
 
 // if there is not size bytes after the rover, reset to the start
-    if (!sc_rover || (byte *)sc_rover - (byte *)sc_base > sc_size - size) {
-        sc_rover = sc_base;
+    if (!band->sc_rover ||
+        (byte *)band->sc_rover - (byte *)band->sc_base > band->sc_size - size) {
+        band->sc_rover = band->sc_base;
     }
 
 // colect and free surfcache_t blocks until the rover block is large enough
-    new = sc_rover;
-    if (sc_rover->owner)
-        *sc_rover->owner = NULL;
+    new = band->sc_rover;
+    if (band->sc_rover->owner)
+        *band->sc_rover->owner = NULL;
 
     while (new->size < size) {
         // free another
-        sc_rover = sc_rover->next;
-        if (!sc_rover)
-            Com_Error(ERR_FATAL, "D_SCAlloc: hit the end of memory");
-        if (sc_rover->owner)
-            *sc_rover->owner = NULL;
-
-        new->size += sc_rover->size;
-        new->next = sc_rover->next;
+        band->sc_rover = band->sc_rover->next;
+        if (!band->sc_rover)
+            R_BandError(ERR_FATAL, "D_SCAlloc: hit the end of memory");
+        if (band->sc_rover->owner)
+            *band->sc_rover->owner = NULL;
+
+        new->size += band->sc_rover->size;
+        new->next = band->sc_rover->next;
     }
 
 // create a fragment out of any leftovers
     if (new->size - size > 256) {
-        sc_rover = (surfcache_t *)((byte *)new + size);
-        sc_rover->size = new->size - size;
-        sc_rover->next = new->next;
-        sc_rover->width = 0;
-        sc_rover->owner = NULL;
-        new->next = sc_rover;
+        band->sc_rover = (surfcache_t *)((byte *)new + size);
+        band->sc_rover->size = new->size - size;
+        band->sc_rover->next = new->next;
+        band->sc_rover->width = 0;
+        band->sc_rover->owner = NULL;
+        new->next = band->sc_rover;
         new->size = size;
     } else
-        sc_rover = new->next;
+        band->sc_rover = new->next;
 
     new->width = width;
 // DEBUG
@@ -311,12 +471,18 @@ D_SCDump
 void D_SCDump_f(void)
 {
     surfcache_t             *test;
-
-    for (test = sc_base; test; test = test->next) {
-        if (test == sc_rover)
-            Com_Printf("ROVER:\n");
-        Com_Printf("%p : %i bytes     %i width\n", test, test->size,
-                   test->width);
+    band_t                  *band;
+    int                     i;
+
+    for (i = 0, band = r_bands; i < r_numbands; i++, band++) {
+        if (r_numbands > 1)
+            Com_Printf("BAND %d:\n", i);
+        for (test = band->sc_base; test; test = test->next) {
+            if (test == band->sc_rover)
+                Com_Printf("ROVER:\n");
+            Com_Printf("%p : %i bytes     %i width\n", test, test->size,
+                       test->width);
+        }
     }
 }
 
@@ -329,8 +495,9 @@ D_CacheSurface
 */
 surfcache_t *D_CacheSurface(mface_t *surface, int miplevel)
 {
-    surfcache_t     *cache;
+    surfcache_t     *cache, **spot;
     float           surfscale;
+    int             num;
 
 //
 // if the surface is animating or flashing, flush the cache
@@ -344,7 +511,11 @@ surfcache_t *D_CacheSurface(mface_t *surface, int miplevel)
 //
 // see if the cache holds apropriate data
 //
-    cache = surface->cachespots[miplevel];
+    num = surface - r_worldmodel->faces;
+    if (num < 0 || num >= r_worldmodel->numfaces)
+        num = r_worldmodel->numfaces + R_SkyFaceNum(surface);
+    spot = &r_band->cachespots[num * MIPLEVELS + miplevel];
+    cache = *spot;
 
     if (cache && !cache->dlight && surface->dlightframe != r_framecount
         && cache->image == r_drawsurf.image
@@ -369,8 +540,8 @@ surfcache_t *D_CacheSurface(mface_t *surface, int miplevel)
     if (!cache) {   // if a texture just animated, don't reallocate it
         cache = D_SCAlloc(r_drawsurf.surfwidth,
                           r_drawsurf.surfwidth * r_drawsurf.surfheight * TEX_BYTES);
-        surface->cachespots[miplevel] = cache;
-        cache->owner = &surface->cachespots[miplevel];
+        *spot = cache;
+        cache->owner = spot;
         cache->mipscale = surfscale;
     }
 
@@ -30,8 +30,32 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "refresh/models.h"
 #include "system/system.h"
 
+#include <setjmp.h>
+
 #define REF_VERSION     "SOFT 0.01"
 
+// assembly code accesses per-frame state as plain globals
+#if USE_THREADS && !USE_ASM
+#define USE_BAND_THREADS    1
+#endif
+
+// intrinsics versions of the pixel kernels, selected at run time
+#if !USE_ASM && (defined __i386__ || defined __x86_64__) && defined __GNUC__
+#define USE_SW_X86  1
+#include <immintrin.h>
+#endif
+
+// per-frame state private to the thread rendering a band
+#if USE_BAND_THREADS
+#ifdef _MSC_VER
+#define R_TLS   __declspec(thread)
+#else
+#define R_TLS   __thread
+#endif
+#else
+#define R_TLS
+#endif
+
 //===================================================================
 
 typedef unsigned char pixel_t;
@@ -78,7 +102,7 @@ typedef struct {
     int             ambientlight;
 } oldrefdef_t;
 
-extern oldrefdef_t      r_refdef;
+extern R_TLS oldrefdef_t      r_refdef;
 
 /*
 ====================================================
@@ -145,6 +169,7 @@ extern oldrefdef_t      r_refdef;
 #define MINSURFACES             NUMSTACKSURFACES
 #define MAXSURFACES             10000
 #define MAXSPANS                3000
+#define MAX_ALPHA_SURFACES      1024
 
 // flags in finalvert_t.flags
 #define ALIAS_LEFT_CLIP             0x0001
@@ -290,6 +315,15 @@ typedef struct espan_s {
     struct espan_s  *pnext;
 } espan_t;
 
+// !!! if this is changed, it must be changed in asm_draw.h too !!!
+typedef struct {
+    void            *pdest;
+    short           *pz;
+    int             count;
+    byte            *ptex;
+    int             sfrac, tfrac, light, zi;
+} spanpackage_t;
+
 // used by the polygon drawer (R_POLY.C) and sprite setup code (R_SPRITE.C)
 typedef struct {
     int         nump;
@@ -370,13 +404,13 @@ VARS
 ====================================================
 */
 
-extern int      d_spanpixcount;
+extern R_TLS int      d_spanpixcount;
 extern int      r_framecount;       // sequence # of current frame since Quake started
 extern float    r_aliasuvscale;     // scale-up factor for screen u and v
                                     // on Alias vertices passed to driver
 extern qboolean r_dowarp;
 
-extern affinetridesc_t  r_affinetridesc;
+extern R_TLS affinetridesc_t  r_affinetridesc;
 
 void D_DrawSurfaces(void);
 void D_ViewChanged(void);
@@ -387,60 +421,97 @@ void R_PolysetUpdateTables(void);
 
 // callbacks to Quake
 
-extern drawsurf_t       r_drawsurf;
+extern R_TLS drawsurf_t       r_drawsurf;
 
 void R_DrawSurface(void);
 
-extern int              c_surf;
+extern R_TLS int              c_surf;
 
 extern byte             r_warpbuffer[WARP_WIDTH * WARP_HEIGHT * VID_BYTES];
 
-extern float    scale_for_mip;
+extern R_TLS float    scale_for_mip;
 
-extern float    d_sdivzstepu, d_tdivzstepu, d_zistepu;
-extern float    d_sdivzstepv, d_tdivzstepv, d_zistepv;
-extern float    d_sdivzorigin, d_tdivzorigin, d_ziorigin;
+extern R_TLS float    d_sdivzstepu, d_tdivzstepu, d_zistepu;
+extern R_TLS float    d_sdivzstepv, d_tdivzstepv, d_zistepv;
+extern R_TLS float    d_sdivzorigin, d_tdivzorigin, d_ziorigin;
 
-extern fixed16_t    sadjust, tadjust;
-extern fixed16_t    bbextents, bbextentt;
+extern R_TLS fixed16_t    sadjust, tadjust;
+extern R_TLS fixed16_t    bbextents, bbextentt;
 
 void D_DrawTurbulent16(espan_t *pspan, int *warptable);
 void D_DrawSpans16(espan_t *pspans);
 void D_DrawZSpans(espan_t *pspans);
 
+void R_DrawSurfaceBlock8_mip0(void);
+void R_DrawSurfaceBlock8_mip1(void);
+void R_DrawSurfaceBlock8_mip2(void);
+void R_DrawSurfaceBlock8_mip3(void);
+
+void R_PolysetDrawSpans8_Opaque(spanpackage_t *pspanpackage);
+void R_PolysetDrawSpans8_Blended(spanpackage_t *pspanpackage);
+void R_PolysetDrawSpansConstant8_Blended(spanpackage_t *pspanpackage);
+
+#if USE_SW_X86
+void D_DrawTurbulent16_SSE2(espan_t *pspan, int *warptable);
+void D_DrawSpans16_SSE2(espan_t *pspans);
+void R_DrawSurfaceBlock8_mip0_SSE2(void);
+void R_DrawSurfaceBlock8_mip1_SSE2(void);
+void R_DrawSurfaceBlock8_mip2_SSE2(void);
+void R_DrawSurfaceBlock8_mip3_SSE2(void);
+
+void D_DrawTurbulent16_AVX2(espan_t *pspan, int *warptable);
+void D_DrawSpans16_AVX2(espan_t *pspans);
+void R_DrawSurfaceBlock8_mip0_AVX2(void);
+void R_DrawSurfaceBlock8_mip1_AVX2(void);
+void R_PolysetDrawSpans8_Opaque_AVX2(spanpackage_t *pspanpackage);
+void R_PolysetDrawSpans8_Blended_AVX2(spanpackage_t *pspanpackage);
+#endif
+
+// pixel kernels that have CPU specific versions. SIMD versions produce the
+// same colors as C, but write the unused fourth byte of each pixel as zero.
+typedef struct {
+    const char  *name;
+    void        (*drawspans)(espan_t *pspans);
+    void        (*drawturbulent)(espan_t *pspan, int *warptable);
+    void        (*surfblock[4])(void);      // indexed by surface mip level
+    void        (*polysetopaque)(spanpackage_t *pspanpackage);
+    void        (*polysetblended)(spanpackage_t *pspanpackage);
+} swkernels_t;
+
+extern const swkernels_t    *sw_kernels;
+
 surfcache_t     *D_CacheSurface(mface_t *surface, int miplevel);
 
-extern int      d_vrectx, d_vrecty, d_vrectright_particle, d_vrectbottom_particle;
+extern R_TLS int      d_vrectx, d_vrecty, d_vrectright_particle, d_vrectbottom_particle;
 
-extern int      d_pix_min, d_pix_max, d_pix_shift;
+extern R_TLS int      d_pix_min, d_pix_max, d_pix_shift;
 
-extern pixel_t  *d_viewbuffer;
+extern R_TLS pixel_t  *d_viewbuffer;
 extern short *d_pzbuffer;
-extern unsigned int d_zrowbytes, d_zwidth;
-extern short    *zspantable[MAXHEIGHT];
-extern int      d_scantable[MAXHEIGHT];
+extern R_TLS unsigned int d_zrowbytes, d_zwidth;
+extern R_TLS short    *zspantable[MAXHEIGHT];
+extern R_TLS int      d_scantable[MAXHEIGHT];
 
 extern int      d_minmip;
 extern float    d_scalemip[3];
 
 //===================================================================
 
-extern int      cachewidth;
-extern pixel_t  *cacheblock;
-extern int      r_screenrowbytes;
+extern R_TLS int      cachewidth;
+extern R_TLS pixel_t  *cacheblock;
+extern R_TLS int      r_screenrowbytes;
 
-extern int      r_drawnpolycount;
+extern R_TLS int      r_drawnpolycount;
 
 extern int      sintable[CYCLE * 2];
 extern int      intsintable[CYCLE * 2];
 extern int      blanktable[CYCLE * 2];      // PGM
 
-extern vec3_t   vup, base_vup;
-extern vec3_t   vpn, base_vpn;
-extern vec3_t   vright, base_vright;
+extern R_TLS vec3_t   vup, base_vup;
+extern R_TLS vec3_t   vpn, base_vpn;
+extern R_TLS vec3_t   vright, base_vright;
 
-extern surf_t   *auxsurfaces;
-extern surf_t   *surfaces, *surface_p, *surf_max;
+extern R_TLS surf_t   *surfaces, *surface_p, *surf_max;
 
 // surfaces are generated in back to front order by the bsp, so if a surf
 // pointer is greater than another one, it should be drawn in front
@@ -453,16 +524,16 @@ extern surf_t   *surfaces, *surface_p, *surf_max;
 extern vec3_t   sxformaxis[4];  // s axis transformed into viewspace
 extern vec3_t   txformaxis[4];  // t axis transformed into viewspac
 
-extern float    xcenter, ycenter;
-extern float    xscale, yscale;
-extern float    xscaleinv, yscaleinv;
-extern float    xscaleshrink, yscaleshrink;
+extern R_TLS float    xcenter, ycenter;
+extern R_TLS float    xscale, yscale;
+extern R_TLS float    xscaleinv, yscaleinv;
+extern R_TLS float    xscaleshrink, yscaleshrink;
 
 extern void R_TransformVector(vec3_t in, vec3_t out);
 extern void SetUpForLineScan(fixed8_t startvertu, fixed8_t startvertv,
                              fixed8_t endvertu, fixed8_t endvertv);
 
-extern int      ubasestep, errorterm, erroradjustup, erroradjustdown;
+extern R_TLS int      ubasestep, errorterm, erroradjustup, erroradjustdown;
 
 //===========================================================================
 
@@ -496,8 +567,8 @@ extern cvar_t   *vid_fullscreen;
 extern cvar_t   *vid_gamma;
 
 
-extern clipplane_t  view_clipplanes[4];
-extern int          *pfrustum_indexes[4];
+extern R_TLS clipplane_t  view_clipplanes[4];
+extern R_TLS int          *pfrustum_indexes[4];
 
 
 //=============================================================================
@@ -506,22 +577,23 @@ void R_RenderWorld(void);
 
 //=============================================================================
 
-extern cplane_t     screenedge[4];
+extern R_TLS cplane_t     screenedge[4];
 
-extern vec3_t       r_origin;
+extern R_TLS vec3_t       r_origin;
 
 extern entity_t     r_worldentity;
-extern model_t      *currentmodel;
-extern entity_t     *currententity;
-extern vec3_t       modelorg;
-extern vec3_t       r_entorigin;
+extern R_TLS model_t      *currentmodel;
+extern R_TLS entity_t     *currententity;
+extern R_TLS vec3_t       modelorg;
+extern R_TLS vec3_t       r_entorigin;
 
-extern float        verticalFieldOfView;
-extern float        xOrigin, yOrigin;
+extern R_TLS float        verticalFieldOfView;
+extern R_TLS float        xOrigin, yOrigin;
 
 extern int          r_visframecount;
 
-extern mface_t      *r_alpha_surfaces;
+extern R_TLS mface_t      *r_alpha_surfaces[MAX_ALPHA_SURFACES];
+extern R_TLS int          r_numalphasurfaces;
 
 //=============================================================================
 
@@ -531,7 +603,7 @@ void R_DrawPolyList(void);
 //
 // current entity info
 //
-extern qboolean     insubmodel;
+extern R_TLS qboolean     insubmodel;
 
 void R_DrawAlphaSurfaces(void);
 
@@ -570,49 +642,48 @@ extern void R_EdgeCodeEnd(void);
 
 extern void R_RotateBmodel(void);
 
-extern int      c_faceclip;
-extern int      r_polycount;
-extern int      r_wholepolycount;
+extern R_TLS int      c_faceclip;
+extern R_TLS int      r_polycount;
+extern R_TLS int      r_wholepolycount;
 
-extern int          ubasestep, errorterm, erroradjustup, erroradjustdown;
+extern R_TLS int          ubasestep, errorterm, erroradjustup, erroradjustdown;
 
-extern fixed16_t    sadjust, tadjust;
-extern fixed16_t    bbextents, bbextentt;
+extern R_TLS fixed16_t    sadjust, tadjust;
+extern R_TLS fixed16_t    bbextents, bbextentt;
 
 extern mvertex_t    *r_ptverts, *r_ptvertsmax;
 
-extern float        entity_rotation[3][3];
+extern R_TLS float        entity_rotation[3][3];
 
-extern int          r_currentkey;
-extern int          r_currentbkey;
+extern R_TLS int          r_currentkey;
+extern R_TLS int          r_currentbkey;
 
 void R_InitTurb(void);
 
 void R_DrawParticles(void);
 void R_SurfacePatch(void);
 
-extern int          r_amodels_drawn;
-extern edge_t       *auxedges;
+extern R_TLS int          r_amodels_drawn;
 extern int          r_numallocatededges;
-extern edge_t       *r_edges, *edge_p, *edge_max;
+extern R_TLS edge_t       *r_edges, *edge_p, *edge_max;
 
-extern edge_t   *newedges[MAXHEIGHT];
-extern edge_t   *removeedges[MAXHEIGHT];
+extern R_TLS edge_t   *newedges[MAXHEIGHT];
+extern R_TLS edge_t   *removeedges[MAXHEIGHT];
 
 // FIXME: make stack vars when debugging done
-extern edge_t   edge_head;
-extern edge_t   edge_tail;
-extern edge_t   edge_aftertail;
+extern R_TLS edge_t   edge_head;
+extern R_TLS edge_t   edge_tail;
+extern R_TLS edge_t   edge_aftertail;
 
-extern fixed8_t r_aliasblendcolor[3];
+extern R_TLS fixed8_t r_aliasblendcolor[3];
 
-extern int      r_alias_alpha;
-extern int      r_alias_one_minus_alpha;
+extern R_TLS int      r_alias_alpha;
+extern R_TLS int      r_alias_one_minus_alpha;
 
-extern float    aliasxscale, aliasyscale, aliasxcenter, aliasycenter;
+extern R_TLS float    aliasxscale, aliasyscale, aliasxcenter, aliasycenter;
 
-extern int      r_outofsurfaces;
-extern int      r_outofedges;
+extern R_TLS int      r_outofsurfaces;
+extern R_TLS int      r_outofedges;
 
 extern int      r_maxvalidedgeoffset;
 
@@ -620,29 +691,29 @@ typedef struct {
     finalvert_t *a, *b, *c;
 } aliastriangleparms_t;
 
-extern aliastriangleparms_t aliastriangleparms;
+extern R_TLS aliastriangleparms_t aliastriangleparms;
 
 void R_DrawTriangle(void);
 void R_AliasClipTriangle(finalvert_t *index0, finalvert_t *index1, finalvert_t *index2);
 
 
 extern float    r_time1;
-extern float    da_time1, da_time2;
-extern float    dp_time1, dp_time2, db_time1, db_time2, rw_time1, rw_time2;
-extern float    se_time1, se_time2, de_time1, de_time2, dv_time1, dv_time2;
-extern int      r_frustum_indexes[4 * 6];
+extern R_TLS float    da_time1, da_time2;
+extern R_TLS float    dp_time1, dp_time2, db_time1, db_time2, rw_time1, rw_time2;
+extern R_TLS float    se_time1, se_time2, de_time1, de_time2;
+extern R_TLS int      r_frustum_indexes[4 * 6];
 extern int      r_maxsurfsseen, r_maxedgesseen, r_cnumsurfs;
 extern qboolean r_surfsonstack;
 
 extern mleaf_t  *r_viewleaf;
 extern int      r_viewcluster, r_oldviewcluster;
 
-extern int      r_clipflags;
+extern R_TLS int      r_clipflags;
 extern int      r_dlightframecount;
 
 extern bsp_t    *r_worldmodel;
 
-extern blocklight_t     blocklights[MAX_BLOCKLIGHTS * LIGHTMAP_BYTES];   // allow some very large lightmaps
+extern R_TLS blocklight_t     blocklights[MAX_BLOCKLIGHTS * LIGHTMAP_BYTES];   // allow some very large lightmaps
 
 void R_PrintAliasStats(void);
 void R_PrintTimes(void);
@@ -702,3 +773,70 @@ void R_IMFlatShadedQuad(vec3_t a, vec3_t b, vec3_t c, vec3_t d, color_t color, f
 
 void R_InitDraw(void);
 
+
+/*
+====================================================
+
+BANDS
+
+The view is split into horizontal bands. Each band is rendered from start
+to finish by its own thread, with private edge and span tables, surface
+cache and per-frame state. Bands share the frame buffer and Z buffer, but
+never touch rows outside of their own range.
+
+====================================================
+*/
+
+#define MAX_BANDS   16
+
+typedef struct {
+    int             top, bottom;    // view rows covered, [top, bottom)
+
+    edge_t          *auxedges;
+    surf_t          *auxsurfaces;
+
+    surfcache_t     *sc_base, *sc_rover;
+    int             sc_size;
+
+    surfcache_t     **cachespots;   // MIPLEVELS per world and sky face
+    uintptr_t       *edgecache;     // per world and sky edge
+    unsigned        *leafkeys;      // BSP order of world leafs
+
+    // statistics for the last frame
+    unsigned        usec;
+    int             faceclip, polycount, drawnpolycount;
+    int             surfs, amodels, outofsurfaces, outofedges;
+    int             outofbedges;
+
+    // error that aborted the band, raised by the main thread after join
+    jmp_buf         abortframe;
+    error_type_t    errtype;
+    char            error[MAX_STRING_CHARS];
+
+#if USE_BAND_THREADS
+    sys_thread_t    *thread;
+    sys_event_t     *start, *done;
+    qboolean        quit;
+#endif
+} band_t;
+
+extern band_t       r_bands[MAX_BANDS];
+extern int          r_numbands;
+extern R_TLS band_t *r_band;
+
+extern cvar_t       *sw_threads;
+
+void R_InitBands(void);
+void R_ShutdownBands(void);
+void R_AllocBandData(void);
+void R_FreeBandData(void);
+void R_RenderBands(void);
+void R_RenderBand(band_t *band);
+void R_PrintBandTimes(void);
+
+void R_BandError(error_type_t type, const char *fmt, ...) q_noreturn q_printf(2, 3);
+
+void R_SetupView(const band_t *band);
+void R_SetupSkyBox(void);
+int R_SkyFaceNum(mface_t *surf);
+int R_SkyEdgeNum(medge_t *edge);
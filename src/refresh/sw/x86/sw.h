@@ -143,7 +143,6 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 // medge_t structure
 #define me_v                0
-#define me_cachededgeoffset    4
 #define me_size                8
 
 // mvertex_t structure
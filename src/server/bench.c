@@ -0,0 +1,482 @@
+/*
+Copyright (C) 2003-2008 Andrey Nazarov
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+//
+// bench.c -- usercmd recording and server simulation benchmark
+//
+
+#include "server.h"
+
+#define BENCH_MAGIC     "Q2UC"
+#define BENCH_VERSION   1
+
+#define BENCH_HEADER    (4 + 4 + MAX_QPATH)
+#define BENCH_RECORD    17
+#define BENCH_MAXCMDS   4096
+
+typedef struct {
+    int         slot;
+    usercmd_t   cmd;
+} bench_cmd_t;
+
+typedef struct {
+    bench_cmd_t *cmds;
+    int         numcmds;
+} bench_frame_t;
+
+static struct {
+    qhandle_t   file;
+    sizebuf_t   buf;
+    int         numcmds;
+    int         numframes;
+} rec;
+
+/*
+==============================================================================
+
+RECORDING
+
+==============================================================================
+*/
+
+/*
+==================
+SV_BenchRecordCmd
+
+Called for every usercmd passed to the game.
+==================
+*/
+void SV_BenchRecordCmd(client_t *client, usercmd_t *cmd)
+{
+    sizebuf_t *buf = &rec.buf;
+
+    if (!rec.file) {
+        return;
+    }
+
+    if (rec.numcmds == BENCH_MAXCMDS) {
+        Com_WPrintf("%s: too many usercmds in frame\n", __func__);
+        return;
+    }
+
+    SZ_WriteByte(buf, client->slot);
+    SZ_WriteByte(buf, cmd->msec);
+    SZ_WriteByte(buf, cmd->buttons);
+    SZ_WriteByte(buf, cmd->impulse);
+    SZ_WriteByte(buf, cmd->lightlevel);
+    SZ_WriteShort(buf, cmd->angles[0]);
+    SZ_WriteShort(buf, cmd->angles[1]);
+    SZ_WriteShort(buf, cmd->angles[2]);
+    SZ_WriteShort(buf, cmd->forwardmove);
+    SZ_WriteShort(buf, cmd->sidemove);
+    SZ_WriteShort(buf, cmd->upmove);
+    rec.numcmds++;
+}
+
+/*
+==================
+SV_BenchEndFrame
+
+Writes usercmds collected during the frame.
+==================
+*/
+void SV_BenchEndFrame(void)
+{
+    if (!rec.file) {
+        return;
+    }
+
+    // frame header is reserved in front of the commands
+    rec.buf.data[0] = rec.numcmds & 255;
+    rec.buf.data[1] = rec.numcmds >> 8;
+    FS_Write(rec.buf.data, rec.buf.cursize, rec.file);
+
+    rec.buf.cursize = 2;
+    rec.numcmds = 0;
+    rec.numframes++;
+}
+
+void SV_BenchStopRecord(void)
+{
+    if (!rec.file) {
+        return;
+    }
+
+    Com_Printf("Stopped usercmd recording (%d frames).\n", rec.numframes);
+
+    FS_FCloseFile(rec.file);
+    Z_Free(rec.buf.data);
+    memset(&rec, 0, sizeof(rec));
+}
+
+/*
+==================
+SV_BenchRecord_f
+
+Begins recording usercmds of all connected clients.
+==================
+*/
+void SV_BenchRecord_f(void)
+{
+    char        buffer[MAX_OSPATH];
+    char        mapname[MAX_QPATH];
+    qhandle_t   f;
+
+    if (Cmd_Argc() != 2) {
+        Com_Printf("Usage: %s <filename>\n", Cmd_Argv(0));
+        return;
+    }
+
+    if (sv.state != ss_game) {
+        Com_Printf("No game running.\n");
+        return;
+    }
+
+    if (rec.file) {
+        Com_Printf("Already recording usercmds.\n");
+        return;
+    }
+
+    f = FS_EasyOpenFile(buffer, sizeof(buffer), FS_MODE_WRITE,
+                        "bench/", Cmd_Argv(1), ".ucmd");
+    if (!f) {
+        return;
+    }
+
+    rec.file = f;
+    SZ_Init(&rec.buf, SV_Malloc(2 + BENCH_MAXCMDS * BENCH_RECORD),
+            2 + BENCH_MAXCMDS * BENCH_RECORD);
+
+    memset(mapname, 0, sizeof(mapname));
+    Q_strlcpy(mapname, sv.name, sizeof(mapname));
+
+    SZ_Write(&rec.buf, BENCH_MAGIC, 4);
+    SZ_WriteLong(&rec.buf, BENCH_VERSION);
+    SZ_Write(&rec.buf, mapname, sizeof(mapname));
+    FS_Write(rec.buf.data, rec.buf.cursize, f);
+
+    rec.buf.cursize = 2;
+
+    Com_Printf("Recording usercmds to %s\n", buffer);
+}
+
+void SV_BenchStop_f(void)
+{
+    if (!rec.file) {
+        Com_Printf("Not recording usercmds.\n");
+        return;
+    }
+
+    SV_BenchStopRecord();
+}
+
+/*
+==============================================================================
+
+PLAYBACK
+
+==============================================================================
+*/
+
+static bench_frame_t *load_frames(const char *name, int *numframes_p, int *numslots_p, int *slots)
+{
+    char            buffer[MAX_OSPATH];
+    byte            *data, *p, *end;
+    bench_frame_t   *frames;
+    bench_cmd_t     *cmd;
+    int             i, j, count, numframes, numcmds, numslots;
+    qboolean        seen[MAX_CLIENTS];
+    ssize_t         len;
+
+    if (Q_concat(buffer, sizeof(buffer), "bench/", name, NULL) >= sizeof(buffer)) {
+        Com_Printf("Oversize filename specified.\n");
+        return NULL;
+    }
+    COM_DefaultExtension(buffer, ".ucmd", sizeof(buffer));
+
+    len = FS_LoadFile(buffer, (void **)&data);
+    if (!data) {
+        Com_EPrintf("Couldn't load %s: %s\n", buffer, Q_ErrorString(len));
+        return NULL;
+    }
+
+    if (len < BENCH_HEADER || memcmp(data, BENCH_MAGIC, 4) || LittleLongMem(data + 4) != BENCH_VERSION) {
+        Com_EPrintf("%s is not a usercmd recording\n", buffer);
+        goto fail;
+    }
+
+    data[8 + MAX_QPATH - 1] = 0;
+    if (strcmp((char *)data + 8, sv.name)) {
+        Com_WPrintf("%s was recorded on %s, not %s\n",
+                    buffer, (char *)data + 8, sv.name);
+    }
+
+    // count frames and commands
+    end = data + len;
+    numframes = numcmds = 0;
+    for (p = data + BENCH_HEADER; end - p >= 2; p += count * BENCH_RECORD) {
+        count = LittleShortMem(p);
+        p += 2;
+        if (end - p < count * BENCH_RECORD) {
+            break;
+        }
+        numframes++;
+        numcmds += count;
+    }
+
+    if (!numcmds) {
+        Com_EPrintf("%s has no usercmds\n", buffer);
+        goto fail;
+    }
+
+    frames = SV_Malloc(sizeof(*frames) * numframes + sizeof(*cmd) * numcmds);
+    cmd = (bench_cmd_t *)(frames + numframes);
+
+    memset(seen, 0, sizeof(seen));
+    p = data + BENCH_HEADER;
+    for (i = 0; i < numframes; i++) {
+        count = LittleShortMem(p);
+        p += 2;
+        frames[i].cmds = cmd;
+        frames[i].numcmds = count;
+        for (j = 0; j < count; j++, cmd++, p += BENCH_RECORD) {
+            cmd->slot = p[0];
+            cmd->cmd.msec = p[1];
+            cmd->cmd.buttons = p[2];
+            cmd->cmd.impulse = p[3];
+            cmd->cmd.lightlevel = p[4];
+            cmd->cmd.angles[0] = (int16_t)LittleShortMem(p + 5);
+            cmd->cmd.angles[1] = (int16_t)LittleShortMem(p + 7);
+            cmd->cmd.angles[2] = (int16_t)LittleShortMem(p + 9);
+            cmd->cmd.forwardmove = (int16_t)LittleShortMem(p + 11);
+            cmd->cmd.sidemove = (int16_t)LittleShortMem(p + 13);
+            cmd->cmd.upmove = (int16_t)LittleShortMem(p + 15);
+            if (cmd->slot < MAX_CLIENTS) {
+                seen[cmd->slot] = qtrue;
+            }
+        }
+    }
+
+    FS_FreeFile(data);
+
+    numslots = 0;
+    for (i = 0; i < MAX_CLIENTS; i++) {
+        if (seen[i]) {
+            slots[numslots++] = i;
+        }
+    }
+
+    *numframes_p = numframes;
+    *numslots_p = numslots;
+    return frames;
+
+fail:
+    FS_FreeFile(data);
+    return NULL;
+}
+
+// feeds a single usercmd through the regular client message path
+static void execute_cmd(client_t *cl, const usercmd_t *cmd)
+{
+    MSG_WriteByte(clc_move);
+    MSG_WriteByte(0);   // checksum
+    MSG_WriteLong(cl->framenum - 1);
+    MSG_WriteDeltaUsercmd(NULL, &cl->lastcmd, 0);
+    MSG_WriteByte(cmd->lightlevel);
+    MSG_WriteDeltaUsercmd(&cl->lastcmd, &cl->lastcmd, 0);
+    MSG_WriteByte(cmd->lightlevel);
+    MSG_WriteDeltaUsercmd(&cl->lastcmd, cmd, 0);
+    MSG_WriteByte(cmd->lightlevel);
+
+    memcpy(msg_read_buffer, msg_write.data, msg_write.cursize);
+    SZ_Init(&msg_read, msg_read_buffer, MAX_MSGLEN);
+    msg_read.cursize = msg_write.cursize;
+    SZ_Clear(&msg_write);
+
+    // pretend netchan accepted the packet
+    cl->netchan->incoming_sequence++;
+    cl->netchan->dropped = 0;
+    cl->netchan->last_received = com_localTime;
+    cl->lastmessage = svs.realtime;
+
+    SV_ExecuteClientMessage(cl);
+}
+
+static int spawn_bots(client_t **bots, int count)
+{
+    char        userinfo[MAX_INFO_STRING];
+    client_t    *cl;
+    int         i, numbots;
+
+    numbots = 0;
+    for (i = 0; i < sv_maxclients->integer && numbots < count; i++) {
+        cl = &svs.client_pool[i];
+        if (cl->state != cs_free) {
+            continue;
+        }
+
+        Q_snprintf(userinfo, sizeof(userinfo),
+                   "\\name\\bench%d\\skin\\male/grunt\\rate\\25000"
+                   "\\msg\\1\\hand\\2", numbots);
+        if (!SV_ConnectSimulatedClient(cl, userinfo)) {
+            Com_WPrintf("Game refused simulated client %d\n", numbots);
+            break;
+        }
+
+        sv_client = cl;
+        sv_player = cl->edict;
+        SV_New_f();
+        SV_Begin_f();
+        sv_client = NULL;
+        sv_player = NULL;
+
+        if (cl->state != cs_spawned) {
+            SV_RemoveClient(cl);
+            break;
+        }
+
+        cl->netchan->reliable_length = 0;
+        cl->netchan->total_bytes_sent = 0;
+        bots[numbots++] = cl;
+    }
+
+    return numbots;
+}
+
+/*
+==================
+SV_Benchmark_f
+
+Replays a usercmd recording with simulated clients, running server
+frames as fast as possible.
+==================
+*/
+void SV_Benchmark_f(void)
+{
+    static const char *const names[BENCH_STAGES] = {
+        "input", "game", "send", "other"
+    };
+    client_t        *bots[MAX_CLIENTS];
+    int             slots[MAX_CLIENTS];
+    uint64_t        times[BENCH_STAGES];
+    uint64_t        start, total, bytes, before;
+    bench_frame_t   *frames, *frame;
+    bench_cmd_t     *cmd;
+    int             i, j, k, numbots, numframes, numslots, count, slot;
+
+    if (Cmd_Argc() < 2) {
+        Com_Printf("Usage: %s <filename> [clients] [frames]\n", Cmd_Argv(0));
+        return;
+    }
+
+    if (sv.state != ss_game) {
+        Com_Printf("No game running.\n");
+        return;
+    }
+
+    if (rec.file) {
+        Com_Printf("Can't benchmark while recording usercmds.\n");
+        return;
+    }
+
+    if (!LIST_EMPTY(&sv_clientlist)) {
+        Com_Printf("Can't benchmark with clients connected.\n");
+        return;
+    }
+
+    frames = load_frames(Cmd_Argv(1), &numframes, &numslots, slots);
+    if (!frames) {
+        return;
+    }
+
+    count = Cmd_Argc() > 2 ? atoi(Cmd_Argv(2)) : numslots;
+    clamp(count, 1, sv_maxclients->integer);
+
+    numbots = spawn_bots(bots, count);
+    if (!numbots) {
+        Com_Printf("No simulated clients spawned.\n");
+        Z_Free(frames);
+        return;
+    }
+
+    count = Cmd_Argc() > 3 ? atoi(Cmd_Argv(3)) : numframes;
+    if (count < 1) {
+        count = numframes;
+    }
+
+    Com_Printf("Benchmarking %d frames with %d clients...\n", count, numbots);
+
+    memset(times, 0, sizeof(times));
+    start = Sys_Microseconds();
+
+    for (i = 0; i < count; i++) {
+        frame = &frames[i % numframes];
+        svs.realtime += SV_FRAMETIME;
+
+        before = Sys_Microseconds();
+        for (j = 0; j < numbots; j++) {
+            slot = slots[j % numslots];
+            for (k = 0, cmd = frame->cmds; k < frame->numcmds; k++, cmd++) {
+                if (cmd->slot == slot && bots[j]->state == cs_spawned) {
+                    execute_cmd(bots[j], &cmd->cmd);
+                }
+            }
+        }
+        times[BENCH_INPUT] += Sys_Microseconds() - before;
+
+        SV_RunFrame(times);
+
+        // acknowledge reliable data right away
+        for (j = 0; j < numbots; j++) {
+            if (bots[j]->netchan) {
+                bots[j]->netchan->reliable_length = 0;
+            }
+        }
+    }
+
+    total = Sys_Microseconds() - start;
+    if (!total) {
+        total = 1;
+    }
+
+    bytes = 0;
+    for (j = 0; j < numbots; j++) {
+        if (bots[j]->netchan) {
+            bytes += bots[j]->netchan->total_bytes_sent;
+        }
+    }
+
+    Com_Printf("%d frames, %.3f seconds, %.1f fps\n", count,
+               total * 1e-6, count * 1e6 / total);
+    for (i = 0; i < BENCH_STAGES; i++) {
+        Com_Printf("%-6s %8.1f usec/frame %5.1f%%\n", names[i],
+                   (double)times[i] / count, times[i] * 100.0 / total);
+    }
+    Com_Printf("%.1f bytes/frame per client\n",
+               (double)bytes / ((uint64_t)count * numbots));
+
+    // bots dropped by the game may be already gone
+    for (j = 0; j < numbots; j++) {
+        if (bots[j]->state != cs_free) {
+            SV_DropClient(bots[j], NULL);
+            SV_RemoveClient(bots[j]);
+        }
+    }
+
+    Z_Free(frames);
+}
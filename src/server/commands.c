@@ -301,6 +301,7 @@ static void SV_Map(int argnum, qboolean restart)
     if (len >= sizeof(expanded)) {
         ret = Q_ERR_NAMETOOLONG;
     } else {
+        SV_CheckMapCache();
         ret = CM_LoadMap(&cm, expanded);
     }
 
@@ -434,6 +435,10 @@ static void SV_Map_f(void)
     if (res < 0)
         return;
 
+    // forced restart picks up changes to map files
+    if (!strcmp(Cmd_Argv(2), "force"))
+        SV_FlushMapCache();
+
     SV_Map(1, !!res);
 }
 
@@ -496,13 +501,10 @@ static void SV_Kick_f(void)
     if (!strcmp(Cmd_Argv(0), "kickban")) {
         netadr_t *addr = &sv_client->netchan->remote_address;
         if (addr->type == NA_IP) {
-            addrmatch_t *match = Z_Malloc(sizeof(*match));
-            match->addr.u32 = addr->ip.u32;
-            match->mask = 0xffffffffU;
-            match->hits = 0;
-            match->time = 0;
-            match->comment[0] = 0;
-            List_Append(&sv_banlist, &match->entry);
+            uint8_t key[ADDR_KEY_BYTES];
+
+            SV_AddressKey(addr, key);
+            SV_AddMatch(&sv_banlist, key, ADDR_KEY_BITS, "");
         }
     }
 
@@ -999,15 +1001,14 @@ static void SV_ServerCommand_f(void)
     ge->ServerCommand();
 }
 
-// (ip & mask) == (addr & mask)
-// bits = 32 --> mask = 255.255.255.255
-// bits = 24 --> mask = 255.255.255.0
+// bits = 32 --> 255.255.255.255
+// bits = 24 --> 255.255.255.0
 
-static qboolean parse_mask(const char *s, uint32_t *addr, uint32_t *mask)
+static qboolean parse_mask(char *s, uint8_t *key, int *bits)
 {
     netadr_t address;
     char *p;
-    int bits;
+    int n;
 
     p = strchr(s, '/');
     if (p) {
@@ -1016,13 +1017,13 @@ static qboolean parse_mask(const char *s, uint32_t *addr, uint32_t *mask)
             Com_Printf("Please specify a mask after '/'.\n");
             return qfalse;
         }
-        bits = atoi(p);
-        if (bits < 1 || bits > 32) {
-            Com_Printf("Bad mask: %d bits\n", bits);
+        n = atoi(p);
+        if (n < 1 || n > 32) {
+            Com_Printf("Bad mask: %d bits\n", n);
             return qfalse;
         }
     } else {
-        bits = 32;
+        n = 32;
     }
 
     if (!NET_StringToAdr(s, &address, 0)) {
@@ -1030,86 +1031,72 @@ static qboolean parse_mask(const char *s, uint32_t *addr, uint32_t *mask)
         return qfalse;
     }
 
-    *addr = address.ip.u32;
-    *mask = BigLong(~((1 << (32 - bits)) - 1));
+    SV_AddressKey(&address, key);
+    *bits = ADDR_V4_OFFSET + n;
     return qtrue;
 }
 
 static size_t format_mask(addrmatch_t *match, char *buf, size_t size)
 {
-    uint8_t *ip = match->addr.u8;
-    uint32_t mask = BigLong(match->mask);
-    int i;
-
-    for (i = 0; i < 32; i++) {
-        if (mask & (1 << i)) {
-            break;
-        }
-    }
+    uint8_t *ip = match->key + 12;
 
     return Q_snprintf(buf, size, "%d.%d.%d.%d/%d",
-                      ip[0], ip[1], ip[2], ip[3], 32 - i);
+                      ip[0], ip[1], ip[2], ip[3], match->bits - ADDR_V4_OFFSET);
 }
 
-void SV_AddMatch_f(list_t *list)
+// adds a single "address[/mask] [comment]" entry, returns qfalse on
+// malformed input
+static qboolean add_match(addrlist_t *list, char *s, const char *comment,
+                          qboolean verbose)
 {
-    char *s, buf[32];
+    uint8_t key[ADDR_KEY_BYTES];
+    char buf[32];
+    int bits;
     addrmatch_t *match;
-    uint32_t addr, mask;
-    size_t len;
 
-    if (Cmd_Argc() < 2) {
-        Com_Printf("Usage: %s <address[/mask]> [comment]\n", Cmd_Argv(0));
-        return;
+    if (!parse_mask(s, key, &bits)) {
+        return qfalse;
     }
 
-    s = Cmd_Argv(1);
-    if (!parse_mask(s, &addr, &mask)) {
-        return;
+    if (!SV_AddMatch(list, key, bits, comment) && verbose) {
+        match = SV_FindMatch(list, key, bits);
+        format_mask(match, buf, sizeof(buf));
+        Com_Printf("Entry %s already exists.\n", buf);
     }
 
-    LIST_FOR_EACH(addrmatch_t, match, list, entry) {
-        if (match->addr.u32 == addr && match->mask == mask) {
-            format_mask(match, buf, sizeof(buf));
-            Com_Printf("Entry %s already exists.\n", buf);
-            return;
-        }
+    return qtrue;
+}
+
+void SV_AddMatch_f(addrlist_t *list)
+{
+    if (Cmd_Argc() < 2) {
+        Com_Printf("Usage: %s <address[/mask]> [comment]\n", Cmd_Argv(0));
+        return;
     }
 
-    s = Cmd_ArgsFrom(2);
-    len = strlen(s);
-    match = Z_Malloc(sizeof(*match) + len);
-    match->addr.u32 = addr;
-    match->mask = mask;
-    match->hits = 0;
-    match->time = 0;
-    memcpy(match->comment, s, len + 1);
-    List_Append(list, &match->entry);
+    add_match(list, Cmd_Argv(1), Cmd_ArgsFrom(2), qtrue);
 }
 
-void SV_DelMatch_f(list_t *list)
+void SV_DelMatch_f(addrlist_t *list)
 {
     char *s;
-    addrmatch_t *match, *next;
-    uint32_t addr, mask;
-    int i;
+    addrmatch_t *match;
+    uint8_t key[ADDR_KEY_BYTES];
+    int i, bits;
 
     if (Cmd_Argc() < 2) {
         Com_Printf("Usage: %s <address[/mask]|id|all>\n", Cmd_Argv(0));
         return;
     }
 
-    if (LIST_EMPTY(list)) {
+    if (LIST_EMPTY(&list->entries)) {
         Com_Printf("Address list is empty.\n");
         return;
     }
 
     s = Cmd_Argv(1);
     if (!strcmp(s, "all")) {
-        LIST_FOR_EACH_SAFE(addrmatch_t, match, next, list, entry) {
-            Z_Free(match);
-        }
-        List_Init(list);
+        SV_ClearMatches(list);
         return;
     }
 
@@ -1120,37 +1107,35 @@ void SV_DelMatch_f(list_t *list)
             Com_Printf("Bad index: %d\n", i);
             return;
         }
-        match = LIST_INDEX(addrmatch_t, i - 1, list, entry);
+        match = LIST_INDEX(addrmatch_t, i - 1, &list->entries, entry);
         if (match) {
-            goto remove;
+            SV_RemoveMatch(list, match);
+            return;
         }
         Com_Printf("No such index: %d\n", i);
         return;
     }
 
-    if (!parse_mask(s, &addr, &mask)) {
+    if (!parse_mask(s, key, &bits)) {
         return;
     }
 
-    LIST_FOR_EACH(addrmatch_t, match, list, entry) {
-        if (match->addr.u32 == addr && match->mask == mask) {
-remove:
-            List_Remove(&match->entry);
-            Z_Free(match);
-            return;
-        }
+    match = SV_FindMatch(list, key, bits);
+    if (match) {
+        SV_RemoveMatch(list, match);
+        return;
     }
     Com_Printf("No such entry: %s\n", s);
 }
 
-void SV_ListMatches_f(list_t *list)
+void SV_ListMatches_f(addrlist_t *list)
 {
     addrmatch_t *match;
     char last[32];
     char addr[32];
     int count;
 
-    if (LIST_EMPTY(list)) {
+    if (LIST_EMPTY(&list->entries)) {
         Com_Printf("Address list is empty.\n");
         return;
     }
@@ -1158,9 +1143,9 @@ void SV_ListMatches_f(list_t *list)
     Com_Printf("id address/mask       hits last hit     comment\n"
                "-- ------------------ ---- ------------ -------\n");
     count = 1;
-    LIST_FOR_EACH(addrmatch_t, match, list, entry) {
+    LIST_FOR_EACH(addrmatch_t, match, &list->entries, entry) {
         format_mask(match, addr, sizeof(addr));
-        if (!match->time) {
+        if (!match->hits) {
             strcpy(last, "never");
         } else {
             strftime(last, sizeof(last), "%d %b %H:%M",
@@ -1172,6 +1157,71 @@ void SV_ListMatches_f(list_t *list)
     }
 }
 
+/*
+==================
+SV_LoadMatches_f
+
+Bulk loads address list from a text file, one "address[/mask] [comment]"
+entry per line. Empty lines and lines starting with '#' or '/' are ignored.
+==================
+*/
+void SV_LoadMatches_f(addrlist_t *list)
+{
+    char *raw, *data, *p, *s;
+    unsigned count;
+    int linenum, added, bad;
+    qerror_t ret;
+
+    if (Cmd_Argc() != 2) {
+        Com_Printf("Usage: %s <filename>\n", Cmd_Argv(0));
+        return;
+    }
+
+    ret = FS_LoadFile(Cmd_Argv(1), (void **)&raw);
+    if (!raw) {
+        Com_Printf("Couldn't load %s: %s\n", Cmd_Argv(1), Q_ErrorString(ret));
+        return;
+    }
+
+    count = list->count;
+    added = bad = 0;
+    linenum = 1;
+    for (data = raw; *data; data = p + 1, linenum++) {
+        p = strchr(data, '\n');
+        if (p) {
+            if (p > data && *(p - 1) == '\r') {
+                *(p - 1) = 0;
+            }
+            *p = 0;
+        }
+
+        data += strspn(data, " \t");
+        if (*data && *data != '#' && *data != '/') {
+            // split address from comment
+            s = data + strcspn(data, " \t");
+            if (*s) {
+                *s++ = 0;
+                s += strspn(s, " \t");
+            }
+            added++;
+            if (!add_match(list, data, s, qfalse)) {
+                Com_Printf("...on line %d\n", linenum);
+                bad++;
+            }
+        }
+
+        if (!p) {
+            break;
+        }
+    }
+
+    FS_FreeFile(raw);
+
+    Com_Printf("Loaded %u entries from %s (%d duplicate, %d malformed).\n",
+               list->count - count, Cmd_Argv(1),
+               added - bad - (int)(list->count - count), bad);
+}
+
 static void SV_AddBan_f(void)
 {
     SV_AddMatch_f(&sv_banlist);
@@ -1184,6 +1234,10 @@ static void SV_ListBans_f(void)
 {
     SV_ListMatches_f(&sv_banlist);
 }
+static void SV_LoadBans_f(void)
+{
+    SV_LoadMatches_f(&sv_banlist);
+}
 
 static void SV_AddBlackHole_f(void)
 {
@@ -1197,6 +1251,10 @@ static void SV_ListBlackHoles_f(void)
 {
     SV_ListMatches_f(&sv_blacklist);
 }
+static void SV_LoadBlackHoles_f(void)
+{
+    SV_LoadMatches_f(&sv_blacklist);
+}
 
 static list_t *SV_FindStuffList(void)
 {
@@ -1536,15 +1594,23 @@ static const cmdreg_t c_server[] = {
     { "addban", SV_AddBan_f },
     { "delban", SV_DelBan_f },
     { "listbans", SV_ListBans_f },
+    { "loadbans", SV_LoadBans_f },
     { "addblackhole", SV_AddBlackHole_f },
     { "delblackhole", SV_DelBlackHole_f },
     { "listblackholes", SV_ListBlackHoles_f },
+    { "loadblackholes", SV_LoadBlackHoles_f },
     { "addstuffcmd", SV_AddStuffCmd_f, SV_StuffCmd_c },
     { "delstuffcmd", SV_DelStuffCmd_f, SV_StuffCmd_c },
     { "liststuffcmds", SV_ListStuffCmds_f, SV_StuffCmd_c },
     { "addfiltercmd", SV_AddFilterCmd_f, SV_AddFilterCmd_c },
     { "delfiltercmd", SV_DelFilterCmd_f, SV_DelFilterCmd_c },
     { "listfiltercmds", SV_ListFilterCmds_f },
+    { "benchrecord", SV_BenchRecord_f },
+    { "benchstop", SV_BenchStop_f },
+    { "benchmark", SV_Benchmark_f },
+#if USE_TESTS
+    { "rewindtest", SV_RewindTest_f },
+#endif
 #if USE_CLIENT
     { "savegame", SV_Savegame_f },
     { "loadgame", SV_Loadgame_f },
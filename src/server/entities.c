@@ -30,6 +30,77 @@ Encode a client frame onto the network channel
 #define Q2PRO_OPTIMIZE(c) \
     ((c)->protocol == PROTOCOL_VERSION_Q2PRO && !(c)->settings[CLS_RECORDING])
 
+/*
+=============================================================================
+
+Cache of encoded entity deltas
+
+Clients using the same protocol, esFlags and delta frame end up encoding
+identical (oldent, newent) pairs. Encoded bytes are memoized in a direct
+mapped table and copied into each client's message. Entries are verified by
+full comparison, thus stale or colliding entries are harmless.
+
+=============================================================================
+*/
+
+// hashes only the fields most likely to change, full comparison follows
+static unsigned hash_delta(const entity_packed_t *from,
+                           const entity_packed_t *to,
+                           msgEsFlags_t flags)
+{
+    unsigned hash;
+
+    hash = to->number | (flags << 16);
+    hash = hash * 31 + (uint16_t)from->origin[0];
+    hash = hash * 31 + (uint16_t)from->origin[1];
+    hash = hash * 31 + (uint16_t)from->origin[2];
+    hash = hash * 31 + (uint16_t)to->origin[0];
+    hash = hash * 31 + (uint16_t)to->origin[1];
+    hash = hash * 31 + (uint16_t)to->origin[2];
+    hash = hash * 31 + (uint16_t)from->angles[1];
+    hash = hash * 31 + (uint16_t)to->angles[1];
+    hash = hash * 31 + from->frame;
+    hash = hash * 31 + to->frame;
+    hash = hash * 31 + to->event;
+
+    return hash ^ (hash >> 11) ^ (hash >> 22);
+}
+
+static void SV_WriteDeltaEntity(const entity_packed_t *from,
+                                const entity_packed_t *to,
+                                msgEsFlags_t flags)
+{
+    delta_cache_t *c;
+    size_t start;
+
+    if (!sv_delta_cache->integer) {
+        MSG_WriteDeltaEntity(from, to, flags);
+        return;
+    }
+
+    if (!svs.delta_cache) {
+        svs.delta_cache = SV_Mallocz(sizeof(*c) * DELTA_CACHE_SIZE);
+    }
+
+    c = &svs.delta_cache[hash_delta(from, to, flags) & DELTA_CACHE_MASK];
+    if (c->flags == flags && c->to.number &&
+        !memcmp(&c->to, to, sizeof(*to)) &&
+        !memcmp(&c->from, from, sizeof(*from))) {
+        if (c->len)
+            MSG_WriteData(c->data, c->len);
+        return;
+    }
+
+    start = msg_write.cursize;
+    MSG_WriteDeltaEntity(from, to, flags);
+
+    c->from = *from;
+    c->to = *to;
+    c->flags = flags;
+    c->len = msg_write.cursize - start;
+    memcpy(c->data, msg_write.data + start, c->len);
+}
+
 /*
 =============
 SV_EmitPacketEntities
@@ -47,6 +118,20 @@ static void SV_EmitPacketEntities(client_t         *client,
     unsigned i, oldindex, newindex, from_num_entities;
     int oldnum, newnum;
     msgEsFlags_t flags;
+#if USE_MVD_CLIENT
+    frame_group_t *group = client->frame_group;
+    qboolean baselines = qfalse;
+    size_t start = msg_write.cursize;
+
+    if (group && group->sequence != svs.frame_sequence)
+        group = NULL;
+
+    if (group && group->len) {
+        MSG_WriteData(group->data, group->len);
+        svs.packets_shared++;
+        return;
+    }
+#endif
 
     if (!from)
         from_num_entities = 0;
@@ -91,7 +176,7 @@ static void SV_EmitPacketEntities(client_t         *client,
             if (Q2PRO_SHORTANGLES(client, newnum)) {
                 flags |= MSG_ES_SHORTANGLES;
             }
-            MSG_WriteDeltaEntity(oldent, newent, flags);
+            SV_WriteDeltaEntity(oldent, newent, flags);
             oldindex++;
             newindex++;
             continue;
@@ -106,6 +191,10 @@ static void SV_EmitPacketEntities(client_t         *client,
             } else {
                 oldent = &nullEntityState;
             }
+#if USE_MVD_CLIENT
+            // baselines are per client, result can't be shared
+            baselines = qtrue;
+#endif
             if (newnum == clientEntityNum) {
                 flags |= MSG_ES_FIRSTPERSON;
                 VectorCopy(oldent->origin, newent->origin);
@@ -114,7 +203,7 @@ static void SV_EmitPacketEntities(client_t         *client,
             if (Q2PRO_SHORTANGLES(client, newnum)) {
                 flags |= MSG_ES_SHORTANGLES;
             }
-            MSG_WriteDeltaEntity(oldent, newent, flags);
+            SV_WriteDeltaEntity(oldent, newent, flags);
             newindex++;
             continue;
         }
@@ -128,23 +217,46 @@ static void SV_EmitPacketEntities(client_t         *client,
     }
 
     MSG_WriteShort(0);      // end of packetentities
+
+#if USE_MVD_CLIENT
+    if (group && !baselines && !msg_write.overflowed &&
+        msg_write.cursize - start <= sizeof(group->data)) {
+        group->len = msg_write.cursize - start;
+        memcpy(group->data, msg_write.data + start, group->len);
+    }
+#endif
+}
+
+// players own entity is sent in first person mode, with origin and angles
+// taken from the previous frame
+static int client_entity_num(client_t *client, client_frame_t *frame)
+{
+    if (client->protocol == PROTOCOL_VERSION_Q2PRO &&
+        frame->ps.pmove.pm_type < PM_DEAD && !client->settings[CLS_RECORDING])
+        return frame->clientNum + 1;
+
+    return 0;
 }
 
-static client_frame_t *get_last_frame(client_t *client)
+// if peeking, only tells what frame is going to be used without side effects
+static client_frame_t *get_last_frame(client_t *client, qboolean peek)
 {
     client_frame_t *frame;
 
     if (client->lastframe <= 0) {
         // client is asking for a retransmit
-        client->frames_nodelta++;
+        if (!peek)
+            client->frames_nodelta++;
         return NULL;
     }
 
-    client->frames_nodelta = 0;
+    if (!peek)
+        client->frames_nodelta = 0;
 
     if (client->framenum - client->lastframe >= UPDATE_BACKUP) {
         // client hasn't gotten a good message through in a long time
-        Com_DPrintf("%s: delta request from out-of-date packet.\n", client->name);
+        if (!peek)
+            Com_DPrintf("%s: delta request from out-of-date packet.\n", client->name);
         return NULL;
     }
 
@@ -152,13 +264,15 @@ static client_frame_t *get_last_frame(client_t *client)
     frame = &client->frames[client->lastframe & UPDATE_MASK];
     if (frame->number != client->lastframe) {
         // but it got never sent
-        Com_DPrintf("%s: delta request from dropped frame.\n", client->name);
+        if (!peek)
+            Com_DPrintf("%s: delta request from dropped frame.\n", client->name);
         return NULL;
     }
 
     if (svs.next_entity - frame->first_entity > svs.num_entities) {
         // but entities are too old
-        Com_DPrintf("%s: delta request from out-of-date entities.\n", client->name);
+        if (!peek)
+            Com_DPrintf("%s: delta request from out-of-date entities.\n", client->name);
         return NULL;
     }
 
@@ -180,7 +294,7 @@ void SV_WriteFrameToClient_Default(client_t *client)
     frame = &client->frames[client->framenum & UPDATE_MASK];
 
     // this is the frame we are delta'ing from
-    oldframe = get_last_frame(client);
+    oldframe = get_last_frame(client, qfalse);
     if (oldframe) {
         oldstate = &oldframe->ps;
         lastframe = client->lastframe;
@@ -228,7 +342,7 @@ void SV_WriteFrameToClient_Enhanced(client_t *client)
     frame = &client->frames[client->framenum & UPDATE_MASK];
 
     // this is the frame we are delta'ing from
-    oldframe = get_last_frame(client);
+    oldframe = get_last_frame(client, qfalse);
     if (oldframe) {
         oldstate = &oldframe->ps;
         delta = client->framenum - client->lastframe;
@@ -271,11 +385,8 @@ void SV_WriteFrameToClient_Enhanced(client_t *client)
         }
     }
 
-    clientEntityNum = 0;
+    clientEntityNum = client_entity_num(client, frame);
     if (client->protocol == PROTOCOL_VERSION_Q2PRO) {
-        if (frame->ps.pmove.pm_type < PM_DEAD && !client->settings[CLS_RECORDING]) {
-            clientEntityNum = frame->clientNum + 1;
-        }
         if (client->settings[CLS_NOPREDICT]) {
             psFlags |= MSG_PS_IGNORE_PREDICTION;
         }
@@ -370,6 +481,157 @@ fix_old_origin(client_t *client, entity_packed_t *state, edict_t *ent, int e)
 }
 #endif
 
+#if USE_MVD_CLIENT
+
+/*
+=============================================================================
+
+Frames shared between MVD spectators
+
+Spectators chasing the same player on the same channel see exactly the same
+entities. Frame of the first such spectator is registered in a small hash
+table and reused by others, provided they delta compress from a frame with
+identical contents. Encoded packet entities are also reused, unless some
+entity had to be sent from per-client baseline.
+
+=============================================================================
+*/
+
+static unsigned hash_group(client_t *client, client_frame_t *frame, const vec3_t org)
+{
+    unsigned hash;
+
+    hash = (unsigned)((size_t)client->pool >> 4);
+    hash = hash * 31 + frame->clientNum;
+    hash = hash * 31 + (int)org[0];
+    hash = hash * 31 + (int)org[1];
+    hash = hash * 31 + (int)org[2];
+    hash = hash * 31 + client->protocol;
+
+    return hash ^ (hash >> 11) ^ (hash >> 22);
+}
+
+// clients that will build and encode identical frames given the same view
+static qboolean same_settings(client_t *a, client_t *b)
+{
+    return a->pool == b->pool && a->cm == b->cm &&
+           a->protocol == b->protocol && a->version == b->version &&
+           a->esFlags == b->esFlags &&
+#if USE_FPS
+           a->framediv == b->framediv &&
+#endif
+           a->settings[CLS_RECORDING] == b->settings[CLS_RECORDING] &&
+           a->settings[CLS_NOFOOTSTEPS] == b->settings[CLS_NOFOOTSTEPS] &&
+           a->settings[CLS_NOGIBS] == b->settings[CLS_NOGIBS];
+}
+
+static qboolean same_entities(client_frame_t *a, client_frame_t *b)
+{
+    unsigned i, j, k;
+
+    if (a->num_entities != b->num_entities)
+        return qfalse;
+
+    if (a->first_entity == b->first_entity)
+        return qtrue;
+
+    for (i = 0; i < a->num_entities; i++) {
+        j = (a->first_entity + i) % svs.num_entities;
+        k = (b->first_entity + i) % svs.num_entities;
+        if (memcmp(&svs.entities[j], &svs.entities[k], sizeof(svs.entities[0])))
+            return qfalse;
+    }
+
+    return qtrue;
+}
+
+static client_frame_t *shareable_frame(client_t *client, client_frame_t *frame)
+{
+    if (sv.state != ss_broadcast || !sv_shared_frames->integer)
+        return NULL;
+
+    // first person entity is patched per client while encoding
+    if (client_entity_num(client, frame))
+        return NULL;
+
+    if (!svs.frame_groups)
+        svs.frame_groups = SV_Mallocz(sizeof(frame_group_t) * FRAME_GROUPS);
+
+    return get_last_frame(client, qtrue);
+}
+
+static qboolean join_frame_group(client_t *client, client_frame_t *frame, const vec3_t org)
+{
+    client_frame_t *oldframe;
+    frame_group_t *group;
+    unsigned i, hash;
+
+    oldframe = shareable_frame(client, frame);
+    if (!oldframe)
+        return qfalse;
+
+    hash = hash_group(client, frame, org);
+    for (i = 0; i < FRAME_GROUP_PROBES; i++) {
+        group = &svs.frame_groups[(hash + i) & FRAME_GROUPS_MASK];
+        if (group->sequence != svs.frame_sequence)
+            continue;
+        if (group->frame->clientNum != frame->clientNum)
+            continue;
+        if (!VectorCompare(group->org, org))
+            continue;
+        if (!same_settings(group->leader, client))
+            continue;
+        // leader's delta frame may have been overwritten since
+        if (svs.next_entity - group->oldframe->first_entity > svs.num_entities)
+            continue;
+        if (!same_entities(group->oldframe, oldframe))
+            continue;
+
+        frame->areabytes = group->frame->areabytes;
+        memcpy(frame->areabits, group->frame->areabits, frame->areabytes);
+        frame->first_entity = group->frame->first_entity;
+        frame->num_entities = group->frame->num_entities;
+
+        client->frame_group = group;
+        svs.frames_shared++;
+        return qtrue;
+    }
+
+    return qfalse;
+}
+
+static void add_frame_group(client_t *client, client_frame_t *frame, const vec3_t org)
+{
+    client_frame_t *oldframe;
+    frame_group_t *group;
+    unsigned i, hash;
+
+    oldframe = shareable_frame(client, frame);
+    if (!oldframe)
+        return;
+
+    svs.frames_built++;
+
+    hash = hash_group(client, frame, org);
+    for (i = 0; i < FRAME_GROUP_PROBES; i++) {
+        group = &svs.frame_groups[(hash + i) & FRAME_GROUPS_MASK];
+        if (group->sequence == svs.frame_sequence)
+            continue;
+
+        group->sequence = svs.frame_sequence;
+        group->leader = client;
+        group->frame = frame;
+        group->oldframe = oldframe;
+        group->len = 0;
+        VectorCopy(org, group->org);
+
+        client->frame_group = group;
+        return;
+    }
+}
+
+#endif // USE_MVD_CLIENT
+
 /*
 =============
 SV_BuildClientFrame
@@ -409,6 +671,23 @@ void SV_BuildClientFrame(client_t *client)
     ps = &clent->client->ps;
     VectorMA(ps->viewoffset, 0.125f, ps->pmove.origin, org);
 
+    // grab the current player_state_t
+    MSG_PackPlayer(&frame->ps, ps);
+
+    // grab the current clientNum
+    if (g_features->integer & GMF_CLIENTNUM) {
+        frame->clientNum = clent->client->clientNum;
+    } else {
+        frame->clientNum = client->number;
+    }
+
+#if USE_MVD_CLIENT
+    // reuse entities of another spectator with the same view
+    client->frame_group = NULL;
+    if (join_frame_group(client, frame, org))
+        return;
+#endif
+
     leaf = CM_PointLeaf(client->cm, org);
     clientarea = CM_LeafArea(leaf);
     clientcluster = CM_LeafCluster(leaf);
@@ -420,16 +699,6 @@ void SV_BuildClientFrame(client_t *client)
         frame->areabytes = 1;
     }
 
-    // grab the current player_state_t
-    MSG_PackPlayer(&frame->ps, ps);
-
-    // grab the current clientNum
-    if (g_features->integer & GMF_CLIENTNUM) {
-        frame->clientNum = clent->client->clientNum;
-    } else {
-        frame->clientNum = client->number;
-    }
-
     CM_FatPVS(client->cm, clientpvs, org);
     BSP_ClusterVis(client->cm->cache, clientphs, clientcluster, DVIS_PHS);
 
@@ -545,5 +814,9 @@ void SV_BuildClientFrame(client_t *client)
             break;
         }
     }
+
+#if USE_MVD_CLIENT
+    add_frame_group(client, frame, org);
+#endif
 }
 
@@ -773,6 +773,7 @@ void SV_ShutdownGameProgs(void)
         ge->Shutdown();
         ge = NULL;
     }
+    SV_FreeHistory();
     if (game_library) {
         Sys_FreeLibrary(game_library);
         game_library = NULL;
@@ -825,7 +826,9 @@ Init the game subsystem for a new map
 void SV_InitGameProgs(void)
 {
     game_import_t   import;
+    game_import_ex_t import_ex;
     game_export_t   *(*entry)(game_import_t *) = NULL;
+    void            (*entry_ex)(const game_import_ex_t *);
 
     // unload anything we have now
     SV_ShutdownGameProgs();
@@ -916,6 +919,22 @@ void SV_InitGameProgs(void)
                   ge->apiversion, GAME_API_VERSION);
     }
 
+    // extended API is optional
+    entry_ex = Sys_GetProcAddress(game_library, "GetGameAPIEx");
+    if (entry_ex) {
+        memset(&import_ex, 0, sizeof(import_ex));
+        import_ex.apiversion = GAME_API_VERSION_EX;
+        import_ex.structsize = sizeof(import_ex);
+
+        import_ex.RewindEntities = SV_RewindEntities;
+        import_ex.RestoreEntities = SV_RestoreEntities;
+#if USE_CLIENT
+        import_ex.WriteSaveFile = SV_WriteSaveFile;
+#endif
+
+        entry_ex(&import_ex);
+    }
+
     // initialize
     ge->Init();
 
@@ -86,6 +86,112 @@ static void resolve_masters(void)
 }
 #endif
 
+/*
+Most recently spawned map and the result of looking up its entity string
+override are kept across server restarts and shutdowns, so that spawning the
+same map again doesn't load anything from disk. Cache is dropped when game
+directory changes, or when size or modification time of either file doesn't
+match what was cached.
+*/
+typedef struct {
+    qboolean    exists;
+    size_t      size;
+    time_t      mtime;
+} mapfile_t;
+
+static struct {
+    bsp_t       *bsp;                   // holds an extra reference
+    mapfile_t   bspfile;
+    char        entpath[MAX_QPATH];     // empty if override wasn't looked up
+    char        *entstring;             // NULL if override doesn't exist
+    mapfile_t   entfile;
+    char        gamedir[MAX_OSPATH];
+} mapcache;
+
+void SV_FlushMapCache(void)
+{
+    BSP_Free(mapcache.bsp);
+    Z_Free(mapcache.entstring);
+    memset(&mapcache, 0, sizeof(mapcache));
+}
+
+static void stat_map_file(const char *path, mapfile_t *file)
+{
+    file_info_t info;
+    qhandle_t f;
+
+    memset(file, 0, sizeof(*file));
+
+    FS_FOpenFile(path, &f, FS_MODE_READ);
+    if (!f) {
+        return;
+    }
+
+    if (!FS_FileInfo(f, &info)) {
+        file->exists = qtrue;
+        file->size = info.size;
+        file->mtime = info.mtime;
+    }
+
+    FS_FCloseFile(f);
+}
+
+static qboolean map_file_changed(const char *path, const mapfile_t *cached)
+{
+    mapfile_t file;
+
+    stat_map_file(path, &file);
+    return memcmp(&file, cached, sizeof(file)) != 0;
+}
+
+/*
+================
+SV_CheckMapCache
+
+Drops cached map if files it was loaded from have changed. Called before
+loading any map, so that BSP_Load doesn't share the stale one.
+================
+*/
+void SV_CheckMapCache(void)
+{
+    if (!mapcache.bsp && !mapcache.entpath[0]) {
+        return;
+    }
+
+    if (strcmp(mapcache.gamedir, fs_gamedir)) {
+        goto flush;
+    }
+
+    if (mapcache.bsp && map_file_changed(mapcache.bsp->name, &mapcache.bspfile)) {
+        goto flush;
+    }
+
+    if (mapcache.entpath[0] && map_file_changed(mapcache.entpath, &mapcache.entfile)) {
+        goto flush;
+    }
+
+    return;
+
+flush:
+    Com_DPrintf("%s: map files changed\n", __func__);
+    SV_FlushMapCache();
+}
+
+static void cache_map(bsp_t *bsp)
+{
+    bsp_t *old = mapcache.bsp;
+
+    if (bsp == old) {
+        return;
+    }
+
+    // this just bumps the refcount
+    BSP_Load(bsp->name, &mapcache.bsp);
+    BSP_Free(old);
+
+    stat_map_file(bsp->name, &mapcache.bspfile);
+}
+
 // optionally load the entity string from external source
 static void override_entity_string(const char *server)
 {
@@ -103,9 +209,20 @@ static void override_entity_string(const char *server)
         goto fail1;
     }
 
-    len = SV_LoadFile(buffer, (void **)&str);
+    if (!strcmp(buffer, mapcache.entpath)) {
+        sv.entitystring = mapcache.entstring;
+        return;
+    }
+
+    Z_Free(mapcache.entstring);
+    mapcache.entstring = NULL;
+    mapcache.entpath[0] = 0;
+
+    len = FS_LoadFileEx(buffer, (void **)&str, 0, TAG_CMODEL);
     if (!str) {
         if (len == Q_ERR_NOENT) {
+            strcpy(mapcache.entpath, buffer);
+            memset(&mapcache.entfile, 0, sizeof(mapcache.entfile));
             return;
         }
         goto fail1;
@@ -117,11 +234,14 @@ static void override_entity_string(const char *server)
     }
 
     Com_Printf("Loaded entity string from %s\n", buffer);
+    strcpy(mapcache.entpath, buffer);
+    mapcache.entstring = str;
+    stat_map_file(buffer, &mapcache.entfile);
     sv.entitystring = str;
     return;
 
 fail2:
-    SV_FreeFile(str);
+    Z_Free(str);
 fail1:
     Com_EPrintf("Couldn't load entity string from %s: %s\n",
                 buffer, Q_ErrorString(len));
@@ -146,6 +266,9 @@ void SV_SpawnServer(cm_t *cm, const char *server, const char *spawnpoint)
     Com_Printf("------- Server Initialization -------\n");
     Com_Printf("SpawnServer: %s\n", server);
 
+    // usercmds don't carry over to the new map
+    SV_BenchStopRecord();
+
     // everyone needs to reconnect
     FOR_EACH_CLIENT(client) {
         SV_ClientReset(client);
@@ -157,10 +280,10 @@ void SV_SpawnServer(cm_t *cm, const char *server, const char *spawnpoint)
 
     // free current level
     CM_FreeMap(&sv.cm);
-    SV_FreeFile(sv.entitystring);
 
     // wipe the entire per-level structure
     memset(&sv, 0, sizeof(sv));
+    SV_InvalidateStatus();
     sv.spawncount = (rand() | (rand() << 16)) ^ Sys_Milliseconds();
     sv.spawncount &= 0x7FFFFFFF;
 
@@ -172,6 +295,9 @@ void SV_SpawnServer(cm_t *cm, const char *server, const char *spawnpoint)
     // reset entity counter
     svs.next_entity = 0;
 
+    // retrain frame code on traffic from previous levels
+    SV_UpdateHuffman();
+
 #if USE_FPS
     // set framerate parameters
     set_frame_time();
@@ -195,6 +321,8 @@ void SV_SpawnServer(cm_t *cm, const char *server, const char *spawnpoint)
     override_entity_string(server);
 
     sv.cm = *cm;
+    cache_map(cm->cache);
+    Q_strlcpy(mapcache.gamedir, fs_gamedir, sizeof(mapcache.gamedir));
     sprintf(sv.configstrings[CS_MAPCHECKSUM], "%d", (int)cm->cache->checksum);
 
     // set inline model names
@@ -280,7 +408,6 @@ void SV_InitGame(unsigned mvd_spawn)
         SCR_BeginLoadingPlaque();
 
         CM_FreeMap(&sv.cm);
-        SV_FreeFile(sv.entitystring);
         memset(&sv, 0, sizeof(sv));
 
 #if USE_FPS
@@ -338,6 +465,9 @@ void SV_InitGame(unsigned mvd_spawn)
     svs.num_entities = sv_maxclients->integer * UPDATE_BACKUP * MAX_PACKET_ENTITIES;
     svs.entities = SV_Mallocz(sizeof(entity_packed_t) * svs.num_entities);
 
+    // start with untrained frame code
+    SV_UpdateHuffman();
+
     // initialize MVD server
     if (!mvd_spawn) {
         SV_MvdInit();
@@ -22,8 +22,8 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 pmoveParams_t   sv_pmp;
 
 LIST_DECL(sv_masterlist);   // address of group servers
-LIST_DECL(sv_banlist);
-LIST_DECL(sv_blacklist);
+ADDRLIST_DECL(sv_banlist);
+ADDRLIST_DECL(sv_blacklist);
 LIST_DECL(sv_cmdlist_connect);
 LIST_DECL(sv_cmdlist_begin);
 LIST_DECL(sv_filterlist);
@@ -32,6 +32,8 @@ LIST_DECL(sv_clientlist);   // linked list of non-free clients
 client_t    *sv_client;         // current client
 edict_t     *sv_player;         // current client edict
 
+static time_t   sv_walltime;    // wall clock time at the start of the frame
+
 cvar_t  *sv_enforcetime;
 cvar_t  *sv_allow_nodelta;
 #if USE_FPS
@@ -51,6 +53,11 @@ cvar_t  *sv_show_name_changes;
 cvar_t  *sv_airaccelerate;
 cvar_t  *sv_qwmod;              // atu QW Physics modificator
 cvar_t  *sv_novis;
+cvar_t  *sv_delta_cache;
+#if USE_MVD_CLIENT
+cvar_t  *sv_shared_frames;
+#endif
+cvar_t  *sv_huffman;
 
 cvar_t  *sv_maxclients;
 cvar_t  *sv_reserved_slots;
@@ -80,9 +87,11 @@ cvar_t  *sv_allow_map;
 cvar_t  *sv_recycle;
 #endif
 cvar_t  *sv_enhanced_setplayer;
+cvar_t  *sv_max_rewind;
 
 cvar_t  *sv_iplimit;
 cvar_t  *sv_status_limit;
+cvar_t  *sv_status_limit_total;
 cvar_t  *sv_status_show;
 cvar_t  *sv_uptime;
 cvar_t  *sv_auth_limit;
@@ -231,6 +240,8 @@ void SV_DropClient(client_t *client, const char *reason)
 
     SV_CleanClient(client);
 
+    SV_InvalidateStatus();
+
     Com_DPrintf("Going to cs_zombie for %s\n", client->name);
 
     // give MVD server a chance to detect if its dummy client was dropped
@@ -360,21 +371,230 @@ void SV_RateInit(ratelimit_t *r, const char *s)
     r->cost = rate2credits(rate);
 }
 
-addrmatch_t *SV_MatchAddress(list_t *list, netadr_t *addr)
+/*
+==============================================================================
+
+ADDRESS LISTS
+
+Ban, blackhole and anticheat lists can hold tens of thousands of entries
+loaded from abuse feeds, and are consulted for every connectionless packet.
+Entries are kept in a compressed binary trie keyed by address prefix, so
+lookup cost depends on the key length rather than the number of entries.
+Among all prefixes matching an address, the one added first wins, same as
+with the linear lists used before.
+
+==============================================================================
+*/
+
+static inline int key_bit(const uint8_t *key, int bit)
 {
-    addrmatch_t *match;
+    return (key[bit >> 3] >> (7 - (bit & 7))) & 1;
+}
+
+// returns length of common prefix of two keys, up to `bits'
+static int key_common(const uint8_t *a, const uint8_t *b, int bits)
+{
+    int i, n;
+    uint8_t x;
+
+    for (i = 0, n = 0; n < bits; i++, n += 8) {
+        x = a[i] ^ b[i];
+        if (x) {
+            while (!(x & 0x80)) {
+                x <<= 1;
+                n++;
+            }
+            break;
+        }
+    }
+
+    return min(n, bits);
+}
+
+static addrnode_t *alloc_node(const uint8_t *key, int bits, addrmatch_t *match)
+{
+    addrnode_t *node = Z_Malloc(sizeof(*node));
 
-    LIST_FOR_EACH(addrmatch_t, match, list, entry) {
-        if ((addr->ip.u32 & match->mask) == (match->addr.u32 & match->mask)) {
-            match->hits++;
-            match->time = time(NULL);
-            return match;
+    node->child[0] = node->child[1] = NULL;
+    node->match = match;
+    memcpy(node->key, key, ADDR_KEY_BYTES);
+    node->bits = bits;
+    return node;
+}
+
+static void insert_node(addrlist_t *list, addrmatch_t *match)
+{
+    addrnode_t **p, *node, *split;
+    const uint8_t *key = match->key;
+    int bits = match->bits;
+    int common;
+
+    for (p = &list->root; (node = *p) != NULL;
+         p = &node->child[key_bit(key, node->bits)]) {
+        common = key_common(key, node->key, min(bits, node->bits));
+        if (common < node->bits) {
+            // new prefix diverges from (or is a parent of) this node
+            if (common == bits) {
+                split = alloc_node(key, bits, match);
+            } else {
+                split = alloc_node(key, common, NULL);
+                split->child[key_bit(key, common)] = alloc_node(key, bits, match);
+            }
+            split->child[key_bit(node->key, common)] = node;
+            *p = split;
+            return;
+        }
+        if (node->bits == bits) {
+            node->match = match;
+            return;
         }
     }
 
+    *p = alloc_node(key, bits, match);
+}
+
+static addrnode_t *remove_node(addrnode_t *node, const uint8_t *key, int bits)
+{
+    addrnode_t *child;
+    int c;
+
+    if (!node || node->bits > bits)
+        return node;
+    if (key_common(key, node->key, node->bits) < node->bits)
+        return node;
+
+    if (node->bits < bits) {
+        c = key_bit(key, node->bits);
+        node->child[c] = remove_node(node->child[c], key, bits);
+    } else {
+        node->match = NULL;
+    }
+
+    // collapse nodes that no longer carry an entry or a branch
+    if (node->match || (node->child[0] && node->child[1]))
+        return node;
+
+    child = node->child[0] ? node->child[0] : node->child[1];
+    Z_Free(node);
+    return child;
+}
+
+static void free_nodes(addrnode_t *node)
+{
+    if (node) {
+        free_nodes(node->child[0]);
+        free_nodes(node->child[1]);
+        Z_Free(node);
+    }
+}
+
+addrmatch_t *SV_FindMatch(addrlist_t *list, const uint8_t *key, int bits)
+{
+    addrnode_t *node;
+
+    for (node = list->root; node && node->bits <= bits;
+         node = node->child[key_bit(key, node->bits)]) {
+        if (key_common(key, node->key, node->bits) < node->bits)
+            break;
+        if (node->bits == bits)
+            return node->match;
+    }
+
     return NULL;
 }
 
+addrmatch_t *SV_AddMatch(addrlist_t *list, const uint8_t *key, int bits,
+                         const char *comment)
+{
+    addrmatch_t *match;
+    size_t len = strlen(comment);
+    uint8_t masked[ADDR_KEY_BYTES];
+    int i;
+
+    // clear host bits, so that entries compare equal by key
+    for (i = 0; i < ADDR_KEY_BYTES; i++) {
+        if (i * 8 + 8 <= bits)
+            masked[i] = key[i];
+        else if (i * 8 < bits)
+            masked[i] = key[i] & (0xff00 >> (bits & 7));
+        else
+            masked[i] = 0;
+    }
+
+    if (SV_FindMatch(list, masked, bits))
+        return NULL;
+
+    match = Z_Malloc(sizeof(*match) + len);
+    match->seq = list->nextseq++;
+    memcpy(match->key, masked, ADDR_KEY_BYTES);
+    match->bits = bits;
+    match->hits = 0;
+    match->time = 0;
+    memcpy(match->comment, comment, len + 1);
+    List_Append(&list->entries, &match->entry);
+    insert_node(list, match);
+    list->count++;
+    return match;
+}
+
+void SV_RemoveMatch(addrlist_t *list, addrmatch_t *match)
+{
+    list->root = remove_node(list->root, match->key, match->bits);
+    List_Remove(&match->entry);
+    Z_Free(match);
+    list->count--;
+}
+
+void SV_ClearMatches(addrlist_t *list)
+{
+    addrmatch_t *match, *next;
+
+    LIST_FOR_EACH_SAFE(addrmatch_t, match, next, &list->entries, entry) {
+        Z_Free(match);
+    }
+    List_Init(&list->entries);
+    free_nodes(list->root);
+    list->root = NULL;
+    list->count = 0;
+    list->nextseq = 0;
+}
+
+// IPv4 addresses are mapped into ::ffff:0:0/96
+void SV_AddressKey(const netadr_t *addr, uint8_t *key)
+{
+    memset(key, 0, 10);
+    key[10] = key[11] = 0xff;
+    memcpy(key + 12, addr->ip.u8, 4);
+}
+
+addrmatch_t *SV_MatchAddress(addrlist_t *list, netadr_t *addr)
+{
+    addrnode_t *node;
+    addrmatch_t *match = NULL;
+    uint8_t key[ADDR_KEY_BYTES];
+
+    if (!list->root)
+        return NULL;
+
+    SV_AddressKey(addr, key);
+
+    for (node = list->root; node; node = node->child[key_bit(key, node->bits)]) {
+        if (key_common(key, node->key, node->bits) < node->bits)
+            break;
+        if (node->match && (!match || node->match->seq < match->seq))
+            match = node->match;
+        if (node->bits == ADDR_KEY_BITS)
+            break;
+    }
+
+    if (match) {
+        match->hits++;
+        match->time = sv_walltime;
+    }
+
+    return match;
+}
+
 /*
 ==============================================================================
 
@@ -452,6 +672,76 @@ static size_t SV_StatusString(char *status)
     return total;
 }
 
+/*
+===============
+SV_InvalidateStatus
+
+Forces status and info replies to be rebuilt on the next query. Cached
+replies are also dropped at the end of every frame, so this is only needed
+for changes that should be visible right away.
+===============
+*/
+void SV_InvalidateStatus(void)
+{
+    svs.status_len = 0;
+    svs.info_len = 0;
+}
+
+static size_t cached_status_string(void)
+{
+    if (!svs.status_len) {
+        svs.status_len = SV_StatusString(svs.status_string);
+    }
+    return svs.status_len;
+}
+
+/*
+===============
+status_limited
+
+Looks up token bucket for the /24 subnet the query came from. If there is
+no bucket for this subnet, the least recently used one among the probed
+slots is taken over and refilled.
+===============
+*/
+static qboolean status_limited(void)
+{
+    subnetlimit_t *s, *oldest;
+    uint32_t subnet;
+    unsigned i, hash;
+
+    if (SV_RateLimited(&svs.ratelimit_status_total)) {
+        return qtrue;
+    }
+
+    subnet = BigLong(net_from.ip.u32) >> 8;
+    hash = (subnet * 0x9e3779b1U) >> 24;
+
+    oldest = NULL;
+    for (i = 0; i < SUBNET_LIMIT_PROBES; i++) {
+        s = &svs.subnet_limits[(hash + i) & (SUBNET_LIMITS - 1)];
+        if (s->subnet == subnet) {
+            goto found;
+        }
+        if (!oldest || svs.realtime - s->limit.time > svs.realtime - oldest->limit.time) {
+            oldest = s;
+        }
+    }
+
+    s = oldest;
+    s->subnet = subnet;
+    s->limit = svs.ratelimit_status;
+    s->limit.time = svs.realtime;
+
+found:
+    if (SV_RateLimited(&s->limit)) {
+        SV_RateRecharge(&svs.ratelimit_status_total);
+        return qtrue;
+    }
+
+    return qfalse;
+}
+
 /*
 ================
 SVC_Status
@@ -468,7 +758,7 @@ static void SVC_Status(void)
         return;
     }
 
-    if (SV_RateLimited(&svs.ratelimit_status)) {
+    if (status_limited()) {
         Com_DPrintf("Dropping status request from %s\n",
                     NET_AdrToString(&net_from));
         return;
@@ -478,7 +768,8 @@ static void SVC_Status(void)
     memcpy(buffer, "\xff\xff\xff\xffprint\n", 10);
     len = 10;
 
-    len += SV_StatusString(buffer + len);
+    len += cached_status_string();
+    memcpy(buffer + 10, svs.status_string, len - 10);
 
     // send the datagram
     NET_SendPacket(NS_SERVER, buffer, len, &net_from);
@@ -517,8 +808,6 @@ The second parameter should be the current protocol version number.
 */
 static void SVC_Info(void)
 {
-    char    buffer[MAX_QPATH+10];
-    size_t  len;
     int     version;
 
     if (sv_maxclients->integer == 1)
@@ -528,12 +817,14 @@ static void SVC_Info(void)
     if (version < PROTOCOL_VERSION_DEFAULT || version > PROTOCOL_VERSION_Q2PRO)
         return; // ignore invalid versions
 
-    len = Q_scnprintf(buffer, sizeof(buffer),
-                      "\xff\xff\xff\xffinfo\n%16s %8s %2i/%2i\n",
-                      sv_hostname->string, sv.name, SV_CountClients(),
-                      sv_maxclients->integer - sv_reserved_slots->integer);
+    if (!svs.info_len) {
+        svs.info_len = Q_scnprintf(svs.info_string, sizeof(svs.info_string),
+                                   "\xff\xff\xff\xffinfo\n%16s %8s %2i/%2i\n",
+                                   sv_hostname->string, sv.name, SV_CountClients(),
+                                   sv_maxclients->integer - sv_reserved_slots->integer);
+    }
 
-    NET_SendPacket(NS_SERVER, buffer, len, &net_from);
+    NET_SendPacket(NS_SERVER, svs.info_string, svs.info_len, &net_from);
 }
 
 /*
@@ -548,6 +839,84 @@ static void SVC_Ping(void)
     OOB_PRINT(NS_SERVER, &net_from, "ack");
 }
 
+/*
+=================
+Challenge cookies
+
+Challenge is HMAC-MD4 of client IP address and period number, keyed by a
+random secret. Verifying it needs no lookups and no per-client state, so
+a spoofed getchallenge flood can't push out pending challenges of real
+clients. Lowest bit of challenge selects the secret it was made with.
+Each secret comes fresh from the system CSPRNG.
+=================
+*/
+
+static void new_challenge_key(uint8_t *key)
+{
+    if (!Sys_RandomBytes(key, CHALLENGE_KEY_BYTES))
+        Com_Error(ERR_FATAL, "Couldn't generate challenge key");
+}
+
+static void rotate_challenge_keys(void)
+{
+    unsigned period = svs.realtime / CHALLENGE_PERIOD + 1;
+
+    if (period == svs.challenge_period)
+        return;
+
+    // previous key is only good if it belongs to the previous period
+    if (!svs.challenge_period || period != svs.challenge_period + 1)
+        new_challenge_key(svs.challenge_keys[(period - 1) & 1]);
+
+    new_challenge_key(svs.challenge_keys[period & 1]);
+    svs.challenge_period = period;
+}
+
+static unsigned challenge_mac(const netadr_t *adr, unsigned period)
+{
+    struct mdfour md;
+    const uint8_t *key = svs.challenge_keys[period & 1];
+    uint8_t buf[64 + 16];
+    uint32_t digest[4], n;
+    int i;
+
+    // inner hash over IP address and period
+    for (i = 0; i < 64; i++)
+        buf[i] = (i < CHALLENGE_KEY_BYTES ? key[i] : 0) ^ 0x36;
+    memcpy(buf + 64, adr->ip.u8, 4);
+    n = LittleLong(period);
+    memcpy(buf + 68, &n, 4);
+
+    mdfour_begin(&md);
+    mdfour_update(&md, buf, 72);
+    mdfour_result(&md, buf + 64);
+
+    // outer hash over inner digest
+    for (i = 0; i < 64; i++)
+        buf[i] = (i < CHALLENGE_KEY_BYTES ? key[i] : 0) ^ 0x5c;
+
+    mdfour_begin(&md);
+    mdfour_update(&md, buf, 80);
+    mdfour_result(&md, (uint8_t *)digest);
+
+    // fits in a positive int, as clients parse it with atoi()
+    return (digest[0] & 0x3ffffffe) | (period & 1);
+}
+
+static qboolean check_challenge(const netadr_t *adr, unsigned challenge)
+{
+    unsigned period;
+
+    rotate_challenge_keys();
+
+    // pick current or previous period by parity
+    period = svs.challenge_period;
+    if ((challenge & 1) != (period & 1))
+        period--;
+
+    return challenge_mac(adr, period) == challenge;
+}
+
 /*
 =================
 SVC_GetChallenge
@@ -561,36 +930,10 @@ challenge, they must give a valid IP address.
 */
 static void SVC_GetChallenge(void)
 {
-    int         i, oldest;
     unsigned    challenge;
-    unsigned    oldestTime;
-
-    oldest = 0;
-    oldestTime = 0xffffffff;
-
-    // see if we already have a challenge for this ip
-    for (i = 0; i < MAX_CHALLENGES; i++) {
-        if (NET_IsEqualBaseAdr(&net_from, &svs.challenges[i].adr))
-            break;
-        if (svs.challenges[i].time > com_eventTime) {
-            svs.challenges[i].time = com_eventTime;
-        }
-        if (svs.challenges[i].time < oldestTime) {
-            oldestTime = svs.challenges[i].time;
-            oldest = i;
-        }
-    }
 
-    challenge = ((rand() << 16) | rand()) & 0x7fffffff;
-    if (i == MAX_CHALLENGES) {
-        // overwrite the oldest
-        svs.challenges[oldest].challenge = challenge;
-        svs.challenges[oldest].adr = net_from;
-        svs.challenges[oldest].time = com_eventTime;
-    } else {
-        svs.challenges[i].challenge = challenge;
-        svs.challenges[i].time = com_eventTime;
-    }
+    rotate_challenge_keys();
+    challenge = challenge_mac(&net_from, svs.challenge_period);
 
     // send it back
     Netchan_OutOfBand(NS_SERVER, &net_from,
@@ -648,7 +991,7 @@ static qboolean parse_basic_params(conn_params_t *p)
 static qboolean permit_connection(conn_params_t *p)
 {
     addrmatch_t *match;
-    int i, count;
+    int count;
     client_t *cl;
     char *s;
 
@@ -657,22 +1000,8 @@ static qboolean permit_connection(conn_params_t *p)
         return qtrue;
 
     // see if the challenge is valid
-    for (i = 0; i < MAX_CHALLENGES; i++) {
-        if (!svs.challenges[i].challenge)
-            continue;
-
-        if (NET_IsEqualBaseAdr(&net_from, &svs.challenges[i].adr)) {
-            if (svs.challenges[i].challenge == p->challenge)
-                break;        // good
-
-            return reject("Bad challenge.\n");
-        }
-    }
-
-    if (i == MAX_CHALLENGES)
-        return reject("No challenge for address.\n");
-
-    svs.challenges[i].challenge = 0;
+    if (!check_challenge(&net_from, p->challenge))
+        return reject("Bad challenge.\n");
 
     // check for banned address
     if ((match = SV_MatchAddress(&sv_banlist, &net_from)) != NULL) {
@@ -987,12 +1316,76 @@ static void send_connect_packet(client_t *newcl, int nctype)
                       ncstring, acstring, dlstring1, dlstring2, newcl->mapname);
 }
 
+// this is the only place a client_t is ever initialized
+static void init_client(client_t *newcl, const conn_params_t *params)
+{
+    int number = newcl - svs.client_pool;
+
+    memset(newcl, 0, sizeof(*newcl));
+    newcl->number = newcl->slot = number;
+    newcl->challenge = params->challenge; // save challenge for checksumming
+    newcl->protocol = params->protocol;
+    newcl->version = params->version;
+    newcl->has_zlib = params->has_zlib;
+    newcl->edict = EDICT_NUM(number + 1);
+    newcl->gamedir = fs_game->string;
+    newcl->mapname = sv.name;
+    newcl->configstrings = (char *)sv.configstrings;
+    newcl->pool = (edict_pool_t *)&ge->edicts;
+    newcl->cm = &sv.cm;
+    newcl->spawncount = sv.spawncount;
+    newcl->maxclients = sv_maxclients->integer;
+    strcpy(newcl->reconnect_var, params->reconnect_var);
+    strcpy(newcl->reconnect_val, params->reconnect_val);
+#if USE_FPS
+    newcl->framediv = sv.framediv;
+    newcl->settings[CLS_FPS] = BASE_FRAMERATE;
+#endif
+
+    init_pmove_and_es_flags(newcl);
+}
+
+// sets up the client accepted by the game and moves it to cs_assigned
+static void activate_client(client_t *newcl, const conn_params_t *params,
+                            const netadr_t *adr, const char *userinfo)
+{
+    // setup netchan
+    newcl->netchan = Netchan_Setup(NS_SERVER, params->nctype,
+                                   adr, params->qport,
+                                   params->maxlength,
+                                   params->protocol);
+    newcl->numpackets = 1;
+
+    // parse some info from the info strings
+    Q_strlcpy(newcl->userinfo, userinfo, sizeof(newcl->userinfo));
+    SV_UserinfoChanged(newcl);
+
+    SV_RateInit(&newcl->ratelimit_namechange, sv_namechange_limit->string);
+
+    SV_InitClientSend(newcl);
+
+    if (newcl->protocol == PROTOCOL_VERSION_DEFAULT) {
+        newcl->WriteFrame = SV_WriteFrameToClient_Default;
+    } else {
+        newcl->WriteFrame = SV_WriteFrameToClient_Enhanced;
+    }
+
+    // add them to the linked list of connected clients
+    List_SeqAdd(&sv_clientlist, &newcl->entry);
+
+    Com_DPrintf("Going from cs_free to cs_assigned for %s\n", newcl->name);
+    newcl->state = cs_assigned;
+    newcl->framenum = 1; // frame 0 can't be used
+    newcl->lastframe = -1;
+    newcl->lastmessage = svs.realtime;    // don't timeout
+    newcl->min_ping = 9999;
+}
+
 static void SVC_DirectConnect(void)
 {
     char            userinfo[MAX_INFO_STRING];
     conn_params_t   params;
     client_t        *newcl;
-    int             number;
     qboolean        allow;
     char            *reason;
 
@@ -1015,33 +1408,8 @@ static void SVC_DirectConnect(void)
     if (!newcl)
         return;
 
-    number = newcl - svs.client_pool;
-
     // build a new connection
-    // accept the new client
-    // this is the only place a client_t is ever initialized
-    memset(newcl, 0, sizeof(*newcl));
-    newcl->number = newcl->slot = number;
-    newcl->challenge = params.challenge; // save challenge for checksumming
-    newcl->protocol = params.protocol;
-    newcl->version = params.version;
-    newcl->has_zlib = params.has_zlib;
-    newcl->edict = EDICT_NUM(number + 1);
-    newcl->gamedir = fs_game->string;
-    newcl->mapname = sv.name;
-    newcl->configstrings = (char *)sv.configstrings;
-    newcl->pool = (edict_pool_t *)&ge->edicts;
-    newcl->cm = &sv.cm;
-    newcl->spawncount = sv.spawncount;
-    newcl->maxclients = sv_maxclients->integer;
-    strcpy(newcl->reconnect_var, params.reconnect_var);
-    strcpy(newcl->reconnect_val, params.reconnect_val);
-#if USE_FPS
-    newcl->framediv = sv.framediv;
-    newcl->settings[CLS_FPS] = BASE_FRAMERATE;
-#endif
-
-    init_pmove_and_es_flags(newcl);
+    init_client(newcl, &params);
 
     // get the game a chance to reject this connection or modify the userinfo
     sv_client = newcl;
@@ -1059,44 +1427,63 @@ static void SVC_DirectConnect(void)
         return;
     }
 
-    // setup netchan
-    newcl->netchan = Netchan_Setup(NS_SERVER, params.nctype,
-                                   &net_from, params.qport,
-                                   params.maxlength,
-                                   params.protocol);
-    newcl->numpackets = 1;
-
-    // parse some info from the info strings
-    Q_strlcpy(newcl->userinfo, userinfo, sizeof(newcl->userinfo));
-    SV_UserinfoChanged(newcl);
-
     // send the connect packet to the client
     send_connect_packet(newcl, params.nctype);
 
-    SV_RateInit(&newcl->ratelimit_namechange, sv_namechange_limit->string);
-
-    SV_InitClientSend(newcl);
-
-    if (newcl->protocol == PROTOCOL_VERSION_DEFAULT) {
-        newcl->WriteFrame = SV_WriteFrameToClient_Default;
-    } else {
-        newcl->WriteFrame = SV_WriteFrameToClient_Enhanced;
-    }
-
     // loopback client doesn't need to reconnect
     if (NET_IsLocalAddress(&net_from)) {
         newcl->reconnected = qtrue;
     }
 
-    // add them to the linked list of connected clients
-    List_SeqAdd(&sv_clientlist, &newcl->entry);
+    // accept the new client
+    activate_client(newcl, &params, &net_from, userinfo);
+}
 
-    Com_DPrintf("Going from cs_free to cs_assigned for %s\n", newcl->name);
-    newcl->state = cs_assigned;
-    newcl->framenum = 1; // frame 0 can't be used
-    newcl->lastframe = -1;
-    newcl->lastmessage = svs.realtime;    // don't timeout
-    newcl->min_ping = 9999;
+/*
+==================
+SV_ConnectSimulatedClient
+
+Puts a client without a network connection into the given free slot.
+Packets sent to it are discarded. Used by the benchmark. Returns qfalse
+if the game refused the connection.
+==================
+*/
+qboolean SV_ConnectSimulatedClient(client_t *newcl, const char *info)
+{
+    char            userinfo[MAX_INFO_STRING];
+    conn_params_t   params;
+    netadr_t        adr;
+    qboolean        allow;
+
+    memset(&params, 0, sizeof(params));
+    params.protocol = PROTOCOL_VERSION_DEFAULT;
+    params.qport = newcl - svs.client_pool;
+    params.maxlength = MAX_PACKETLEN_WRITABLE_DEFAULT;
+    params.nctype = NETCHAN_OLD;
+    strcpy(params.reconnect_var, "simulated");
+
+    init_client(newcl, &params);
+    newcl->reconnected = qtrue;
+    newcl->version_string = SV_CopyString("simulated");
+
+    Q_strlcpy(userinfo, info, sizeof(userinfo));
+
+    sv_client = newcl;
+    sv_player = newcl->edict;
+    allow = ge->ClientConnect(newcl->edict, userinfo);
+    sv_client = NULL;
+    sv_player = NULL;
+    if (!allow) {
+        Z_Free(newcl->version_string);
+        newcl->version_string = NULL;
+        return qfalse;
+    }
+
+    memset(&adr, 0, sizeof(adr));
+    adr.type = NA_BAD;
+
+    activate_client(newcl, &params, &adr, userinfo);
+    return qtrue;
 }
 
 static qboolean rcon_valid(void)
@@ -1656,6 +2043,9 @@ static void SV_RunGameFrame(void)
         SZ_Clear(&msg_write);
     }
 
+    // remember entity positions for lag compensation
+    SV_RecordHistory();
+
     // save the entire world state if recording a serverdemo
     SV_MvdEndFrame();
 }
@@ -1690,7 +2080,8 @@ static void SV_MasterHeartbeat(void)
     len = 14;
 
     // send the same string that we would give for a status OOB command
-    len += SV_StatusString(buffer + len);
+    len += cached_status_string();
+    memcpy(buffer + 14, svs.status_string, len - 14);
 
     // send to group master
     FOR_EACH_MASTER(m) {
@@ -1734,6 +2125,59 @@ static void SV_MasterShutdown(void)
     }
 }
 
+static inline void bench_split(uint64_t *times, bench_stage_t stage, uint64_t *start)
+{
+    uint64_t now;
+
+    if (times) {
+        now = Sys_Microseconds();
+        times[stage] += now - *start;
+        *start = now;
+    }
+}
+
+/*
+==================
+SV_RunFrame
+
+Runs one game frame and sends the results to clients. If times is not
+NULL, microseconds spent in each stage are added to it.
+==================
+*/
+void SV_RunFrame(uint64_t *times)
+{
+    uint64_t start = times ? Sys_Microseconds() : 0;
+
+    // check timeouts
+    SV_CheckTimeouts();
+
+    // update ping based on the last known frame from all clients
+    SV_CalcPings();
+
+    // give the clients some timeslices
+    SV_GiveMsec();
+
+    bench_split(times, BENCH_OTHER, &start);
+
+    // let everything in the world think and move
+    SV_RunGameFrame();
+
+    bench_split(times, BENCH_GAME, &start);
+
+    // send messages back to the UDP clients
+    SV_SendClientMessages();
+
+    bench_split(times, BENCH_SEND, &start);
+
+    // clear teleport flags, etc for next frame
+    SV_PrepWorldFrame();
+
+    // advance for next frame
+    sv.framenum++;
+
+    bench_split(times, BENCH_OTHER, &start);
+}
+
 /*
 ==================
 SV_Frame
@@ -1752,6 +2196,7 @@ unsigned SV_Frame(unsigned msec)
 
     // advance local server time
     svs.realtime += msec;
+    sv_walltime = time(NULL);
 
     if (COM_DEDICATED) {
         // process console commands if not running a client
@@ -1783,32 +2228,22 @@ unsigned SV_Frame(unsigned msec)
         return SV_FRAMETIME - sv.frameresidual;
     }
 
-    if (svs.initialized && !check_paused()) {
-        // check timeouts
-        SV_CheckTimeouts();
-
-        // update ping based on the last known frame from all clients
-        SV_CalcPings();
-
-        // give the clients some timeslices
-        SV_GiveMsec();
-
-        // let everything in the world think and move
-        SV_RunGameFrame();
+    // scores, pings and uptime are about to change
+    SV_InvalidateStatus();
 
-        // send messages back to the UDP clients
-        SV_SendClientMessages();
+    if (svs.initialized && !check_paused()) {
+        SV_RunFrame(NULL);
 
         // send a heartbeat to the master if needed
         SV_MasterHeartbeat();
 
-        // clear teleport flags, etc for next frame
-        SV_PrepWorldFrame();
-
-        // advance for next frame
-        sv.framenum++;
+        // record usercmds executed this frame
+        SV_BenchEndFrame();
     }
 
+    // report savegame written in background
+    SV_FinishSavegame(qfalse);
+
     if (COM_DEDICATED) {
         // run cmd buffer in dedicated mode
         if (cmd_buffer.waitCount > 0) {
@@ -1876,6 +2311,7 @@ void SV_UserinfoChanged(client_t *cl)
             }
     }
     memcpy(cl->name, name, len + 1);
+    SV_InvalidateStatus();
 
     // rate command
     val = Info_ValueForKey(cl->userinfo, "rate");
@@ -1921,9 +2357,25 @@ void SV_SetConsoleTitle(void)
 }
 #endif
 
+static void reset_subnet_limits(void)
+{
+    int i;
+
+    // subnets are 24 bit, so this never matches
+    for (i = 0; i < SUBNET_LIMITS; i++) {
+        svs.subnet_limits[i].subnet = 0xffffffff;
+    }
+}
+
 static void sv_status_limit_changed(cvar_t *self)
 {
     SV_RateInit(&svs.ratelimit_status, self->string);
+    reset_subnet_limits();
+}
+
+static void sv_status_limit_total_changed(cvar_t *self)
+{
+    SV_RateInit(&svs.ratelimit_status_total, self->string);
 }
 
 static void sv_auth_limit_changed(cvar_t *self)
@@ -1939,6 +2391,8 @@ static void sv_rcon_limit_changed(cvar_t *self)
 static void init_rate_limits(void)
 {
     SV_RateInit(&svs.ratelimit_status, sv_status_limit->string);
+    reset_subnet_limits();
+    SV_RateInit(&svs.ratelimit_status_total, sv_status_limit_total->string);
     SV_RateInit(&svs.ratelimit_auth, sv_auth_limit->string);
     SV_RateInit(&svs.ratelimit_rcon, sv_rcon_limit->string);
 }
@@ -2025,6 +2479,11 @@ void SV_Init(void)
     sv_reserved_password = Cvar_Get("sv_reserved_password", "", CVAR_PRIVATE);
     sv_locked = Cvar_Get("sv_locked", "0", 0);
     sv_novis = Cvar_Get("sv_novis", "0", 0);
+    sv_delta_cache = Cvar_Get("sv_delta_cache", "1", 0);
+#if USE_MVD_CLIENT
+    sv_shared_frames = Cvar_Get("sv_shared_frames", "1", 0);
+#endif
+    sv_huffman = Cvar_Get("sv_huffman", "1", 0);
     sv_downloadserver = Cvar_Get("sv_downloadserver", "", 0);
     sv_redirect_address = Cvar_Get("sv_redirect_address", "", 0);
 
@@ -2051,12 +2510,16 @@ void SV_Init(void)
 
     sv_enhanced_setplayer = Cvar_Get("sv_enhanced_setplayer", "0", 0);
 
+    sv_max_rewind = Cvar_Get("sv_max_rewind", "250", 0);
+
     sv_iplimit = Cvar_Get("sv_iplimit", "3", 0);
 
     sv_status_show = Cvar_Get("sv_status_show", "2", 0);
 
-    sv_status_limit = Cvar_Get("sv_status_limit", "15", 0);
+    sv_status_limit = Cvar_Get("sv_status_limit", "3", 0);
     sv_status_limit->changed = sv_status_limit_changed;
+    sv_status_limit_total = Cvar_Get("sv_status_limit_total", "100", 0);
+    sv_status_limit_total->changed = sv_status_limit_total_changed;
 
     sv_uptime = Cvar_Get("sv_uptime", "0", 0);
 
@@ -2175,20 +2638,31 @@ void SV_Shutdown(const char *finalmsg, error_type_t type)
 
     AC_Disconnect();
 
+    SV_FinishSavegame(qtrue);
+
     SV_MvdShutdown(type);
 
+    SV_BenchStopRecord();
+
     SV_FinalMessage(finalmsg, type);
     SV_MasterShutdown();
     SV_ShutdownGameProgs();
 
     // free current level
     CM_FreeMap(&sv.cm);
-    SV_FreeFile(sv.entitystring);
     memset(&sv, 0, sizeof(sv));
 
+    // map data may be what crashed the server
+    if (type == ERR_FATAL)
+        SV_FlushMapCache();
+
     // free server static data
     Z_Free(svs.client_pool);
     Z_Free(svs.entities);
+    Z_Free(svs.delta_cache);
+#if USE_MVD_CLIENT
+    Z_Free(svs.frame_groups);
+#endif
 #if USE_ZLIB
     deflateEnd(&svs.z);
 #endif
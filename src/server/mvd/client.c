@@ -117,6 +117,7 @@ static cvar_t  *mvd_suspend_time;
 static cvar_t  *mvd_wait_delay;
 static cvar_t  *mvd_wait_percent;
 static cvar_t  *mvd_buffer_size;
+static cvar_t  *mvd_pace_percent;
 static cvar_t  *mvd_username;
 static cvar_t  *mvd_password;
 static cvar_t  *mvd_snaps;
@@ -156,6 +157,8 @@ static void MVD_Free(mvd_t *mvd)
     }
 
     Z_Free(mvd->players);
+    Z_Free(mvd->edicts);
+    Z_Free(mvd->baseconfigstrings);
 
     CM_FreeMap(&mvd->cm);
 
@@ -324,9 +327,7 @@ static mvd_t *create_channel(gtv_t *gtv)
     mvd->gtv = gtv;
     mvd->id = gtv->id;
     Q_strlcpy(mvd->name, gtv->name, sizeof(mvd->name));
-    mvd->pool.edicts = mvd->edicts;
     mvd->pool.edict_size = sizeof(edict_t);
-    mvd->pool.max_edicts = MAX_EDICTS;
     mvd->pm_type = PM_SPECTATOR;
     mvd->min_packets = mvd_wait_delay->value * 10;
     List_Init(&mvd->snapshots);
@@ -566,7 +567,8 @@ static void demo_emit_snapshot(mvd_t *mvd)
     mvd_snap_t *snap;
     gtv_t *gtv;
     off_t pos;
-    char *from, *to;
+    const char *from;
+    char *to;
     size_t len;
     int i;
 
@@ -593,10 +595,10 @@ static void demo_emit_snapshot(mvd_t *mvd)
 
     // write configstrings
     for (i = 0; i < MAX_CONFIGSTRINGS; i++) {
-        from = mvd->baseconfigstrings[i];
+        from = MVD_BaseConfigstring(mvd, i);
         to = mvd->configstrings[i];
 
-        if (!strcmp(from, to))
+        if (!strncmp(from, to, MAX_QPATH))
             continue;
 
         len = strlen(to);
@@ -885,11 +887,101 @@ stop:
         MVD_BroadcastPrintf(mvd, PRINT_HIGH, 0,
                             "[MVD] Streaming resumed.\n");
     }
+    mvd->target_packets = mvd->num_packets;
+    mvd->pace = 0;
     mvd->state = MVD_READING;
     mvd->dirty = qtrue;
     return qtrue;
 }
 
+/*
+Delay buffer is paced from observed packet arrival times. Jitter estimate is
+the largest recent gap between packets, slowly decaying towards the nominal
+frame time. When the buffer gets shallower than needed to ride out such a
+gap, playback is slowed down by holding some frames. When the buffer grows
+well past the depth reading was started with, playback is sped up by reading
+an extra frame now and then. Rate is adjusted by at most mvd_pace_percent.
+*/
+
+static unsigned gtv_jitter_frames(mvd_t *mvd)
+{
+    return mvd->jitter / SV_FRAMETIME + 1;
+}
+
+static void gtv_packet_arrived(mvd_t *mvd)
+{
+    unsigned now = Sys_Milliseconds();
+    unsigned gap = now - mvd->last_arrival;
+    unsigned limit = mvd_wait_delay->value * 1000;
+
+    if (mvd->last_arrival) {
+        // don't let suspended streams blow up the estimate
+        if (gap > limit) {
+            gap = limit;
+        }
+        if (gap > mvd->jitter) {
+            mvd->jitter = gap;
+        } else if (mvd->jitter > SV_FRAMETIME) {
+            mvd->jitter -= (mvd->jitter - SV_FRAMETIME + 255) / 256;
+        }
+    }
+
+    mvd->last_arrival = now;
+}
+
+static void gtv_record_depth(mvd_t *mvd)
+{
+    unsigned n = mvd->num_packets;
+    int i;
+
+    for (i = 0; n && i < MVD_DEPTH_BUCKETS - 1; i++) {
+        n >>= 1;
+    }
+
+    mvd->depth_hist[i]++;
+}
+
+// returns qfalse if this frame should be held to refill the buffer
+static qboolean gtv_pace(mvd_t *mvd)
+{
+    unsigned low, high;
+    qboolean hold;
+
+    gtv_record_depth(mvd);
+
+    if (mvd_pace_percent->integer <= 0) {
+        return qtrue;
+    }
+
+    low = gtv_jitter_frames(mvd);
+    high = max(mvd->target_packets, 2 * low);
+    high += high / 2 + 2;
+
+    if (mvd->num_packets < low) {
+        hold = qtrue;
+    } else if (mvd->num_packets > high) {
+        hold = qfalse;
+    } else {
+        mvd->pace = 0;
+        return qtrue;
+    }
+
+    mvd->pace += Cvar_ClampInteger(mvd_pace_percent, 0, 50);
+    if (mvd->pace < 100) {
+        return qtrue;
+    }
+    mvd->pace -= 100;
+
+    if (hold) {
+        mvd->held++;
+        return qfalse;
+    }
+
+    mvd->caught++;
+    mvd->catchup = qtrue;
+    return qtrue;
+}
+
 // ran out of buffers
 static void gtv_wait_start(mvd_t *mvd)
 {
@@ -909,12 +1001,10 @@ static void gtv_wait_start(mvd_t *mvd)
     Com_Printf("[%s] -=- Buffering data...\n", mvd->name);
 
     // oops, underflowed in the middle of the game,
-    // resume as quickly as possible after there is some
-    // data available again
-    mvd->min_packets = 50 + 5 * mvd->underflows;
-    if (mvd->min_packets > tr) {
-        mvd->min_packets = tr;
-    }
+    // resume as soon as there is enough data buffered
+    // to ride out the arrival gaps seen recently
+    mvd->min_packets = 2 * gtv_jitter_frames(mvd) + 5 * mvd->underflows;
+    clamp(mvd->min_packets, 10, tr);
     mvd->underflows++;
     mvd->state = MVD_WAITING;
     mvd->dirty = qtrue;
@@ -942,9 +1032,16 @@ static qboolean gtv_read_frame(mvd_t *mvd)
         break;
     case MVD_READING:
         if (!mvd->num_packets) {
+            mvd->catchup = qfalse;
             gtv_wait_start(mvd);
             return qfalse;
         }
+        if (mvd->catchup) {
+            // extra frame this tick
+            mvd->catchup = qfalse;
+        } else if (!gtv_pace(mvd)) {
+            return qfalse;
+        }
         break;
     default:
         MVD_Destroyf(mvd, "%s: bad mvd->state", __func__);
@@ -1245,6 +1342,8 @@ static void parse_stream_data(gtv_t *gtv)
         // increment buffered packets counter
         mvd->num_packets++;
 
+        gtv_packet_arrived(mvd);
+
         msg_read.readcount = msg_read.cursize;
     }
 }
@@ -1730,6 +1829,66 @@ static void list_recordings(void)
     }
 }
 
+static void list_memory(void)
+{
+    mvd_t *mvd;
+    mvd_snap_t *snap;
+    size_t edicts, base, players, snaps, total;
+    char buf[6][8];
+
+    Com_Printf(
+        "id name         edic base plrs dely snap total\n"
+        "-- ------------ ---- ---- ---- ---- ---- -----\n");
+
+    FOR_EACH_MVD(mvd) {
+        edicts = sizeof(edict_t) * mvd->pool.max_edicts;
+        base = mvd->baseconfigstrings ? mvd->baseconfigstrings->size : 0;
+        players = sizeof(mvd_player_t) * mvd->maxclients;
+        snaps = 0;
+        LIST_FOR_EACH(mvd_snap_t, snap, &mvd->snapshots, entry) {
+            snaps += sizeof(*snap) + snap->msglen - 1;
+        }
+        total = sizeof(*mvd) + edicts + base + players + mvd->delay.size + snaps;
+
+        Com_FormatSize(buf[0], sizeof(buf[0]), edicts);
+        Com_FormatSize(buf[1], sizeof(buf[1]), base);
+        Com_FormatSize(buf[2], sizeof(buf[2]), players);
+        Com_FormatSize(buf[3], sizeof(buf[3]), mvd->delay.size);
+        Com_FormatSize(buf[4], sizeof(buf[4]), snaps);
+        Com_FormatSize(buf[5], sizeof(buf[5]), total);
+        Com_Printf("%2d %-12.12s %-4s %-4s %-4s %-4s %-4s %s\n",
+                   mvd->id, mvd->name, buf[0], buf[1], buf[2], buf[3], buf[4],
+                   buf[5]);
+    }
+}
+
+static void list_buffers(void)
+{
+    mvd_t *mvd;
+    unsigned total;
+    int i;
+
+    Com_Printf(
+        "id name         dpth trgt jitr held ctch  uf  of | %% of frames by depth\n"
+        "                                                 |   0   1   2   4   8  16  32  64 128 256\n"
+        "-- ------------ ---- ---- ---- ---- ---- --- --- | --- --- --- --- --- --- --- --- --- ---\n");
+
+    FOR_EACH_MVD(mvd) {
+        Com_Printf("%2d %-12.12s %4u %4u %4u %4u %4u %3u %3u |",
+                   mvd->id, mvd->name, mvd->num_packets, mvd->target_packets,
+                   mvd->jitter, mvd->held, mvd->caught,
+                   mvd->underflows, mvd->overflows);
+
+        for (i = 0, total = 0; i < MVD_DEPTH_BUCKETS; i++) {
+            total += mvd->depth_hist[i];
+        }
+        for (i = 0; i < MVD_DEPTH_BUCKETS; i++) {
+            Com_Printf(" %3u", total ? mvd->depth_hist[i] * 100 / total : 0);
+        }
+        Com_Printf("\n");
+    }
+}
+
 static void MVD_ListChannels_f(void)
 {
     char *s;
@@ -1742,9 +1901,18 @@ static void MVD_ListChannels_f(void)
     s = Cmd_Argv(1);
     if (*s == 'r') {
         list_recordings();
+    } else if (*s == 'm') {
+        list_memory();
+    } else if (*s == 'b') {
+        list_buffers();
     } else {
         list_generic();
     }
+
+    if (svs.frames_built) {
+        Com_Printf("%u spectator frames built, %u shared, %u encoded once\n",
+                   svs.frames_built, svs.frames_shared, svs.packets_shared);
+    }
 }
 
 static void MVD_ListServers_f(void)
@@ -2160,7 +2328,8 @@ static void MVD_Seek_f(void)
     gtv_t *gtv;
     mvd_snap_t *snap;
     int i, j, ret, index, frames, dest;
-    char *from, *to;
+    const char *from;
+    char *to;
     edict_t *ent;
     qboolean gamestate;
 
@@ -2238,14 +2407,15 @@ static void MVD_Seek_f(void)
 
             // reset configstrings
             for (i = 0; i < MAX_CONFIGSTRINGS; i++) {
-                from = mvd->baseconfigstrings[i];
+                from = MVD_BaseConfigstring(mvd, i);
                 to = mvd->configstrings[i];
 
-                if (!strcmp(from, to))
+                if (!strncmp(from, to, MAX_QPATH))
                     continue;
 
+                // long strings are restored slot by slot
                 Q_SetBit(mvd->dcs, i);
-                strcpy(to, from);
+                strncpy(to, from, MAX_QPATH);
             }
 
             // set player names
@@ -2586,6 +2756,7 @@ void MVD_Register(void)
     mvd_wait_delay = Cvar_Get("mvd_wait_delay", "20", 0);
     mvd_wait_percent = Cvar_Get("mvd_wait_percent", "35", 0);
     mvd_buffer_size = Cvar_Get("mvd_buffer_size", "3", 0);
+    mvd_pace_percent = Cvar_Get("mvd_pace_percent", "10", 0);
     mvd_username = Cvar_Get("mvd_username", "unnamed", 0);
     mvd_password = Cvar_Get("mvd_password", "", CVAR_PRIVATE);
     mvd_snaps = Cvar_Get("mvd_snaps", "10", 0);
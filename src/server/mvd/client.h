@@ -114,10 +114,25 @@ typedef struct {
     byte data[1];
 } mvd_snap_t;
 
+// packed copy of configstrings, empty slots take no space
+typedef struct {
+    size_t      size;
+    uint32_t    offsets[MAX_CONFIGSTRINGS]; // 0 for empty slots
+    char        data[1];                    // data[0] is always empty
+} mvd_cstable_t;
+
+#define MVD_BaseConfigstring(mvd, index) \
+    ((mvd)->baseconfigstrings->data + (mvd)->baseconfigstrings->offsets[index])
+
+#define MVD_EDICTS_CHUNK    64
+
+// delay buffer depth histogram, power of two buckets
+#define MVD_DEPTH_BUCKETS   10
+
 struct gtv_s;
 
-// FIXME: entire struct is > 500 kB in size!
-// need to eliminate those large static arrays below...
+// current configstrings are kept in a flat array referenced by UDP clients,
+// entities and base configstrings are allocated on demand
 typedef struct mvd_s {
     list_t      entry;
 
@@ -142,6 +157,15 @@ typedef struct mvd_s {
     unsigned    underflows, overflows;
     int         framenum;
 
+    // adaptive pacing of delay buffer
+    unsigned    last_arrival;   // Sys_Milliseconds() of last packet
+    unsigned    jitter;         // decaying maximum of arrival gaps, ms
+    unsigned    target_packets; // depth when reading started
+    unsigned    pace;           // accumulated rate adjustment, percent
+    unsigned    held, caught;   // frames delayed / read ahead
+    qboolean    catchup;        // read one more frame this tick
+    unsigned    depth_hist[MVD_DEPTH_BUCKETS];
+
     // game state
     char    gamedir[MAX_QPATH];
     char    mapname[MAX_QPATH];
@@ -153,9 +177,9 @@ typedef struct mvd_s {
     vec3_t  spawnAngles;
     int     pm_type;
     byte            dcs[CS_BITMAP_BYTES];
-    char            baseconfigstrings[MAX_CONFIGSTRINGS][MAX_QPATH];
+    mvd_cstable_t   *baseconfigstrings; // saved after gamestate
     char            configstrings[MAX_CONFIGSTRINGS][MAX_QPATH];
-    edict_t         edicts[MAX_EDICTS];
+    edict_t         *edicts; // [pool.max_edicts], grown on demand
     mvd_player_t    *players; // [maxclients]
     mvd_player_t    *dummy; // &players[clientNum]
     int             numplayers; // number of active players in frame
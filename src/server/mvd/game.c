@@ -619,6 +619,9 @@ static void MVD_UpdateClient(mvd_client_t *client)
             if (!target->inuse || target == mvd->dummy) {
                 continue;
             }
+            if (i + 1 >= mvd->pool.max_edicts) {
+                continue;
+            }
             ent = &mvd->edicts[i + 1].s;
             if (ent->effects & mask) {
                 MVD_FollowStart(client, target);
@@ -1955,17 +1958,18 @@ static void MVD_GameRunFrame(void)
             continue;
         }
 
-        // parse stream
-        if (!mvd->read_frame(mvd)) {
-            goto update;
-        }
+        // parse stream, twice if catching up
+        do {
+            if (!mvd->read_frame(mvd)) {
+                break;
+            }
 
-        // write this message to demofile
-        if (mvd->demorecording) {
-            MVD_WriteDemoMessage(mvd);
-        }
+            // write this message to demofile
+            if (mvd->demorecording) {
+                MVD_WriteDemoMessage(mvd);
+            }
+        } while (mvd->catchup);
 
-update:
         MVD_UpdateLayouts(mvd);
         numplayers += mvd->numplayers;
     }
@@ -518,6 +518,11 @@ static void MVD_ParseSound(mvd_t *mvd, int extrabits)
         MVD_Destroyf(mvd, "%s: bad entnum: %d", __func__, entnum);
     }
 
+    if (entnum >= mvd->pool.max_edicts) {
+        Com_DPrintf("%s: entnum not allocated: %d\n", __func__, entnum);
+        return;
+    }
+
     entity = &mvd->edicts[entnum];
     if (!entity->inuse) {
         Com_DPrintf("%s: entnum not in use: %d\n", __func__, entnum);
@@ -683,6 +688,10 @@ static void MVD_PlayerToEntityStates(mvd_t *mvd)
             // server should provide valid data
         }
 
+        if (i >= mvd->pool.max_edicts) {
+            continue; // never seen
+        }
+
         edict = &mvd->edicts[i];
         if (!edict->inuse) {
             continue; // not present in this frame
@@ -696,6 +705,34 @@ static void MVD_PlayerToEntityStates(mvd_t *mvd)
 
 #define RELINK_MASK        (U_MODEL|U_ORIGIN1|U_ORIGIN2|U_ORIGIN3|U_SOLID)
 
+/*
+==================
+MVD_AllocEdict
+
+Entities are allocated in chunks, covering the highest entity number seen
+on the channel so far. Edicts may move in memory, don't keep pointers.
+==================
+*/
+static edict_t *MVD_AllocEdict(mvd_t *mvd, int number)
+{
+    int count;
+
+    if (number >= mvd->pool.max_edicts) {
+        count = min((number + MVD_EDICTS_CHUNK) & ~(MVD_EDICTS_CHUNK - 1), MAX_EDICTS);
+        if (mvd->edicts) {
+            mvd->edicts = Z_Realloc(mvd->edicts, sizeof(edict_t) * count);
+        } else {
+            mvd->edicts = MVD_Malloc(sizeof(edict_t) * count);
+        }
+        memset(mvd->edicts + mvd->pool.max_edicts, 0,
+               sizeof(edict_t) * (count - mvd->pool.max_edicts));
+        mvd->pool.edicts = mvd->edicts;
+        mvd->pool.max_edicts = count;
+    }
+
+    return &mvd->edicts[number];
+}
+
 /*
 ==================
 MVD_ParsePacketEntities
@@ -721,7 +758,7 @@ static void MVD_ParsePacketEntities(mvd_t *mvd)
             break;
         }
 
-        ent = &mvd->edicts[number];
+        ent = MVD_AllocEdict(mvd, number);
 
 #ifdef _DEBUG
         if (mvd_shownet->integer > 2) {
@@ -854,7 +891,9 @@ void MVD_ClearState(mvd_t *mvd, qboolean full)
 
     // clear all entities, don't trust num_edicts as it is possible
     // to miscount removed entities
-    memset(mvd->edicts, 0, sizeof(mvd->edicts));
+    if (mvd->edicts) {
+        memset(mvd->edicts, 0, sizeof(edict_t) * mvd->pool.max_edicts);
+    }
     mvd->pool.num_edicts = 0;
 
     // clear all players
@@ -876,6 +915,15 @@ void MVD_ClearState(mvd_t *mvd, qboolean full)
 
     List_Init(&mvd->snapshots);
 
+    // next map may use less entities
+    Z_Free(mvd->edicts);
+    mvd->edicts = NULL;
+    mvd->pool.edicts = NULL;
+    mvd->pool.max_edicts = 0;
+
+    Z_Free(mvd->baseconfigstrings);
+    mvd->baseconfigstrings = NULL;
+
     // free current map
     CM_FreeMap(&mvd->cm);
 
@@ -926,6 +974,54 @@ static void MVD_ChangeLevel(mvd_t *mvd)
     SV_SendAsyncPackets();
 }
 
+/*
+==================
+MVD_SaveBaseConfigstrings
+
+Base configstrings are only needed for writing snapshots and rewinding state
+while seeking. Save them packed, each slot separately, as strings longer than
+MAX_QPATH span several slots.
+==================
+*/
+static void MVD_SaveBaseConfigstrings(mvd_t *mvd)
+{
+    mvd_cstable_t *table;
+    size_t size, len;
+    char *s;
+    int i;
+
+    size = sizeof(*table);
+    for (i = 0; i < MAX_CONFIGSTRINGS; i++) {
+        len = strlen(mvd->configstrings[i]);
+        if (len > MAX_QPATH)
+            len = MAX_QPATH;
+        if (len)
+            size += len + 1;
+    }
+
+    Z_Free(mvd->baseconfigstrings);
+    table = MVD_Malloc(size);
+    table->size = size;
+    table->data[0] = 0;
+
+    s = table->data + 1;
+    for (i = 0; i < MAX_CONFIGSTRINGS; i++) {
+        len = strlen(mvd->configstrings[i]);
+        if (len > MAX_QPATH)
+            len = MAX_QPATH;
+        if (!len) {
+            table->offsets[i] = 0;
+            continue;
+        }
+        table->offsets[i] = s - table->data;
+        memcpy(s, mvd->configstrings[i], len);
+        s[len] = 0;
+        s += len + 1;
+    }
+
+    mvd->baseconfigstrings = table;
+}
+
 static void MVD_ParseServerData(mvd_t *mvd, int extrabits)
 {
     int protocol;
@@ -1027,6 +1123,7 @@ static void MVD_ParseServerData(mvd_t *mvd, int extrabits)
 
     // load the world model (we are only interesed in visibility info)
     Com_Printf("[%s] -=- Loading %s...\n", mvd->name, string);
+    SV_CheckMapCache();
     ret = CM_LoadMap(&mvd->cm, string);
     if (ret) {
         Com_EPrintf("[%s] =!= Couldn't load %s: %s\n", mvd->name, string, Q_ErrorString(ret));
@@ -1043,7 +1140,7 @@ static void MVD_ParseServerData(mvd_t *mvd, int extrabits)
     MVD_SetPlayerNames(mvd);
 
     // init world entity
-    ent = &mvd->edicts[0];
+    ent = MVD_AllocEdict(mvd, 0);
     ent->solid = SOLID_BSP;
     ent->inuse = qtrue;
 
@@ -1056,7 +1153,7 @@ static void MVD_ParseServerData(mvd_t *mvd, int extrabits)
     MVD_ParseFrame(mvd);
 
     // save base configstrings
-    memcpy(mvd->baseconfigstrings, mvd->configstrings, sizeof(mvd->baseconfigstrings));
+    MVD_SaveBaseConfigstrings(mvd);
 
     // force inital snapshot
     mvd->last_snapshot = INT_MIN;
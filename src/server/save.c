@@ -25,6 +25,33 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 // save to temporary dir and rename only when done
 #define SAVE_CURRENT ".current"
 
+/*
+Server and game state are serialized into memory on the main thread. Game
+DLL hands its buffers over through WriteSaveFile (older games write their
+files themselves). Writing out the buffered files and moving the whole set
+into the target directory is done by the background writer, so that disk
+latency doesn't stall the server. Saving or loading another game and
+shutting down the server wait for the pending writer first.
+*/
+typedef struct {
+    char        path[MAX_OSPATH];
+    byte        *data;
+    size_t      len;
+} savefile_t;
+
+static struct {
+#if USE_THREADS
+    sys_thread_t        *thread;
+    volatile qboolean   done;
+#endif
+    qboolean    pending;
+    qboolean    collecting; // accepting files from the game
+    char        dir[MAX_QPATH];
+    savefile_t  files[4];   // server and game .level and .state
+    int         numfiles;
+    qerror_t    ret;
+} writer;
+
 /*
 ===============================================================================
 
@@ -33,6 +60,64 @@ SAVEGAME FILES
 ===============================================================================
 */
 
+// moves contents of msg_write into a file to be written by the writer
+static qerror_t buffer_file(const char *name)
+{
+    savefile_t *file = &writer.files[writer.numfiles];
+    size_t len;
+    qerror_t ret;
+
+    len = Q_snprintf(file->path, sizeof(file->path),
+                     "%s/save/" SAVE_CURRENT "/%s", fs_gamedir, name);
+    if (len >= sizeof(file->path)) {
+        SZ_Clear(&msg_write);
+        return Q_ERR_NAMETOOLONG;
+    }
+
+    // older game DLL writes its files right away
+    ret = FS_CreatePath(file->path);
+    if (ret) {
+        SZ_Clear(&msg_write);
+        return ret;
+    }
+
+    file->data = Z_Malloc(msg_write.cursize);
+    file->len = msg_write.cursize;
+    memcpy(file->data, msg_write.data, msg_write.cursize);
+    writer.numfiles++;
+
+    SZ_Clear(&msg_write);
+    return Q_ERR_SUCCESS;
+}
+
+/*
+==============
+SV_WriteSaveFile
+
+Takes a copy of the game DLL savegame file to be written by the writer.
+==============
+*/
+qboolean SV_WriteSaveFile(const char *filename, const void *data, size_t len)
+{
+    savefile_t *file;
+
+    if (!writer.collecting)
+        return qfalse;
+    if (writer.numfiles == q_countof(writer.files))
+        return qfalse;
+
+    file = &writer.files[writer.numfiles];
+    if (Q_strlcpy(file->path, filename, sizeof(file->path)) >= sizeof(file->path))
+        return qfalse;
+
+    file->data = Z_Malloc(len);
+    file->len = len;
+    memcpy(file->data, data, len);
+    writer.numfiles++;
+
+    return qtrue;
+}
+
 static qerror_t write_server_file(qboolean autosave)
 {
     char name[MAX_OSPATH];
@@ -63,13 +148,9 @@ static qerror_t write_server_file(qboolean autosave)
     }
     MSG_WriteString(NULL);
 
-    // write server state
-    ret = FS_WriteFile("save/" SAVE_CURRENT "/server.state",
-                       msg_write.data, msg_write.cursize);
-
-    SZ_Clear(&msg_write);
-
-    if (ret < 0) {
+    // server state is written out later
+    ret = buffer_file("server.state");
+    if (ret) {
         return ret;
     }
 
@@ -118,12 +199,9 @@ static qerror_t write_level_file(void)
     MSG_WriteByte(len);
     MSG_WriteData(portalbits, len);
 
-    ret = FS_WriteFile("save/" SAVE_CURRENT "/server.level",
-                       msg_write.data, msg_write.cursize);
-
-    SZ_Clear(&msg_write);
-
-    if (ret < 0) {
+    // server level is written out later
+    ret = buffer_file("server.level");
+    if (ret) {
         return ret;
     }
 
@@ -188,6 +266,102 @@ static qerror_t move_files(const char *dir)
     return Q_ERR_SUCCESS;
 }
 
+// only uses OS functions, safe to call from the writer thread
+static qerror_t write_file(savefile_t *file)
+{
+    FILE *f;
+    size_t len;
+
+    f = fopen(file->path, "wb");
+    if (!f) {
+        return Q_Errno();
+    }
+
+    len = fwrite(file->data, 1, file->len, f);
+    if (fclose(f) || len != file->len) {
+        return Q_ERR_FAILURE;
+    }
+
+    return Q_ERR_SUCCESS;
+}
+
+static void write_files(void *arg)
+{
+    qerror_t ret = Q_ERR_SUCCESS;
+    int i;
+
+    for (i = 0; i < writer.numfiles && !ret; i++)
+        ret = write_file(&writer.files[i]);
+    if (!ret)
+        ret = move_files(writer.dir);
+
+    writer.ret = ret;
+#if USE_THREADS
+    writer.done = qtrue;
+#endif
+}
+
+static void start_writer(const char *dir)
+{
+    Q_strlcpy(writer.dir, dir, sizeof(writer.dir));
+    writer.pending = qtrue;
+
+#if USE_THREADS
+    writer.done = qfalse;
+    writer.thread = Sys_CreateThread(write_files, NULL);
+    if (writer.thread)
+        return;
+#endif
+
+    write_files(NULL);
+}
+
+static void free_files(void)
+{
+    int i;
+
+    for (i = 0; i < writer.numfiles; i++)
+        Z_Free(writer.files[i].data);
+    memset(writer.files, 0, sizeof(writer.files));
+    writer.numfiles = 0;
+    writer.collecting = qfalse;
+}
+
+/*
+==============
+SV_FinishSavegame
+
+Reports result of the background writer if it is done. If `wait' is set,
+blocks until it is.
+==============
+*/
+void SV_FinishSavegame(qboolean wait)
+{
+    if (!writer.pending) {
+        // savegame was aborted by an error
+        if (writer.collecting)
+            free_files();
+        return;
+    }
+
+#if USE_THREADS
+    if (writer.thread) {
+        if (!wait && !writer.done)
+            return;
+        Sys_JoinThread(writer.thread);
+        writer.thread = NULL;
+    }
+#endif
+
+    writer.pending = qfalse;
+    free_files();
+
+    if (writer.ret)
+        Com_EPrintf("Couldn't write %s: %s\n", writer.dir, Q_ErrorString(writer.ret));
+    else
+        Com_Printf("Game saved.\n");
+}
+
 static qerror_t read_binary_file(const char *name)
 {
     qhandle_t f;
@@ -287,6 +461,7 @@ static qerror_t read_server_file(const char *dir)
         return Q_ERR_NAMETOOLONG;
     }
 
+    SV_CheckMapCache();
     ret = CM_LoadMap(&cm, name);
     if (ret) {
         return ret;
@@ -447,6 +622,9 @@ void SV_Loadgame_f(void)
         return;
     }
 
+    // it might be writing this very game
+    SV_FinishSavegame(qtrue);
+
     ret = read_server_file(dir);
     if (ret) {
         Com_Printf("Couldn't load %s: %s\n", dir, Q_ErrorString(ret));
@@ -505,6 +683,11 @@ void SV_Savegame_f(void)
         return;
     }
 
+    // previous save is still using the temporary dir
+    SV_FinishSavegame(qtrue);
+
+    writer.collecting = qtrue;
+
     // archive current level, including all client edicts.
     // when the level is reloaded, they will be shells awaiting
     // a connecting client
@@ -517,15 +700,14 @@ void SV_Savegame_f(void)
     if (ret)
         goto fail;
 
-    // rename all stuff
-    ret = move_files(dir);
-    if (ret)
-        goto fail;
+    writer.collecting = qfalse;
 
-    Com_Printf("Game saved.\n");
+    // write buffered files and rename all stuff
+    start_writer(dir);
     return;
 
 fail:
+    free_files();
     Com_EPrintf("Couldn't write %s: %s\n", dir, Q_ErrorString(ret));
 }
 
@@ -724,6 +724,74 @@ static void add_message_new(client_t *client, byte *data,
     }
 }
 
+/*
+=======================
+SV_UpdateHuffman
+
+Rebuilds frame code from byte statistics collected so far. Called on level
+change, when all clients are going to receive new serverdata.
+=======================
+*/
+#define HUFF_MIN_SAMPLES    0x10000
+#define HUFF_MAX_SAMPLES    0x1000000
+
+void SV_UpdateHuffman(void)
+{
+    int i;
+
+    if (svs.huffbytes && svs.huffbytes < HUFF_MIN_SAMPLES) {
+        return; // not enough data yet, keep the old code
+    }
+
+    HUFF_BuildFromFrequencies(&svs.huffman, svs.huffstats);
+
+    SV_DPrintf(0, "%s: %u bytes sampled\n", __func__, svs.huffbytes);
+
+    // decay statistics to follow changes in traffic
+    for (i = 0; i < HUFF_SYMBOLS; i++) {
+        svs.huffstats[i] >>= 1;
+    }
+    svs.huffbytes >>= 1;
+}
+
+static void compress_frame(client_t *client)
+{
+    byte buffer[MAX_MSGLEN];
+    size_t i, len;
+
+    // collect statistics from all clients
+    if (svs.huffbytes < HUFF_MAX_SAMPLES) {
+        for (i = 0; i < msg_write.cursize; i++) {
+            svs.huffstats[msg_write.data[i]]++;
+        }
+        svs.huffbytes += msg_write.cursize;
+    }
+
+    if (!sv_huffman->integer || !Q2PRO_HUFFMAN(client)) {
+        return;
+    }
+
+    if (msg_write.cursize < 16) {
+        return; // not worth it
+    }
+
+    len = HUFF_Encode(&svs.huffman, buffer, msg_write.cursize - 5,
+                      msg_write.data, msg_write.cursize);
+    if (!len) {
+        return; // doesn't compress
+    }
+
+    SV_DPrintf(1, "%s: huff: %"PRIz" into %"PRIz"\n",
+               client->name, msg_write.cursize, len);
+
+    i = msg_write.cursize;
+    SZ_Clear(&msg_write);
+    MSG_WriteByte(svc_hpacket);
+    MSG_WriteShort(len);
+    MSG_WriteShort(i);
+    MSG_WriteData(buffer, len);
+}
+
 static void write_datagram_new(client_t *client)
 {
     size_t cursize;
@@ -738,6 +806,8 @@ static void write_datagram_new(client_t *client)
         SZ_Clear(&msg_write);
     }
 
+    compress_frame(client);
+
     // now write unreliable messages
     // for this client out to the message
     // it is necessary for this to be after the WriteFrame
@@ -821,6 +891,11 @@ void SV_SendClientMessages(void)
     client_t    *client;
     size_t      cursize;
 
+#if USE_MVD_CLIENT
+    // invalidate frames shared during previous call
+    svs.frame_sequence++;
+#endif
+
     // send a message to each connected client
     FOR_EACH_CLIENT(client) {
         if (client->state != cs_spawned || client->download || client->nodata)
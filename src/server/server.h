@@ -28,6 +28,8 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "common/cvar.h"
 #include "common/error.h"
 #include "common/files.h"
+#include "common/huffman.h"
+#include "common/mdfour.h"
 #include "common/msg.h"
 #include "common/net/net.h"
 #include "common/net/chan.h"
@@ -88,7 +90,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 // game features this server supports
 #define SV_FEATURES (GMF_CLIENTNUM | GMF_PROPERINUSE | GMF_MVDSPEC | \
                      GMF_WANT_ALL_DISCONNECTS | GMF_ENHANCED_SAVEGAMES | \
-                     SV_GMF_VARIABLE_FPS)
+                     SV_GMF_VARIABLE_FPS | GMF_ENTITY_HISTORY)
 
 // ugly hack for SV_Shutdown
 #define MVD_SPAWN_DISABLED  0
@@ -157,7 +159,7 @@ typedef struct {
 
     char        name[MAX_QPATH];            // map name, or cinematic name
     cm_t        cm;
-    char        *entitystring;
+    char        *entitystring;              // override, owned by map cache
 
     char        configstrings[MAX_CONFIGSTRINGS][MAX_QPATH];
 
@@ -180,6 +182,10 @@ typedef struct {
      sv.state == ss_game && \
      EDICT_POOL(c, e)->solid == SOLID_BSP)
 
+#define Q2PRO_HUFFMAN(c) \
+    ((c)->protocol == PROTOCOL_VERSION_Q2PRO && \
+     (c)->version >= PROTOCOL_VERSION_Q2PRO_HUFFMAN)
+
 typedef enum {
     cs_free,        // can be reused for a new connection
     cs_zombie,      // client has been disconnected, but don't reuse
@@ -250,6 +256,16 @@ typedef struct {
     unsigned    cost;
 } ratelimit_t;
 
+// status queries are rate limited per /24 subnet, with a fixed number of
+// buckets shared by hashing; the least recently used bucket is recycled
+#define SUBNET_LIMITS           256
+#define SUBNET_LIMIT_PROBES     4
+
+typedef struct {
+    uint32_t        subnet;
+    ratelimit_t     limit;
+} subnetlimit_t;
+
 typedef struct client_s {
     list_t          entry;
 
@@ -301,6 +317,9 @@ typedef struct client_s {
     int             framediv;
 #endif
     unsigned        frameflags;
+#if USE_MVD_CLIENT
+    struct frame_group_s    *frame_group;   // shared with other spectators
+#endif
 
     // rate dropping
     size_t          message_size[RATE_MESSAGES];    // used to rate drop normal packets
@@ -374,26 +393,45 @@ typedef struct client_s {
 
 //=============================================================================
 
-// MAX_CHALLENGES is made large to prevent a denial
-// of service attack that could cycle all of them
-// out before legitimate users connected
-#define    MAX_CHALLENGES    1024
+// challenges are not stored anywhere, they are MACs of client address keyed
+// by a secret that is replaced every CHALLENGE_PERIOD msec. The previous
+// secret is still accepted, so a challenge is good for at least one period.
+#define CHALLENGE_PERIOD    15000
+#define CHALLENGE_KEY_BYTES 16
 
-typedef struct {
-    netadr_t    adr;
-    unsigned    challenge;
-    unsigned    time;
-} challenge_t;
+// address keys are 128 bits wide, IPv4 addresses are stored mapped
+// into ::ffff:0:0/96
+#define ADDR_KEY_BYTES  16
+#define ADDR_KEY_BITS   (ADDR_KEY_BYTES * 8)
+#define ADDR_V4_OFFSET  96
 
 typedef struct {
-    list_t      entry;
-    netadrip_t  addr;
-    uint32_t    mask;
+    list_t      entry;  // in order of addition, for listing and ids
+    unsigned    seq;    // order of addition, first match wins
+    uint8_t     key[ADDR_KEY_BYTES];
+    int         bits;   // prefix length in key bits
     unsigned    hits;
-    time_t      time;   // time of the last hit
+    time_t      time;   // wall clock time of the last hit
     char        comment[1];
 } addrmatch_t;
 
+typedef struct addrnode_s {
+    struct addrnode_s   *child[2];
+    addrmatch_t         *match; // entry for exactly this prefix, if any
+    uint8_t             key[ADDR_KEY_BYTES];
+    int                 bits;
+} addrnode_t;
+
+// compressed binary trie of address prefixes
+typedef struct {
+    list_t      entries;
+    addrnode_t  *root;
+    unsigned    count;
+    unsigned    nextseq;
+} addrlist_t;
+
+#define ADDRLIST_DECL(x)    addrlist_t x = { { &x.entries, &x.entries } }
+
 typedef struct {
     list_t  entry;
     int     len;
@@ -432,6 +470,34 @@ typedef struct {
 #define FOR_EACH_MASTER_SAFE(m, n) \
     LIST_FOR_EACH_SAFE(master_t, m, n, &sv_masterlist, entry)
 
+#define DELTA_CACHE_SIZE    2048
+#define DELTA_CACHE_MASK    (DELTA_CACHE_SIZE - 1)
+
+typedef struct {
+    entity_packed_t from;
+    entity_packed_t to;
+    msgEsFlags_t    flags;
+    size_t          len;
+    byte            data[MAX_PACKED_ENTITY_BYTES];
+} delta_cache_t;
+
+#if USE_MVD_CLIENT
+#define FRAME_GROUPS        64
+#define FRAME_GROUPS_MASK   (FRAME_GROUPS - 1)
+#define FRAME_GROUP_PROBES  4
+
+// frame built for the first MVD spectator of a group, reused by the rest
+typedef struct frame_group_s {
+    unsigned        sequence;       // valid for this svs.frame_sequence only
+    client_t        *leader;
+    client_frame_t  *frame;
+    client_frame_t  *oldframe;
+    vec3_t          org;            // view origin frame was built for
+    size_t          len;            // encoded packet entities, 0 if none
+    byte            data[MAX_MSGLEN / 4];
+} frame_group_t;
+#endif
+
 typedef struct server_static_s {
     qboolean    initialized;        // sv_init has completed
     unsigned    realtime;           // always increasing, no clamping, etc
@@ -441,25 +507,48 @@ typedef struct server_static_s {
     unsigned        num_entities;   // maxclients*UPDATE_BACKUP*MAX_PACKET_ENTITIES
     unsigned        next_entity;    // next state to use
     entity_packed_t *entities;      // [num_entities]
+    delta_cache_t   *delta_cache;   // [DELTA_CACHE_SIZE], allocated on demand
+
+#if USE_MVD_CLIENT
+    frame_group_t   *frame_groups;  // [FRAME_GROUPS], allocated on demand
+    unsigned        frame_sequence; // bumped each SV_SendClientMessages
+    unsigned        frames_built;   // by broadcast clients
+    unsigned        frames_shared;
+    unsigned        packets_shared;
+#endif
 
 #if USE_ZLIB
     z_stream        z;  // for compressing messages at once
 #endif
 
+    huffman_t       huffman;    // frame code for current level
+    unsigned        huffstats[HUFF_SYMBOLS];
+    unsigned        huffbytes;  // number of bytes sampled
+
     unsigned        last_heartbeat;
 
-    ratelimit_t     ratelimit_status;
+    ratelimit_t     ratelimit_status;   // template for subnet buckets
+    ratelimit_t     ratelimit_status_total;
+    subnetlimit_t   subnet_limits[SUBNET_LIMITS];
     ratelimit_t     ratelimit_auth;
     ratelimit_t     ratelimit_rcon;
 
-    challenge_t     challenges[MAX_CHALLENGES]; // to prevent invalid IPs from connecting
+    // to prevent invalid IPs from connecting
+    unsigned        challenge_period;   // current period + 1, 0 if not keyed
+    uint8_t         challenge_keys[2][CHALLENGE_KEY_BYTES]; // by period parity
+
+    // replies to status and info queries, rebuilt at most once per frame
+    size_t          status_len;
+    size_t          info_len;
+    char            status_string[MAX_PACKETLEN_DEFAULT];
+    char            info_string[MAX_QPATH * 2];
 } server_static_t;
 
 //=============================================================================
 
 extern list_t      sv_masterlist; // address of the master server
-extern list_t      sv_banlist;
-extern list_t      sv_blacklist;
+extern addrlist_t  sv_banlist;
+extern addrlist_t  sv_blacklist;
 extern list_t      sv_cmdlist_connect;
 extern list_t      sv_cmdlist_begin;
 extern list_t      sv_filterlist;
@@ -488,6 +577,11 @@ extern cvar_t       *sv_debug;
 extern cvar_t       *sv_pad_packets;
 #endif
 extern cvar_t       *sv_novis;
+extern cvar_t       *sv_delta_cache;
+#if USE_MVD_CLIENT
+extern cvar_t       *sv_shared_frames;
+#endif
+extern cvar_t       *sv_huffman;
 extern cvar_t       *sv_lan_force_rate;
 extern cvar_t       *sv_calcpings_method;
 extern cvar_t       *sv_changemapcmd;
@@ -501,6 +595,7 @@ extern cvar_t       *sv_allow_map;
 extern cvar_t       *sv_recycle;
 #endif
 extern cvar_t       *sv_enhanced_setplayer;
+extern cvar_t       *sv_max_rewind;
 
 extern cvar_t       *sv_status_limit;
 extern cvar_t       *sv_status_show;
@@ -533,14 +628,34 @@ void SV_InitOperatorCommands(void);
 
 void SV_UserinfoChanged(client_t *cl);
 
+void SV_InvalidateStatus(void);
+
 qboolean SV_RateLimited(ratelimit_t *r);
 void SV_RateRecharge(ratelimit_t *r);
 void SV_RateInit(ratelimit_t *r, const char *s);
 
-addrmatch_t *SV_MatchAddress(list_t *list, netadr_t *address);
+void SV_AddressKey(const netadr_t *address, uint8_t *key);
+addrmatch_t *SV_MatchAddress(addrlist_t *list, netadr_t *address);
+addrmatch_t *SV_FindMatch(addrlist_t *list, const uint8_t *key, int bits);
+addrmatch_t *SV_AddMatch(addrlist_t *list, const uint8_t *key, int bits,
+                         const char *comment);
+void SV_RemoveMatch(addrlist_t *list, addrmatch_t *match);
+void SV_ClearMatches(addrlist_t *list);
 
 int SV_CountClients(void);
 
+typedef enum {
+    BENCH_INPUT,
+    BENCH_GAME,
+    BENCH_SEND,
+    BENCH_OTHER,
+
+    BENCH_STAGES
+} bench_stage_t;
+
+void SV_RunFrame(uint64_t *times);
+qboolean SV_ConnectSimulatedClient(client_t *newcl, const char *info);
+
 #if USE_ZLIB
 voidpf SV_zalloc(voidpf opaque, uInt items, uInt size);
 void SV_zfree(voidpf opaque, voidpf address);
@@ -580,6 +695,7 @@ void SV_BroadcastCommand(const char *fmt, ...) q_printf(1, 2);
 void SV_ClientAddMessage(client_t *client, int flags);
 void SV_ShutdownClientSend(client_t *client);
 void SV_InitClientSend(client_t *newcl);
+void SV_UpdateHuffman(void);
 
 //
 // sv_mvd.c
@@ -672,6 +788,16 @@ void SV_Nextserver(void);
 void SV_ExecuteClientMessage(client_t *cl);
 void SV_CloseDownload(client_t *client);
 
+//
+// sv_bench.c
+//
+void SV_BenchRecordCmd(client_t *client, usercmd_t *cmd);
+void SV_BenchEndFrame(void);
+void SV_BenchStopRecord(void);
+void SV_Benchmark_f(void);
+void SV_BenchRecord_f(void);
+void SV_BenchStop_f(void);
+
 //
 // sv_ccmds.c
 //
@@ -679,9 +805,10 @@ void SV_CloseDownload(client_t *client);
 extern const cmd_option_t o_record[];
 #endif
 
-void SV_AddMatch_f(list_t *list);
-void SV_DelMatch_f(list_t *list);
-void SV_ListMatches_f(list_t *list);
+void SV_AddMatch_f(addrlist_t *list);
+void SV_DelMatch_f(addrlist_t *list);
+void SV_ListMatches_f(addrlist_t *list);
+void SV_LoadMatches_f(addrlist_t *list);
 client_t *SV_GetPlayer(const char *s, qboolean partial);
 void SV_PrintMiscInfo(void);
 
@@ -714,6 +841,10 @@ void PF_Pmove(pmove_t *pm);
 //
 void SV_Savegame_f(void);
 void SV_Loadgame_f(void);
+void SV_FinishSavegame(qboolean wait);
+qboolean SV_WriteSaveFile(const char *filename, const void *data, size_t len);
+#else
+#define SV_FinishSavegame(wait) (void)0
 #endif
 
 //============================================================
@@ -760,6 +891,16 @@ trace_t q_gameabi SV_Trace(vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end,
                            edict_t *passedict, int contentmask);
 // mins and maxs are relative
 
+void SV_RecordHistory(void);
+void SV_FreeHistory(void);
+qboolean SV_RewindEntities(edict_t *ent);
+void SV_RestoreEntities(void);
+// lag compensation, see game_import_ex_t
+
+#if USE_TESTS
+void SV_RewindTest_f(void);
+#endif
+
 // if the entire move stays in a solid volume, trace.allsolid will be set,
 // trace.startsolid will be set, and trace.fraction will be 0
 
@@ -427,6 +427,10 @@ void SV_New_f(void)
         if (sv_client->version >= PROTOCOL_VERSION_Q2PRO_WATERJUMP_HACK) {
             MSG_WriteByte(sv_client->pmp.waterhack);
         }
+        if (sv_client->version >= PROTOCOL_VERSION_Q2PRO_HUFFMAN) {
+            HUFF_PackLengths(&svs.huffman,
+                             SZ_GetSpace(&msg_write, HUFF_LENGTHS_BYTES));
+        }
         break;
     default:
         break;
@@ -1025,6 +1029,8 @@ static inline void SV_ClientThink(usercmd_t *cmd)
         return;
     }
 
+    SV_BenchRecordCmd(sv_client, cmd);
+
     ge->ClientThink(sv_player, cmd);
 }
 
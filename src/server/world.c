@@ -47,6 +47,39 @@ static edict_t  **area_list;
 static int      area_count, area_maxcount;
 static int      area_type;
 
+#define REWIND_FRAMES   32
+#define REWIND_MASK     (REWIND_FRAMES - 1)
+
+typedef struct {
+    int     time;       // level time in milliseconds
+    int     first;      // offset of the first entity
+    int     count;
+} history_frame_t;
+
+// recorded entities are stored per frame as structure of arrays
+static struct {
+    history_frame_t frames[REWIND_FRAMES];
+    unsigned    framenum;   // number of frames recorded on this level
+    int         maxcount;   // entities per frame
+    vec3_t      *origins;
+    vec3_t      *mins;
+    vec3_t      *maxs;
+    short       *numbers;
+} sv_history;
+
+// entities positions are currently rewound to
+static struct {
+    qboolean    active;
+    int         count;
+    vec3_t      absmins[MAX_EDICTS];
+    vec3_t      absmaxs[MAX_EDICTS];
+    vec3_t      origins[MAX_EDICTS];
+    vec3_t      mins[MAX_EDICTS];
+    vec3_t      maxs[MAX_EDICTS];
+    short       numbers[MAX_EDICTS];
+    byte        mask[MAX_EDICTS / CHAR_BIT];
+} sv_rewind;
+
 /*
 ===============
 SV_CreateAreaNode
@@ -117,6 +150,10 @@ void SV_ClearWorld(void)
         ent = EDICT_NUM(i);
         ent->area.prev = ent->area.next = NULL;
     }
+
+    // history from previous level is meaningless
+    SV_RestoreEntities();
+    sv_history.framenum = 0;
 }
 
 /*
@@ -478,6 +515,65 @@ int SV_PointContents(vec3_t p)
     return contents;
 }
 
+static qboolean SV_PassEntity(edict_t *touch, edict_t *passedict, int contentmask)
+{
+    if (touch->solid == SOLID_NOT)
+        return qtrue;
+    if (touch == passedict)
+        return qtrue;
+    if (passedict) {
+        if (touch->owner == passedict)
+            return qtrue;    // don't clip against own missiles
+        if (passedict->owner == touch)
+            return qtrue;    // don't clip against owner
+    }
+
+    if (!(contentmask & CONTENTS_DEADMONSTER)
+        && (touch->svflags & SVF_DEADMONSTER))
+        return qtrue;
+
+    return qfalse;
+}
+
+/*
+====================
+SV_ClipMoveToRewound
+
+Clips against rewound entities at their recorded positions.
+====================
+*/
+static void SV_ClipMoveToRewound(vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end,
+                                 vec3_t boxmins, vec3_t boxmaxs,
+                                 edict_t *passedict, int contentmask, trace_t *tr)
+{
+    int         i;
+    edict_t     *touch;
+    trace_t     trace;
+
+    for (i = 0; i < sv_rewind.count; i++) {
+        if (sv_rewind.absmins[i][0] > boxmaxs[0]
+            || sv_rewind.absmins[i][1] > boxmaxs[1]
+            || sv_rewind.absmins[i][2] > boxmaxs[2]
+            || sv_rewind.absmaxs[i][0] < boxmins[0]
+            || sv_rewind.absmaxs[i][1] < boxmins[1]
+            || sv_rewind.absmaxs[i][2] < boxmins[2])
+            continue;        // not touching
+
+        if (tr->allsolid)
+            return;
+
+        touch = EDICT_NUM(sv_rewind.numbers[i]);
+        if (SV_PassEntity(touch, passedict, contentmask))
+            continue;
+
+        CM_TransformedBoxTrace(&trace, start, end, mins, maxs,
+                               CM_HeadnodeForBox(sv_rewind.mins[i], sv_rewind.maxs[i]),
+                               contentmask, sv_rewind.origins[i], vec3_origin);
+
+        CM_ClipEntity(tr, &trace, touch);
+    }
+}
+
 /*
 ====================
 SV_ClipMoveToEntities
@@ -509,21 +605,13 @@ static void SV_ClipMoveToEntities(vec3_t start, vec3_t mins, vec3_t maxs, vec3_t
     // list removed before we get to it (killtriggered)
     for (i = 0; i < num; i++) {
         touch = touchlist[i];
-        if (touch->solid == SOLID_NOT)
-            continue;
-        if (touch == passedict)
-            continue;
         if (tr->allsolid)
             return;
-        if (passedict) {
-            if (touch->owner == passedict)
-                continue;    // don't clip against own missiles
-            if (passedict->owner == touch)
-                continue;    // don't clip against owner
-        }
+        if (SV_PassEntity(touch, passedict, contentmask))
+            continue;
 
-        if (!(contentmask & CONTENTS_DEADMONSTER)
-            && (touch->svflags & SVF_DEADMONSTER))
+        // rewound entities are clipped at their recorded positions
+        if (sv_rewind.active && Q_IsBitSet(sv_rewind.mask, NUM_FOR_EDICT(touch)))
             continue;
 
         // might intersect, so do an exact clip
@@ -533,6 +621,10 @@ static void SV_ClipMoveToEntities(vec3_t start, vec3_t mins, vec3_t maxs, vec3_t
 
         CM_ClipEntity(tr, &trace, touch);
     }
+
+    if (sv_rewind.active)
+        SV_ClipMoveToRewound(start, mins, maxs, end, boxmins, boxmaxs,
+                             passedict, contentmask, tr);
 }
 
 /*
@@ -580,3 +672,394 @@ trace_t q_gameabi SV_Trace(vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end,
     return trace;
 }
 
+
+/*
+===============================================================================
+
+ENTITY HISTORY
+
+If the game sets GMF_ENTITY_HISTORY, positions and bounds of all solid
+bounding box entities are recorded after each game frame. Game may then
+rewind entities to where a client saw them, compensating for its latency.
+Rewound entities stay linked at their current positions. SV_Trace checks
+them against rewound bounds instead of going through the area tree.
+
+===============================================================================
+*/
+
+static void SV_AllocHistory(void)
+{
+    size_t count = REWIND_FRAMES * ge->max_edicts;
+    byte *data;
+
+    data = SV_Malloc(count * (sizeof(vec3_t) * 3 + sizeof(short)));
+
+    sv_history.maxcount = ge->max_edicts;
+    sv_history.origins = (vec3_t *)data;
+    sv_history.mins = sv_history.origins + count;
+    sv_history.maxs = sv_history.mins + count;
+    sv_history.numbers = (short *)(sv_history.maxs + count);
+    sv_history.framenum = 0;
+}
+
+void SV_FreeHistory(void)
+{
+    SV_RestoreEntities();
+    Z_Free(sv_history.origins);
+    memset(&sv_history, 0, sizeof(sv_history));
+}
+
+static void SV_RecordFrame(int time)
+{
+    history_frame_t *frame;
+    edict_t *ent;
+    int i, n;
+
+    if (!sv_history.origins)
+        SV_AllocHistory();
+
+    frame = &sv_history.frames[sv_history.framenum & REWIND_MASK];
+    frame->time = time;
+    frame->first = n = (sv_history.framenum & REWIND_MASK) * sv_history.maxcount;
+
+    for (i = 1; i < ge->num_edicts; i++) {
+        ent = EDICT_NUM(i);
+        if (ent->solid != SOLID_BBOX)
+            continue;
+        if (!ent->area.prev)
+            continue;   // not linked in anywhere
+        VectorCopy(ent->s.origin, sv_history.origins[n]);
+        VectorCopy(ent->mins, sv_history.mins[n]);
+        VectorCopy(ent->maxs, sv_history.maxs[n]);
+        sv_history.numbers[n] = i;
+        n++;
+    }
+
+    frame->count = n - frame->first;
+    sv_history.framenum++;
+}
+
+/*
+===============
+SV_RecordHistory
+
+Called after each game frame.
+===============
+*/
+void SV_RecordHistory(void)
+{
+    if (!(g_features->integer & GMF_ENTITY_HISTORY))
+        return;
+
+    if (sv_rewind.active) {
+        Com_DPrintf("Game didn't restore rewound entities\n");
+        SV_RestoreEntities();
+    }
+
+    SV_RecordFrame(sv.framenum * SV_FRAMETIME);
+}
+
+static int SV_ClientLatency(edict_t *ent)
+{
+    client_t *cl;
+    client_frame_t *frame;
+    int num = NUM_FOR_EDICT(ent);
+
+    if (num < 1 || num > sv_maxclients->integer)
+        return 0;
+
+    cl = &svs.client_pool[num - 1];
+    if (cl->state != cs_spawned)
+        return 0;
+
+    // latency of the last frame client has seen, if it is known
+    frame = &cl->frames[cl->lastframe & UPDATE_MASK];
+    if (frame->number == cl->lastframe && frame->latency >= 0)
+        return frame->latency;
+
+    return cl->ping;
+}
+
+static void SV_RewindEntity(int i, int j, float frac, edict_t *ent)
+{
+    int k, n = sv_rewind.count;
+    edict_t *check = EDICT_NUM(sv_history.numbers[i]);
+
+    if (check == ent)
+        return;     // shooter stays where it is
+    if (check->solid != SOLID_BBOX || !check->area.prev)
+        return;     // not solid any more
+
+    VectorCopy(sv_history.origins[i], sv_rewind.origins[n]);
+    VectorCopy(sv_history.mins[i], sv_rewind.mins[n]);
+    VectorCopy(sv_history.maxs[i], sv_rewind.maxs[n]);
+
+    // lerp towards the next frame unless the entity has teleported,
+    // using the same threshold as the client does
+    if (j != -1) {
+        for (k = 0; k < 3; k++) {
+            if (fabs(sv_history.origins[j][k] - sv_history.origins[i][k]) > 512)
+                break;
+        }
+        if (k == 3) {
+            LerpVector(sv_history.origins[i], sv_history.origins[j],
+                       frac, sv_rewind.origins[n]);
+        }
+    }
+
+    for (k = 0; k < 3; k++) {
+        sv_rewind.absmins[n][k] = sv_rewind.origins[n][k] + sv_rewind.mins[n][k] - 1;
+        sv_rewind.absmaxs[n][k] = sv_rewind.origins[n][k] + sv_rewind.maxs[n][k] + 1;
+    }
+
+    sv_rewind.numbers[n] = sv_history.numbers[i];
+    Q_SetBit(sv_rewind.mask, sv_history.numbers[i]);
+    sv_rewind.count++;
+}
+
+// rewinds recorded entities by the given latency, which must be positive
+static void SV_RewindLatency(edict_t *ent, int latency)
+{
+    const history_frame_t *f1, *f2;
+    int i, j, end, numframes, target;
+    float frac;
+
+    numframes = min(sv_history.framenum, REWIND_FRAMES);
+    f2 = &sv_history.frames[(sv_history.framenum - 1) & REWIND_MASK];
+    target = f2->time - latency;
+
+    // find the newest frame recorded at or before the target time
+    f1 = f2;
+    for (i = 1; i < numframes; i++) {
+        f1 = &sv_history.frames[(sv_history.framenum - 1 - i) & REWIND_MASK];
+        if (f1->time <= target)
+            break;
+        f2 = f1;
+    }
+
+    if (i == numframes) {
+        // not enough history, use the oldest frame
+        f2 = NULL;
+        frac = 0;
+    } else if (f2->time > f1->time) {
+        frac = (float)(target - f1->time) / (f2->time - f1->time);
+    } else {
+        frac = 0;
+    }
+
+    // both frames are sorted by entity number
+    j = f2 ? f2->first : 0;
+    end = f2 ? f2->first + f2->count : 0;
+    for (i = f1->first; i < f1->first + f1->count; i++) {
+        while (j < end && sv_history.numbers[j] < sv_history.numbers[i])
+            j++;
+        if (j < end && sv_history.numbers[j] == sv_history.numbers[i])
+            SV_RewindEntity(i, j, frac, ent);
+        else
+            SV_RewindEntity(i, -1, frac, ent);
+    }
+
+    sv_rewind.active = qtrue;
+}
+
+/*
+===============
+SV_RewindEntities
+
+Moves recorded entities, except the client itself, back by the client's
+latency, limited by sv_max_rewind. Position is interpolated between the
+two closest recorded frames. Traces use rewound positions until
+SV_RestoreEntities is called. Returns qfalse if there is nothing to
+rewind.
+===============
+*/
+qboolean SV_RewindEntities(edict_t *ent)
+{
+    int latency;
+
+    SV_RestoreEntities();
+
+    if (!sv_history.framenum)
+        return qfalse;
+
+    latency = SV_ClientLatency(ent);
+    if (latency > sv_max_rewind->integer)
+        latency = sv_max_rewind->integer;
+    if (latency <= 0)
+        return qfalse;
+
+    SV_RewindLatency(ent, latency);
+    return qtrue;
+}
+
+/*
+===============
+SV_RestoreEntities
+
+Ends the effect of SV_RewindEntities.
+===============
+*/
+void SV_RestoreEntities(void)
+{
+    int i;
+
+    for (i = 0; i < sv_rewind.count; i++)
+        Q_ClearBit(sv_rewind.mask, sv_rewind.numbers[i]);
+
+    sv_rewind.count = 0;
+    sv_rewind.active = qfalse;
+}
+
+#if USE_TESTS
+
+/*
+===============
+SV_RewindTest_f
+
+Moves a test entity along a line over recorded frames, then checks traces
+against it while rewound by various latencies and after restoring. Runs on
+its own edicts and area tree, so no map needs to be loaded. Entity history
+recorded so far is discarded.
+===============
+*/
+
+#define RT_FRAMES   10
+#define RT_STEP     30      // units per 100 ms frame
+
+typedef struct {
+    int         latency;    // 0 = not rewound
+    qboolean    shooter;    // rewind on behalf of the test entity itself
+    float       hit, miss;  // offsets along the line
+} rewind_test_t;
+
+static const rewind_test_t rewind_tests[] = {
+    {    0, qfalse, 270, 210 },  // current position
+    {  200, qfalse, 210, 270 },  // exactly at a recorded frame
+    {  150, qfalse, 225, 205 },  // interpolated between frames
+    { 5000, qfalse,   0,  30 },  // older than history
+    {  200, qtrue,  270, 210 },  // shooter stays where it is
+};
+
+static void rewind_test_move(edict_t *ent, float ofs)
+{
+    int i;
+
+    if (ent->area.prev)
+        List_Remove(&ent->area);
+
+    VectorSet(ent->s.origin, ofs, 0, 0);
+    for (i = 0; i < 3; i++) {
+        ent->absmin[i] = ent->s.origin[i] + ent->mins[i] - 1;
+        ent->absmax[i] = ent->s.origin[i] + ent->maxs[i] + 1;
+    }
+
+    // head node is always searched
+    List_Append(&sv_areanodes[0].solid_edicts, &ent->area);
+}
+
+static qboolean rewind_test_hit(edict_t *ent, float ofs)
+{
+    vec3_t start = { ofs, -64, 0 };
+    vec3_t end = { ofs, 64, 0 };
+    trace_t tr;
+
+    // there is no world to clip against
+    memset(&tr, 0, sizeof(tr));
+    tr.fraction = 1;
+    tr.ent = ge->edicts;
+    VectorCopy(end, tr.endpos);
+
+    SV_ClipMoveToEntities(start, vec3_origin, vec3_origin, end, NULL, MASK_SHOT, &tr);
+    return tr.ent == ent;
+}
+
+static int rewind_test_check(edict_t *ent, float hit, float miss, const char *what)
+{
+    int errors = 0;
+
+    if (!rewind_test_hit(ent, hit)) {
+        Com_EPrintf("%s: missed at %.f\n", what, hit);
+        errors++;
+    }
+    if (rewind_test_hit(ent, miss)) {
+        Com_EPrintf("%s: hit at %.f\n", what, miss);
+        errors++;
+    }
+
+    return errors;
+}
+
+void SV_RewindTest_f(void)
+{
+    static areanode_t nodes[AREA_NODES];
+    static edict_t edicts[2];   // world and test entity
+    vec3_t mins = { -4096, -4096, -4096 };
+    vec3_t maxs = { 4096, 4096, 4096 };
+    game_export_t *oldge = ge, testge;
+    const rewind_test_t *t;
+    edict_t *ent;
+    int i, numnodes, errors;
+    char what[32];
+
+    SV_FreeHistory();
+
+    // swap in test edicts and area tree
+    memcpy(nodes, sv_areanodes, sizeof(nodes));
+    numnodes = sv_numareanodes;
+    memset(sv_areanodes, 0, sizeof(sv_areanodes));
+    sv_numareanodes = 0;
+    SV_CreateAreaNode(0, mins, maxs);
+
+    memset(edicts, 0, sizeof(edicts));
+    memset(&testge, 0, sizeof(testge));
+    testge.edicts = edicts;
+    testge.edict_size = sizeof(edicts[0]);
+    testge.num_edicts = testge.max_edicts = q_countof(edicts);
+    ge = &testge;
+
+    ent = &edicts[1];
+    ent->inuse = qtrue;
+    ent->solid = SOLID_BBOX;
+    VectorSet(ent->mins, -16, -16, -16);
+    VectorSet(ent->maxs, 16, 16, 16);
+
+    for (i = 0; i < RT_FRAMES; i++) {
+        rewind_test_move(ent, i * RT_STEP);
+        SV_RecordFrame(i * 100);
+    }
+
+    errors = 0;
+    for (i = 0; i < q_countof(rewind_tests); i++) {
+        t = &rewind_tests[i];
+
+        Q_snprintf(what, sizeof(what), "rewind %d ms%s", t->latency,
+                   t->shooter ? " by self" : "");
+        if (t->latency)
+            SV_RewindLatency(t->shooter ? ent : ge->edicts, t->latency);
+        errors += rewind_test_check(ent, t->hit, t->miss, what);
+
+        SV_RestoreEntities();
+        if (Q_IsBitSet(sv_rewind.mask, 1)) {
+            Com_EPrintf("%s: still masked after restore\n", what);
+            errors++;
+        }
+        errors += rewind_test_check(ent, 270, t->hit != 270 ? t->hit : 210, "restore");
+    }
+
+    // teleported entities are not interpolated
+    rewind_test_move(ent, (RT_FRAMES - 1) * RT_STEP + 1000);
+    SV_RecordFrame(RT_FRAMES * 100);
+    SV_RewindLatency(ge->edicts, 50);
+    errors += rewind_test_check(ent, 270, 770, "teleport");
+
+    SV_FreeHistory();
+
+    ge = oldge;
+    memcpy(sv_areanodes, nodes, sizeof(nodes));
+    sv_numareanodes = numnodes;
+
+    Com_Printf("%d failures, %d rewinds tested\n", errors,
+               (int)q_countof(rewind_tests) + 1);
+}
+
+#endif // USE_TESTS
@@ -0,0 +1,2429 @@
+/*
+Copyright (C) 2003-2008 Andrey Nazarov
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+//
+// demotool.c -- offline demo analyzer, stripper and converter
+//
+// Standalone program that walks client (.dm2) and multiview (.mvd2) demos
+// using the same message parsing routines as the client and MVD server,
+// without starting either of them. Game state is tracked across deltas the
+// same way the client and MVD client do it, which allows rewriting demos
+// in either format with frames delta compressed from scratch. Each file is
+// processed independently, so many demos can be handled in parallel with
+// the -j option.
+//
+
+#include "shared/shared.h"
+#include "common/cmodel.h"
+#include "common/net/net.h"
+#include "common/protocol.h"
+#include "common/sizebuf.h"
+#include "common/msg.h"
+#include "common/utils.h"
+
+#include <errno.h>
+#include <setjmp.h>
+#if USE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef _WIN32
+#include <windows.h>
+#include <process.h>
+#else
+#include <unistd.h>
+#include <sys/wait.h>
+#endif
+
+typedef enum {
+    CAT_FRAME,
+    CAT_GAMESTATE,
+    CAT_SOUND,
+    CAT_EFFECT,
+    CAT_PRINT,
+    CAT_STUFF,
+    CAT_LAYOUT,
+    CAT_OTHER,
+
+    CAT_TOTAL
+} category_t;
+
+static const char *const cat_names[CAT_TOTAL] = {
+    "frames",
+    "gamestate",
+    "sounds",
+    "effects",
+    "prints",
+    "stufftext",
+    "layouts",
+    "other"
+};
+
+typedef enum {
+    DEMO_DM2,
+    DEMO_MVD2
+} demo_format_t;
+
+static const char *const format_names[2] = { "dm2", "mvd2" };
+
+#if USE_ZLIB
+typedef gzFile  demo_file_t;
+#else
+typedef FILE    *demo_file_t;
+#endif
+
+// client demo frame, same as server_frame_t on the client side
+typedef struct {
+    qboolean        valid;
+    int             number;
+    int             firstEntity;
+    int             numEntities;
+    player_state_t  ps;
+    int             areabytes;
+    byte            areabits[MAX_MAP_AREA_BYTES];
+} dm2_frame_t;
+
+typedef struct {
+    const char      *name;
+    demo_file_t     fp;
+    FILE            *out;
+    demo_format_t   format;
+    demo_format_t   outformat;
+    int             protocol;
+    char            mapname[MAX_QPATH];
+
+    uint32_t        firstlen;
+    qboolean        havefirst;
+
+    // game state, tracked across deltas
+    int             servercount;
+    char            gamedir[MAX_QPATH];
+    char            levelname[MAX_QPATH];
+    int             clientNum;      // recording client or MVD dummy
+    int             maxclients;
+    int             mvdflags;
+    char            configstrings[MAX_CONFIGSTRINGS][MAX_QPATH];
+    entity_state_t  baselines[MAX_EDICTS];
+    entity_state_t  entities[MAX_EDICTS];
+    player_state_t  players[MAX_CLIENTS];
+    byte            entitybits[MAX_EDICTS / CHAR_BIT];
+    byte            playerbits[MAX_CLIENTS / CHAR_BIT];
+    int             portalbytes;
+    byte            portalbits[MAX_MAP_PORTAL_BYTES];
+
+    // client demo delta frames
+    dm2_frame_t     frame;
+    dm2_frame_t     frames[UPDATE_BACKUP];
+    entity_state_t  entityStates[MAX_PARSE_ENTITIES];
+    int             numEntityStates;
+
+    // stripped copy of the current message
+    byte            outbuf[MAX_MSGLEN];
+    size_t          outlen;
+
+    // statistics
+    unsigned        messages;
+    unsigned        frames_parsed;
+    unsigned        frames_bad;
+    unsigned        msgframes;
+    size_t          bytes[CAT_TOTAL];
+    size_t          total;
+    size_t          minframe;
+    size_t          maxframe;
+    size_t          frametotal;
+    int             maxentities;
+    int             maxplayers;
+    uint64_t        sumentities;
+} demo_t;
+
+// state of the demo being written by the convert command
+typedef struct {
+    qboolean        gamestate;      // gamestate has been written
+    qboolean        pending;        // frame parsed, but not written yet
+    size_t          maxlen;         // output message size limit
+    int             clientNum;      // dm2 point of view or recording client
+    int             dummy;          // MVD dummy
+    int             maxclients;
+    int             mvdflags;
+    int             framenum;       // dm2 frames written so far
+    int             lastframe;      // dm2 frame to delta from, -1 if none
+
+    // last written state and the one being built
+    player_packed_t ps, newps;
+    player_packed_t players[MAX_CLIENTS];
+    player_packed_t newplayers[MAX_CLIENTS];
+    entity_packed_t entities[MAX_EDICTS];
+    entity_packed_t newentities[MAX_EDICTS];
+
+    // commands queued for the next message
+    sizebuf_t       message;        // reliable
+    sizebuf_t       datagram;       // unreliable
+    byte            message_buf[MAX_MSGLEN];
+    byte            datagram_buf[MAX_MSGLEN];
+
+    // statistics
+    unsigned        frames_written;
+    unsigned        frames_dropped;
+    size_t          bytes_dropped;
+    size_t          total;
+} convert_t;
+
+static demo_t       demo;
+static convert_t    conv;
+
+static jmp_buf      abortframe;
+static char         errormsg[1024];
+
+static qboolean     verbose;
+static int          drop_mask;
+static const char   *outdir;
+static qboolean     convert;
+static int          target = -1;
+static int          pov = -1;
+
+/*
+==============================================================================
+
+SUPPORT ROUTINES
+
+==============================================================================
+*/
+
+void Com_LPrintf(print_type_t type, const char *fmt, ...)
+{
+    va_list argptr;
+
+    if (type == PRINT_DEVELOPER && !verbose) {
+        return;
+    }
+
+    va_start(argptr, fmt);
+    vfprintf(stderr, fmt, argptr);
+    va_end(argptr);
+}
+
+void Com_Error(error_type_t type, const char *fmt, ...)
+{
+    va_list argptr;
+
+    va_start(argptr, fmt);
+    Q_vsnprintf(errormsg, sizeof(errormsg), fmt, argptr);
+    va_end(argptr);
+
+    longjmp(abortframe, 1);
+}
+
+static demo_file_t demo_open(const char *name)
+{
+#if USE_ZLIB
+    return gzopen(name, "rb");
+#else
+    return fopen(name, "rb");
+#endif
+}
+
+static int demo_read(demo_file_t f, void *buffer, int len)
+{
+#if USE_ZLIB
+    return gzread(f, buffer, len);
+#else
+    return fread(buffer, 1, len, f);
+#endif
+}
+
+static void demo_close(demo_file_t f)
+{
+#if USE_ZLIB
+    gzclose(f);
+#else
+    fclose(f);
+#endif
+}
+
+static void skip_bytes(size_t len)
+{
+    if (msg_read.readcount + len > msg_read.cursize) {
+        Com_Error(ERR_DROP, "read past end of message");
+    }
+    msg_read.readcount += len;
+}
+
+static int count_bits(const byte *data, int numbits)
+{
+    int i, count = 0;
+
+    for (i = 0; i < numbits; i++) {
+        if (Q_IsBitSet(data, i)) {
+            count++;
+        }
+    }
+
+    return count;
+}
+
+static void keep_data(demo_t *d, const byte *data, size_t len)
+{
+    if (d->outlen + len > sizeof(d->outbuf)) {
+        Com_Error(ERR_DROP, "output message overflowed");
+    }
+    memcpy(d->outbuf + d->outlen, data, len);
+    d->outlen += len;
+}
+
+// accounts bytes of the command started at 'start' and copies them to the
+// output message unless the category is being stripped
+static void account(demo_t *d, category_t cat, size_t start)
+{
+    size_t len = msg_read.readcount - start;
+
+    d->bytes[cat] += len;
+    if (d->out && !convert && !(drop_mask & (1 << cat))) {
+        keep_data(d, msg_read.data + start, len);
+    }
+}
+
+static void parse_mapname(demo_t *d)
+{
+    const char *string = d->configstrings[CS_MODELS + 1];
+    size_t len;
+
+    // strip "maps/" and ".bsp"
+    len = strlen(string);
+    if (len > 9) {
+        memcpy(d->mapname, string + 5, len - 9);
+        d->mapname[len - 9] = 0;
+    }
+}
+
+static int parse_maxclients(demo_t *d)
+{
+    int maxclients = atoi(d->configstrings[CS_MAXCLIENTS]);
+
+    clamp(maxclients, 1, MAX_CLIENTS);
+    return maxclients;
+}
+
+static void parse_configstring(demo_t *d, int index)
+{
+    size_t len, maxlen;
+
+    if (index < 0 || index >= MAX_CONFIGSTRINGS) {
+        Com_Error(ERR_DROP, "bad configstring index: %d", index);
+    }
+
+    maxlen = CS_SIZE(index);
+    len = MSG_ReadString(d->configstrings[index], maxlen);
+    if (len >= maxlen) {
+        Com_Error(ERR_DROP, "configstring %d overflowed", index);
+    }
+
+    if (index == CS_MODELS + 1) {
+        parse_mapname(d);
+    }
+}
+
+static void clear_state(demo_t *d)
+{
+    memset(d->configstrings, 0, sizeof(d->configstrings));
+    memset(d->baselines, 0, sizeof(d->baselines));
+    memset(d->entities, 0, sizeof(d->entities));
+    memset(d->players, 0, sizeof(d->players));
+    memset(d->entitybits, 0, sizeof(d->entitybits));
+    memset(d->playerbits, 0, sizeof(d->playerbits));
+    memset(d->frames, 0, sizeof(d->frames));
+    memset(&d->frame, 0, sizeof(d->frame));
+    d->numEntityStates = 0;
+    d->portalbytes = 0;
+}
+
+static void finish_frame(demo_t *d)
+{
+    int numentities, numplayers;
+
+    numentities = count_bits(d->entitybits, MAX_EDICTS);
+    numplayers = count_bits(d->playerbits, MAX_CLIENTS);
+
+    d->sumentities += numentities;
+    d->maxentities = max(d->maxentities, numentities);
+    d->maxplayers = max(d->maxplayers, numplayers);
+    d->frames_parsed++;
+    d->msgframes++;
+
+    if (verbose) {
+        if (d->format == DEMO_MVD2) {
+            printf("%s: frame %u: %d entities, %d players\n",
+                   d->name, d->frames_parsed, numentities, numplayers);
+        } else {
+            printf("%s: frame %u: %d entities\n",
+                   d->name, d->frames_parsed, numentities);
+        }
+    }
+}
+
+static void begin_output(demo_t *d);
+static void flush_frame(demo_t *d);
+static void flush_output(demo_t *d);
+static void reset_output(void);
+static void queue_command(demo_t *d, qboolean reliable, const void *data, size_t len);
+static void queue_mvd_command(demo_t *d, int op, int clientNum, const byte *data, size_t len);
+static qboolean dm2_unicast_visible(demo_t *d, int clientNum, int cmd);
+static void dm2_convert_command(demo_t *d, int cmd, size_t start);
+static void mvd_convert_command(demo_t *d, int cmd, int extrabits, size_t start);
+
+/*
+==============================================================================
+
+CLIENT DEMOS
+
+==============================================================================
+*/
+
+// returns the number of bytes following temp entity type byte
+static int te_length(int type)
+{
+    switch (type) {
+    case TE_BLOOD:
+    case TE_GUNSHOT:
+    case TE_SPARKS:
+    case TE_BULLET_SPARKS:
+    case TE_SCREEN_SPARKS:
+    case TE_SHIELD_SPARKS:
+    case TE_SHOTGUN:
+    case TE_BLASTER:
+    case TE_GREENBLOOD:
+    case TE_BLASTER2:
+    case TE_FLECHETTE:
+    case TE_HEATBEAM_SPARKS:
+    case TE_HEATBEAM_STEAM:
+    case TE_MOREBLOOD:
+    case TE_ELECTRIC_SPARKS:
+        return 6 + 1;
+
+    case TE_SPLASH:
+    case TE_LASER_SPARKS:
+    case TE_WELDING_SPARKS:
+    case TE_TUNNEL_SPARKS:
+        return 1 + 6 + 1 + 1;
+
+    case TE_BLUEHYPERBLASTER:
+    case TE_RAILTRAIL:
+    case TE_BUBBLETRAIL:
+    case TE_DEBUGTRAIL:
+    case TE_BUBBLETRAIL2:
+    case TE_BFG_LASER:
+        return 6 + 6;
+
+    case TE_GRENADE_EXPLOSION:
+    case TE_GRENADE_EXPLOSION_WATER:
+    case TE_EXPLOSION2:
+    case TE_PLASMA_EXPLOSION:
+    case TE_ROCKET_EXPLOSION:
+    case TE_ROCKET_EXPLOSION_WATER:
+    case TE_EXPLOSION1:
+    case TE_EXPLOSION1_NP:
+    case TE_EXPLOSION1_BIG:
+    case TE_BFG_EXPLOSION:
+    case TE_BFG_BIGEXPLOSION:
+    case TE_BOSSTPORT:
+    case TE_PLAIN_EXPLOSION:
+    case TE_CHAINFIST_SMOKE:
+    case TE_TRACKER_EXPLOSION:
+    case TE_TELEPORT_EFFECT:
+    case TE_DBALL_GOAL:
+    case TE_WIDOWSPLASH:
+    case TE_NUKEBLAST:
+        return 6;
+
+    case TE_PARASITE_ATTACK:
+    case TE_MEDIC_CABLE_ATTACK:
+    case TE_HEATBEAM:
+    case TE_MONSTER_HEATBEAM:
+        return 2 + 6 + 6;
+
+    case TE_GRAPPLE_CABLE:
+        return 2 + 6 + 6 + 6;
+
+    case TE_LIGHTNING:
+        return 2 + 2 + 6 + 6;
+
+    case TE_FLASHLIGHT:
+        return 6 + 2;
+
+    case TE_FORCEWALL:
+        return 6 + 6 + 1;
+
+    case TE_WIDOWBEAMOUT:
+        return 2 + 6;
+
+    default:
+        return -1;
+    }
+}
+
+static void dm2_parse_temp_entity(void)
+{
+    int type, len;
+
+    type = MSG_ReadByte();
+    if (type == TE_STEAM) {
+        // variable length
+        len = MSG_ReadShort();
+        skip_bytes(1 + 6 + 1 + 1 + 2);
+        if (len != -1) {
+            skip_bytes(4);
+        }
+        return;
+    }
+
+    len = te_length(type);
+    if (len < 0) {
+        Com_Error(ERR_DROP, "bad temp entity type: %d", type);
+    }
+    skip_bytes(len);
+}
+
+static void dm2_parse_sound(void)
+{
+    int flags;
+
+    flags = MSG_ReadByte();
+    skip_bytes(1);  // index
+    if (flags & SND_VOLUME)
+        skip_bytes(1);
+    if (flags & SND_ATTENUATION)
+        skip_bytes(1);
+    if (flags & SND_OFFSET)
+        skip_bytes(1);
+    if (flags & SND_ENT)
+        skip_bytes(2);
+    if (flags & SND_POS)
+        skip_bytes(6);
+}
+
+static void dm2_parse_serverdata(demo_t *d)
+{
+    d->protocol = MSG_ReadLong();
+    if (d->protocol != PROTOCOL_VERSION_DEFAULT &&
+        d->protocol != PROTOCOL_VERSION_OLD) {
+        Com_Error(ERR_DROP, "unsupported protocol: %d", d->protocol);
+    }
+
+    clear_state(d);
+
+    d->servercount = MSG_ReadLong();
+    MSG_ReadByte();             // attractloop
+    MSG_ReadString(d->gamedir, sizeof(d->gamedir));
+    d->clientNum = MSG_ReadShort();
+    MSG_ReadString(d->levelname, sizeof(d->levelname));
+}
+
+static void dm2_parse_baseline(demo_t *d)
+{
+    int number, bits;
+
+    number = MSG_ParseEntityBits(&bits);
+    if (number < 1 || number >= MAX_EDICTS) {
+        Com_Error(ERR_DROP, "bad baseline number: %d", number);
+    }
+    MSG_ParseDeltaEntity(NULL, &d->baselines[number], number, bits, 0);
+}
+
+static void dm2_parse_delta_entity(demo_t *d, dm2_frame_t *frame, int newnum,
+                                   entity_state_t *old, int bits)
+{
+    entity_state_t *state;
+
+    if (frame->numEntities >= MAX_PACKET_ENTITIES) {
+        Com_Error(ERR_DROP, "%s: MAX_PACKET_ENTITIES exceeded", __func__);
+    }
+
+    state = &d->entityStates[d->numEntityStates & PARSE_ENTITIES_MASK];
+    d->numEntityStates++;
+    frame->numEntities++;
+
+    MSG_ParseDeltaEntity(old, state, newnum, bits, 0);
+
+    // shuffle previous origin to old
+    if (!(bits & U_OLDORIGIN) && !(state->renderfx & RF_BEAM))
+        VectorCopy(old->origin, state->old_origin);
+}
+
+// same as CL_ParsePacketEntities
+static void dm2_parse_packet_entities(demo_t *d, dm2_frame_t *oldframe,
+                                      dm2_frame_t *frame)
+{
+    entity_state_t *oldstate = NULL;
+    int newnum, bits, oldindex = 0, oldnum;
+
+    frame->firstEntity = d->numEntityStates;
+    frame->numEntities = 0;
+
+#define NEXT_OLDSTATE \
+    if (!oldframe || oldindex >= oldframe->numEntities) { \
+        oldnum = 99999; \
+    } else { \
+        oldstate = &d->entityStates[(oldframe->firstEntity + oldindex) & PARSE_ENTITIES_MASK]; \
+        oldnum = oldstate->number; \
+    }
+
+    NEXT_OLDSTATE
+
+    while (1) {
+        newnum = MSG_ParseEntityBits(&bits);
+        if (newnum < 0 || newnum >= MAX_EDICTS) {
+            Com_Error(ERR_DROP, "%s: bad number: %d", __func__, newnum);
+        }
+
+        if (msg_read.readcount > msg_read.cursize) {
+            Com_Error(ERR_DROP, "%s: read past end of message", __func__);
+        }
+
+        if (!newnum) {
+            break;
+        }
+
+        while (oldnum < newnum) {
+            // one or more entities from the old packet are unchanged
+            dm2_parse_delta_entity(d, frame, oldnum, oldstate, 0);
+            oldindex++;
+            NEXT_OLDSTATE
+        }
+
+        if (bits & U_REMOVE) {
+            // the entity present in oldframe is not in the current frame
+            if (!oldframe) {
+                Com_Error(ERR_DROP, "%s: U_REMOVE with NULL oldframe", __func__);
+            }
+            oldindex++;
+            NEXT_OLDSTATE
+            continue;
+        }
+
+        if (oldnum == newnum) {
+            // delta from previous state
+            dm2_parse_delta_entity(d, frame, newnum, oldstate, bits);
+            oldindex++;
+            NEXT_OLDSTATE
+            continue;
+        }
+
+        if (oldnum > newnum) {
+            // delta from baseline
+            dm2_parse_delta_entity(d, frame, newnum, &d->baselines[newnum], bits);
+        }
+    }
+
+    // any remaining entities in the old frame are copied over
+    while (oldnum != 99999) {
+        dm2_parse_delta_entity(d, frame, oldnum, oldstate, 0);
+        oldindex++;
+        NEXT_OLDSTATE
+    }
+
+#undef NEXT_OLDSTATE
+}
+
+static void dm2_parse_frame(demo_t *d)
+{
+    dm2_frame_t frame, *oldframe;
+    player_state_t *from;
+    entity_state_t *state;
+    int i, deltaframe, length, bits;
+
+    if (!d->protocol) {
+        Com_Error(ERR_DROP, "frame before serverdata");
+    }
+
+    if (conv.pending) {
+        flush_frame(d);
+    }
+
+    memset(&frame, 0, sizeof(frame));
+    frame.number = MSG_ReadLong();
+    deltaframe = MSG_ReadLong();
+    if (d->protocol != PROTOCOL_VERSION_OLD) {
+        MSG_ReadByte(); // suppressCount
+    }
+
+    // frames delta compressed from data that is no longer available are
+    // parsed, but not used, unless the previous frame can stand in for it
+    // like it does during client demo playback
+    if (deltaframe > 0) {
+        oldframe = &d->frames[deltaframe & UPDATE_MASK];
+        if (deltaframe != frame.number && oldframe->number == deltaframe &&
+            oldframe->valid && d->numEntityStates - oldframe->firstEntity <=
+            MAX_PARSE_ENTITIES - MAX_PACKET_ENTITIES) {
+            frame.valid = qtrue;
+        } else if (d->frame.valid) {
+            oldframe = &d->frame;
+            frame.valid = qtrue;
+        }
+        from = &oldframe->ps;
+    } else {
+        oldframe = NULL;
+        from = NULL;
+        frame.valid = qtrue;
+    }
+
+    // read areabits
+    length = MSG_ReadByte();
+    if (length < 0 || length > sizeof(frame.areabits)) {
+        Com_Error(ERR_DROP, "%s: invalid areabits length", __func__);
+    }
+    if (msg_read.readcount + length > msg_read.cursize) {
+        Com_Error(ERR_DROP, "%s: read past end of message", __func__);
+    }
+    memcpy(frame.areabits, msg_read.data + msg_read.readcount, length);
+    msg_read.readcount += length;
+    frame.areabytes = length;
+
+    if (MSG_ReadByte() != svc_playerinfo) {
+        Com_Error(ERR_DROP, "%s: not playerinfo", __func__);
+    }
+    bits = MSG_ReadShort();
+    MSG_ParseDeltaPlayerstate_Default(from, &frame.ps, bits);
+
+    if (MSG_ReadByte() != svc_packetentities) {
+        Com_Error(ERR_DROP, "%s: not packetentities", __func__);
+    }
+    dm2_parse_packet_entities(d, oldframe, &frame);
+
+    d->frames[frame.number & UPDATE_MASK] = frame;
+
+    if (!frame.valid) {
+        d->frames_bad++;
+        return;
+    }
+
+    d->frame = frame;
+
+    // rebuild the current set of entities
+    memset(d->entitybits, 0, sizeof(d->entitybits));
+    for (i = 0; i < frame.numEntities; i++) {
+        state = &d->entityStates[(frame.firstEntity + i) & PARSE_ENTITIES_MASK];
+        d->entities[state->number] = *state;
+        Q_SetBit(d->entitybits, state->number);
+    }
+
+    finish_frame(d);
+
+    if (convert) {
+        conv.pending = qtrue;
+    }
+}
+
+static void dm2_parse_message(demo_t *d)
+{
+    category_t cat;
+    size_t start;
+    int cmd, size;
+
+    while (msg_read.readcount < msg_read.cursize) {
+        start = msg_read.readcount;
+        cmd = MSG_ReadByte();
+
+        switch (cmd) {
+        case svc_muzzleflash:
+        case svc_muzzleflash2:
+            skip_bytes(3);
+            cat = CAT_EFFECT;
+            break;
+        case svc_temp_entity:
+            dm2_parse_temp_entity();
+            cat = CAT_EFFECT;
+            break;
+        case svc_layout:
+            MSG_ReadString(NULL, 0);
+            cat = CAT_LAYOUT;
+            break;
+        case svc_inventory:
+            skip_bytes(MAX_ITEMS * 2);
+            cat = CAT_LAYOUT;
+            break;
+        case svc_nop:
+        case svc_disconnect:
+        case svc_reconnect:
+            cat = CAT_OTHER;
+            break;
+        case svc_sound:
+            dm2_parse_sound();
+            cat = CAT_SOUND;
+            break;
+        case svc_print:
+            MSG_ReadByte();
+            MSG_ReadString(NULL, 0);
+            cat = CAT_PRINT;
+            break;
+        case svc_centerprint:
+            MSG_ReadString(NULL, 0);
+            cat = CAT_PRINT;
+            break;
+        case svc_stufftext:
+            MSG_ReadString(NULL, 0);
+            cat = CAT_STUFF;
+            break;
+        case svc_serverdata:
+            flush_output(d);
+            reset_output();
+            dm2_parse_serverdata(d);
+            cat = CAT_GAMESTATE;
+            break;
+        case svc_configstring:
+            parse_configstring(d, MSG_ReadShort());
+            cat = CAT_GAMESTATE;
+            break;
+        case svc_spawnbaseline:
+            dm2_parse_baseline(d);
+            cat = CAT_GAMESTATE;
+            break;
+        case svc_download:
+            size = MSG_ReadShort();
+            MSG_ReadByte();
+            if (size > 0) {
+                skip_bytes(size);
+            }
+            cat = CAT_OTHER;
+            break;
+        case svc_frame:
+            dm2_parse_frame(d);
+            cat = CAT_FRAME;
+            break;
+        default:
+            Com_Error(ERR_DROP, "illegible command at %"PRIz": %d", start, cmd);
+        }
+
+        if (msg_read.readcount > msg_read.cursize) {
+            Com_Error(ERR_DROP, "read past end of message");
+        }
+
+        account(d, cat, start);
+
+        if (convert && !(drop_mask & (1 << cat))) {
+            dm2_convert_command(d, cmd, start);
+        }
+    }
+}
+
+/*
+==============================================================================
+
+MULTIVIEW DEMOS
+
+==============================================================================
+*/
+
+static void mvd_parse_players(demo_t *d)
+{
+    int number, bits;
+
+    while (1) {
+        if (msg_read.readcount > msg_read.cursize) {
+            Com_Error(ERR_DROP, "%s: read past end of message", __func__);
+        }
+
+        number = MSG_ReadByte();
+        if (number == CLIENTNUM_NONE) {
+            break;
+        }
+
+        if (number < 0 || number >= d->maxclients) {
+            Com_Error(ERR_DROP, "%s: bad number: %d", __func__, number);
+        }
+
+        bits = MSG_ReadShort();
+        MSG_ParseDeltaPlayerstate_Packet(&d->players[number],
+                                         &d->players[number], bits);
+
+        if (bits & PPS_REMOVE) {
+            Q_ClearBit(d->playerbits, number);
+        } else {
+            Q_SetBit(d->playerbits, number);
+        }
+    }
+}
+
+static void mvd_parse_entities(demo_t *d)
+{
+    int number, bits;
+
+    while (1) {
+        if (msg_read.readcount > msg_read.cursize) {
+            Com_Error(ERR_DROP, "%s: read past end of message", __func__);
+        }
+
+        number = MSG_ParseEntityBits(&bits);
+        if (number < 0 || number >= MAX_EDICTS) {
+            Com_Error(ERR_DROP, "%s: bad number: %d", __func__, number);
+        }
+
+        if (!number) {
+            break;
+        }
+
+        MSG_ParseDeltaEntity(&d->entities[number], &d->entities[number],
+                             number, bits, 0);
+
+        if (bits & U_REMOVE) {
+            Q_ClearBit(d->entitybits, number);
+        } else {
+            Q_SetBit(d->entitybits, number);
+        }
+    }
+}
+
+// same as MVD_PlayerToEntityStates
+static void mvd_player_to_entity_states(demo_t *d)
+{
+    int i;
+
+    for (i = 0; i < d->maxclients; i++) {
+        if (!Q_IsBitSet(d->playerbits, i) || i == d->clientNum) {
+            continue;
+        }
+        if (d->players[i].pmove.pm_type != PM_NORMAL) {
+            continue;
+        }
+        if (!Q_IsBitSet(d->entitybits, i + 1)) {
+            continue;
+        }
+        Com_PlayerToEntityState(&d->players[i], &d->entities[i + 1]);
+    }
+}
+
+static void mvd_parse_frame(demo_t *d, qboolean baseline)
+{
+    int i, length;
+
+    if (conv.pending) {
+        flush_frame(d);
+    }
+
+    // events are not delta compressed
+    for (i = 1; i < MAX_EDICTS; i++) {
+        d->entities[i].event = 0;
+    }
+
+    length = MSG_ReadByte();
+    if (length < 0 || length > MAX_MAP_PORTAL_BYTES) {
+        Com_Error(ERR_DROP, "%s: bad portalbits length: %d", __func__, length);
+    }
+    if (msg_read.readcount + length > msg_read.cursize) {
+        Com_Error(ERR_DROP, "%s: read past end of message", __func__);
+    }
+    memcpy(d->portalbits, msg_read.data + msg_read.readcount, length);
+    msg_read.readcount += length;
+    d->portalbytes = length;
+
+    mvd_parse_players(d);
+    mvd_parse_entities(d);
+    mvd_player_to_entity_states(d);
+
+    if (!baseline) {
+        finish_frame(d);
+        if (convert) {
+            conv.pending = qtrue;
+        }
+    }
+}
+
+static void mvd_parse_serverdata(demo_t *d, int extrabits)
+{
+    int i, index;
+
+    d->protocol = MSG_ReadLong();
+    if (d->protocol != PROTOCOL_VERSION_MVD) {
+        Com_Error(ERR_DROP, "unsupported protocol: %d", d->protocol);
+    }
+
+    index = MSG_ReadShort();
+    if (!MVD_SUPPORTED(index)) {
+        Com_Error(ERR_DROP, "unsupported MVD protocol version: %d", index);
+    }
+
+    clear_state(d);
+
+    d->mvdflags = extrabits;
+    d->servercount = MSG_ReadLong();
+    MSG_ReadString(d->gamedir, sizeof(d->gamedir));
+    d->clientNum = MSG_ReadShort();
+
+    while (1) {
+        index = MSG_ReadShort();
+        if (index == MAX_CONFIGSTRINGS) {
+            break;
+        }
+
+        parse_configstring(d, index);
+
+        if (msg_read.readcount > msg_read.cursize) {
+            Com_Error(ERR_DROP, "read past end of message");
+        }
+    }
+
+    d->maxclients = parse_maxclients(d);
+    if (d->clientNum < 0 || d->clientNum >= d->maxclients) {
+        Com_Error(ERR_DROP, "invalid client num: %d", d->clientNum);
+    }
+
+    mvd_parse_frame(d, qtrue);
+
+    // the baseline frame doubles as baselines for client demos
+    for (i = 1; i < MAX_EDICTS; i++) {
+        if (Q_IsBitSet(d->entitybits, i)) {
+            d->baselines[i] = d->entities[i];
+        }
+    }
+
+    if (convert) {
+        begin_output(d);
+    }
+}
+
+static void mvd_parse_sound(void)
+{
+    int flags;
+
+    flags = MSG_ReadByte();
+    skip_bytes(1);  // index
+    if (flags & SND_VOLUME)
+        skip_bytes(1);
+    if (flags & SND_ATTENUATION)
+        skip_bytes(1);
+    if (flags & SND_OFFSET)
+        skip_bytes(1);
+    skip_bytes(2);  // sendchan
+}
+
+// unicasts are rebuilt from the subcommands that survive stripping
+static void mvd_parse_unicast(demo_t *d, int op, int extrabits, size_t start)
+{
+    static byte data[MAX_MSGLEN];
+    size_t length, last, sub, kept;
+    category_t cat;
+    int clientNum, cmd;
+
+    length = MSG_ReadByte();
+    length |= extrabits << 8;
+    clientNum = MSG_ReadByte();
+
+    last = msg_read.readcount + length;
+    if (last > msg_read.cursize) {
+        Com_Error(ERR_DROP, "%s: read past end of message", __func__);
+    }
+
+    d->bytes[CAT_OTHER] += msg_read.readcount - start;
+
+    kept = 0;
+    while (msg_read.readcount < last) {
+        sub = msg_read.readcount;
+        cmd = MSG_ReadByte();
+
+        switch (cmd) {
+        case svc_layout:
+            MSG_ReadString(NULL, 0);
+            cat = CAT_LAYOUT;
+            break;
+        case svc_configstring:
+            MSG_ReadShort();
+            MSG_ReadString(NULL, 0);
+            cat = CAT_GAMESTATE;
+            break;
+        case svc_print:
+            MSG_ReadByte();
+            MSG_ReadString(NULL, 0);
+            cat = CAT_PRINT;
+            break;
+        case svc_stufftext:
+            MSG_ReadString(NULL, 0);
+            cat = CAT_STUFF;
+            break;
+        default:
+            // the rest is opaque
+            msg_read.readcount = last;
+            cat = CAT_OTHER;
+            break;
+        }
+
+        if (msg_read.readcount > last) {
+            Com_Error(ERR_DROP, "%s: read past end of unicast", __func__);
+        }
+
+        d->bytes[cat] += msg_read.readcount - sub;
+        if (drop_mask & (1 << cat)) {
+            continue;
+        }
+
+        if (convert && d->outformat == DEMO_DM2) {
+            if (dm2_unicast_visible(d, clientNum, cmd)) {
+                queue_command(d, op == mvd_unicast_r, msg_read.data + sub,
+                              msg_read.readcount - sub);
+            }
+            continue;
+        }
+
+        memcpy(data + kept, msg_read.data + sub, msg_read.readcount - sub);
+        kept += msg_read.readcount - sub;
+    }
+
+    if (!kept) {
+        return;
+    }
+
+    if (convert) {
+        queue_mvd_command(d, op, clientNum, data, kept);
+    } else if (d->out) {
+        byte header[3];
+
+        header[0] = op | ((kept >> 8) << SVCMD_BITS);
+        header[1] = kept & 255;
+        header[2] = clientNum;
+        keep_data(d, header, sizeof(header));
+        keep_data(d, data, kept);
+    }
+}
+
+static void mvd_parse_message(demo_t *d)
+{
+    category_t cat;
+    size_t start;
+    int cmd, extrabits, length;
+
+    while (msg_read.readcount < msg_read.cursize) {
+        start = msg_read.readcount;
+        cmd = MSG_ReadByte();
+        extrabits = cmd >> SVCMD_BITS;
+        cmd &= SVCMD_MASK;
+
+        switch (cmd) {
+        case mvd_serverdata:
+            flush_output(d);
+            reset_output();
+            mvd_parse_serverdata(d, extrabits);
+            cat = CAT_GAMESTATE;
+            break;
+        case mvd_multicast_all:
+        case mvd_multicast_all_r:
+            length = MSG_ReadByte() | (extrabits << 8);
+            skip_bytes(length);
+            cat = CAT_EFFECT;
+            break;
+        case mvd_multicast_pvs:
+        case mvd_multicast_phs:
+        case mvd_multicast_pvs_r:
+        case mvd_multicast_phs_r:
+            length = MSG_ReadByte() | (extrabits << 8);
+            MSG_ReadWord(); // leafnum
+            skip_bytes(length);
+            cat = CAT_EFFECT;
+            break;
+        case mvd_unicast:
+        case mvd_unicast_r:
+            mvd_parse_unicast(d, cmd, extrabits, start);
+            continue;
+        case mvd_configstring:
+            parse_configstring(d, MSG_ReadShort());
+            cat = CAT_GAMESTATE;
+            break;
+        case mvd_frame:
+            if (!d->protocol) {
+                Com_Error(ERR_DROP, "frame before serverdata");
+            }
+            mvd_parse_frame(d, qfalse);
+            cat = CAT_FRAME;
+            break;
+        case mvd_sound:
+            mvd_parse_sound();
+            cat = CAT_SOUND;
+            break;
+        case mvd_print:
+            MSG_ReadByte();
+            MSG_ReadString(NULL, 0);
+            cat = CAT_PRINT;
+            break;
+        case mvd_nop:
+            cat = CAT_OTHER;
+            break;
+        default:
+            Com_Error(ERR_DROP, "illegible command at %"PRIz": %d", start, cmd);
+        }
+
+        if (msg_read.readcount > msg_read.cursize) {
+            Com_Error(ERR_DROP, "read past end of message");
+        }
+
+        account(d, cat, start);
+
+        if (convert && !(drop_mask & (1 << cat))) {
+            mvd_convert_command(d, cmd, extrabits, start);
+        }
+    }
+}
+
+/*
+==============================================================================
+
+CONVERSION
+
+==============================================================================
+*/
+
+static void write_data(demo_t *d, const void *data, size_t len)
+{
+    if (fwrite(data, 1, len, d->out) != len) {
+        Com_Error(ERR_DROP, "couldn't write output: %s", strerror(errno));
+    }
+}
+
+static void write_message(demo_t *d, const void *data, size_t len)
+{
+    uint32_t ul;
+    uint16_t us;
+
+    // empty message would terminate MVD stream, drop it
+    if (!len) {
+        return;
+    }
+
+    if (d->outformat == DEMO_MVD2) {
+        us = LittleShort(len);
+        write_data(d, &us, 2);
+    } else {
+        ul = LittleLong(len);
+        write_data(d, &ul, 4);
+    }
+    write_data(d, data, len);
+
+    conv.total += len;
+}
+
+// flushes the message being built if it can't take 'len' more bytes
+static void reserve_space(demo_t *d, size_t len)
+{
+    if (msg_write.cursize + len > conv.maxlen) {
+        write_message(d, msg_write.data, msg_write.cursize);
+        SZ_Clear(&msg_write);
+    }
+}
+
+// queues a command for the next output message. reliable commands that
+// don't fit flush the queue, unreliable ones are dropped.
+static void queue_command(demo_t *d, qboolean reliable, const void *data, size_t len)
+{
+    sizebuf_t *buf = reliable ? &conv.message : &conv.datagram;
+
+    if (buf->cursize + len > conv.maxlen) {
+        if (!reliable || !conv.gamestate || len > conv.maxlen) {
+            conv.bytes_dropped += len;
+            return;
+        }
+        write_message(d, buf->data, buf->cursize);
+        SZ_Clear(buf);
+    }
+
+    SZ_Write(buf, data, len);
+}
+
+// queues a command wrapped into MVD multicast or unicast
+static void queue_mvd_command(demo_t *d, int op, int clientNum, const byte *data, size_t len)
+{
+    static byte buffer[3 + 0x7ff];
+    qboolean reliable;
+    size_t header = 2;
+
+    if (len > 0x7ff) {
+        conv.bytes_dropped += len;
+        return;
+    }
+
+    buffer[0] = op | ((len >> 8) << SVCMD_BITS);
+    buffer[1] = len & 255;
+    if (op == mvd_unicast || op == mvd_unicast_r) {
+        buffer[header++] = clientNum;
+    }
+    memcpy(buffer + header, data, len);
+
+    reliable = op == mvd_unicast_r || op == mvd_multicast_all_r;
+    queue_command(d, reliable, buffer, header + len);
+}
+
+// queues a reliable command with opcode replaced
+static void queue_translated(demo_t *d, int op, const byte *data, size_t len)
+{
+    MSG_WriteByte(op);
+    MSG_WriteData(data + 1, len - 1);
+    queue_command(d, qtrue, msg_write.data, msg_write.cursize);
+    SZ_Clear(&msg_write);
+}
+
+// returns player state to be written for the given player slot
+static const player_state_t *get_player_state(demo_t *d, int number)
+{
+    if (d->format == DEMO_MVD2) {
+        if (!Q_IsBitSet(d->playerbits, number)) {
+            return NULL;
+        }
+        return &d->players[number];
+    }
+
+    // client demo has only one player, MVD dummy mirrors it
+    if (number == conv.clientNum || number == conv.dummy) {
+        return &d->frame.ps;
+    }
+
+    return NULL;
+}
+
+static void dm2_write_gamestate(demo_t *d)
+{
+    entity_packed_t pack;
+    const char *s;
+    size_t len;
+    int i;
+
+    // send the serverdata
+    MSG_WriteByte(svc_serverdata);
+    MSG_WriteLong(PROTOCOL_VERSION_DEFAULT);
+    MSG_WriteLong(d->servercount);
+    MSG_WriteByte(1);      // demos are always attract loops
+    MSG_WriteString(d->gamedir);
+    MSG_WriteShort(conv.clientNum);
+    if (d->format == DEMO_DM2) {
+        MSG_WriteString(d->levelname);
+    } else {
+        MSG_WriteString(d->configstrings[CS_NAME]);
+    }
+
+    // configstrings
+    for (i = 0; i < MAX_CONFIGSTRINGS; i++) {
+        s = d->configstrings[i];
+        if (!*s)
+            continue;
+
+        len = strlen(s);
+        if (len > MAX_QPATH)
+            len = MAX_QPATH;
+
+        reserve_space(d, len + 4);
+
+        MSG_WriteByte(svc_configstring);
+        MSG_WriteShort(i);
+        MSG_WriteData(s, len);
+        MSG_WriteByte(0);
+    }
+
+    // baselines
+    for (i = 1; i < MAX_EDICTS; i++) {
+        if (!d->baselines[i].number)
+            continue;
+
+        reserve_space(d, 1 + MAX_PACKED_ENTITY_BYTES);
+
+        MSG_WriteByte(svc_spawnbaseline);
+        MSG_PackEntity(&pack, &d->baselines[i], qfalse);
+        MSG_WriteDeltaEntity(NULL, &pack, MSG_ES_FORCE);
+    }
+
+    reserve_space(d, 11);
+
+    MSG_WriteByte(svc_stufftext);
+    MSG_WriteString("precache\n");
+
+    write_message(d, msg_write.data, msg_write.cursize);
+    SZ_Clear(&msg_write);
+}
+
+// same as emit_gamestate on the server, baseline frame is the current state
+static void mvd_write_gamestate(demo_t *d)
+{
+    const player_state_t *ps;
+    player_packed_t *pp;
+    entity_packed_t *es;
+    const char *s;
+    char buffer[16];
+    size_t len;
+    int i, flags;
+
+    // send the serverdata
+    MSG_WriteByte(mvd_serverdata | (conv.mvdflags << SVCMD_BITS));
+    MSG_WriteLong(PROTOCOL_VERSION_MVD);
+    MSG_WriteShort(PROTOCOL_VERSION_MVD_CURRENT);
+    MSG_WriteLong(d->servercount);
+    MSG_WriteString(d->gamedir);
+    MSG_WriteShort(conv.dummy);
+
+    // send configstrings
+    for (i = 0; i < MAX_CONFIGSTRINGS; i++) {
+        s = d->configstrings[i];
+        if (i == CS_MAXCLIENTS) {
+            Q_snprintf(buffer, sizeof(buffer), "%d", conv.maxclients);
+            s = buffer;
+        }
+        if (!*s) {
+            continue;
+        }
+        len = strlen(s);
+        if (len > MAX_QPATH) {
+            len = MAX_QPATH;
+        }
+
+        MSG_WriteShort(i);
+        MSG_WriteData(s, len);
+        MSG_WriteByte(0);
+    }
+    MSG_WriteShort(MAX_CONFIGSTRINGS);
+
+    // send baseline frame
+    if (d->format == DEMO_MVD2) {
+        MSG_WriteByte(d->portalbytes);
+        MSG_WriteData(d->portalbits, d->portalbytes);
+    } else {
+        MSG_WriteByte(0);
+    }
+
+    // send player states
+    for (i = 0; i < conv.maxclients; i++) {
+        ps = get_player_state(d, i);
+        if (!ps) {
+            continue;
+        }
+        pp = &conv.players[i];
+        MSG_PackPlayer(pp, ps);
+        PPS_INUSE(pp) = qtrue;
+        MSG_WriteDeltaPlayerstate_Packet(NULL, pp, i, 0);
+    }
+    MSG_WriteByte(CLIENTNUM_NONE);
+
+    // send entity states
+    for (i = 1; i < MAX_EDICTS; i++) {
+        if (!Q_IsBitSet(d->entitybits, i)) {
+            continue;
+        }
+        flags = MSG_ES_UMASK;
+        if (i <= conv.maxclients && i - 1 != conv.dummy) {
+            pp = &conv.players[i - 1];
+            if (PPS_INUSE(pp) && pp->pmove.pm_type == PM_NORMAL) {
+                flags |= MSG_ES_FIRSTPERSON;
+            }
+        }
+        es = &conv.entities[i];
+        MSG_PackEntity(es, &d->entities[i], qfalse);
+        MSG_WriteDeltaEntity(NULL, es, flags);
+        es->event = 0;
+    }
+    MSG_WriteShort(0);
+
+    write_message(d, msg_write.data, msg_write.cursize);
+    SZ_Clear(&msg_write);
+}
+
+// starts a new output gamestate from the current input state
+static void begin_output(demo_t *d)
+{
+    int i;
+
+    memset(&conv.ps, 0, sizeof(conv.ps));
+    memset(conv.players, 0, sizeof(conv.players));
+    memset(conv.entities, 0, sizeof(conv.entities));
+    conv.lastframe = -1;
+    conv.maxclients = parse_maxclients(d);
+    conv.clientNum = conv.dummy = -1;
+
+    if (d->outformat == DEMO_DM2) {
+        if (d->format == DEMO_DM2) {
+            conv.clientNum = d->clientNum;
+        } else if (pov >= 0) {
+            if (pov >= conv.maxclients) {
+                Com_Error(ERR_DROP, "player %d out of range", pov);
+            }
+            conv.clientNum = pov;
+        } else {
+            // follow the first active player, or the dummy
+            conv.clientNum = d->clientNum;
+            for (i = 0; i < conv.maxclients; i++) {
+                if (i != d->clientNum && Q_IsBitSet(d->playerbits, i)) {
+                    conv.clientNum = i;
+                    break;
+                }
+            }
+        }
+        dm2_write_gamestate(d);
+    } else {
+        if (d->format == DEMO_MVD2) {
+            conv.dummy = d->clientNum;
+            conv.mvdflags = d->mvdflags;
+        } else {
+            // recording client keeps its slot, the dummy takes another one
+            if (d->clientNum < 0 || d->clientNum >= conv.maxclients) {
+                Com_Error(ERR_DROP, "bad client number: %d", d->clientNum);
+            }
+            conv.clientNum = d->clientNum;
+            conv.dummy = d->clientNum ? 0 : 1;
+            conv.maxclients = max(conv.maxclients, conv.dummy + 1);
+
+            // prints are sent to the dummy and shown to everyone
+            conv.mvdflags = MVF_NOMSGS;
+        }
+        mvd_write_gamestate(d);
+    }
+
+    conv.gamestate = qtrue;
+}
+
+// same as emit_delta_frame on the client, always delta compressed from
+// the last frame written
+static void dm2_emit_frame(demo_t *d)
+{
+    entity_packed_t *oldes, *newes, base;
+    const entity_state_t *es;
+    const player_state_t *ps;
+    int i, count;
+
+    MSG_WriteByte(svc_frame);
+    MSG_WriteLong(conv.framenum + 1);
+    MSG_WriteLong(conv.lastframe);   // what we are delta'ing from
+    MSG_WriteByte(0);   // rate dropped packets
+
+    // map PVS is not available for MVD sources, send no areabits
+    if (d->format == DEMO_DM2) {
+        MSG_WriteByte(d->frame.areabytes);
+        MSG_WriteData(d->frame.areabits, d->frame.areabytes);
+        ps = &d->frame.ps;
+    } else {
+        MSG_WriteByte(0);
+        ps = &d->players[conv.clientNum];
+    }
+
+    // delta encode the playerstate
+    MSG_WriteByte(svc_playerinfo);
+    MSG_PackPlayer(&conv.newps, ps);
+    if (conv.lastframe == -1) {
+        MSG_WriteDeltaPlayerstate_Default(NULL, &conv.newps);
+    } else {
+        MSG_WriteDeltaPlayerstate_Default(&conv.ps, &conv.newps);
+    }
+
+    // delta encode the entities
+    MSG_WriteByte(svc_packetentities);
+    for (i = 1, count = 0; i < MAX_EDICTS; i++) {
+        oldes = &conv.entities[i];
+        newes = &conv.newentities[i];
+        newes->number = 0;
+
+        es = &d->entities[i];
+        if (Q_IsBitSet(d->entitybits, i) && count < MAX_PACKET_ENTITIES &&
+            (es->modelindex || es->effects || es->sound || es->event)) {
+            MSG_PackEntity(newes, es, qfalse);
+            count++;
+        }
+
+        if (newes->number && oldes->number) {
+            // note that players are always 'newentities' in compatibility
+            // mode, this updates their oldorigin always and prevents warping
+            MSG_WriteDeltaEntity(oldes, newes,
+                                 i <= conv.maxclients ? MSG_ES_NEWENTITY : 0);
+        } else if (newes->number) {
+            // this is a new entity, send it from the baseline
+            MSG_PackEntity(&base, &d->baselines[i], qfalse);
+            MSG_WriteDeltaEntity(&base, newes, MSG_ES_FORCE | MSG_ES_NEWENTITY);
+        } else if (oldes->number) {
+            // the old entity isn't present in the new message
+            MSG_WriteDeltaEntity(oldes, NULL, MSG_ES_FORCE);
+        }
+    }
+    MSG_WriteShort(0);      // end of packetentities
+}
+
+// same as emit_frame on the server
+static void mvd_emit_frame(demo_t *d)
+{
+    player_packed_t *oldps, *newps;
+    entity_packed_t *oldes, *newes, pack;
+    const player_state_t *ps;
+    int i, flags;
+
+    MSG_WriteByte(mvd_frame);
+
+    // send portal bits
+    if (d->format == DEMO_MVD2) {
+        MSG_WriteByte(d->portalbytes);
+        MSG_WriteData(d->portalbits, d->portalbytes);
+    } else {
+        MSG_WriteByte(0);
+    }
+
+    flags = MSG_PS_IGNORE_PREDICTION | MSG_PS_IGNORE_DELTAANGLES;
+
+    // send player states
+    for (i = 0; i < conv.maxclients; i++) {
+        oldps = &conv.players[i];
+        newps = &conv.newplayers[i];
+        *newps = *oldps;
+
+        ps = get_player_state(d, i);
+        if (!ps) {
+            if (PPS_INUSE(oldps)) {
+                // the old player isn't present in the new message
+                MSG_WriteDeltaPlayerstate_Packet(NULL, NULL, i, flags);
+                PPS_INUSE(newps) = qfalse;
+            }
+            continue;
+        }
+
+        MSG_PackPlayer(newps, ps);
+
+        if (PPS_INUSE(oldps)) {
+            MSG_WriteDeltaPlayerstate_Packet(oldps, newps, i, flags);
+        } else {
+            // this is a new player, send it from the last state
+            MSG_WriteDeltaPlayerstate_Packet(oldps, newps, i,
+                                             flags | MSG_PS_FORCE);
+        }
+
+        PPS_INUSE(newps) = qtrue;
+    }
+
+    MSG_WriteByte(CLIENTNUM_NONE);      // end of packetplayers
+
+    // send entity states
+    for (i = 1; i < MAX_EDICTS; i++) {
+        oldes = &conv.entities[i];
+        newes = &conv.newentities[i];
+        *newes = *oldes;
+
+        if (!Q_IsBitSet(d->entitybits, i)) {
+            if (oldes->number) {
+                // the old entity isn't present in the new message
+                MSG_WriteDeltaEntity(oldes, NULL, MSG_ES_FORCE);
+                newes->number = 0;
+            }
+            continue;
+        }
+
+        // calculate flags, dummy is not linked to any entity
+        flags = MSG_ES_UMASK;
+        if (i <= conv.maxclients && i - 1 != conv.dummy) {
+            newps = &conv.newplayers[i - 1];
+            if (PPS_INUSE(newps) && newps->pmove.pm_type == PM_NORMAL) {
+                flags |= MSG_ES_FIRSTPERSON;
+            }
+        }
+
+        if (!oldes->number) {
+            // this is a new entity, send it from the last state
+            flags |= MSG_ES_FORCE | MSG_ES_NEWENTITY;
+        }
+
+        MSG_PackEntity(&pack, &d->entities[i], qfalse);
+        MSG_WriteDeltaEntity(oldes, &pack, flags);
+
+        // same as copy_entity_state on the server
+        if (!(flags & MSG_ES_FIRSTPERSON)) {
+            VectorCopy(pack.origin, newes->origin);
+            VectorCopy(pack.angles, newes->angles);
+            VectorCopy(pack.old_origin, newes->old_origin);
+        }
+        newes->modelindex = pack.modelindex;
+        newes->modelindex2 = pack.modelindex2;
+        newes->modelindex3 = pack.modelindex3;
+        newes->modelindex4 = pack.modelindex4;
+        newes->frame = pack.frame;
+        newes->skinnum = pack.skinnum;
+        newes->effects = pack.effects;
+        newes->renderfx = pack.renderfx;
+        newes->solid = pack.solid;
+        newes->sound = pack.sound;
+        newes->event = 0;
+        newes->number = i;
+    }
+
+    MSG_WriteShort(0);      // end of packetentities
+}
+
+// writes the frame just parsed along with the commands queued so far.
+// frame that doesn't fit is dropped, next one will be delta compressed
+// from the last frame written.
+static void flush_frame(demo_t *d)
+{
+    size_t len;
+
+    conv.pending = qfalse;
+
+    if (!conv.gamestate) {
+        begin_output(d);
+    }
+
+    if (d->outformat == DEMO_MVD2) {
+        mvd_emit_frame(d);
+    } else {
+        dm2_emit_frame(d);
+    }
+
+    len = msg_write.cursize;
+    if (conv.message.cursize + len + conv.datagram.cursize > conv.maxlen) {
+        conv.bytes_dropped += conv.datagram.cursize;
+        SZ_Clear(&conv.datagram);
+
+        if (conv.message.cursize + len > conv.maxlen) {
+            write_message(d, conv.message.data, conv.message.cursize);
+            SZ_Clear(&conv.message);
+        }
+
+        if (len > conv.maxlen) {
+            conv.frames_dropped++;
+            SZ_Clear(&msg_write);
+            return;
+        }
+    }
+
+    // shuffle current state to previous
+    if (d->outformat == DEMO_MVD2) {
+        memcpy(conv.players, conv.newplayers, sizeof(conv.players));
+    } else {
+        conv.ps = conv.newps;
+        conv.lastframe = ++conv.framenum;
+    }
+    memcpy(conv.entities, conv.newentities, sizeof(conv.entities));
+    conv.frames_written++;
+
+    SZ_Write(&conv.message, msg_write.data, len);
+    SZ_Write(&conv.message, conv.datagram.data, conv.datagram.cursize);
+    SZ_Clear(&msg_write);
+
+    write_message(d, conv.message.data, conv.message.cursize);
+    SZ_Clear(&conv.message);
+    SZ_Clear(&conv.datagram);
+}
+
+// writes out whatever is left from the input message
+static void flush_output(demo_t *d)
+{
+    if (conv.pending) {
+        flush_frame(d);
+        return;
+    }
+
+    // keep the commands until the gamestate is written
+    if (!conv.gamestate) {
+        return;
+    }
+
+    if (conv.message.cursize + conv.datagram.cursize > conv.maxlen) {
+        write_message(d, conv.message.data, conv.message.cursize);
+        SZ_Clear(&conv.message);
+    }
+
+    SZ_Write(&conv.message, conv.datagram.data, conv.datagram.cursize);
+    write_message(d, conv.message.data, conv.message.cursize);
+    SZ_Clear(&conv.message);
+    SZ_Clear(&conv.datagram);
+}
+
+static void reset_output(void)
+{
+    conv.gamestate = qfalse;
+    SZ_Clear(&conv.message);
+    SZ_Clear(&conv.datagram);
+}
+
+static void dm2_convert_command(demo_t *d, int cmd, size_t start)
+{
+    const byte *data = msg_read.data + start;
+    size_t len = msg_read.readcount - start;
+    int index;
+
+    switch (cmd) {
+    case svc_muzzleflash:
+    case svc_muzzleflash2:
+    case svc_temp_entity:
+    case svc_sound:
+        if (d->outformat == DEMO_MVD2) {
+            queue_mvd_command(d, mvd_multicast_all, 0, data, len);
+        } else {
+            queue_command(d, qfalse, data, len);
+        }
+        break;
+    case svc_stufftext:
+        // gamestate is followed by a precache command of its own
+        if (len == 11 && !memcmp(data + 1, "precache\n", 10)) {
+            break;
+        }
+        if (d->outformat == DEMO_MVD2) {
+            // discard any stufftexts, except of play sound hacks
+            if (len > 6 && !memcmp(data + 1, "play ", 5)) {
+                queue_mvd_command(d, mvd_unicast_r, conv.clientNum, data, len);
+            }
+        } else {
+            queue_command(d, qtrue, data, len);
+        }
+        break;
+    case svc_layout:
+    case svc_print:
+        if (d->outformat == DEMO_MVD2) {
+            queue_mvd_command(d, mvd_unicast_r, conv.dummy, data, len);
+        } else {
+            queue_command(d, qtrue, data, len);
+        }
+        break;
+    case svc_inventory:
+    case svc_centerprint:
+        if (d->outformat == DEMO_MVD2) {
+            queue_mvd_command(d, mvd_unicast_r, conv.clientNum, data, len);
+        } else {
+            queue_command(d, qtrue, data, len);
+        }
+        break;
+    case svc_configstring:
+        // the ones before the first frame are part of the gamestate
+        if (!conv.gamestate) {
+            break;
+        }
+        if (d->outformat == DEMO_MVD2) {
+            index = data[1] | (data[2] << 8);
+            if (index != CS_MAXCLIENTS) {
+                queue_translated(d, mvd_configstring, data, len);
+            }
+        } else {
+            queue_command(d, qtrue, data, len);
+        }
+        break;
+    }
+}
+
+// client demo gets what MVD client would send to the spectator chasing
+// the point of view player, see MVD_UnicastLayout and MVD_UnicastPrint
+static qboolean dm2_unicast_visible(demo_t *d, int clientNum, int cmd)
+{
+    switch (cmd) {
+    case svc_layout:
+        return clientNum == d->clientNum;
+    case svc_print:
+        if (d->mvdflags & MVF_NOMSGS) {
+            return clientNum == d->clientNum;
+        }
+        return clientNum == conv.clientNum;
+    default:
+        return clientNum == conv.clientNum;
+    }
+}
+
+static void mvd_convert_sound(demo_t *d, int extrabits, const byte *data, size_t len)
+{
+    const entity_state_t *ent;
+    int flags, sendchan, entnum;
+
+    flags = data[1];
+    sendchan = data[len - 2] | (data[len - 1] << 8);
+    entnum = sendchan >> 3;
+    if (entnum >= MAX_EDICTS || !Q_IsBitSet(d->entitybits, entnum)) {
+        return;
+    }
+    ent = &d->entities[entnum];
+
+    // client finds out position of brush models on its own
+    flags |= SND_ENT;
+    if (ent->solid != PACKED_BSP) {
+        flags |= SND_POS;
+    }
+
+    MSG_WriteByte(svc_sound);
+    MSG_WriteByte(flags);
+    MSG_WriteData(data + 2, len - 4);  // index, volume, attenuation, offset
+    MSG_WriteShort(sendchan);
+    if (flags & SND_POS) {
+        MSG_WritePos(ent->origin);
+    }
+
+    queue_command(d, extrabits & 2, msg_write.data, msg_write.cursize);
+    SZ_Clear(&msg_write);
+}
+
+static void mvd_convert_command(demo_t *d, int cmd, int extrabits, size_t start)
+{
+    const byte *data = msg_read.data + start;
+    size_t len = msg_read.readcount - start;
+
+    if (d->outformat == DEMO_MVD2) {
+        switch (cmd) {
+        case mvd_multicast_all_r:
+        case mvd_multicast_phs_r:
+        case mvd_multicast_pvs_r:
+        case mvd_configstring:
+        case mvd_print:
+            queue_command(d, qtrue, data, len);
+            break;
+        case mvd_multicast_all:
+        case mvd_multicast_phs:
+        case mvd_multicast_pvs:
+            queue_command(d, qfalse, data, len);
+            break;
+        case mvd_sound:
+            queue_command(d, extrabits & 2, data, len);
+            break;
+        }
+        return;
+    }
+
+    switch (cmd) {
+    case mvd_multicast_all:
+    case mvd_multicast_all_r:
+        queue_command(d, cmd == mvd_multicast_all_r, data + 2, len - 2);
+        break;
+    case mvd_multicast_phs:
+    case mvd_multicast_pvs:
+        queue_command(d, qfalse, data + 4, len - 4);
+        break;
+    case mvd_multicast_phs_r:
+    case mvd_multicast_pvs_r:
+        queue_command(d, qtrue, data + 4, len - 4);
+        break;
+    case mvd_configstring:
+        queue_translated(d, svc_configstring, data, len);
+        break;
+    case mvd_print:
+        queue_translated(d, svc_print, data, len);
+        break;
+    case mvd_sound:
+        mvd_convert_sound(d, extrabits, data, len);
+        break;
+    }
+}
+
+/*
+==============================================================================
+
+FILE PROCESSING
+
+==============================================================================
+*/
+
+static qboolean read_message(demo_t *d)
+{
+    uint32_t ul;
+    uint16_t us;
+    int msglen;
+
+    if (d->format == DEMO_MVD2) {
+        msglen = demo_read(d->fp, &us, 2);
+        if (msglen == 0) {
+            return qfalse;  // missing terminator
+        }
+        if (msglen != 2) {
+            Com_Error(ERR_DROP, "unexpected end of file");
+        }
+        if (!us) {
+            return qfalse;
+        }
+        msglen = LittleShort(us);
+    } else {
+        if (d->havefirst) {
+            ul = d->firstlen;
+            d->havefirst = qfalse;
+        } else {
+            msglen = demo_read(d->fp, &ul, 4);
+            if (msglen == 0) {
+                return qfalse;  // missing terminator
+            }
+            if (msglen != 4) {
+                Com_Error(ERR_DROP, "unexpected end of file");
+            }
+        }
+        if (ul == (uint32_t)-1) {
+            return qfalse;
+        }
+        ul = LittleLong(ul);
+        if (ul > MAX_MSGLEN) {
+            Com_Error(ERR_DROP, "oversize message: %u bytes", ul);
+        }
+        msglen = ul;
+    }
+
+    if (msglen > MAX_MSGLEN) {
+        Com_Error(ERR_DROP, "oversize message: %d bytes", msglen);
+    }
+
+    if (demo_read(d->fp, msg_read_buffer, msglen) != msglen) {
+        Com_Error(ERR_DROP, "unexpected end of file");
+    }
+
+    SZ_Init(&msg_read, msg_read_buffer, sizeof(msg_read_buffer));
+    msg_read.cursize = msglen;
+
+    return qtrue;
+}
+
+static void open_output(demo_t *d)
+{
+    char path[MAX_OSPATH];
+    const char *base, *ext = "";
+    uint32_t magic;
+    size_t len;
+
+    base = strrchr(d->name, '/');
+    base = base ? base + 1 : d->name;
+
+    // output is never compressed
+    len = strlen(base);
+    if (len > 3 && !Q_stricmp(base + len - 3, ".gz")) {
+        len -= 3;
+    }
+
+    // converted demos get extension of the output format
+    if (convert) {
+        if (len > 4 && !Q_stricmpn(base + len - 4, ".dm2", 4)) {
+            len -= 4;
+        } else if (len > 5 && !Q_stricmpn(base + len - 5, ".mvd2", 5)) {
+            len -= 5;
+        }
+        ext = d->outformat == DEMO_MVD2 ? ".mvd2" : ".dm2";
+    }
+
+    if (Q_snprintf(path, sizeof(path), "%s/%.*s%s", outdir, (int)len, base, ext) >= sizeof(path)) {
+        Com_Error(ERR_DROP, "oversize output path");
+    }
+
+    // refuse to overwrite the input
+    if (!strcmp(path, d->name)) {
+        Com_Error(ERR_DROP, "output file is the same as input");
+    }
+
+    d->out = fopen(path, "wb");
+    if (!d->out) {
+        Com_Error(ERR_DROP, "couldn't open %s: %s", path, strerror(errno));
+    }
+
+    if (d->outformat == DEMO_MVD2) {
+        magic = MVD_MAGIC;
+        write_data(d, &magic, 4);
+    }
+}
+
+static void close_output(demo_t *d)
+{
+    uint32_t ul;
+    uint16_t us;
+
+    if (d->outformat == DEMO_MVD2) {
+        us = 0;
+        write_data(d, &us, 2);
+    } else {
+        ul = (uint32_t)-1;
+        write_data(d, &ul, 4);
+    }
+
+    if (fclose(d->out)) {
+        d->out = NULL;
+        Com_Error(ERR_DROP, "couldn't write output: %s", strerror(errno));
+    }
+    d->out = NULL;
+}
+
+static void print_stats(demo_t *d)
+{
+    int i;
+
+    printf("%s: %s protocol %d, map %s\n", d->name,
+           format_names[d->format], d->protocol,
+           d->mapname[0] ? d->mapname : "unknown");
+    printf("  %u messages, %u frames, %"PRIz" bytes\n",
+           d->messages, d->frames_parsed, d->total);
+
+    if (d->frames_parsed) {
+        printf("  message size min/avg/max: %"PRIz"/%"PRIz"/%"PRIz"\n",
+               d->minframe, d->frametotal / d->frames_parsed, d->maxframe);
+        printf("  entities avg/max: %u/%d",
+               (unsigned)(d->sumentities / d->frames_parsed), d->maxentities);
+        if (d->format == DEMO_MVD2) {
+            printf(", players max: %d", d->maxplayers);
+        }
+        printf("\n");
+    }
+
+    if (d->frames_bad) {
+        printf("  %u frames delta compressed from missing frames\n", d->frames_bad);
+    }
+
+    for (i = 0; i < CAT_TOTAL; i++) {
+        if (!d->bytes[i]) {
+            continue;
+        }
+        printf("  %-10s %10"PRIz" bytes (%4.1f%%)%s\n", cat_names[i],
+               d->bytes[i], d->bytes[i] * 100.0 / max(d->total, 1),
+               (drop_mask & (1 << i)) ? ", stripped" : "");
+    }
+
+    if (convert) {
+        printf("  converted to %s: %u frames, %"PRIz" bytes (%4.1f%%)\n",
+               format_names[d->outformat], conv.frames_written, conv.total,
+               conv.total * 100.0 / max(d->total, 1));
+        if (conv.frames_dropped || conv.bytes_dropped) {
+            printf("  %u oversize frames and %"PRIz" bytes of commands dropped\n",
+                   conv.frames_dropped, conv.bytes_dropped);
+        }
+    }
+}
+
+// returns 0 on success, 1 on failure
+static int process_file(const char *name)
+{
+    demo_t *d = &demo;
+    uint32_t magic;
+
+    memset(d, 0, sizeof(*d));
+    d->name = name;
+    d->minframe = SIZE_MAX;
+
+    memset(&conv, 0, sizeof(conv));
+    SZ_Init(&conv.message, conv.message_buf, sizeof(conv.message_buf));
+    SZ_Init(&conv.datagram, conv.datagram_buf, sizeof(conv.datagram_buf));
+    SZ_Clear(&msg_write);
+
+    if (setjmp(abortframe)) {
+        fprintf(stderr, "%s: %s\n", name, errormsg);
+        if (d->fp) {
+            demo_close(d->fp);
+        }
+        if (d->out) {
+            fclose(d->out);
+        }
+        return 1;
+    }
+
+    d->fp = demo_open(name);
+    if (!d->fp) {
+        Com_Error(ERR_DROP, "couldn't open: %s", strerror(errno));
+    }
+
+    if (demo_read(d->fp, &magic, 4) != 4) {
+        Com_Error(ERR_DROP, "unexpected end of file");
+    }
+
+    if (magic == MVD_MAGIC) {
+        d->format = DEMO_MVD2;
+    } else {
+        d->format = DEMO_DM2;
+        d->firstlen = magic;
+        d->havefirst = qtrue;
+    }
+
+    d->outformat = d->format;
+    if (convert && target != -1) {
+        d->outformat = target;
+    }
+    conv.maxlen = d->outformat == DEMO_MVD2 ? MAX_MSGLEN : MAX_PACKETLEN_WRITABLE;
+
+    if (outdir) {
+        open_output(d);
+    }
+
+    while (read_message(d)) {
+        d->outlen = 0;
+        d->msgframes = 0;
+
+        if (d->format == DEMO_MVD2) {
+            mvd_parse_message(d);
+        } else {
+            dm2_parse_message(d);
+        }
+
+        d->messages++;
+        d->total += msg_read.cursize;
+
+        if (d->msgframes) {
+            d->minframe = min(d->minframe, msg_read.cursize);
+            d->maxframe = max(d->maxframe, msg_read.cursize);
+            d->frametotal += msg_read.cursize;
+        }
+
+        if (convert) {
+            flush_output(d);
+        } else if (d->out) {
+            write_message(d, d->outbuf, d->outlen);
+        }
+    }
+
+    if (d->out) {
+        close_output(d);
+    }
+
+    demo_close(d->fp);
+    d->fp = NULL;
+
+    print_stats(d);
+    return 0;
+}
+
+#ifdef _WIN32
+static char *quote_arg(const char *s)
+{
+    size_t len = strlen(s);
+    char *q = malloc(len + 3);
+
+    if (!q) {
+        perror("malloc");
+        exit(1);
+    }
+
+    q[0] = '"';
+    memcpy(q + 1, s, len);
+    q[len + 1] = '"';
+    q[len + 2] = 0;
+    return q;
+}
+
+static int wait_job(HANDLE *handles, int running)
+{
+    DWORD ret, code;
+    int n;
+
+    ret = WaitForMultipleObjects(running, handles, FALSE, INFINITE);
+    if (ret >= WAIT_OBJECT_0 + running) {
+        fprintf(stderr, "WaitForMultipleObjects failed: %lu\n", GetLastError());
+        exit(1);
+    }
+
+    n = ret - WAIT_OBJECT_0;
+    if (!GetExitCodeProcess(handles[n], &code)) {
+        code = 1;
+    }
+    CloseHandle(handles[n]);
+    handles[n] = handles[running - 1];
+
+    return code ? 1 : 0;
+}
+
+// there is no fork(), each file is processed by a child started with the
+// same command line and that single file
+static int run_jobs(char **argv, int first, int argc, int jobs)
+{
+    HANDLE handles[MAXIMUM_WAIT_OBJECTS];
+    char **args;
+    int i, running = 0, failed = 0;
+    intptr_t h;
+
+    jobs = min(jobs, MAXIMUM_WAIT_OBJECTS);
+
+    args = malloc(sizeof(args[0]) * (first + 2));
+    if (!args) {
+        perror("malloc");
+        exit(1);
+    }
+    for (i = 0; i < first; i++) {
+        args[i] = quote_arg(argv[i]);
+    }
+    args[first + 1] = NULL;
+
+    for (i = first; i < argc; i++) {
+        if (running == jobs) {
+            failed += wait_job(handles, running--);
+        }
+
+        fflush(stdout);
+        args[first] = quote_arg(argv[i]);
+        h = _spawnv(_P_NOWAIT, argv[0], (const char *const *)args);
+        free(args[first]);
+        if (h == -1) {
+            perror("spawn");
+            failed += process_file(argv[i]);
+            continue;
+        }
+        handles[running++] = (HANDLE)h;
+    }
+
+    while (running > 0) {
+        failed += wait_job(handles, running--);
+    }
+
+    for (i = 0; i < first; i++) {
+        free(args[i]);
+    }
+    free(args);
+
+    return failed;
+}
+#else
+static int run_jobs(char **argv, int first, int argc, int jobs)
+{
+    int i, status, running = 0, failed = 0;
+    pid_t pid;
+
+    for (i = first; i < argc; i++) {
+        if (running == jobs) {
+            if (wait(&status) > 0) {
+                if (!WIFEXITED(status) || WEXITSTATUS(status)) {
+                    failed++;
+                }
+                running--;
+            }
+        }
+
+        fflush(stdout);
+        pid = fork();
+        if (pid < 0) {
+            perror("fork");
+            failed += process_file(argv[i]);
+            continue;
+        }
+        if (pid == 0) {
+            exit(process_file(argv[i]));
+        }
+        running++;
+    }
+
+    while (running > 0 && wait(&status) > 0) {
+        if (!WIFEXITED(status) || WEXITSTATUS(status)) {
+            failed++;
+        }
+        running--;
+    }
+
+    return failed;
+}
+#endif
+
+static void usage(void)
+{
+    fprintf(stderr,
+            "Usage: q2prodemo info [-v] [-j jobs] <demo> [...]\n"
+            "       q2prodemo strip [-psln] [-j jobs] -o <dir> <demo> [...]\n"
+            "       q2prodemo convert [-psln] [-f dm2|mvd2] [-c player] [-j jobs] -o <dir> <demo> [...]\n"
+            "\n"
+            "Commands:\n"
+            "  info     print per-file size and entity statistics\n"
+            "  strip    write copies of demos into <dir> with messages removed\n"
+            "  convert  rewrite demos into <dir> with frames delta compressed\n"
+            "           from scratch, optionally in another format\n"
+            "\n"
+            "Options:\n"
+            "  -v     print per-frame statistics\n"
+            "  -j     number of files to process in parallel\n"
+            "  -p     strip prints and centerprints (default for strip)\n"
+            "  -s     strip stufftext\n"
+            "  -l     strip layouts and inventory\n"
+            "  -n     strip sounds\n"
+            "  -f     output format (defaults to input format)\n"
+            "  -c     player to follow when converting mvd2 to dm2\n"
+            "         (defaults to the first active one)\n"
+            "  -o     output directory\n");
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    qboolean strip = qfalse;
+    int i, jobs = 1, failed = 0;
+    const char *s;
+
+    if (argc < 2) {
+        usage();
+    }
+
+    if (!strcmp(argv[1], "info")) {
+        strip = qfalse;
+    } else if (!strcmp(argv[1], "strip")) {
+        strip = qtrue;
+    } else if (!strcmp(argv[1], "convert")) {
+        convert = qtrue;
+    } else {
+        usage();
+    }
+
+    for (i = 2; i < argc && argv[i][0] == '-'; i++) {
+        if (argv[i][1] && strchr("jofc", argv[i][1]) && !argv[i][2]) {
+            if (i + 1 >= argc) {
+                usage();
+            }
+            s = argv[++i];
+            switch (argv[i - 1][1]) {
+            case 'j':
+                jobs = atoi(s);
+                break;
+            case 'o':
+                outdir = s;
+                break;
+            case 'f':
+                if (!strcmp(s, "dm2")) {
+                    target = DEMO_DM2;
+                } else if (!strcmp(s, "mvd2")) {
+                    target = DEMO_MVD2;
+                } else {
+                    usage();
+                }
+                break;
+            case 'c':
+                pov = atoi(s);
+                if (pov < 0 || pov >= MAX_CLIENTS) {
+                    usage();
+                }
+                break;
+            }
+            continue;
+        }
+
+        for (s = argv[i] + 1; *s; s++) {
+            switch (*s) {
+            case 'v':
+                verbose = qtrue;
+                break;
+            case 'p':
+                drop_mask |= 1 << CAT_PRINT;
+                break;
+            case 's':
+                drop_mask |= 1 << CAT_STUFF;
+                break;
+            case 'l':
+                drop_mask |= 1 << CAT_LAYOUT;
+                break;
+            case 'n':
+                drop_mask |= 1 << CAT_SOUND;
+                break;
+            default:
+                usage();
+            }
+        }
+    }
+
+    if (i == argc || jobs < 1) {
+        usage();
+    }
+
+    if (strip || convert) {
+        if (!outdir) {
+            usage();
+        }
+        if (strip && !drop_mask) {
+            drop_mask = 1 << CAT_PRINT;
+        }
+    } else if (drop_mask || outdir) {
+        usage();
+    }
+
+    if (!convert && (target != -1 || pov != -1)) {
+        usage();
+    }
+
+    MSG_Init();
+
+    if (jobs > 1 && argc - i > 1) {
+        failed = run_jobs(argv, i, argc, jobs);
+    } else {
+        for (; i < argc; i++) {
+            failed += process_file(argv[i]);
+        }
+    }
+
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,279 @@
+/*
+Copyright (C) 2003-2008 Andrey Nazarov
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+//
+// headless.c -- offscreen video and null sound drivers
+//
+// Software renderer draws into a plain memory buffer that is never displayed.
+// Intended for running timedemos and render benchmarks on machines without
+// a display or GPU.
+//
+
+#include "shared/shared.h"
+#include "common/cvar.h"
+#include "common/common.h"
+#include "common/mdfour.h"
+#include "common/zone.h"
+#include "client/client.h"
+#include "client/input.h"
+#include "client/video.h"
+#include "client/sound/dma.h"
+#include "refresh/refresh.h"
+#include "system/system.h"
+
+static struct {
+    byte        *pixels;
+    int         width, height;
+    unsigned    framenum;
+    uint64_t    begin, last;
+} hl;
+
+static cvar_t   *vid_frametimes;
+static cvar_t   *vid_framehash;
+static cvar_t   *vid_framedump;
+
+/*
+===============================================================================
+
+VIDEO
+
+===============================================================================
+*/
+
+static void set_mode(void)
+{
+    vrect_t rc;
+
+    VID_GetGeometry(&rc);
+
+    if (!hl.pixels || rc.width != hl.width || rc.height != hl.height) {
+        Z_Free(hl.pixels);
+        hl.pixels = Z_Mallocz(rc.width * rc.height * 4);
+        hl.width = rc.width;
+        hl.height = rc.height;
+    }
+
+    Com_DPrintf("...setting offscreen mode: %dx%d\n", hl.width, hl.height);
+
+    R_ModeChanged(hl.width, hl.height, 0, hl.width * 4, hl.pixels);
+    SCR_ModeChanged();
+}
+
+char *VID_GetDefaultModeList(void)
+{
+    return Z_CopyString(VID_MODELIST);
+}
+
+void VID_SetMode(void)
+{
+    set_mode();
+}
+
+void VID_FatalShutdown(void)
+{
+}
+
+qboolean VID_Init(void)
+{
+    Com_Printf("Using headless video driver\n");
+
+    vid_frametimes = Cvar_Get("vid_frametimes", "0", 0);
+    vid_framehash = Cvar_Get("vid_framehash", "0", 0);
+    vid_framedump = Cvar_Get("vid_framedump", "0", 0);
+
+    hl.framenum = 0;
+    hl.last = Sys_Microseconds();
+
+    set_mode();
+    CL_Activate(ACT_ACTIVATED);
+
+    return qtrue;
+}
+
+void VID_Shutdown(void)
+{
+    Z_Free(hl.pixels);
+    memset(&hl, 0, sizeof(hl));
+}
+
+void VID_UpdateGamma(const byte *table)
+{
+}
+
+void VID_VideoWait(void)
+{
+}
+
+qboolean VID_VideoSync(void)
+{
+    return qtrue;
+}
+
+void VID_BeginFrame(void)
+{
+    hl.begin = Sys_Microseconds();
+}
+
+/*
+============
+VID_EndFrame
+
+Frame is complete in memory at this point. Optionally report how long it
+took to render, checksum the framebuffer and dump it to disk.
+============
+*/
+void VID_EndFrame(void)
+{
+    uint64_t now = Sys_Microseconds();
+    unsigned render = now - hl.begin;
+    unsigned total = now - hl.last;
+
+    hl.last = now;
+    hl.framenum++;
+
+    if (vid_frametimes->integer) {
+        if (vid_framehash->integer) {
+            Com_Printf("frame %u: %u us render, %u us total, hash %08x\n",
+                       hl.framenum, render, total,
+                       Com_BlockChecksum(hl.pixels, hl.width * hl.height * 4));
+        } else {
+            Com_Printf("frame %u: %u us render, %u us total\n",
+                       hl.framenum, render, total);
+        }
+    } else if (vid_framehash->integer) {
+        Com_Printf("frame %u: hash %08x\n", hl.framenum,
+                   Com_BlockChecksum(hl.pixels, hl.width * hl.height * 4));
+    }
+
+    if (vid_framedump->integer > 0 && hl.framenum % vid_framedump->integer == 0) {
+        char buffer[MAX_QPATH];
+
+        Q_snprintf(buffer, sizeof(buffer), "frame%06u", hl.framenum);
+        IMG_SaveFrame(buffer);
+    }
+}
+
+char *VID_GetClipboardData(void)
+{
+    return NULL;
+}
+
+void VID_SetClipboardData(const char *data)
+{
+}
+
+void VID_PumpEvents(void)
+{
+}
+
+/*
+===============================================================================
+
+INPUT
+
+===============================================================================
+*/
+
+static qboolean InitMouse(void)
+{
+    return qfalse;
+}
+
+void VID_FillInputAPI(inputAPI_t *api)
+{
+    memset(api, 0, sizeof(*api));
+    api->Init = InitMouse;
+}
+
+/*
+===============================================================================
+
+SOUND
+
+Mixes into a buffer that nobody listens to, consuming samples in real time so
+that mixing cost is still accounted for in benchmarks.
+
+===============================================================================
+*/
+
+#if USE_SNDDMA
+
+static unsigned snd_time;
+
+static sndinitstat_t Init(void)
+{
+    switch (s_khz->integer) {
+    case 48:
+        dma.speed = 48000;
+        break;
+    case 44:
+        dma.speed = 44100;
+        break;
+    case 22:
+        dma.speed = 22050;
+        break;
+    default:
+        dma.speed = 11025;
+        break;
+    }
+
+    dma.channels = 2;
+    dma.samples = 0x8000 * dma.channels;
+    dma.submission_chunk = 1;
+    dma.samplebits = 16;
+    dma.buffer = Z_Mallocz(dma.samples * 2);
+    dma.samplepos = 0;
+
+    snd_time = Sys_Milliseconds();
+
+    Com_Printf("Using null audio driver\n");
+
+    return SIS_SUCCESS;
+}
+
+static void Shutdown(void)
+{
+    Z_Free(dma.buffer);
+    dma.buffer = NULL;
+}
+
+static void BeginPainting(void)
+{
+    unsigned now = Sys_Milliseconds();
+    unsigned frames = (uint64_t)(now - snd_time) * dma.speed / 1000;
+
+    if (frames) {
+        snd_time += (uint64_t)frames * 1000 / dma.speed;
+        dma.samplepos = (dma.samplepos + frames * dma.channels) & (dma.samples - 1);
+    }
+}
+
+static void Submit(void)
+{
+}
+
+void WAVE_FillAPI(snddmaAPI_t *api)
+{
+    api->Init = Init;
+    api->Shutdown = Shutdown;
+    api->BeginPainting = BeginPainting;
+    api->Submit = Submit;
+    api->Activate = NULL;
+}
+
+#endif // USE_SNDDMA
@@ -21,6 +21,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "common/common.h"
 #include "common/cvar.h"
 #include "common/files.h"
+#include "common/zone.h"
 #if USE_REF
 #include "client/video.h"
 #endif
@@ -37,6 +38,12 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include <dirent.h>
 #include <dlfcn.h>
 #include <errno.h>
+#if USE_THREADS
+#include <pthread.h>
+#endif
+#ifdef __linux__
+#include <sys/prctl.h>
+#endif
 
 cvar_t  *sys_basedir;
 cvar_t  *sys_libdir;
@@ -70,6 +77,15 @@ unsigned Sys_Milliseconds(void)
     return time;
 }
 
+// monotonic, for measuring short intervals
+uint64_t Sys_Microseconds(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
 /*
 =================
 Sys_Quit
@@ -125,6 +141,138 @@ void Sys_Sleep(int msec)
     nanosleep(&req, NULL);
 }
 
+// sleeps until Sys_Microseconds reaches deadline
+void Sys_SleepUntil(uint64_t deadline)
+{
+    struct timespec req;
+
+    req.tv_sec = deadline / 1000000;
+    req.tv_nsec = (deadline % 1000000) * 1000;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &req, NULL) == EINTR)
+        ;
+}
+
+// fills buffer from the system CSPRNG
+qboolean Sys_RandomBytes(void *buffer, size_t size)
+{
+    byte *p = buffer;
+    ssize_t ret;
+    int fd;
+
+    fd = open("/dev/urandom", O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        Com_EPrintf("Couldn't open /dev/urandom: %s\n", strerror(errno));
+        return qfalse;
+    }
+
+    while (size) {
+        ret = read(fd, p, size);
+        if (ret < 0 && errno == EINTR) {
+            continue;
+        }
+        if (ret <= 0) {
+            Com_EPrintf("Couldn't read /dev/urandom: %s\n",
+                        ret ? strerror(errno) : "unexpected end of file");
+            close(fd);
+            return qfalse;
+        }
+        p += ret;
+        size -= ret;
+    }
+
+    close(fd);
+    return qtrue;
+}
+
+#if USE_THREADS
+
+struct sys_thread_s {
+    pthread_t   thread;
+    void        (*func)(void *);
+    void        *arg;
+};
+
+struct sys_event_s {
+    pthread_mutex_t mutex;
+    pthread_cond_t  cond;
+    qboolean        signaled;
+};
+
+static void *thread_func(void *arg)
+{
+    sys_thread_t *t = arg;
+
+    t->func(t->arg);
+    return NULL;
+}
+
+sys_thread_t *Sys_CreateThread(void (*func)(void *), void *arg)
+{
+    sys_thread_t *t = Z_Malloc(sizeof(*t));
+    sigset_t set, oldset;
+    int ret;
+
+    t->func = func;
+    t->arg = arg;
+
+    // signal handlers must run on the main thread
+    sigfillset(&set);
+    pthread_sigmask(SIG_SETMASK, &set, &oldset);
+    ret = pthread_create(&t->thread, NULL, thread_func, t);
+    pthread_sigmask(SIG_SETMASK, &oldset, NULL);
+
+    if (ret) {
+        Com_EPrintf("Couldn't create thread: %s\n", strerror(ret));
+        Z_Free(t);
+        return NULL;
+    }
+
+    return t;
+}
+
+void Sys_JoinThread(sys_thread_t *t)
+{
+    pthread_join(t->thread, NULL);
+    Z_Free(t);
+}
+
+sys_event_t *Sys_CreateEvent(void)
+{
+    sys_event_t *e = Z_Malloc(sizeof(*e));
+
+    pthread_mutex_init(&e->mutex, NULL);
+    pthread_cond_init(&e->cond, NULL);
+    e->signaled = qfalse;
+    return e;
+}
+
+void Sys_DestroyEvent(sys_event_t *e)
+{
+    pthread_cond_destroy(&e->cond);
+    pthread_mutex_destroy(&e->mutex);
+    Z_Free(e);
+}
+
+void Sys_SignalEvent(sys_event_t *e)
+{
+    pthread_mutex_lock(&e->mutex);
+    e->signaled = qtrue;
+    pthread_cond_signal(&e->cond);
+    pthread_mutex_unlock(&e->mutex);
+}
+
+void Sys_WaitEvent(sys_event_t *e)
+{
+    pthread_mutex_lock(&e->mutex);
+    while (!e->signaled) {
+        pthread_cond_wait(&e->cond, &e->mutex);
+    }
+    e->signaled = qfalse;
+    pthread_mutex_unlock(&e->mutex);
+}
+
+#endif // USE_THREADS
+
 #if USE_AC_CLIENT
 qboolean Sys_GetAntiCheatAPI(void)
 {
@@ -181,6 +329,11 @@ void Sys_Init(void)
     signal(SIGTTOU, SIG_IGN);
     signal(SIGUSR1, hup_handler);
 
+#ifdef __linux__
+    // default 50 usec timer slack is too coarse for frame deadlines
+    prctl(PR_SET_TIMERSLACK, 1UL, 0UL, 0UL, 0UL);
+#endif
+
     // basedir <path>
     // allows the game to run from outside the data tree
     sys_basedir = Cvar_Get("basedir", DATADIR, CVAR_NOSET);
@@ -20,7 +20,9 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "common/cvar.h"
 #include "common/field.h"
 #include "common/prompt.h"
+#include "common/zone.h"
 #include <mmsystem.h>
+#include <wincrypt.h>
 #if USE_WINSVC
 #include <winsvc.h>
 #endif
@@ -641,6 +643,21 @@ unsigned Sys_Milliseconds(void)
     return timeGetTime();
 }
 
+// monotonic, for measuring short intervals
+uint64_t Sys_Microseconds(void)
+{
+    static LARGE_INTEGER freq;
+    LARGE_INTEGER count;
+
+    if (!freq.QuadPart) {
+        QueryPerformanceFrequency(&freq);
+    }
+
+    QueryPerformanceCounter(&count);
+    return count.QuadPart / freq.QuadPart * 1000000 +
+           count.QuadPart % freq.QuadPart * 1000000 / freq.QuadPart;
+}
+
 void Sys_AddDefaultConfig(void)
 {
 }
@@ -650,6 +667,109 @@ void Sys_Sleep(int msec)
     Sleep(msec);
 }
 
+// sleeps until Sys_Microseconds reaches deadline
+void Sys_SleepUntil(uint64_t deadline)
+{
+    uint64_t now = Sys_Microseconds();
+
+    if (deadline > now) {
+        Sleep((deadline - now + 999) / 1000);
+    }
+}
+
+// fills buffer from the system CSPRNG
+qboolean Sys_RandomBytes(void *buffer, size_t size)
+{
+    HCRYPTPROV prov;
+    BOOL ret;
+
+    if (!CryptAcquireContext(&prov, NULL, NULL, PROV_RSA_FULL,
+                             CRYPT_VERIFYCONTEXT | CRYPT_SILENT)) {
+        Com_EPrintf("CryptAcquireContext failed: %#lx\n", GetLastError());
+        return qfalse;
+    }
+
+    ret = CryptGenRandom(prov, size, buffer);
+    if (!ret) {
+        Com_EPrintf("CryptGenRandom failed: %#lx\n", GetLastError());
+    }
+
+    CryptReleaseContext(prov, 0);
+    return ret ? qtrue : qfalse;
+}
+
+#if USE_THREADS
+
+struct sys_thread_s {
+    HANDLE      handle;
+    void        (*func)(void *);
+    void        *arg;
+};
+
+struct sys_event_s {
+    HANDLE      handle;
+};
+
+static DWORD WINAPI thread_func(LPVOID arg)
+{
+    sys_thread_t *t = arg;
+
+    t->func(t->arg);
+    return 0;
+}
+
+sys_thread_t *Sys_CreateThread(void (*func)(void *), void *arg)
+{
+    sys_thread_t *t = Z_Malloc(sizeof(*t));
+
+    t->func = func;
+    t->arg = arg;
+    t->handle = CreateThread(NULL, 0, thread_func, t, 0, NULL);
+    if (!t->handle) {
+        Com_EPrintf("Couldn't create thread: %#lx\n", GetLastError());
+        Z_Free(t);
+        return NULL;
+    }
+
+    return t;
+}
+
+void Sys_JoinThread(sys_thread_t *t)
+{
+    WaitForSingleObject(t->handle, INFINITE);
+    CloseHandle(t->handle);
+    Z_Free(t);
+}
+
+sys_event_t *Sys_CreateEvent(void)
+{
+    sys_event_t *e = Z_Malloc(sizeof(*e));
+
+    e->handle = CreateEvent(NULL, FALSE, FALSE, NULL);
+    if (!e->handle) {
+        Com_Error(ERR_FATAL, "Couldn't create event: %#lx", GetLastError());
+    }
+    return e;
+}
+
+void Sys_DestroyEvent(sys_event_t *e)
+{
+    CloseHandle(e->handle);
+    Z_Free(e);
+}
+
+void Sys_SignalEvent(sys_event_t *e)
+{
+    SetEvent(e->handle);
+}
+
+void Sys_WaitEvent(sys_event_t *e)
+{
+    WaitForSingleObject(e->handle, INFINITE);
+}
+
+#endif // USE_THREADS
+
 /*
 ================
 Sys_Init